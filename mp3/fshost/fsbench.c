@@ -0,0 +1,222 @@
+/* fsbench.c - Times the file system driver on a file system image, outside
+ * the kernel. Reports lookup latency of read_dentry_by_name for every name
+ * in the image and for missing names, then read_data latency for small
+ * reads and read_data/file_read throughput over whole files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fshost.h"
+
+#define BENCH_DEFAULT_ITERS 200000
+#define BENCH_SMALL_READ    128
+#define BENCH_STREAM_BYTES  (256 << 20)     /* Read per throughput measurement */
+#define BENCH_MAX_NAMES     4096
+#define MB                  (1024.0 * 1024.0)
+
+static fshost_dentry_t names[BENCH_MAX_NAMES];
+static unsigned int num_names;
+
+/*
+ * now_ns
+ *   DESCRIPTION: Monotonic clock in nanoseconds
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * load_image
+ *   DESCRIPTION: Reads a whole image file into a page aligned buffer
+ *        INPUTS: path - image file
+ *       OUTPUTS: size - image size in bytes
+ *  RETURN VALUE: Buffer holding the image, exits on error
+ */
+static void* load_image(const char* path, unsigned int* size)
+{
+    FILE* fp = fopen(path, "rb");
+    void* img;
+    long len;
+
+    if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    rewind(fp);
+    if (posix_memalign(&img, 4096, len ? len : 1) != 0 || fread(img, 1, len, fp) != (size_t)len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(fp);
+
+    *size = len;
+    return img;
+}
+
+/*
+ * bench_lookup
+ *   DESCRIPTION: Times read_dentry_by_name on every name of the image in
+ *                turn, then on names that are not in the image
+ */
+static void bench_lookup(unsigned int iters)
+{
+    static const char* missing[] = { "nosuchfile", "cat2", "verylargetextwithverylongname.txx", "" };
+    fshost_dentry_t dentry;
+    unsigned int i, found = 0;
+    double start;
+
+    if (num_names == 0)
+        return;
+
+    start = now_ns();
+    for (i = 0; i < iters; ++i)
+        found += fshost_dentry_by_name(names[i % num_names].name, &dentry) == 0;
+    printf("read_dentry_by_name hit:  %8.1f ns/lookup (%u/%u found)\n", (now_ns() - start) / iters, found, iters);
+
+    found = 0;
+    start = now_ns();
+    for (i = 0; i < iters; ++i)
+        found += fshost_dentry_by_name(missing[i % 4], &dentry) == 0;
+    printf("read_dentry_by_name miss: %8.1f ns/lookup (%u/%u found)\n", (now_ns() - start) / iters, found, iters);
+}
+
+/*
+ * bench_small_reads
+ *   DESCRIPTION: Times BENCH_SMALL_READ byte read_data calls spread over
+ *                every file of the image
+ */
+static void bench_small_reads(unsigned int iters)
+{
+    unsigned char buf[BENCH_SMALL_READ];
+    unsigned int i, n = 0, bytes = 0;
+    unsigned int files[BENCH_MAX_NAMES];
+    double start;
+
+    for (i = 0; i < num_names; ++i)
+        if (names[i].type == FSHOST_FILE_TYPE && fshost_length(names[i].inode) > 0)
+            files[n++] = names[i].inode;
+    if (n == 0)
+        return;
+
+    start = now_ns();
+    for (i = 0; i < iters; ++i)
+    {
+        unsigned int inode = files[i % n];
+        unsigned int offset = (i * 2654435761U) % (unsigned int)fshost_length(inode);
+        bytes += fshost_read_data(inode, offset, buf, BENCH_SMALL_READ);
+    }
+    printf("read_data %d bytes:      %8.1f ns/read (%u bytes)\n", BENCH_SMALL_READ, (now_ns() - start) / iters,
+           bytes);
+}
+
+/*
+ * bench_stream
+ *   DESCRIPTION: Streams the largest file with read_data and through the
+ *                file_read cursor, in several chunk sizes, until
+ *                BENCH_STREAM_BYTES have been read
+ */
+static void bench_stream(void)
+{
+    static const unsigned int chunks[] = { 512, 4096, 65536, 1 << 20 };
+    unsigned int i, c, inode = 0;
+    int largest = 0;
+    unsigned char* buf;
+
+    for (i = 0; i < num_names; ++i)
+    {
+        if (names[i].type == FSHOST_FILE_TYPE && fshost_length(names[i].inode) > largest)
+        {
+            largest = fshost_length(names[i].inode);
+            inode = names[i].inode;
+        }
+    }
+    if (largest == 0)
+        return;
+
+    buf = malloc(1 << 20);
+    printf("largest file: inode %u, %d bytes\n", inode, largest);
+
+    for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c)
+    {
+        unsigned long long total = 0;
+        double start = now_ns();
+        unsigned int offset = 0;
+        int ret;
+
+        while (total < BENCH_STREAM_BYTES)
+        {
+            ret = fshost_read_data(inode, offset, buf, chunks[c]);
+            if (ret <= 0)
+            {
+                if (ret < 0)
+                    break;
+                offset = 0;
+                continue;
+            }
+            offset += ret;
+            total += ret;
+        }
+        double read_data_mbs = total / MB / ((now_ns() - start) / 1e9);
+
+        total = 0;
+        start = now_ns();
+        fshost_file_open(inode);
+        while (total < BENCH_STREAM_BYTES)
+        {
+            ret = fshost_file_read(buf, chunks[c]);
+            if (ret <= 0)
+            {
+                if (ret < 0 || fshost_file_seek(0, 0) != 0)
+                    break;
+                continue;
+            }
+            total += ret;
+        }
+        double file_read_mbs = total / MB / ((now_ns() - start) / 1e9);
+
+        printf("%8u byte chunks: read_data %9.1f MB/s, file_read %9.1f MB/s\n", chunks[c], read_data_mbs,
+               file_read_mbs);
+    }
+    free(buf);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int iters = BENCH_DEFAULT_ITERS;
+    unsigned int size, i;
+    void* img;
+
+    if (argc == 4 && strcmp(argv[1], "-n") == 0)
+    {
+        iters = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 2 || iters == 0)
+    {
+        fprintf(stderr, "usage: fsbench [-n iterations] <image>\n");
+        return 1;
+    }
+
+    img = load_image(argv[1], &size);
+    fshost_mount(img, size);
+
+    for (i = 0; i < BENCH_MAX_NAMES && fshost_dentry_by_index(i, &names[i]) == 0; ++i);
+    num_names = i;
+    printf("%s: %u bytes, %u entries\n", argv[1], size, fshost_dir_count());
+
+    bench_lookup(iters);
+    bench_small_reads(iters);
+    bench_stream();
+
+    free(img);
+    return 0;
+}
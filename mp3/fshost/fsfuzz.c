@@ -0,0 +1,189 @@
+/* fsfuzz.c - Fuzz target for the file system driver. Mounts each input as an
+ * image and walks it the way the kernel's system calls would, so the
+ * sanitizers flag any read outside the image. The walk is repeated with the
+ * image mounted as a disk, which must read the same data and leave no cache
+ * block pinned.
+ *
+ * Built with -fsanitize=fuzzer this is a libFuzzer target. Otherwise main()
+ * runs every image named on the command line, or stdin, which is what
+ * afl-fuzz expects and also replays a corpus or crash file.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fshost.h"
+
+#define FUZZ_MAX_ENTRIES    1024        /* Dentries walked per image */
+#define FUZZ_MAX_READ       (1 << 20)   /* Bytes read per file */
+#define FUZZ_CHUNK          3000        /* Not a multiple of the block size */
+#define FUZZ_MAX_INPUT      (64 << 20)
+
+static unsigned char buf[FUZZ_MAX_READ];
+static uint32_t digest;                 /* FNV-1a of everything read by a walk */
+
+/*
+ * mix_value
+ *   DESCRIPTION: Adds a number to digest
+ */
+static void mix_value(uint32_t value)
+{
+    digest = (digest ^ value) * 16777619U;
+}
+
+/*
+ * mix
+ *   DESCRIPTION: Adds the result of a read, and the bytes it returned, to digest
+ */
+static int mix(int ret)
+{
+    int i;
+
+    mix_value(ret);
+    for (i = 0; i < ret; ++i)
+        digest = (digest ^ buf[i]) * 16777619U;
+    return ret;
+}
+
+/*
+ * fuzz_file
+ *   DESCRIPTION: Reads a file of the image through every data path
+ */
+static void fuzz_file(unsigned int inode)
+{
+    int length = fshost_length(inode);
+    unsigned int offset, block;
+    int ret, total = 0;
+
+    mix_value(length);
+    mix(fshost_read_data(inode, 0, buf, FUZZ_MAX_READ));
+    mix(fshost_read_data(inode, length, buf, 1));
+    mix(fshost_read_data(inode, 0xFFFFF000, buf, FUZZ_CHUNK));
+    if (length > 0)
+    {
+        for (offset = 1; offset < (unsigned int)length && offset < FUZZ_MAX_READ; offset = offset * 3 + 7)
+            mix(fshost_read_data(inode, offset, buf, FUZZ_CHUNK));
+    }
+
+    for (block = 0; block < 4; ++block)
+    {
+        unsigned char* data = fshost_data_block(inode, block);
+        if (data != NULL)
+            buf[0] = data[0] ^ data[4095];
+    }
+
+    fshost_file_open(inode);
+    while (total < FUZZ_MAX_READ && (ret = mix(fshost_file_read(buf, FUZZ_CHUNK))) > 0)
+        total += ret;
+    fshost_file_seek(-1, 2);
+    mix(fshost_file_read(buf, FUZZ_CHUNK));
+}
+
+/*
+ * walk_image
+ *   DESCRIPTION: Looks up and reads every entry of the mounted image
+ *  RETURN VALUE: digest of the walk
+ */
+static uint32_t walk_image(void)
+{
+    fshost_dentry_t dentry, found;
+    unsigned int i, position;
+    char name[FSHOST_NAME_LEN];
+
+    digest = 2166136261U;
+    for (i = 0; i < FUZZ_MAX_ENTRIES && fshost_dentry_by_index(i, &dentry) == 0; ++i)
+    {
+        if (mix(fshost_dentry_by_name(dentry.name, &found)) == 0)
+            mix_value(found.inode);
+        if (dentry.type == FSHOST_FILE_TYPE)
+            fuzz_file(dentry.inode);
+    }
+    fshost_dentry_by_name("", &found);
+    fshost_dentry_by_name("nosuchfile", &found);
+    fshost_dentry_by_name("verylargetextwithverylongname.txt", &found);
+    for (i = 0; i < 4; ++i)
+        fuzz_file(0x7FFFFFF0 + i * 0x10000000);
+
+    position = 0;
+    for (i = 0; i < FUZZ_MAX_ENTRIES && fshost_dir_read(&position, name) > 0; ++i);
+    position = 0;
+    for (i = 0; i < FUZZ_MAX_ENTRIES && fshost_getdents(&position, 7) > 0; ++i);
+
+    mix_value(i);
+    return digest;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    /* Exact size copy so reads past the end are caught */
+    unsigned char* img = malloc(size ? size : 1);
+    memcpy(img, data, size);
+
+    fshost_mount(img, size);
+    uint32_t in_memory = walk_image();
+
+    if (fshost_mount_disk(img, size) == 0)
+    {
+        if (walk_image() != in_memory)
+        {
+            fprintf(stderr, "image reads differently from disk\n");
+            abort();
+        }
+        if (fshost_pinned_blocks() != 0)
+        {
+            fprintf(stderr, "%u cache blocks left pinned\n", fshost_pinned_blocks());
+            abort();
+        }
+    }
+
+    free(img);
+    return 0;
+}
+
+#ifndef FSHOST_LIBFUZZER
+
+/*
+ * run_file
+ *   DESCRIPTION: Runs the fuzz target on one image file
+ */
+static int run_file(FILE* fp, const char* name)
+{
+    unsigned char* data = malloc(FUZZ_MAX_INPUT);
+    size_t size = fread(data, 1, FUZZ_MAX_INPUT, fp);
+
+    if (ferror(fp))
+    {
+        perror(name);
+        free(data);
+        return 1;
+    }
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int i, ret = 0;
+
+    if (argc == 1)
+        return run_file(stdin, "stdin");
+
+    for (i = 1; i < argc; ++i)
+    {
+        FILE* fp = fopen(argv[i], "rb");
+        if (fp == NULL)
+        {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        ret |= run_file(fp, argv[i]);
+        fclose(fp);
+    }
+    return ret;
+}
+
+#endif /* FSHOST_LIBFUZZER */
@@ -0,0 +1,50 @@
+/* fshost.h - Interface between the host programs and file_sys.c. The shim
+ * behind it is compiled against the kernel headers, which clash with the C
+ * library's, so only plain C types cross this boundary.
+ */
+
+#ifndef FSHOST_H_
+#define FSHOST_H_
+
+#define FSHOST_NAME_LEN     32
+#define FSHOST_FAILURE      -1
+
+/* Dentry types, as in file_sys.h */
+#define FSHOST_RTC_TYPE     0
+#define FSHOST_DIR_TYPE     1
+#define FSHOST_FILE_TYPE    2
+
+/* One directory entry. name is always NUL terminated */
+typedef struct fshost_dentry
+{
+    char name[FSHOST_NAME_LEN + 1];
+    int type;
+    unsigned int inode;
+} fshost_dentry_t;
+
+/* Image */
+void fshost_mount(void* img, unsigned int size);
+unsigned int fshost_dir_count(void);
+
+/* Mounts the image as if it were on disk, read through the buffer cache.
+ * Fails for images the kernel would not mount from a drive */
+int fshost_mount_disk(void* img, unsigned int size);
+unsigned int fshost_pinned_blocks(void);
+
+/* Directory */
+int fshost_dentry_by_index(unsigned int index, fshost_dentry_t* dentry);
+int fshost_dentry_by_name(const char* name, fshost_dentry_t* dentry);
+int fshost_dir_read(unsigned int* position, char* name);
+int fshost_getdents(unsigned int* position, unsigned int max_records);
+
+/* File data */
+int fshost_length(unsigned int inode);
+int fshost_read_data(unsigned int inode, unsigned int offset, void* buf, unsigned int length);
+void* fshost_data_block(unsigned int inode, unsigned int block);
+
+/* Reads through a file descriptor, using the sequential read cursor */
+void fshost_file_open(unsigned int inode);
+int fshost_file_read(void* buf, int nbytes);
+int fshost_file_seek(int offset, int whence);
+
+#endif /* FSHOST_H_ */
@@ -0,0 +1,271 @@
+/* shim.c - Kernel side of the host build of file_sys.c. Stands in for the
+ * process control block, the RAM file system, the buffer cache and the lib.c
+ * string functions file_sys.c links against, and wraps the driver in the
+ * fshost.h interface.
+ *
+ * The Makefile renames the lib.c functions in file_sys.c and here to shim_*,
+ * since the C library's versions take size_t and compare strings as unsigned
+ * characters.
+ */
+
+#include "fshost.h"
+#include "../student-distrib/file_sys.h"
+#include "../student-distrib/tmpfs.h"
+#include "../student-distrib/pcb.h"
+#include "../student-distrib/bcache.h"
+
+#define SHIM_FILE_FD    2
+#define SHIM_DIR_FD     3
+#define SHIM_DIRENTS    16
+#define SHIM_CACHE_BUFS 8           /* More than file_sys.c ever pins at once */
+
+static pcb_t pcb;
+static dirent_t dirents[SHIM_DIRENTS];
+
+/*
+ * get_current_pcb
+ *   DESCRIPTION: The host build has a single process
+ */
+pcb_t* get_current_pcb()
+{
+    return &pcb;
+}
+
+/*
+ * release_fd
+ *   DESCRIPTION: Same as pcb.c, called by file_close
+ */
+void release_fd(int32_t fd)
+{
+    pcb.fd_table[fd].flags = NOT_IN_USE;
+    pcb.fd_map &= ~(1U << fd);
+}
+
+/* lib.c functions used by file_sys.c, same semantics */
+
+uint32_t strlen(const int8_t* s)
+{
+    uint32_t len = 0;
+    while (s[len] != '\0')
+        len++;
+    return len;
+}
+
+void* memset(void* s, int32_t c, uint32_t n)
+{
+    return __builtin_memset(s, c, n);
+}
+
+void* memcpy(void* dest, const void* src, uint32_t n)
+{
+    return __builtin_memcpy(dest, src, n);
+}
+
+int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n)
+{
+    uint32_t i;
+    for (i = 0; i < n; i++)
+    {
+        if ((s1[i] != s2[i]) || (s1[i] == '\0'))
+            return s1[i] - s2[i];
+    }
+    return 0;
+}
+
+int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n)
+{
+    uint32_t i = 0;
+    while (i < n && src[i] != '\0')
+    {
+        dest[i] = src[i];
+        i++;
+    }
+    while (i < n)
+    {
+        dest[i] = '\0';
+        i++;
+    }
+    return dest;
+}
+
+/* RAM file system with no files, so only the boot image is exercised */
+
+int32_t tmpfs_lookup(const uint8_t* fname, uint32_t name_len, dentry_t* dentry) { return FAILURE; }
+int32_t tmpfs_dentry_at(uint32_t index, dentry_t* dentry) { return FAILURE; }
+uint32_t tmpfs_file_count() { return 0; }
+int32_t tmpfs_is_inode(uint32_t inode_idx) { return 0; }
+int32_t tmpfs_length(uint32_t inode_idx) { return FAILURE; }
+int32_t tmpfs_read(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t length) { return FAILURE; }
+int32_t tmpfs_write(uint32_t inode_idx, uint32_t offset, const uint8_t* buf, uint32_t length) { return FAILURE; }
+int32_t tmpfs_truncate(uint32_t inode_idx, uint32_t length) { return FAILURE; }
+uint8_t* tmpfs_get_block(uint32_t inode_idx, uint32_t block_num) { return NULL; }
+
+/* Buffer cache over an image in memory. Every get copies the block into a
+ * free buffer, so pins that are never released run the cache dry */
+
+static bcache_buf_t cache_bufs[SHIM_CACHE_BUFS];
+static uint8_t cache_data[SHIM_CACHE_BUFS][BLOCK_SIZE];
+static uint8_t* disk_img;
+static uint32_t disk_blocks;
+
+uint32_t bcache_num_blocks()
+{
+    return disk_blocks;
+}
+
+bcache_buf_t* bcache_get(uint32_t block, uint32_t ahead)
+{
+    uint32_t i;
+
+    if (block >= disk_blocks)
+        return NULL;
+
+    for (i = 0; i < SHIM_CACHE_BUFS; i++)
+    {
+        if (cache_bufs[i].refs == 0)
+        {
+            cache_bufs[i].refs = 1;
+            cache_bufs[i].block = block;
+            cache_bufs[i].data = cache_data[i];
+            memcpy(cache_data[i], disk_img + block * BLOCK_SIZE, BLOCK_SIZE);
+            return &cache_bufs[i];
+        }
+    }
+    return NULL;
+}
+
+void bcache_put(bcache_buf_t* buf)
+{
+    buf->refs--;
+}
+
+/*
+ * __copy_dentry
+ *   DESCRIPTION: Converts a kernel dentry to the host interface's
+ */
+static void __copy_dentry(const dentry_t* src, fshost_dentry_t* dst)
+{
+    strncpy(dst->name, src->filename, FSHOST_NAME_LEN);
+    dst->name[FSHOST_NAME_LEN] = '\0';
+    dst->type = src->filetype;
+    dst->inode = src->inode_num;
+}
+
+/*
+ * __reset_pcb
+ *   DESCRIPTION: Closes everything but the directory
+ */
+static void __reset_pcb(void)
+{
+    memset(&pcb, 0, sizeof(pcb));
+    pcb.fd_table[SHIM_DIR_FD].file_ops = &dir_type_op_table;
+    pcb.fd_table[SHIM_DIR_FD].flags = IN_USE;
+}
+
+void fshost_mount(void* img, unsigned int size)
+{
+    file_sys_init(img, size);
+    __reset_pcb();
+}
+
+int fshost_mount_disk(void* img, unsigned int size)
+{
+    memset(cache_bufs, 0, sizeof(cache_bufs));
+    disk_img = img;
+    disk_blocks = size / BLOCK_SIZE;
+    __reset_pcb();
+    return file_sys_init_disk() == SUCCESS ? 0 : FSHOST_FAILURE;
+}
+
+unsigned int fshost_pinned_blocks(void)
+{
+    unsigned int i, pinned = 0;
+
+    for (i = 0; i < SHIM_CACHE_BUFS; i++)
+        pinned += cache_bufs[i].refs;
+    return pinned;
+}
+
+unsigned int fshost_dir_count(void)
+{
+    stat_t stat;
+    return dir_stat(SHIM_DIR_FD, &stat) == SUCCESS ? stat.length : 0;
+}
+
+int fshost_dentry_by_index(unsigned int index, fshost_dentry_t* dentry)
+{
+    dirent_t record;
+
+    /* getdents is the directory's only by-position accessor */
+    pcb.fd_table[SHIM_DIR_FD].file_position = index;
+    if (dir_getdents(SHIM_DIR_FD, &record, sizeof(record)) <= 0)
+        return FSHOST_FAILURE;
+
+    strncpy(dentry->name, record.filename, FSHOST_NAME_LEN);
+    dentry->name[FSHOST_NAME_LEN] = '\0';
+    dentry->type = record.filetype;
+    dentry->inode = record.inode_num;
+    return 0;
+}
+
+int fshost_dentry_by_name(const char* name, fshost_dentry_t* dentry)
+{
+    dentry_t kdentry;
+    if (read_dentry_by_name((const uint8_t*)name, &kdentry) == FAILURE)
+        return FSHOST_FAILURE;
+    __copy_dentry(&kdentry, dentry);
+    return 0;
+}
+
+int fshost_dir_read(unsigned int* position, char* name)
+{
+    pcb.fd_table[SHIM_DIR_FD].file_position = *position;
+    int32_t ret = dir_read(SHIM_DIR_FD, name, FSHOST_NAME_LEN);
+    *position = pcb.fd_table[SHIM_DIR_FD].file_position;
+    return ret;
+}
+
+int fshost_getdents(unsigned int* position, unsigned int max_records)
+{
+    if (max_records > SHIM_DIRENTS)
+        max_records = SHIM_DIRENTS;
+    pcb.fd_table[SHIM_DIR_FD].file_position = *position;
+    int32_t ret = dir_getdents(SHIM_DIR_FD, dirents, max_records * sizeof(dirent_t));
+    *position = pcb.fd_table[SHIM_DIR_FD].file_position;
+    return ret;
+}
+
+int fshost_length(unsigned int inode)
+{
+    return file_length(inode);
+}
+
+int fshost_read_data(unsigned int inode, unsigned int offset, void* buf, unsigned int length)
+{
+    return read_data(inode, offset, buf, length);
+}
+
+void* fshost_data_block(unsigned int inode, unsigned int block)
+{
+    return get_data_block(inode, block);
+}
+
+void fshost_file_open(unsigned int inode)
+{
+    file_t* file = &pcb.fd_table[SHIM_FILE_FD];
+
+    memset(file, 0, sizeof(file_t));
+    file->file_ops = &file_type_op_table;
+    file->inode = inode;
+    file->flags = IN_USE;
+}
+
+int fshost_file_read(void* buf, int nbytes)
+{
+    return file_read(SHIM_FILE_FD, buf, nbytes);
+}
+
+int fshost_file_seek(int offset, int whence)
+{
+    return file_lseek(SHIM_FILE_FD, offset, whence);
+}
@@ -0,0 +1,525 @@
+/*
+ * mkfs - builds a file system image for the student-distrib kernel from a
+ * flat source directory. Unlike the prebuilt createfs, every file's data
+ * blocks are packed one after another so the kernel can copy a whole file
+ * with one memcpy, and the leading extent of each file is recorded in its
+ * dentry. Identical blocks can optionally be stored once.
+ *
+ * The on-disk structures below must match student-distrib/file_sys.h.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE          4096
+#define FILENAME_LEN        32
+#define DENTRY_RESERVED     16
+#define BOOT_BLOCK_RESERVED 28
+#define NUM_DIR_ENTRIES     63
+#define NUM_DNODE_PER_INODE 1023
+#define NUM_DIRECT_DNODES   (NUM_DNODE_PER_INODE - 2)
+#define INDIRECT_SLOT       NUM_DIRECT_DNODES
+#define DOUBLE_INDIRECT_SLOT (NUM_DIRECT_DNODES + 1)
+#define DNODES_PER_BLOCK    (BLOCK_SIZE / sizeof(int32_t))
+#define DENTRIES_PER_BLOCK  (BLOCK_SIZE / sizeof(dentry_t))
+#define INDEX_PER_BLOCK     (BLOCK_SIZE / sizeof(uint32_t))
+/* Blocks the inode can address. Lengths are int32_t, so files also stay under 2 GiB */
+#define MAX_FILE_BLOCKS     (NUM_DIRECT_DNODES + DNODES_PER_BLOCK + DNODES_PER_BLOCK * DNODES_PER_BLOCK)
+
+#define FS_MAGIC            0x31395346
+#define FS_REVISION_LEGACY  0
+#define FS_REVISION_INDIRECT 3
+#define FS_FEATURE_EXTENTS  0x1
+#define FS_FEATURE_DEDUP    0x2
+
+#define RTC_TYPE            0
+#define DIR_TYPE            1
+#define FILE_TYPE           2
+
+#define DEDUP_HASH_SIZE     (1 << 16)   /* Power of 2 */
+#define DEDUP_NONE          -1
+#define FNV_OFFSET_BASIS    2166136261U
+#define FNV_PRIME           16777619U
+
+typedef struct dentry
+{
+    char     filename[FILENAME_LEN];
+    int32_t  filetype;
+    int32_t  inode_num;
+    uint32_t extent_start;
+    uint32_t extent_blocks;
+    int8_t   reserved[DENTRY_RESERVED];
+} dentry_t;
+
+typedef struct boot_block
+{
+    int32_t  dir_count;
+    int32_t  inode_count;
+    int32_t  data_count;
+    uint32_t magic;
+    uint32_t revision;
+    uint32_t dir_start;
+    uint32_t index_start;
+    uint32_t inode_start;
+    uint32_t features;
+    int8_t   reserved[BOOT_BLOCK_RESERVED];
+    dentry_t dir_entries[NUM_DIR_ENTRIES];
+} boot_block_t;
+
+typedef struct inode
+{
+    int32_t length;
+    int32_t data_block_num[NUM_DNODE_PER_INODE];
+} inode_t;
+
+/* A source file and the data block numbers given to its blocks */
+typedef struct src_file
+{
+    char      name[FILENAME_LEN + 1];
+    char*     path;
+    uint32_t  length;
+    uint32_t  num_blocks;
+    int32_t*  blocks;
+} src_file_t;
+
+static src_file_t* files;
+static uint32_t num_files;
+static dentry_t* dentries;
+static uint32_t num_dentries;
+
+static uint8_t* data;               /* Data blocks of the image */
+static uint32_t data_count;
+static uint32_t data_alloc;
+
+static int32_t* dedup_head;         /* Hash bucket -> block number */
+static int32_t* dedup_next;         /* Block number -> next block in bucket */
+static uint32_t dedup_hits;
+
+static int opt_dedup;
+static int opt_legacy;
+
+/*
+ * die
+ *   DESCRIPTION: Prints an error message and exits
+ *        INPUTS: msg - message
+ *                arg - string printed after the message, or NULL
+ *  RETURN VALUE: none (does not return)
+ */
+static void die(const char* msg, const char* arg)
+{
+    if (arg != NULL)
+        fprintf(stderr, "mkfs: %s: %s\n", msg, arg);
+    else
+        fprintf(stderr, "mkfs: %s\n", msg);
+    exit(1);
+}
+
+/*
+ * xrealloc
+ *   DESCRIPTION: realloc that exits when out of memory
+ */
+static void* xrealloc(void* ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (ptr == NULL && size != 0)
+        die("out of memory", NULL);
+    return ptr;
+}
+
+/*
+ * hash_block
+ *   DESCRIPTION: FNV-1a hash of a data block, reduced to a dedup bucket
+ */
+static uint32_t hash_block(const uint8_t* block)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    int i;
+
+    for (i = 0; i < BLOCK_SIZE; ++i)
+    {
+        hash ^= block[i];
+        hash *= FNV_PRIME;
+    }
+    return hash & (DEDUP_HASH_SIZE - 1);
+}
+
+/*
+ * add_block
+ *   DESCRIPTION: Appends a data block to the image. With deduplication on,
+ *                a block identical to an earlier file data block is not
+ *                stored again and the earlier block number is returned.
+ *        INPUTS: block - BLOCK_SIZE bytes of content
+ *                dedup - whether this block may be shared
+ *  RETURN VALUE: Data block number holding the content
+ */
+static int32_t add_block(const uint8_t* block, int dedup)
+{
+    uint32_t bucket = 0;
+    int32_t num;
+
+    if (dedup)
+    {
+        bucket = hash_block(block);
+        for (num = dedup_head[bucket]; num != DEDUP_NONE; num = dedup_next[num])
+        {
+            if (memcmp(data + (size_t)num * BLOCK_SIZE, block, BLOCK_SIZE) == 0)
+            {
+                ++dedup_hits;
+                return num;
+            }
+        }
+    }
+
+    if (data_count == data_alloc)
+    {
+        data_alloc = data_alloc ? data_alloc * 2 : 256;
+        data = xrealloc(data, (size_t)data_alloc * BLOCK_SIZE);
+        if (opt_dedup)
+            dedup_next = xrealloc(dedup_next, data_alloc * sizeof(int32_t));
+    }
+
+    num = data_count++;
+    memcpy(data + (size_t)num * BLOCK_SIZE, block, BLOCK_SIZE);
+    if (dedup)
+    {
+        dedup_next[num] = dedup_head[bucket];
+        dedup_head[bucket] = num;
+    }
+    else if (opt_dedup)
+    {
+        dedup_next[num] = DEDUP_NONE;
+    }
+    return num;
+}
+
+/*
+ * cmp_files
+ *   DESCRIPTION: qsort comparator ordering source files by name
+ */
+static int cmp_files(const void* a, const void* b)
+{
+    return strcmp(((const src_file_t*)a)->name, ((const src_file_t*)b)->name);
+}
+
+/*
+ * cmp_index
+ *   DESCRIPTION: qsort comparator ordering dentry numbers by the dentry's
+ *                name the way the kernel's strncmp does, comparing signed
+ *                characters up to the first NUL
+ */
+static int cmp_index(const void* a, const void* b)
+{
+    const signed char* s1 = (const signed char*)dentries[*(const uint32_t*)a].filename;
+    const signed char* s2 = (const signed char*)dentries[*(const uint32_t*)b].filename;
+    int i;
+
+    for (i = 0; i < FILENAME_LEN; ++i)
+    {
+        if (s1[i] != s2[i] || s1[i] == '\0')
+            return s1[i] - s2[i];
+    }
+    return 0;
+}
+
+/*
+ * scan_dir
+ *   DESCRIPTION: Collects the regular files of the source directory, sorted
+ *                by name. Names longer than FILENAME_LEN are truncated as
+ *                createfs does.
+ *        INPUTS: dir_path - source directory
+ *  RETURN VALUE: none
+ */
+static void scan_dir(const char* dir_path)
+{
+    DIR* dir = opendir(dir_path);
+    struct dirent* ent;
+    struct stat st;
+    uint32_t i;
+
+    if (dir == NULL)
+        die("cannot open directory", dir_path);
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        char* path = xrealloc(NULL, strlen(dir_path) + strlen(ent->d_name) + 2);
+        sprintf(path, "%s/%s", dir_path, ent->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            free(path);
+            continue;
+        }
+        if (strlen(ent->d_name) > FILENAME_LEN)
+            fprintf(stderr, "mkfs: warning: %s truncated to %d characters\n", ent->d_name, FILENAME_LEN);
+
+        files = xrealloc(files, (num_files + 1) * sizeof(src_file_t));
+        memset(&files[num_files], 0, sizeof(src_file_t));
+        memcpy(files[num_files].name, ent->d_name, strnlen(ent->d_name, FILENAME_LEN));
+        files[num_files].path = path;
+        if (st.st_size > INT32_MAX)
+            die("file too large", path);
+        files[num_files].length = st.st_size;
+        ++num_files;
+    }
+    closedir(dir);
+
+    qsort(files, num_files, sizeof(src_file_t), cmp_files);
+    for (i = 1; i < num_files; ++i)
+        if (strcmp(files[i - 1].name, files[i].name) == 0)
+            die("duplicate file name", files[i].name);
+}
+
+/*
+ * pack_files
+ *   DESCRIPTION: Reads every source file into consecutive data blocks, in
+ *                name order, so each file occupies a single extent unless
+ *                some of its blocks were deduplicated.
+ *        INPUTS: none
+ *  RETURN VALUE: none
+ */
+static void pack_files(void)
+{
+    uint8_t block[BLOCK_SIZE];
+    uint32_t i, b;
+
+    for (i = 0; i < num_files; ++i)
+    {
+        src_file_t* file = &files[i];
+        FILE* fp = fopen(file->path, "rb");
+        if (fp == NULL)
+            die("cannot open file", file->path);
+
+        file->num_blocks = (file->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (file->num_blocks > (opt_legacy ? NUM_DNODE_PER_INODE : MAX_FILE_BLOCKS))
+            die("file too large", file->path);
+        file->blocks = xrealloc(NULL, (file->num_blocks + 1) * sizeof(int32_t));
+
+        for (b = 0; b < file->num_blocks; ++b)
+        {
+            memset(block, 0, BLOCK_SIZE);
+            if (fread(block, 1, BLOCK_SIZE, fp) == 0)
+                die("short read", file->path);
+            file->blocks[b] = add_block(block, opt_dedup);
+        }
+        fclose(fp);
+    }
+}
+
+/*
+ * new_table
+ *   DESCRIPTION: Appends an indirect block listing block numbers
+ *        INPUTS: nums - block numbers
+ *                count - number of entries, at most DNODES_PER_BLOCK
+ *  RETURN VALUE: Data block number of the table
+ */
+static int32_t new_table(const int32_t* nums, uint32_t count)
+{
+    int32_t table[DNODES_PER_BLOCK];
+
+    memset(table, 0, sizeof(table));
+    memcpy(table, nums, count * sizeof(int32_t));
+    return add_block((uint8_t*)table, 0);
+}
+
+/*
+ * fill_inode
+ *   DESCRIPTION: Writes a file's block numbers into its inode, adding the
+ *                single and double indirect tables it needs after all file
+ *                data so they don't split any extent.
+ *        INPUTS: file - packed source file
+ *       OUTPUTS: inode - inode to fill
+ *  RETURN VALUE: none
+ */
+static void fill_inode(const src_file_t* file, inode_t* inode)
+{
+    uint32_t direct = opt_legacy ? NUM_DNODE_PER_INODE : NUM_DIRECT_DNODES;
+    uint32_t done, count;
+
+    memset(inode, 0, sizeof(inode_t));
+    inode->length = file->length;
+
+    done = file->num_blocks < direct ? file->num_blocks : direct;
+    memcpy(inode->data_block_num, file->blocks, done * sizeof(int32_t));
+    if (done == file->num_blocks)
+        return;
+
+    count = file->num_blocks - done;
+    if (count > DNODES_PER_BLOCK)
+        count = DNODES_PER_BLOCK;
+    inode->data_block_num[INDIRECT_SLOT] = new_table(file->blocks + done, count);
+    done += count;
+    if (done == file->num_blocks)
+        return;
+
+    /* Double indirect table lists single indirect tables */
+    int32_t tables[DNODES_PER_BLOCK];
+    uint32_t num_tables = 0;
+    while (done < file->num_blocks)
+    {
+        count = file->num_blocks - done;
+        if (count > DNODES_PER_BLOCK)
+            count = DNODES_PER_BLOCK;
+        tables[num_tables++] = new_table(file->blocks + done, count);
+        done += count;
+    }
+    inode->data_block_num[DOUBLE_INDIRECT_SLOT] = new_table(tables, num_tables);
+}
+
+/*
+ * leading_extent
+ *   DESCRIPTION: Counts the file blocks that are stored consecutively from
+ *                the first one
+ *        INPUTS: file - packed source file
+ *  RETURN VALUE: Number of blocks in the first extent, 0 for an empty file
+ */
+static uint32_t leading_extent(const src_file_t* file)
+{
+    uint32_t count;
+
+    if (file->num_blocks == 0)
+        return 0;
+    for (count = 1; count < file->num_blocks && file->blocks[count] == file->blocks[0] + (int32_t)count;
+         ++count);
+    return count;
+}
+
+/*
+ * write_image
+ *   DESCRIPTION: Lays out and writes the image. Revision FS_REVISION_INDIRECT
+ *                places the boot block, extra directory blocks, the sorted
+ *                name index, the inodes and the data blocks in that order.
+ *                Legacy images keep the original layout with the inodes
+ *                right after the boot block.
+ *        INPUTS: out_path - image file to create
+ *  RETURN VALUE: none
+ */
+static void write_image(const char* out_path)
+{
+    uint32_t extra, num_dir_blocks, num_index_blocks, first_inode, i;
+    inode_t* inodes;
+    uint32_t* index;
+    boot_block_t boot;
+    FILE* fp;
+
+    /* "." and the RTC device come first like in createfs images */
+    num_dentries = num_files + 2;
+    if (opt_legacy && num_dentries > NUM_DIR_ENTRIES)
+        die("too many files for a legacy image", NULL);
+    dentries = xrealloc(NULL, num_dentries * sizeof(dentry_t));
+    memset(dentries, 0, num_dentries * sizeof(dentry_t));
+    strcpy(dentries[0].filename, ".");
+    dentries[0].filetype = DIR_TYPE;
+    strcpy(dentries[1].filename, "rtc");
+    dentries[1].filetype = RTC_TYPE;
+
+    inodes = xrealloc(NULL, (num_files ? num_files : 1) * sizeof(inode_t));
+    for (i = 0; i < num_files; ++i)
+    {
+        dentry_t* dentry = &dentries[i + 2];
+        memcpy(dentry->filename, files[i].name, FILENAME_LEN);
+        dentry->filetype = FILE_TYPE;
+        dentry->inode_num = i;
+        dentry->extent_blocks = leading_extent(&files[i]);
+        dentry->extent_start = dentry->extent_blocks ? files[i].blocks[0] : 0;
+        fill_inode(&files[i], &inodes[i]);
+    }
+
+    extra = num_dentries > NUM_DIR_ENTRIES ? num_dentries - NUM_DIR_ENTRIES : 0;
+    num_dir_blocks = (extra + DENTRIES_PER_BLOCK - 1) / DENTRIES_PER_BLOCK;
+    num_index_blocks = opt_legacy ? 0 : (num_dentries + INDEX_PER_BLOCK - 1) / INDEX_PER_BLOCK;
+    first_inode = 1 + num_dir_blocks + num_index_blocks;
+
+    index = xrealloc(NULL, num_index_blocks * BLOCK_SIZE + 1);
+    memset(index, 0, num_index_blocks * BLOCK_SIZE);
+    if (!opt_legacy)
+    {
+        for (i = 0; i < num_dentries; ++i)
+            index[i] = i;
+        qsort(index, num_dentries, sizeof(uint32_t), cmp_index);
+    }
+
+    memset(&boot, 0, sizeof(boot));
+    boot.dir_count = num_dentries;
+    boot.inode_count = num_files;
+    boot.data_count = data_count;
+    boot.features = FS_FEATURE_EXTENTS | (opt_dedup ? FS_FEATURE_DEDUP : 0);
+    if (!opt_legacy)
+    {
+        boot.magic = FS_MAGIC;
+        boot.revision = FS_REVISION_INDIRECT;
+        boot.dir_start = 1;
+        boot.index_start = 1 + num_dir_blocks;
+        boot.inode_start = first_inode;
+    }
+    memcpy(boot.dir_entries, dentries, (num_dentries < NUM_DIR_ENTRIES ? num_dentries : NUM_DIR_ENTRIES) *
+           sizeof(dentry_t));
+
+    fp = fopen(out_path, "wb");
+    if (fp == NULL)
+        die("cannot create image", out_path);
+
+    uint8_t* dir_blocks = xrealloc(NULL, num_dir_blocks * BLOCK_SIZE + 1);
+    memset(dir_blocks, 0, num_dir_blocks * BLOCK_SIZE);
+    if (extra)
+        memcpy(dir_blocks, dentries + NUM_DIR_ENTRIES, extra * sizeof(dentry_t));
+
+    if (fwrite(&boot, sizeof(boot), 1, fp) != 1 ||
+        fwrite(dir_blocks, BLOCK_SIZE, num_dir_blocks, fp) != num_dir_blocks ||
+        fwrite(index, BLOCK_SIZE, num_index_blocks, fp) != num_index_blocks ||
+        fwrite(inodes, sizeof(inode_t), num_files, fp) != num_files ||
+        fwrite(data, BLOCK_SIZE, data_count, fp) != data_count || fclose(fp) != 0)
+        die("write failed", out_path);
+
+    printf("%s: %u files, %u inodes, %u data blocks (%u deduplicated), %u bytes\n", out_path,
+           num_dentries, num_files, data_count, dedup_hits, (first_inode + num_files + data_count) * BLOCK_SIZE);
+
+    free(dir_blocks);
+    free(index);
+    free(inodes);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: mkfs [-d] [-l] -i <source dir> -o <image>\n"
+            "  -d  store identical data blocks once\n"
+            "  -l  legacy layout (at most %d files, no indirect blocks) for older kernels\n",
+            NUM_DIR_ENTRIES - 2);
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* in_dir = NULL;
+    const char* out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "dli:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': opt_dedup = 1; break;
+            case 'l': opt_legacy = 1; break;
+            case 'i': in_dir = optarg; break;
+            case 'o': out_path = optarg; break;
+            default: usage();
+        }
+    }
+    if (in_dir == NULL || out_path == NULL || optind != argc)
+        usage();
+
+    if (opt_dedup)
+    {
+        dedup_head = xrealloc(NULL, DEDUP_HASH_SIZE * sizeof(int32_t));
+        memset(dedup_head, DEDUP_NONE, DEDUP_HASH_SIZE * sizeof(int32_t));
+    }
+
+    scan_dir(in_dir);
+    pack_files();
+    write_image(out_path);
+    return 0;
+}
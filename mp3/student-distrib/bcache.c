@@ -0,0 +1,377 @@
+#include "bcache.h"
+#include "device/ata.h"
+#include "file_sys.h"
+#include "kstats.h"
+#include "lib.h"
+
+/* Buffers live in identity mapped kernel memory, so DMA can fill them */
+static uint8_t bcache_data[BCACHE_NUM_BUFS][BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+static bcache_buf_t bcache_bufs[BCACHE_NUM_BUFS];
+static bcache_buf_t* bcache_hash[BCACHE_HASH_SIZE];
+static bcache_buf_t bcache_lru;         /* List head, next is most and prev least recently used */
+
+static int32_t bcache_drive = BCACHE_NO_DRIVE;
+static uint32_t bcache_blocks;          /* Blocks on the drive */
+static uint32_t last_block;             /* Block of the previous request */
+static uint32_t seq_window;             /* Read ahead window of a sequential stream */
+static uint32_t registered;             /* Stats file registered */
+static bcache_stats_t stats;
+
+/* Local helpers */
+bcache_buf_t* __bcache_lookup(uint32_t block);
+void __bcache_hash(bcache_buf_t* buf);
+void __bcache_unhash(bcache_buf_t* buf);
+void __bcache_unlink(bcache_buf_t* buf);
+void __bcache_push_front(bcache_buf_t* buf);
+void __bcache_push_back(bcache_buf_t* buf);
+bcache_buf_t* __bcache_victim(void);
+int32_t __bcache_fill(int8_t* buf, int32_t size);
+
+/*
+ * bcache_init
+ *   DESCRIPTION: Empties the buffer cache and points it at a drive. Registers
+ *                the "bcachestat" kernel stats file the first time.
+ *        INPUTS: drive - ATA drive number
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if the drive is not present
+ *  SIDE EFFECTS: Drops every cached block and resets the stats
+ */
+int32_t bcache_init(int32_t drive)
+{
+    int32_t i;
+
+    if (!ata_drive_present(drive))
+        return FAILURE;
+
+    bcache_drive = drive;
+    bcache_blocks = ata_num_blocks(drive);
+    last_block = 0;
+    seq_window = 1;
+    memset(&stats, 0, sizeof(stats));
+    memset(bcache_hash, 0, sizeof(bcache_hash));
+
+    bcache_lru.next = &bcache_lru;
+    bcache_lru.prev = &bcache_lru;
+    for (i = 0; i < BCACHE_NUM_BUFS; ++i)
+    {
+        bcache_bufs[i].valid = 0;
+        bcache_bufs[i].refs = 0;
+        bcache_bufs[i].prefetched = 0;
+        bcache_bufs[i].data = bcache_data[i];
+        bcache_bufs[i].hash_next = NULL;
+        __bcache_push_back(&bcache_bufs[i]);
+    }
+
+    if (!registered)
+        registered = kstats_register("bcachestat", __bcache_fill) == SUCCESS;
+
+    return SUCCESS;
+}
+
+/*
+ * bcache_get_drive
+ *   DESCRIPTION: Gets the drive the cache reads from
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: ATA drive number or BCACHE_NO_DRIVE before bcache_init
+ *  SIDE EFFECTS: none
+ */
+int32_t bcache_get_drive()
+{
+    return bcache_drive;
+}
+
+/*
+ * bcache_num_blocks
+ *   DESCRIPTION: Gets the number of blocks on the cached drive
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of blocks, 0 before bcache_init
+ *  SIDE EFFECTS: none
+ */
+uint32_t bcache_num_blocks()
+{
+    return bcache_drive == BCACHE_NO_DRIVE ? 0 : bcache_blocks;
+}
+
+/*
+ * bcache_get
+ *   DESCRIPTION: Gets a block of the drive, pinned until bcache_put. A miss
+ *                reads the block together with the blocks after it that are
+ *                not cached yet, with one disk command: as many as the
+ *                caller expects to need next, or more while requests arrive
+ *                in sequence, where the window doubles on every miss up to
+ *                BCACHE_READ_AHEAD. Least recently used unpinned buffers are
+ *                reused.
+ *        INPUTS: block - block number on the drive
+ *                ahead - number of blocks after this one the caller will
+ *                        read next
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pinned buffer, or NULL for a bad block, a disk error, or if
+ *                every buffer is pinned
+ *  SIDE EFFECTS: May read from disk with interrupts disabled
+ */
+bcache_buf_t* bcache_get(uint32_t block, uint32_t ahead)
+{
+    bcache_buf_t* bufs[BCACHE_READ_AHEAD];
+    uint8_t* data[BCACHE_READ_AHEAD];
+    uint32_t i, want, count;
+    bcache_buf_t* buf;
+    long flags;
+
+    if (bcache_drive == BCACHE_NO_DRIVE || block >= bcache_blocks)
+        return NULL;
+
+    cli_and_save(flags);
+
+    buf = __bcache_lookup(block);
+    if (buf != NULL)
+    {
+        ++stats.hits;
+        if (buf->prefetched)
+        {
+            ++stats.read_ahead_hits;
+            buf->prefetched = 0;
+        }
+        ++buf->refs;
+        __bcache_unlink(buf);
+        __bcache_push_front(buf);
+        last_block = block;
+        restore_flags(flags);
+        return buf;
+    }
+
+    ++stats.misses;
+    if (block == last_block + 1)
+        seq_window = seq_window * 2 < BCACHE_READ_AHEAD ? seq_window * 2 : BCACHE_READ_AHEAD;
+    else
+        seq_window = 1;
+    last_block = block;
+
+    want = ahead < BCACHE_READ_AHEAD ? ahead + 1 : BCACHE_READ_AHEAD;
+    if (want < seq_window)
+        want = seq_window;
+    if (want > bcache_blocks - block)
+        want = bcache_blocks - block;
+
+    /* Pin victims for the run of uncached blocks starting at block */
+    for (count = 0; count < want; ++count)
+    {
+        if (count > 0 && __bcache_lookup(block + count) != NULL)
+            break;
+        buf = __bcache_victim();
+        if (buf == NULL)
+            break;
+        if (buf->valid)
+        {
+            ++stats.evictions;
+            __bcache_unhash(buf);
+            buf->valid = 0;
+        }
+        buf->refs = 1;
+        buf->block = block + count;
+        bufs[count] = buf;
+        data[count] = buf->data;
+    }
+
+    if (count == 0 || ata_read_blocks(bcache_drive, block, count, data) == FAILURE)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            bufs[i]->refs = 0;
+            __bcache_unlink(bufs[i]);
+            __bcache_push_back(bufs[i]);
+        }
+        restore_flags(flags);
+        return NULL;
+    }
+
+    ++stats.reads;
+    stats.blocks_read += count;
+    stats.read_ahead += count - 1;
+
+    /* Requested block ends up most recently used, read ahead ones behind it */
+    for (i = count; i-- > 0;)
+    {
+        bufs[i]->valid = 1;
+        bufs[i]->prefetched = i > 0;
+        bufs[i]->refs = i == 0;
+        __bcache_hash(bufs[i]);
+        __bcache_unlink(bufs[i]);
+        __bcache_push_front(bufs[i]);
+    }
+
+    restore_flags(flags);
+    return bufs[0];
+}
+
+/*
+ * bcache_put
+ *   DESCRIPTION: Unpins a buffer returned by bcache_get
+ *        INPUTS: buf - buffer
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Buffer may be reused once no longer pinned
+ */
+void bcache_put(bcache_buf_t* buf)
+{
+    long flags;
+
+    cli_and_save(flags);
+    if (buf != NULL && buf->refs > 0)
+        --buf->refs;
+    restore_flags(flags);
+}
+
+/*
+ * bcache_get_stats
+ *   DESCRIPTION: Copies the cache counters
+ *        INPUTS: none
+ *       OUTPUTS: stats_out - counters
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void bcache_get_stats(bcache_stats_t* stats_out)
+{
+    *stats_out = stats;
+}
+
+/*
+ * __bcache_lookup
+ *   DESCRIPTION: Finds the cached buffer of a block
+ *        INPUTS: block - block number
+ *       OUTPUTS: none
+ *  RETURN VALUE: Buffer or NULL if not cached
+ *  SIDE EFFECTS: none
+ */
+bcache_buf_t* __bcache_lookup(uint32_t block)
+{
+    bcache_buf_t* buf;
+
+    for (buf = bcache_hash[block & (BCACHE_HASH_SIZE - 1)]; buf != NULL; buf = buf->hash_next)
+    {
+        if (buf->block == block)
+            return buf;
+    }
+    return NULL;
+}
+
+/*
+ * __bcache_hash
+ *   DESCRIPTION: Adds a valid buffer to the hash chain of its block
+ *        INPUTS: buf - buffer
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void __bcache_hash(bcache_buf_t* buf)
+{
+    bcache_buf_t** head = &bcache_hash[buf->block & (BCACHE_HASH_SIZE - 1)];
+
+    buf->hash_next = *head;
+    *head = buf;
+}
+
+/*
+ * __bcache_unhash
+ *   DESCRIPTION: Removes a buffer from the hash chain of its block
+ *        INPUTS: buf - hashed buffer
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void __bcache_unhash(bcache_buf_t* buf)
+{
+    bcache_buf_t** link = &bcache_hash[buf->block & (BCACHE_HASH_SIZE - 1)];
+
+    while (*link != NULL && *link != buf)
+        link = &(*link)->hash_next;
+    if (*link != NULL)
+        *link = buf->hash_next;
+    buf->hash_next = NULL;
+}
+
+/*
+ * __bcache_unlink
+ *   DESCRIPTION: Removes a buffer from the LRU list
+ */
+void __bcache_unlink(bcache_buf_t* buf)
+{
+    buf->prev->next = buf->next;
+    buf->next->prev = buf->prev;
+}
+
+/*
+ * __bcache_push_front
+ *   DESCRIPTION: Makes a buffer the most recently used
+ */
+void __bcache_push_front(bcache_buf_t* buf)
+{
+    buf->next = bcache_lru.next;
+    buf->prev = &bcache_lru;
+    bcache_lru.next->prev = buf;
+    bcache_lru.next = buf;
+}
+
+/*
+ * __bcache_push_back
+ *   DESCRIPTION: Makes a buffer the next one to be reused
+ */
+void __bcache_push_back(bcache_buf_t* buf)
+{
+    buf->prev = bcache_lru.prev;
+    buf->next = &bcache_lru;
+    bcache_lru.prev->next = buf;
+    bcache_lru.prev = buf;
+}
+
+/*
+ * __bcache_victim
+ *   DESCRIPTION: Finds the least recently used buffer that is not pinned
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Buffer or NULL if all are pinned
+ *  SIDE EFFECTS: none
+ */
+bcache_buf_t* __bcache_victim(void)
+{
+    bcache_buf_t* buf;
+
+    for (buf = bcache_lru.prev; buf != &bcache_lru; buf = buf->prev)
+    {
+        if (buf->refs == 0)
+            return buf;
+    }
+    return NULL;
+}
+
+/*
+ * __bcache_fill
+ *   DESCRIPTION: Fill function of the "bcachestat" kernel stats file
+ *        INPUTS: size - size of buf
+ *       OUTPUTS: buf - text of stats file
+ *  RETURN VALUE: Length of text
+ *  SIDE EFFECTS: none
+ */
+int32_t __bcache_fill(int8_t* buf, int32_t size)
+{
+    int32_t len = 0;
+    uint32_t lookups = stats.hits + stats.misses;
+
+    /* Percent without overflowing hits * 100 */
+    uint32_t hit_ratio = lookups == 0 ? 0 :
+                         lookups < 100 ? stats.hits * 100 / lookups : stats.hits / (lookups / 100);
+
+    len = kstats_line(buf, size, len, "drive", bcache_drive);
+    len = kstats_line(buf, size, len, "dma", ata_uses_dma(bcache_drive));
+    len = kstats_line(buf, size, len, "buffers", BCACHE_NUM_BUFS);
+    len = kstats_line(buf, size, len, "hits", stats.hits);
+    len = kstats_line(buf, size, len, "misses", stats.misses);
+    len = kstats_line(buf, size, len, "hit ratio %", hit_ratio);
+    len = kstats_line(buf, size, len, "disk reads", stats.reads);
+    len = kstats_line(buf, size, len, "blocks read", stats.blocks_read);
+    len = kstats_line(buf, size, len, "read ahead", stats.read_ahead);
+    len = kstats_line(buf, size, len, "read ahead hits", stats.read_ahead_hits);
+    len = kstats_line(buf, size, len, "evictions", stats.evictions);
+    return len;
+}
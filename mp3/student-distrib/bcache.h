@@ -0,0 +1,41 @@
+#ifndef BCACHE_H_
+#define BCACHE_H_
+
+#include "types.h"
+
+#define BCACHE_NUM_BUFS     64          /* 256 KiB of BLOCK_SIZE buffers */
+#define BCACHE_HASH_SIZE    128         /* Power of 2, at least twice BCACHE_NUM_BUFS */
+#define BCACHE_READ_AHEAD   16          /* Most blocks read by one miss, at most ATA_MAX_BLOCKS */
+#define BCACHE_NO_DRIVE     -1
+
+/* Cached disk block. Buffers with refs > 0 are pinned and never evicted */
+typedef struct bcache_buf {
+    uint32_t block;
+    uint32_t valid;
+    uint32_t refs;
+    uint32_t prefetched;                /* Read ahead and not requested yet */
+    uint8_t* data;
+    struct bcache_buf* prev;            /* LRU list, most recently used first */
+    struct bcache_buf* next;
+    struct bcache_buf* hash_next;
+} bcache_buf_t;
+
+/* Counters reported by the "bcachestat" kernel stats file */
+typedef struct bcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t reads;                     /* Disk commands */
+    uint32_t blocks_read;
+    uint32_t read_ahead;                /* Blocks read past the one requested */
+    uint32_t read_ahead_hits;           /* Read ahead blocks requested later */
+    uint32_t evictions;
+} bcache_stats_t;
+
+int32_t bcache_init(int32_t drive);
+int32_t bcache_get_drive();
+uint32_t bcache_num_blocks();
+bcache_buf_t* bcache_get(uint32_t block, uint32_t ahead);
+void bcache_put(bcache_buf_t* buf);
+void bcache_get_stats(bcache_stats_t* stats);
+
+#endif /* BCACHE_H_ */
@@ -0,0 +1,382 @@
+#include "ata.h"
+#include "../lib.h"
+
+/* Local Helpers, see func def comments */
+uint32_t __pci_read(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg);
+void __pci_write(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg, uint32_t val);
+uint16_t __find_bus_master(void);
+void __identify(ata_drive_t* drive);
+void __select(ata_drive_t* drive, uint32_t lba);
+int32_t __wait_ready(ata_drive_t* drive);
+int32_t __start_command(ata_drive_t* drive, uint32_t lba, uint32_t sectors, uint8_t cmd);
+int32_t __read_pio(ata_drive_t* drive, uint32_t lba, uint32_t count, uint8_t** bufs);
+int32_t __read_dma(ata_drive_t* drive, uint32_t lba, uint32_t count, uint8_t** bufs);
+
+static ata_drive_t drives[ATA_MAX_DRIVES];      /* Primary master, primary slave, secondary master, secondary slave */
+static prd_t prd_table[ATA_MAX_BLOCKS] __attribute__((aligned(sizeof(prd_t) * ATA_MAX_BLOCKS)));
+
+/*
+ * __insw
+ *   DESCRIPTION: Reads count 16-bit words from a port into buf
+ */
+static inline void __insw(uint16_t port, void* buf, uint32_t count) {
+    asm volatile ("cld; rep insw"
+            : "+D"(buf), "+c"(count)
+            : "d"(port)
+            : "memory", "cc"
+    );
+}
+
+/* ata_init
+ *  DESCRIPTION: Finds the ATA drives on both IDE channels and the bus master
+ *               IDE controller, if any, that lets them use DMA. Drive
+ *               interrupts are left off since transfers are polled.
+ *       INPUTS: None
+ *      OUTPUTS: None
+ * RETURN VALUE: Number of drives found
+ * SIDE EFFECTS: Enables bus mastering on the IDE controller
+ */
+int32_t ata_init() {
+    int32_t i, count = 0;
+    uint16_t bm_base = __find_bus_master();
+
+    for (i = 0; i < ATA_MAX_DRIVES; i++) {
+        ata_drive_t* drive = &drives[i];
+        drive->io_base = i < 2 ? ATA_PRIMARY_IO : ATA_SECONDARY_IO;
+        drive->ctrl_base = i < 2 ? ATA_PRIMARY_CTRL : ATA_SECONDARY_CTRL;
+        drive->slave = i % 2;
+        drive->bm_base = bm_base ? bm_base + (i < 2 ? 0 : BM_CHANNEL_OFFSET) : 0;
+
+        outb(ATA_CTRL_NIEN, drive->ctrl_base);
+        __identify(drive);
+        count += drive->present;
+    }
+
+    return count;
+}
+
+/* ata_drive_present
+ *  DESCRIPTION: Checks whether a drive was found by ata_init
+ *       INPUTS: drive - drive number, 0 to ATA_MAX_DRIVES - 1
+ *      OUTPUTS: None
+ * RETURN VALUE: 1 if present, 0 otherwise
+ * SIDE EFFECTS: None
+ */
+int32_t ata_drive_present(int32_t drive) {
+    return drive >= 0 && drive < ATA_MAX_DRIVES && drives[drive].present;
+}
+
+/* ata_num_blocks
+ *  DESCRIPTION: Gets the capacity of a drive
+ *       INPUTS: drive - drive number
+ *      OUTPUTS: None
+ * RETURN VALUE: Number of whole ATA_BLOCK_SIZE blocks, 0 if not present
+ * SIDE EFFECTS: None
+ */
+uint32_t ata_num_blocks(int32_t drive) {
+    if (!ata_drive_present(drive))
+        return 0;
+    return drives[drive].sectors / ATA_SECTORS_PER_BLOCK;
+}
+
+/* ata_uses_dma
+ *  DESCRIPTION: Checks whether reads from a drive go through bus master DMA
+ *       INPUTS: drive - drive number
+ *      OUTPUTS: None
+ * RETURN VALUE: 1 for DMA, 0 for PIO or if not present
+ * SIDE EFFECTS: None
+ */
+int32_t ata_uses_dma(int32_t drive) {
+    return ata_drive_present(drive) && drives[drive].bm_base != 0;
+}
+
+/* ata_read_blocks
+ *  DESCRIPTION: Reads consecutive blocks from a drive with one command. Each
+ *               block goes to its own buffer, so the buffers need not be
+ *               adjacent. Uses DMA when available and drops back to PIO for
+ *               good if a DMA transfer fails.
+ *       INPUTS: drive - drive number
+ *               block - first block, in ATA_BLOCK_SIZE units
+ *               count - number of blocks, 1 to ATA_MAX_BLOCKS
+ *               bufs - count ATA_BLOCK_SIZE buffers in identity mapped kernel
+ *                      memory, so their addresses are physical
+ *      OUTPUTS: bufs - filled with the blocks
+ * RETURN VALUE: SUCCESS or FAILURE for bad parameters or a drive error
+ * SIDE EFFECTS: Busy waits with interrupts disabled until the drive is done
+ */
+int32_t ata_read_blocks(int32_t drive, uint32_t block, uint32_t count, uint8_t** bufs) {
+    long flags;
+    int32_t ret;
+
+    if (!ata_drive_present(drive) || bufs == NULL || count == 0 || count > ATA_MAX_BLOCKS ||
+        block >= ata_num_blocks(drive) || count > ata_num_blocks(drive) - block)
+        return FAILURE;
+
+    ata_drive_t* ata = &drives[drive];
+    uint32_t lba = block * ATA_SECTORS_PER_BLOCK;
+
+    cli_and_save(flags);
+    ret = FAILURE;
+    if (ata->bm_base != 0) {
+        ret = __read_dma(ata, lba, count, bufs);
+        if (ret == FAILURE)
+            ata->bm_base = 0;
+    }
+    if (ret == FAILURE)
+        ret = __read_pio(ata, lba, count, bufs);
+    restore_flags(flags);
+
+    return ret;
+}
+
+/* __pci_read
+ *  DESCRIPTION: Reads a dword of PCI configuration space
+ *       INPUTS: bus, dev, func - PCI function
+ *               reg - dword aligned register offset
+ *      OUTPUTS: None
+ * RETURN VALUE: Register value
+ * SIDE EFFECTS: None
+ */
+uint32_t __pci_read(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg) {
+    outl(PCI_ENABLE | (bus << 16) | (dev << 11) | (func << 8) | reg, PCI_CONFIG_ADDRESS);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/* __pci_write
+ *  DESCRIPTION: Writes a dword of PCI configuration space
+ *       INPUTS: bus, dev, func - PCI function
+ *               reg - dword aligned register offset
+ *               val - value to write
+ *      OUTPUTS: None
+ * RETURN VALUE: None
+ * SIDE EFFECTS: None
+ */
+void __pci_write(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg, uint32_t val) {
+    outl(PCI_ENABLE | (bus << 16) | (dev << 11) | (func << 8) | reg, PCI_CONFIG_ADDRESS);
+    outl(val, PCI_CONFIG_DATA);
+}
+
+/* __find_bus_master
+ *  DESCRIPTION: Looks for an IDE controller on PCI bus 0 with bus master
+ *               support (programming interface bit 7), like QEMU's PIIX
+ *       INPUTS: None
+ *      OUTPUTS: None
+ * RETURN VALUE: I/O base of its bus master registers, 0 if none
+ * SIDE EFFECTS: Enables I/O decoding and bus mastering on the controller
+ */
+uint16_t __find_bus_master(void) {
+    uint32_t dev, func;
+
+    for (dev = 0; dev < PCI_NUM_DEVICES; dev++) {
+        for (func = 0; func < PCI_NUM_FUNCTIONS; func++) {
+            if ((__pci_read(0, dev, func, PCI_REG_ID) & 0xFFFF) == 0xFFFF) {
+                if (func == 0)
+                    break;
+                continue;
+            }
+
+            uint32_t class = __pci_read(0, dev, func, PCI_REG_CLASS);
+            if ((class >> 16) == PCI_CLASS_IDE && (class & 0x8000)) {
+                uint32_t bar4 = __pci_read(0, dev, func, PCI_REG_BAR4);
+                if (!(bar4 & 1))
+                    continue;
+
+                uint32_t cmd = __pci_read(0, dev, func, PCI_REG_COMMAND);
+                __pci_write(0, dev, func, PCI_REG_COMMAND, cmd | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+                return bar4 & PCI_BAR_IO_MASK;
+            }
+
+            /* Only multifunction devices have functions past 0 */
+            if (func == 0 && !(__pci_read(0, dev, func, PCI_REG_HEADER) & PCI_MULTIFUNCTION))
+                break;
+        }
+    }
+
+    return 0;
+}
+
+/* __identify
+ *  DESCRIPTION: Sends IDENTIFY DEVICE and records the drive's capacity. ATAPI
+ *               and absent drives are left marked not present, as are drives
+ *               without LBA28 capacity. DMA is kept only if the drive
+ *               reports it.
+ *       INPUTS: drive - drive with ports filled in
+ *      OUTPUTS: drive - present and sectors set
+ * RETURN VALUE: None
+ * SIDE EFFECTS: None
+ */
+void __identify(ata_drive_t* drive) {
+    uint16_t id[ATA_ID_WORDS];
+    uint32_t i;
+
+    drive->present = 0;
+    __select(drive, 0);
+    outb(0, drive->io_base + ATA_REG_COUNT);
+    outb(ATA_CMD_IDENTIFY, drive->io_base + ATA_REG_COMMAND);
+
+    /* Floating bus or no drive */
+    uint8_t status = inb(drive->io_base + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF)
+        return;
+
+    for (i = 0; i < ATA_TIMEOUT && (inb(drive->io_base + ATA_REG_STATUS) & ATA_SR_BSY); i++);
+
+    /* ATAPI devices set the signature in the LBA registers */
+    if (inb(drive->io_base + ATA_REG_LBA_MID) != 0 || inb(drive->io_base + ATA_REG_LBA_HIGH) != 0)
+        return;
+
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        status = inb(drive->io_base + ATA_REG_STATUS);
+        if (status & (ATA_SR_ERR | ATA_SR_DRQ))
+            break;
+    }
+    if (!(status & ATA_SR_DRQ))
+        return;
+
+    __insw(drive->io_base + ATA_REG_DATA, id, ATA_ID_WORDS);
+
+    drive->sectors = id[ATA_ID_LBA28_SECTORS] | ((uint32_t)id[ATA_ID_LBA28_SECTORS + 1] << 16);
+    drive->present = drive->sectors != 0;
+    if (!(id[ATA_ID_CAPABILITIES] & ATA_ID_CAP_DMA))
+        drive->bm_base = 0;
+}
+
+/* __select
+ *  DESCRIPTION: Selects the drive on its channel with the top bits of an LBA
+ *               and waits the 400ns the status register needs to settle
+ *       INPUTS: drive - drive to select
+ *               lba - sector address
+ *      OUTPUTS: None
+ * RETURN VALUE: None
+ * SIDE EFFECTS: None
+ */
+void __select(ata_drive_t* drive, uint32_t lba) {
+    int32_t i;
+
+    outb(ATA_DRIVE_LBA | (drive->slave << 4) | ((lba >> 24) & 0x0F), drive->io_base + ATA_REG_DRIVE);
+    for (i = 0; i < 4; i++)
+        inb(drive->ctrl_base);
+}
+
+/* __wait_ready
+ *  DESCRIPTION: Waits for the drive to finish a command
+ *       INPUTS: drive - selected drive
+ *      OUTPUTS: None
+ * RETURN VALUE: SUCCESS, or FAILURE on an error or timeout
+ * SIDE EFFECTS: None
+ */
+int32_t __wait_ready(ata_drive_t* drive) {
+    uint32_t i;
+    uint8_t status;
+
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        status = inb(drive->io_base + ATA_REG_STATUS);
+        if (!(status & ATA_SR_BSY))
+            return (status & (ATA_SR_ERR | ATA_SR_DF)) ? FAILURE : SUCCESS;
+    }
+    return FAILURE;
+}
+
+/* __start_command
+ *  DESCRIPTION: Programs the sector address and count and issues a command
+ *       INPUTS: drive - drive to use
+ *               lba - first sector
+ *               sectors - number of sectors, 256 is sent as 0
+ *               cmd - command byte
+ *      OUTPUTS: None
+ * RETURN VALUE: SUCCESS or FAILURE if the drive stays busy
+ * SIDE EFFECTS: None
+ */
+int32_t __start_command(ata_drive_t* drive, uint32_t lba, uint32_t sectors, uint8_t cmd) {
+    __select(drive, lba);
+    if (__wait_ready(drive) == FAILURE)
+        return FAILURE;
+
+    outb(sectors & 0xFF, drive->io_base + ATA_REG_COUNT);
+    outb(lba & 0xFF, drive->io_base + ATA_REG_LBA_LOW);
+    outb((lba >> 8) & 0xFF, drive->io_base + ATA_REG_LBA_MID);
+    outb((lba >> 16) & 0xFF, drive->io_base + ATA_REG_LBA_HIGH);
+    outb(cmd, drive->io_base + ATA_REG_COMMAND);
+    return SUCCESS;
+}
+
+/* __read_pio
+ *  DESCRIPTION: Reads blocks one sector at a time through the data port
+ *       INPUTS: drive - drive to read
+ *               lba - first sector
+ *               count - number of blocks
+ *               bufs - one buffer per block
+ *      OUTPUTS: bufs - filled with the blocks
+ * RETURN VALUE: SUCCESS or FAILURE on a drive error
+ * SIDE EFFECTS: None
+ */
+int32_t __read_pio(ata_drive_t* drive, uint32_t lba, uint32_t count, uint8_t** bufs) {
+    uint32_t sectors = count * ATA_SECTORS_PER_BLOCK;
+    uint32_t i, j;
+
+    if (__start_command(drive, lba, sectors, ATA_CMD_READ_PIO) == FAILURE)
+        return FAILURE;
+
+    for (i = 0; i < sectors; i++) {
+        /* Each sector raises DRQ once the drive has it buffered */
+        for (j = 0; j < ATA_TIMEOUT; j++) {
+            uint8_t status = inb(drive->io_base + ATA_REG_STATUS);
+            if (status & (ATA_SR_ERR | ATA_SR_DF))
+                return FAILURE;
+            if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ))
+                break;
+        }
+        if (j == ATA_TIMEOUT)
+            return FAILURE;
+
+        __insw(drive->io_base + ATA_REG_DATA,
+               bufs[i / ATA_SECTORS_PER_BLOCK] + (i % ATA_SECTORS_PER_BLOCK) * ATA_SECTOR_SIZE,
+               ATA_SECTOR_SIZE / 2);
+    }
+
+    return __wait_ready(drive);
+}
+
+/* __read_dma
+ *  DESCRIPTION: Reads blocks with one bus master DMA transfer, one physical
+ *               region descriptor per buffer
+ *       INPUTS: drive - drive to read, with bus master registers
+ *               lba - first sector
+ *               count - number of blocks
+ *               bufs - one buffer per block
+ *      OUTPUTS: bufs - filled with the blocks
+ * RETURN VALUE: SUCCESS or FAILURE on a controller or drive error
+ * SIDE EFFECTS: None
+ */
+int32_t __read_dma(ata_drive_t* drive, uint32_t lba, uint32_t count, uint8_t** bufs) {
+    uint32_t i;
+    uint8_t bm_status = 0;
+
+    for (i = 0; i < count; i++) {
+        prd_table[i].addr = (uint32_t)bufs[i];
+        prd_table[i].count = ATA_BLOCK_SIZE;
+    }
+    prd_table[count - 1].count |= PRD_EOT;
+
+    outb(0, drive->bm_base + BM_REG_COMMAND);
+    outl((uint32_t)prd_table, drive->bm_base + BM_REG_PRDT);
+    outb(BM_SR_ERR | BM_SR_IRQ, drive->bm_base + BM_REG_STATUS);     /* Write 1 to clear */
+    outb(BM_CMD_READ, drive->bm_base + BM_REG_COMMAND);
+
+    if (__start_command(drive, lba, count * ATA_SECTORS_PER_BLOCK, ATA_CMD_READ_DMA) == FAILURE)
+        return FAILURE;
+    outb(BM_CMD_READ | BM_CMD_START, drive->bm_base + BM_REG_COMMAND);
+
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        bm_status = inb(drive->bm_base + BM_REG_STATUS);
+        if (!(bm_status & BM_SR_ACTIVE) || (bm_status & BM_SR_ERR))
+            break;
+    }
+
+    outb(BM_CMD_READ, drive->bm_base + BM_REG_COMMAND);
+    outb(BM_SR_ERR | BM_SR_IRQ, drive->bm_base + BM_REG_STATUS);
+
+    if (i == ATA_TIMEOUT || (bm_status & BM_SR_ERR))
+        return FAILURE;
+    return __wait_ready(drive);
+}
@@ -0,0 +1,101 @@
+#ifndef ATA_H_
+#define ATA_H_
+
+#include "../types.h"
+
+#define ATA_MAX_DRIVES          4           /* Master and slave on two channels */
+#define ATA_SECTOR_SIZE         512
+#define ATA_BLOCK_SIZE          4096        /* Same as the file system's BLOCK_SIZE */
+#define ATA_SECTORS_PER_BLOCK   (ATA_BLOCK_SIZE / ATA_SECTOR_SIZE)
+#define ATA_MAX_BLOCKS          32          /* Blocks per transfer, 256 sectors */
+
+/* Channel ports */
+#define ATA_PRIMARY_IO          0x1F0
+#define ATA_PRIMARY_CTRL        0x3F6
+#define ATA_SECONDARY_IO        0x170
+#define ATA_SECONDARY_CTRL      0x376
+
+/* Offsets from the channel's I/O base */
+#define ATA_REG_DATA            0
+#define ATA_REG_ERROR           1
+#define ATA_REG_COUNT           2
+#define ATA_REG_LBA_LOW         3
+#define ATA_REG_LBA_MID         4
+#define ATA_REG_LBA_HIGH        5
+#define ATA_REG_DRIVE           6
+#define ATA_REG_STATUS          7
+#define ATA_REG_COMMAND         7
+
+/* Status bits */
+#define ATA_SR_ERR              0x01
+#define ATA_SR_DRQ              0x08
+#define ATA_SR_DF               0x20
+#define ATA_SR_BSY              0x80
+
+/* Commands */
+#define ATA_CMD_READ_PIO        0x20
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_IDENTIFY        0xEC
+
+#define ATA_DRIVE_LBA           0xE0        /* LBA mode, bit 4 selects the slave */
+#define ATA_CTRL_NIEN           0x02        /* Drive interrupts off, completion is polled */
+#define ATA_MAX_LBA28           0x0FFFFFFF
+#define ATA_TIMEOUT             1000000     /* Status polls before giving up */
+
+/* IDENTIFY words */
+#define ATA_ID_WORDS            256
+#define ATA_ID_CAPABILITIES     49
+#define ATA_ID_CAP_DMA          0x0100
+#define ATA_ID_LBA28_SECTORS    60
+
+/* PCI configuration space, for the bus master IDE controller */
+#define PCI_CONFIG_ADDRESS      0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+#define PCI_ENABLE              0x80000000
+#define PCI_REG_ID              0x00
+#define PCI_REG_COMMAND         0x04
+#define PCI_REG_CLASS           0x08
+#define PCI_REG_HEADER          0x0C
+#define PCI_REG_BAR4            0x20
+#define PCI_CMD_IO              0x0001
+#define PCI_CMD_BUS_MASTER      0x0004
+#define PCI_CLASS_IDE           0x0101      /* Mass storage, IDE */
+#define PCI_MULTIFUNCTION       0x00800000
+#define PCI_NUM_DEVICES         32
+#define PCI_NUM_FUNCTIONS       8
+#define PCI_BAR_IO_MASK         0xFFFC
+
+/* Bus master registers, per channel */
+#define BM_CHANNEL_OFFSET       8           /* Secondary channel registers */
+#define BM_REG_COMMAND          0
+#define BM_REG_STATUS           2
+#define BM_REG_PRDT             4
+#define BM_CMD_START            0x01
+#define BM_CMD_READ             0x08        /* Device to memory */
+#define BM_SR_ACTIVE            0x01
+#define BM_SR_ERR               0x02
+#define BM_SR_IRQ               0x04
+#define PRD_EOT                 0x80000000  /* Last entry of the table */
+
+/* Physical region descriptor of a DMA transfer */
+typedef struct prd {
+    uint32_t addr;
+    uint32_t count;                         /* Bytes in the low 16 bits, 0 means 64 KiB */
+} prd_t;
+
+typedef struct ata_drive {
+    uint16_t io_base;
+    uint16_t ctrl_base;
+    uint16_t bm_base;                       /* Bus master registers, 0 if no DMA */
+    uint8_t slave;
+    uint8_t present;
+    uint32_t sectors;                       /* LBA28 capacity */
+} ata_drive_t;
+
+int32_t ata_init();
+int32_t ata_drive_present(int32_t drive);
+uint32_t ata_num_blocks(int32_t drive);
+int32_t ata_uses_dma(int32_t drive);
+int32_t ata_read_blocks(int32_t drive, uint32_t block, uint32_t count, uint8_t** bufs);
+
+#endif /* ATA_H_ */
@@ -0,0 +1,411 @@
+#include "exec_cache.h"
+#include "frame.h"
+#include "kstats.h"
+#include "lib.h"
+#include "paging.h"
+#include "system.h"
+
+#define ELF_PHOFF_OFF           28          /* Offset of program header table offset */
+#define ELF_PHNUM_OFF           44          /* Offset of number of program headers */
+#define ELF_PT_LOAD             1           /* Program header type of a loaded segment */
+#define ELF_PF_W                0x2         /* Program header flag of a writable segment */
+#define IMAGE_VIRT_ADDR         (PROG_VIRT_ADDR + PROG_OFFSET)
+
+/* ELF program header, one per segment */
+typedef struct elf_phdr {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} elf_phdr_t;
+
+/* Cached images. Slot i's image lives at exec_cache_images[i] */
+static uint8_t exec_cache_images[EXEC_CACHE_SLOTS][EXEC_CACHE_SLOT_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+static exec_cache_entry_t exec_cache[EXEC_CACHE_SLOTS];
+static exec_cache_stats_t exec_cache_stats;
+static uint32_t exec_cache_clock;
+
+/* Local helpers */
+int32_t __validate_image(const uint8_t* image, int32_t length);
+void __find_text(exec_cache_entry_t* entry);
+void __drop_text(exec_cache_entry_t* entry);
+exec_cache_entry_t* __find_victim(void);
+int32_t __exec_cache_fill(int8_t* buf, int32_t size);
+
+/*
+ * exec_cache_init
+ *   DESCRIPTION: Empties the executable cache, clears its statistics, and
+ *                registers the "execstat" kernel stats file.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void exec_cache_init()
+{
+    int i;
+    for (i = 0; i < EXEC_CACHE_SLOTS; ++i)
+    {
+        exec_cache[i].valid = 0;
+        exec_cache[i].image = exec_cache_images[i];
+        memset(exec_cache[i].text_frames, 0, sizeof(exec_cache[i].text_frames));
+    }
+
+    memset(&exec_cache_stats, 0, sizeof(exec_cache_stats));
+    exec_cache_clock = 0;
+
+    kstats_register("execstat", __exec_cache_fill);
+}
+
+/*
+ * exec_cache_load
+ *   DESCRIPTION: Validates the executable of the given dentry and gets its
+ *                entry point without copying it anywhere; the program's pages
+ *                are filled in on first touch through exec_cache_read. On a
+ *                hit there is no file system access; on a miss the file is
+ *                read and validated into the least recently used slot. Images
+ *                larger than a slot only have their header read.
+ *        INPUTS: dentry - dentry of a regular file
+ *       OUTPUTS: length - length of the image
+ *  RETURN VALUE: Program's entry point or FAILURE if file is not a valid
+ *                executable that fits in the program page.
+ *  SIDE EFFECTS: May evict a cached image
+ */
+int32_t exec_cache_load(const dentry_t* dentry, uint32_t* length)
+{
+    int i;
+    int32_t file_len;
+    exec_cache_entry_t* entry;
+    uint8_t header[PROG_EIP_OFF + sizeof(uint32_t)];
+
+    /* Hit: no file system access */
+    for (i = 0; i < EXEC_CACHE_SLOTS; ++i)
+    {
+        entry = &exec_cache[i];
+        if (entry->valid && entry->inode_num == dentry->inode_num)
+        {
+            ++exec_cache_stats.hits;
+            entry->last_use = ++exec_cache_clock;
+            *length = entry->length;
+            return entry->eip;
+        }
+    }
+
+    ++exec_cache_stats.misses;
+
+    /* Image must fit in the program page */
+    file_len = file_length(dentry->inode_num);
+    if (file_len == FAILURE || file_len > PROG_PAGE_SIZE - PROG_OFFSET)
+        return FAILURE;
+
+    /* Too big to cache: validate the header only */
+    if (file_len > EXEC_CACHE_SLOT_SIZE)
+    {
+        ++exec_cache_stats.bypasses;
+        if (read_data(dentry->inode_num, 0, header, sizeof(header)) != sizeof(header) ||
+            __validate_image(header, file_len) == FAILURE)
+            return FAILURE;
+        *length = file_len;
+        return *((uint32_t*)(header + PROG_EIP_OFF));
+    }
+
+    /* Miss: read and validate into a slot */
+    entry = __find_victim();
+    if (entry->valid)
+        ++exec_cache_stats.evictions;
+    entry->valid = 0;
+    __drop_text(entry);
+
+    if (read_data(dentry->inode_num, 0, entry->image, file_len) != file_len || __validate_image(entry->image, file_len) == FAILURE)
+        return FAILURE;
+
+    entry->inode_num = dentry->inode_num;
+    entry->length = file_len;
+    entry->eip = *((uint32_t*)(entry->image + PROG_EIP_OFF));
+    entry->last_use = ++exec_cache_clock;
+    __find_text(entry);
+    entry->valid = 1;
+
+    *length = file_len;
+    return entry->eip;
+}
+
+/*
+ * exec_cache_read
+ *   DESCRIPTION: Reads part of an executable for the page fault handler,
+ *                from its cached image when there is one and from the file
+ *                system otherwise.
+ *        INPUTS: inode_num - inode of the executable
+ *                offset - offset into the file
+ *                length - number of bytes to read
+ *       OUTPUTS: buf - buffer in which to place the bytes
+ *  RETURN VALUE: Number of bytes read or FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t exec_cache_read(uint32_t inode_num, uint32_t offset, uint8_t* buf, uint32_t length)
+{
+    int i;
+    exec_cache_entry_t* entry;
+
+    for (i = 0; i < EXEC_CACHE_SLOTS; ++i)
+    {
+        entry = &exec_cache[i];
+        if (entry->valid && entry->inode_num == inode_num)
+        {
+            if (offset >= entry->length)
+                return 0;
+            if (length > entry->length - offset)
+                length = entry->length - offset;
+            memcpy(buf, entry->image + offset, length);
+            return length;
+        }
+    }
+
+    return read_data(inode_num, offset, buf, length);
+}
+
+/*
+ * exec_cache_text_page
+ *   DESCRIPTION: Gets the shared frame holding a read-only text page of a
+ *                cached executable, filling it from the cached image the
+ *                first time. The caller gets its own reference to the frame
+ *                and must map it read-only.
+ *        INPUTS: inode_num - inode of the executable
+ *                offset - page aligned offset into the image
+ *       OUTPUTS: none
+ *  RETURN VALUE: Frame with a new reference, or NULL if the executable is
+ *                not cached, the page is not text, or memory is exhausted
+ *  SIDE EFFECTS: May allocate a frame, which the cache keeps until the image
+ *                is evicted
+ */
+uint32_t exec_cache_text_page(uint32_t inode_num, uint32_t offset)
+{
+    int i;
+    uint32_t page = offset / PAGE_SIZE;
+    uint32_t frame, bytes;
+    exec_cache_entry_t* entry;
+
+    for (i = 0; i < EXEC_CACHE_SLOTS; ++i)
+    {
+        entry = &exec_cache[i];
+        if (!entry->valid || entry->inode_num != inode_num)
+            continue;
+        if (offset < entry->text_start || offset >= entry->text_end)
+            return NULL;
+
+        if (entry->text_frames[page] == NULL)
+        {
+            frame = frame_alloc();
+            if (frame == NULL)
+                return NULL;
+
+            bytes = entry->length - offset < PAGE_SIZE ? entry->length - offset : PAGE_SIZE;
+            memcpy((void*)frame, entry->image + offset, bytes);
+            memset((uint8_t*)frame + bytes, 0, PAGE_SIZE - bytes);
+            entry->text_frames[page] = frame;
+            ++exec_cache_stats.text_pages;
+        }
+
+        if (frame_ref(entry->text_frames[page]) == FAILURE)
+            return NULL;
+        ++exec_cache_stats.text_maps;
+        return entry->text_frames[page];
+    }
+
+    return NULL;
+}
+
+/*
+ * exec_cache_invalidate
+ *   DESCRIPTION: Drops the cached image of an inode, if any. Must be called
+ *                whenever a file's data may change. Processes already running
+ *                it keep the text pages they mapped.
+ *        INPUTS: inode_num - inode whose image is stale
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Releases the cache's references to shared text frames
+ */
+void exec_cache_invalidate(uint32_t inode_num)
+{
+    int i;
+    for (i = 0; i < EXEC_CACHE_SLOTS; ++i)
+    {
+        if (exec_cache[i].valid && exec_cache[i].inode_num == inode_num)
+        {
+            exec_cache[i].valid = 0;
+            __drop_text(&exec_cache[i]);
+        }
+    }
+}
+
+/*
+ * get_exec_cache_stats
+ *   DESCRIPTION: Gets executable cache statistics.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer to executable cache statistics
+ *  SIDE EFFECTS: none
+ */
+exec_cache_stats_t* get_exec_cache_stats()
+{
+    return &exec_cache_stats;
+}
+
+/*
+ * __validate_image
+ *   DESCRIPTION: Checks that an image is an executable holding an entry point.
+ *        INPUTS: image - executable image
+ *                length - length of image
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS/FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t __validate_image(const uint8_t* image, int32_t length)
+{
+    if (length < PROG_EIP_OFF + (int32_t)sizeof(uint32_t) || *((uint32_t*)image) != EXEC_MAGIC_STR)
+        return FAILURE;
+
+    return SUCCESS;
+}
+
+/*
+ * __find_text
+ *   DESCRIPTION: Finds the pages of a cached image that only hold read-only
+ *                text, using the ELF program headers: pages touching a
+ *                read-only loaded segment, up to the first page touching a
+ *                writable one. Images without usable headers share nothing.
+ *        INPUTS: entry - slot holding a validated image
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Sets text_start and text_end of entry
+ */
+void __find_text(exec_cache_entry_t* entry)
+{
+    uint32_t phoff = *((uint32_t*)(entry->image + ELF_PHOFF_OFF));
+    uint32_t phnum = *((uint16_t*)(entry->image + ELF_PHNUM_OFF));
+    uint32_t start = entry->length;
+    uint32_t end = 0;
+    uint32_t limit = (entry->length + PAGE_SIZE - 1) & FLAG_MASK;
+    elf_phdr_t* phdr;
+    uint32_t i;
+
+    entry->text_start = 0;
+    entry->text_end = 0;
+
+    if (phoff > entry->length || phnum > (entry->length - phoff) / sizeof(elf_phdr_t))
+        return;
+
+    for (i = 0; i < phnum; ++i)
+    {
+        phdr = (elf_phdr_t*)(entry->image + phoff) + i;
+        if (phdr->type != ELF_PT_LOAD || phdr->memsz == 0)
+            continue;
+        if (phdr->vaddr < IMAGE_VIRT_ADDR || phdr->vaddr - IMAGE_VIRT_ADDR >= PROG_PAGE_SIZE ||
+            phdr->memsz > PROG_PAGE_SIZE)
+            return;
+
+        if (phdr->flags & ELF_PF_W)
+        {
+            /* Writable data, bss, and everything after stay private */
+            if (((phdr->vaddr - IMAGE_VIRT_ADDR) & FLAG_MASK) < limit)
+                limit = (phdr->vaddr - IMAGE_VIRT_ADDR) & FLAG_MASK;
+        }
+        else
+        {
+            if (phdr->vaddr - IMAGE_VIRT_ADDR < start)
+                start = phdr->vaddr - IMAGE_VIRT_ADDR;
+            if (phdr->vaddr - IMAGE_VIRT_ADDR + phdr->memsz > end)
+                end = phdr->vaddr - IMAGE_VIRT_ADDR + phdr->memsz;
+        }
+    }
+
+    start &= FLAG_MASK;
+    end = (end + PAGE_SIZE - 1) & FLAG_MASK;
+    if (end > limit)
+        end = limit;
+    if (start < end)
+    {
+        entry->text_start = start;
+        entry->text_end = end;
+    }
+}
+
+/*
+ * __drop_text
+ *   DESCRIPTION: Releases the cache's references to the shared text frames
+ *                of a slot. Frames still mapped by processes are freed when
+ *                the last of them halts.
+ *        INPUTS: entry - slot being evicted or invalidated
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: May free frames
+ */
+void __drop_text(exec_cache_entry_t* entry)
+{
+    int i;
+    for (i = 0; i < EXEC_CACHE_PAGES; ++i)
+    {
+        if (entry->text_frames[i] != NULL)
+        {
+            frame_free(entry->text_frames[i]);
+            entry->text_frames[i] = NULL;
+            --exec_cache_stats.text_pages;
+        }
+    }
+}
+
+/*
+ * __find_victim
+ *   DESCRIPTION: Picks the slot to fill on a miss: an empty slot if there is
+ *                one, otherwise the least recently used image.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer to slot
+ *  SIDE EFFECTS: none
+ */
+exec_cache_entry_t* __find_victim(void)
+{
+    int i;
+    exec_cache_entry_t* victim = &exec_cache[0];
+
+    for (i = 0; i < EXEC_CACHE_SLOTS; ++i)
+    {
+        if (!exec_cache[i].valid)
+            return &exec_cache[i];
+        if (exec_cache[i].last_use < victim->last_use)
+            victim = &exec_cache[i];
+    }
+
+    return victim;
+}
+
+/*
+ * __exec_cache_fill
+ *   DESCRIPTION: Generates text of the "execstat" stats file: cache counters
+ *                followed by execute latency.
+ *        INPUTS: size - size of buf
+ *       OUTPUTS: buf - text of stats file
+ *  RETURN VALUE: Length of text
+ *  SIDE EFFECTS: none
+ */
+int32_t __exec_cache_fill(int8_t* buf, int32_t size)
+{
+    exec_stats_t* exec_stats = get_exec_stats();
+    int32_t len = 0;
+
+    len = kstats_line(buf, size, len, "cache hits", exec_cache_stats.hits);
+    len = kstats_line(buf, size, len, "cache misses", exec_cache_stats.misses);
+    len = kstats_line(buf, size, len, "cache evictions", exec_cache_stats.evictions);
+    len = kstats_line(buf, size, len, "cache bypasses", exec_cache_stats.bypasses);
+    len = kstats_line(buf, size, len, "shared text pages", exec_cache_stats.text_pages);
+    len = kstats_line(buf, size, len, "text page maps", exec_cache_stats.text_maps);
+    len = kstats_line(buf, size, len, "executes", exec_stats->count);
+    len = kstats_line(buf, size, len, "last cycles", exec_stats->last_cycles);
+    len = kstats_line(buf, size, len, "min cycles", exec_stats->min_cycles);
+    len = kstats_line(buf, size, len, "max cycles", exec_stats->max_cycles);
+    return len;
+}
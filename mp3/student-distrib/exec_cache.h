@@ -0,0 +1,40 @@
+#ifndef EXEC_CACHE_H_
+#define EXEC_CACHE_H_
+
+#include "types.h"
+#include "file_sys.h"
+
+#define EXEC_CACHE_SLOTS        8           /* Number of cached executables */
+#define EXEC_CACHE_SLOT_SIZE    0x10000     /* 64 KiB; larger images bypass the cache */
+#define EXEC_CACHE_PAGES        16          /* 4 KiB pages in a slot */
+
+/* Validated executable image, read by the page fault handler */
+typedef struct exec_cache_entry {
+    uint32_t valid;
+    uint32_t inode_num;
+    uint32_t length;
+    uint32_t eip;                       /* Entry point read from PROG_EIP_OFF */
+    uint32_t last_use;                  /* exec_cache_clock at last hit, for LRU */
+    uint8_t* image;
+    uint32_t text_start;                /* Page aligned image offsets of read-only text */
+    uint32_t text_end;
+    uint32_t text_frames[EXEC_CACHE_PAGES]; /* Shared text pages, NULL until first fault */
+} exec_cache_entry_t;
+
+typedef struct exec_cache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t bypasses;                  /* Images too large to cache */
+    uint32_t text_pages;                /* Shared text frames held by the cache */
+    uint32_t text_maps;                 /* Shared text pages mapped into processes */
+} exec_cache_stats_t;
+
+void exec_cache_init();
+int32_t exec_cache_load(const dentry_t* dentry, uint32_t* length);
+int32_t exec_cache_read(uint32_t inode_num, uint32_t offset, uint8_t* buf, uint32_t length);
+uint32_t exec_cache_text_page(uint32_t inode_num, uint32_t offset);
+void exec_cache_invalidate(uint32_t inode_num);
+exec_cache_stats_t* get_exec_cache_stats();
+
+#endif /* EXEC_CACHE_H_ */
@@ -7,6 +7,20 @@
 #define NOT_IN_USE          0
 #define IN_USE              1
 #define INIT_FILE_POS       0
+#define MAX_FILE_POS        0x7FFFFFFF
+
+/* lseek origins */
+#define SEEK_SET            0
+#define SEEK_CUR            1
+#define SEEK_END            2
+
+/* File information returned by stat */
+typedef struct file_stat
+{
+    int32_t filetype;
+    int32_t inode_num;
+    int32_t length;     /* Bytes for regular files, entries for directories */
+} stat_t;
 
 typedef struct file_operations_table
 {
@@ -14,6 +28,9 @@ typedef struct file_operations_table
     int32_t (*write)(int32_t, const void*, int32_t);
     int32_t (*open)(const uint8_t*);
     int32_t (*close)(int32_t);
+    int32_t (*stat)(int32_t, stat_t*);
+    int32_t (*lseek)(int32_t, int32_t, int32_t);
+    int32_t (*pread)(int32_t, void*, int32_t, uint32_t);
 } file_op_table_t;
 
 /* File Descriptor Entry */
@@ -23,6 +40,16 @@ typedef struct file_descriptor_entry
     uint32_t inode;
     uint32_t file_position;
     uint32_t flags;
+
+    /* Sequential read cursor for regular files. Valid only while cursor_valid
+     * is set and cursor_pos matches file_position */
+    uint32_t cursor_valid;
+    uint32_t file_len;                  /* Length of the file */
+    int32_t dnode;                      /* First data block of the run holding cursor_pos, or -1 */
+    uint32_t dnode_num;                 /* Index of dnode within the file */
+    uint32_t dnode_pos;                 /* Offset of cursor_pos within the run */
+    uint32_t run_len;                   /* Bytes in the run of consecutive data blocks */
+    uint32_t cursor_pos;                /* File position the cursor describes */
 } file_t;
 
 
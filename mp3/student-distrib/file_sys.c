@@ -1,4 +1,6 @@
 #include "file_sys.h"
+#include "bcache.h"
+#include "tmpfs.h"
 #include "file.h"
 #include "lib.h"
 #include "rtc.h"
@@ -7,31 +9,114 @@
 #include "pcb.h"
 
 static boot_block_t* boot_blk;
+static boot_block_t empty_boot_blk;  /* Mounted instead of an image that does not add up */
+static boot_block_t disk_boot_blk;  /* Copy of the boot block of an image on disk */
+static uint8_t* img_base;           /* Image in memory, unused when mounted from disk */
+static uint32_t on_disk;            /* Blocks are read through the buffer cache */
+static uint32_t fs_revision;
+static uint32_t boot_dir_count;     /* Usable dentries of the image */
+static uint32_t dir_start;          /* Block of dentry NUM_DIR_ENTRIES, 0 if none */
+static uint32_t index_start;        /* First block of the sorted name index, 0 if none */
+static uint32_t inode_start;        /* Block of inode 0 */
+static uint32_t data_start;         /* Block of data block 0, just past the inodes */
+static extent_t inode_extents[MAX_EXTENT_INODES];   /* Checked dentry extents, blocks 0 if none */
+
+/* Hashed dentry index of legacy images, built once from the boot block */
+static int8_t dentry_index[DENTRY_HASH_SIZE];           /* Dentry number or DENTRY_HASH_EMPTY */
+static uint32_t dentry_index_hash[DENTRY_HASH_SIZE];    /* Cached hash of the indexed name */
+static neg_cache_entry_t neg_cache[NEG_CACHE_SIZE];
+
+/* Local helpers */
+int32_t __read_data_cursor(file_t* file, uint8_t* buf, uint32_t length);
+uint8_t* __get_block(uint32_t block, uint32_t ahead, bcache_buf_t** buf);
+void __put_block(bcache_buf_t* buf);
+int32_t __copy_run(uint32_t dnode, uint32_t run_blocks, uint32_t pos, uint8_t* buf, uint32_t length);
+inode_t* __get_inode(uint32_t inode_idx, bcache_buf_t** buf);
+int32_t __read_dentry(uint32_t dentry_num, dentry_t* dentry);
+uint32_t __index_entry(uint32_t pos);
+int32_t __mount(uint32_t img_blocks);
+void __init_op_tables(void);
+int32_t __read_header(uint32_t img_blocks);
+int32_t __read_legacy_header(uint32_t img_blocks);
+int32_t __check_counts(uint32_t first_inode, uint32_t img_blocks);
+dentry_t* __lookup_hashed(const uint8_t* fname, uint32_t name_len, uint32_t hash);
+int32_t __lookup_sorted(const uint8_t* fname, uint32_t name_len, dentry_t* dentry);
+int32_t __name_cmp(const int8_t* fname, uint32_t name_len, const int8_t* name);
+int32_t* __dnode_slot(inode_t* inode, uint32_t dnode_num, uint32_t* slots_left, bcache_buf_t** buf);
+int32_t* __indirect_table(int32_t block, bcache_buf_t** buf);
+int32_t __resolve_run(inode_t* inode, uint32_t inode_idx, uint32_t dnode_num, uint32_t* run_blocks);
+void __build_dentry_index(void);
+void __build_extents(void);
+void __clear_neg_cache(void);
+uint32_t __name_len(const int8_t* name, uint32_t max_len);
+uint32_t __hash_name(const int8_t* name, uint32_t len);
+int32_t __seek(file_t* file, int32_t offset, int32_t whence, int32_t length);
+uint32_t __dir_count(void);
+int32_t __dentry_at(uint32_t index, dentry_t* dentry);
 
 /*
  * file_sys_init
  *   DESCRIPTION: Gets file system address and initializes the file and
- *                directory operations tables
+ *                directory operations tables. An image whose header
+ *                describes more blocks than img_size holds is replaced by an
+ *                empty file system.
  *        INPUTS: file_sys_img - address of file system image
+ *                img_size - size of the image in bytes
  *       OUTPUTS: none
  *  RETURN VALUE: none
  *  SIDE EFFECTS: See description
  */
-void file_sys_init(void* file_sys_img)
+void file_sys_init(void* file_sys_img, uint32_t img_size)
 {
     boot_blk = (boot_block_t*)file_sys_img;
+    img_base = (uint8_t*)file_sys_img;
+    on_disk = 0;
 
-    /* Initialize file type file_op_table */
-    file_type_op_table.read = file_read;
-    file_type_op_table.write = file_write;
-    file_type_op_table.open = file_open;
-    file_type_op_table.close = file_close;
+    if (img_size < BLOCK_SIZE || __mount(img_size / BLOCK_SIZE) == FAILURE)
+    {
+        boot_blk = &empty_boot_blk;
+        __mount(1);
+    }
+    __init_op_tables();
+}
 
-    /* Initialize dir type file_op_table */
-    dir_type_op_table.read = dir_read;
-    dir_type_op_table.write = dir_write;
-    dir_type_op_table.open = dir_open;
-    dir_type_op_table.close = dir_close;
+/*
+ * file_sys_init_disk
+ *   DESCRIPTION: Mounts the image on the drive the buffer cache was set up
+ *                for. Its blocks are read through the cache when needed
+ *                rather than kept in memory. A drive whose first block does
+ *                not hold a consistent, non-empty header is not mounted.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE
+ *  SIDE EFFECTS: Reads the boot block, and the inodes of files whose extent
+ *                is recorded, from disk
+ */
+int32_t file_sys_init_disk(void)
+{
+    bcache_buf_t* buf;
+    uint8_t* block;
+
+    on_disk = 1;
+    block = __get_block(0, 0, &buf);
+    if (block == NULL)
+    {
+        on_disk = 0;
+        return FAILURE;
+    }
+    memcpy(&disk_boot_blk, block, sizeof(boot_block_t));
+    __put_block(buf);
+
+    /* A blank drive passes as an empty legacy image, leave it alone */
+    boot_blk = &disk_boot_blk;
+    if (__mount(bcache_num_blocks()) == FAILURE || boot_dir_count == 0)
+    {
+        on_disk = 0;
+        return FAILURE;
+    }
+    __init_op_tables();
+
+    return SUCCESS;
 }
 
 /*** File Open/Close/Read/Write functions ***/
@@ -66,8 +151,8 @@ int32_t file_read(int32_t fd, void* buf, int32_t nbytes)
     if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || buf == NULL || nbytes < 0)
         return FAILURE;
 
-    /* Read data from file */
-    int32_t bytes_read = read_data(fd_array[fd].inode, fd_array[fd].file_position, (uint8_t*)buf, (uint32_t)nbytes);
+    /* Read data from file, continuing from the cursor of the last read */
+    int32_t bytes_read = __read_data_cursor(&fd_array[fd], (uint8_t*)buf, (uint32_t)nbytes);
 
     /* Update file cursor */
     if (bytes_read == FAILURE)
@@ -84,15 +169,55 @@ int32_t file_read(int32_t fd, void* buf, int32_t nbytes)
 
 /*
  * file_write
- *   DESCRIPTION: Does nothing.
- *        INPUTS: none
+ *   DESCRIPTION: Writes nbytes from buf to a RAM file at the file position
+ *                and updates the file position.
+ *        INPUTS: fd - file descriptor index of file
+ *                buf - data to write
+ *                nbytes - number of bytes to write
  *       OUTPUTS: none
- *  RETURN VALUE: FAILURE
- *  SIDE EFFECTS: none
+ *  RETURN VALUE: Number of bytes written or FAILURE for invalid parameters,
+ *                boot image files, or no space
+ *  SIDE EFFECTS: File position is updated
  */
 int32_t file_write(int32_t fd, const void* buf, int32_t nbytes)
 {
-    return FAILURE;
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid parameters. Boot image files are read-only */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || buf == NULL || nbytes < 0 ||
+        !tmpfs_is_inode(fd_array[fd].inode))
+        return FAILURE;
+
+    int32_t bytes_written = tmpfs_write(fd_array[fd].inode, fd_array[fd].file_position, (uint8_t*)buf, nbytes);
+
+    /* Update file position */
+    if (bytes_written != FAILURE)
+        fd_array[fd].file_position += bytes_written;
+
+    return bytes_written;
+}
+
+/*
+ * file_truncate
+ *   DESCRIPTION: Sets the length of a RAM file. The file position is left
+ *                alone, so it may end up past the end of file.
+ *        INPUTS: fd - file descriptor index of file
+ *                length - new length in bytes
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE for invalid parameters, boot image files,
+ *                or not enough space
+ *  SIDE EFFECTS: Changes the file's length
+ */
+int32_t file_truncate(int32_t fd, int32_t length)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid parameters. Boot image files are read-only */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || length < 0 ||
+        !tmpfs_is_inode(fd_array[fd].inode))
+        return FAILURE;
+
+    return tmpfs_truncate(fd_array[fd].inode, length);
 }
 
 /*
@@ -113,13 +238,89 @@ int32_t file_close(int32_t fd)
 
     /* Mark file descriptor as not in use */
     fd_array[fd].file_ops = NULL;
-    fd_array[fd].flags = NOT_IN_USE;
+    release_fd(fd);
     return SUCCESS;
 }
 
 
 /*** Directory Open/Close/Read/Write functions ***/
 
+/*
+ * file_stat
+ *   DESCRIPTION: Gets type, inode number and length of an open file.
+ *        INPUTS: fd - file descriptor index of file
+ *       OUTPUTS: buf - stat_t to fill in
+ *  RETURN VALUE: SUCCESS or FAILURE for invalid parameters
+ *  SIDE EFFECTS: none
+ */
+int32_t file_stat(int32_t fd, stat_t* buf)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid parameters */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || buf == NULL)
+        return FAILURE;
+
+    int32_t length = file_length(fd_array[fd].inode);
+    if (length == FAILURE)
+        return FAILURE;
+
+    buf->filetype = FILE_TYPE;
+    buf->inode_num = fd_array[fd].inode;
+    buf->length = length;
+
+    return SUCCESS;
+}
+
+/*
+ * file_lseek
+ *   DESCRIPTION: Moves the file position of an open file. Positions past the
+ *                end of the file are allowed and read as end of file.
+ *        INPUTS: fd - file descriptor index of file
+ *                offset - byte offset from whence
+ *                whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *       OUTPUTS: none
+ *  RETURN VALUE: New file position or FAILURE for invalid parameters or a
+ *                negative resulting position
+ *  SIDE EFFECTS: File position is updated
+ */
+int32_t file_lseek(int32_t fd, int32_t offset, int32_t whence)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid parameters */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE)
+        return FAILURE;
+
+    int32_t length = file_length(fd_array[fd].inode);
+    if (length == FAILURE)
+        return FAILURE;
+
+    return __seek(&fd_array[fd], offset, whence, length);
+}
+
+/*
+ * file_pread
+ *   DESCRIPTION: Reads nbytes from file at the given offset without using or
+ *                changing the file position.
+ *        INPUTS: fd - file descriptor index of file
+ *                nbytes - number of bytes to read
+ *                offset - byte offset in the file to read from
+ *       OUTPUTS: buf - buffer in which to place read data
+ *  RETURN VALUE: Number of bytes read and placed in the buffer or FAILURE.
+ *  SIDE EFFECTS: none
+ */
+int32_t file_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid parameters */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || buf == NULL || nbytes < 0)
+        return FAILURE;
+
+    return read_data(fd_array[fd].inode, offset, (uint8_t*)buf, (uint32_t)nbytes);
+}
+
 /*
  * dir_open
  *   DESCRIPTION: Does nothing
@@ -158,11 +359,12 @@ int32_t dir_read(int32_t fd, void* buf, int32_t nbytes)
     uint32_t dentry_num = fd_array[fd].file_position;
 
     /* Check for end of dentry list */
-    if (dentry_num >= boot_blk->dir_count)
+    dentry_t dentry;
+    if (__dentry_at(dentry_num, &dentry) == FAILURE)
         return 0;
 
     /* Write filename to buf with 0 padding */
-    strncpy((int8_t*)buf, boot_blk->dir_entries[dentry_num].filename, num_bytes);
+    strncpy((int8_t*)buf, dentry.filename, num_bytes);
 
     /* Increment file_position */
     ++fd_array[fd].file_position;
@@ -171,6 +373,99 @@ int32_t dir_read(int32_t fd, void* buf, int32_t nbytes)
     return num_bytes;
 }
 
+/*
+ * dir_getdents
+ *   DESCRIPTION: Starting at the dentry indexed by the file_position, fills
+ *                buf with as many dirent_t records as fit in nbytes and
+ *                advances the file_position past them.
+ *        INPUTS: fd - file descriptor index of directory file
+ *                nbytes - size of buf in bytes
+ *       OUTPUTS: buf - buffer in which to place the records
+ *  RETURN VALUE: Number of bytes placed in the buffer, 0 at the end of the
+ *                directory, or FAILURE if buf cannot hold a single record.
+ *  SIDE EFFECTS: File position is updated
+ */
+int32_t dir_getdents(int32_t fd, void* buf, int32_t nbytes)
+{
+    /* Check for valid parameters */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || buf == NULL || nbytes < 0)
+        return FAILURE;
+
+    file_t* fd_array = get_current_pcb()->fd_table;
+    uint32_t dentry_num = fd_array[fd].file_position;
+    uint32_t max_records = (uint32_t)nbytes / sizeof(dirent_t);
+    dirent_t* records = (dirent_t*)buf;
+    uint32_t dir_count = __dir_count();
+    dentry_t dentry;
+    uint32_t i;
+
+    /* Check for end of dentry list */
+    if (dentry_num >= dir_count)
+        return 0;
+
+    if (max_records == 0)
+        return FAILURE;
+
+    for (i = 0; i < max_records && __dentry_at(dentry_num, &dentry) == SUCCESS; ++i, ++dentry_num) {
+        strncpy(records[i].filename, dentry.filename, FILENAME_LEN);
+        records[i].filetype = dentry.filetype;
+        records[i].inode_num = dentry.inode_num;
+        records[i].length = dentry.filetype == FILE_TYPE ? file_length(dentry.inode_num) : 0;
+    }
+
+    fd_array[fd].file_position = dentry_num;
+
+    /* Return number of bytes written */
+    return i * sizeof(dirent_t);
+}
+
+/*
+ * dir_stat
+ *   DESCRIPTION: Gets type, inode number and number of entries of the
+ *                directory.
+ *        INPUTS: fd - file descriptor index of directory file
+ *       OUTPUTS: buf - stat_t to fill in
+ *  RETURN VALUE: SUCCESS or FAILURE for invalid parameters
+ *  SIDE EFFECTS: none
+ */
+int32_t dir_stat(int32_t fd, stat_t* buf)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid parameters */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || buf == NULL)
+        return FAILURE;
+
+    buf->filetype = DIR_TYPE;
+    buf->inode_num = fd_array[fd].inode;
+    buf->length = __dir_count();
+
+    return SUCCESS;
+}
+
+/*
+ * dir_lseek
+ *   DESCRIPTION: Moves the directory's file position, which counts entries
+ *                rather than bytes.
+ *        INPUTS: fd - file descriptor index of directory file
+ *                offset - number of entries from whence
+ *                whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *       OUTPUTS: none
+ *  RETURN VALUE: New file position or FAILURE for invalid parameters or a
+ *                negative resulting position
+ *  SIDE EFFECTS: File position is updated
+ */
+int32_t dir_lseek(int32_t fd, int32_t offset, int32_t whence)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid parameters */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE)
+        return FAILURE;
+
+    return __seek(&fd_array[fd], offset, whence, __dir_count());
+}
+
 /*
  * dir_write
  *   DESCRIPTION: Does nothing.
@@ -202,14 +497,69 @@ int32_t dir_close(int32_t fd)
 
 /*
  * read_dentry_by_name
- *   DESCRIPTION: Searches dentries of the boot block to match given file name.
+ *   DESCRIPTION: Looks up given file name in the hashed dentry index built by
+ *                file_sys_init. Names that recently failed to match skip the
+ *                index through the negative cache. Names missing from the
+ *                boot image are then looked up among the RAM files. If match
+ *                is found the entry is copied to dentry.
+ *        INPUTS: fname - char string to match against dentry names
+ *       OUTPUTS: dentry - matched dentry copied to struct at this pointer
+ *  RETURN VALUE: Success/failure
+ *  SIDE EFFECTS: Boot image misses are recorded in the negative cache
+ */
+int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry)
+{
+    uint32_t name_len = __name_len((int8_t*)fname, FILENAME_LEN + 1);
+
+    /* Check for invalid fnames that are too long */
+    if (name_len > FILENAME_LEN)
+        return FAILURE;
+
+    uint32_t hash = __hash_name((int8_t*)fname, name_len);
+
+    /* Check for a recent miss on the same name */
+    neg_cache_entry_t* neg = &neg_cache[hash & (NEG_CACHE_SIZE - 1)];
+    if (neg->valid && neg->hash == hash &&
+        __name_len(neg->filename, FILENAME_LEN) == name_len &&
+        strncmp((int8_t*)fname, neg->filename, name_len) == 0)
+        return tmpfs_lookup(fname, name_len, dentry);
+
+    if (index_start != 0)
+    {
+        if (__lookup_sorted(fname, name_len, dentry) == SUCCESS)
+            return SUCCESS;
+    }
+    else
+    {
+        dentry_t* entry = __lookup_hashed(fname, name_len, hash);
+        if (entry != NULL)
+        {
+            /* Match found */
+            *dentry = *entry;
+            return SUCCESS;
+        }
+    }
+
+    /* Remember miss, replacing whatever name shared its cache slot */
+    neg->hash = hash;
+    neg->valid = 1;
+    strncpy(neg->filename, (int8_t*)fname, FILENAME_LEN);
+
+    /* Not in the boot image, try the RAM file system */
+    return tmpfs_lookup(fname, name_len, dentry);
+}
+
+/*
+ * read_dentry_by_scan
+ *   DESCRIPTION: Searches dentries of the boot block linearly to match given
+ *                file name. Reference implementation for the hashed lookup.
  *                If match is found the entry is copied to dentry.
  *        INPUTS: fname - char string to match against dentry names
  *       OUTPUTS: dentry - matched dentry copied to struct at this pointer
  *  RETURN VALUE: Success/failure
  *  SIDE EFFECTS: none
  */
-int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry)
+int32_t read_dentry_by_scan(const uint8_t* fname, dentry_t* dentry)
 {
     uint32_t name_len = strlen((int8_t*)fname);
 
@@ -218,19 +568,21 @@ int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry)
         return FAILURE;
 
     int i;
-    for (i = 0; i < boot_blk->dir_count; ++i)
+    dentry_t entry;
+    for (i = 0; i < boot_dir_count; ++i)
     {
-        if (boot_blk->dir_entries[i].inode_num < boot_blk->inode_count)
+        if (__read_dentry(i, &entry) == FAILURE)
+            return FAILURE;
+        if (entry.inode_num < boot_blk->inode_count)
         {
             /* Get length of d_entry filename */
-            uint32_t entry_length = strlen((int8_t*)boot_blk->dir_entries[i].filename);
-            entry_length = entry_length > FILENAME_LEN ? FILENAME_LEN : entry_length;
-            
-            if (strncmp((int8_t*)fname, (int8_t*)(boot_blk->dir_entries[i].filename), name_len) == 0 &&
-                strncmp((int8_t*)fname, (int8_t*)(boot_blk->dir_entries[i].filename), entry_length) == 0)
+            uint32_t entry_length = __name_len(entry.filename, FILENAME_LEN);
+
+            if (strncmp((int8_t*)fname, (int8_t*)(entry.filename), name_len) == 0 &&
+                strncmp((int8_t*)fname, (int8_t*)(entry.filename), entry_length) == 0)
             {
                 /* Match found */
-                *dentry = boot_blk->dir_entries[i];
+                *dentry = entry;
                 return SUCCESS;
             }
         }
@@ -244,14 +596,18 @@ int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry)
  * read_data
  *   DESCRIPTION: Reads up to length bytes from position offset in the file of
  *                the given inode number. Returns the number of bytes read and
- *                placed in the buffer.
+ *                placed in the buffer. Data is copied one run of consecutive
+ *                data blocks at a time, each run being the part of the run
+ *                within the request.
  *        INPUTS: inode - inode number to corresponding file to read
  *                offset - position in file data at which to start reading
  *                length - number of bytes to read
  *       OUTPUTS: buf - buffer into which read bytes are placed
  *  RETURN VALUE: Number of bytes read and placed in the buffer. An number less
- *                than length indicates that the EOF reached.
- *  SIDE EFFECTS: none
+ *                than length indicates that the EOF reached. FAILURE for an
+ *                invalid inode, a block number outside the image or a disk
+ *                error.
+ *  SIDE EFFECTS: May read from disk
  */
 int32_t read_data(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t length)
 {
@@ -259,50 +615,970 @@ int32_t read_data(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t le
     if (length == 0)
         return 0;
 
+    if (tmpfs_is_inode(inode_idx))
+        return tmpfs_read(inode_idx, offset, buf, length);
+
     /* Check for invalid inode number */
     if (inode_idx >= boot_blk->inode_count)
         return FAILURE;
 
-    inode_t* inode = (inode_t*)((uint32_t)boot_blk + (inode_idx + 1) * BLOCK_SIZE);
-    uint8_t* dnodes_start = (uint8_t*)((uint32_t)boot_blk + (boot_blk->inode_count + 1) * BLOCK_SIZE);
+    bcache_buf_t* inode_buf;
+    inode_t* inode = __get_inode(inode_idx, &inode_buf);
+    if (inode == NULL)
+        return FAILURE;
 
-    /* Check that offset doesn't extend beyond length of file */
+    /* Nothing to read past end of file, otherwise stop at end of file */
     if (offset >= inode->length)
-        return 0;
+        length = 0;
+    else if (length > inode->length - offset)
+        length = inode->length - offset;
 
     /* Get starting place within dnodes based on offset */
-    int dnode_num = offset / BLOCK_SIZE;
-    int pos_in_dnode = offset % BLOCK_SIZE;
+    uint32_t dnode_num = offset / BLOCK_SIZE;
+    uint32_t pos_in_dnode = offset % BLOCK_SIZE;
+
+    uint32_t buf_idx = 0;   /* Tracks number of bytes read to buf */
+    int32_t ret = SUCCESS;
+
+    while (buf_idx < length)
+    {
+        uint32_t run_blocks;
+        int32_t dnode = __resolve_run(inode, inode_idx, dnode_num, &run_blocks);
+        if (dnode == FAILURE)
+        {
+            ret = FAILURE;
+            break;
+        }
+
+        /* Copy rest of this run or rest of request, whichever is shorter */
+        uint32_t run = run_blocks * BLOCK_SIZE - pos_in_dnode;
+        if (run > length - buf_idx)
+            run = length - buf_idx;
+
+        if (__copy_run(dnode, run_blocks, pos_in_dnode, buf + buf_idx, run) == FAILURE)
+        {
+            ret = FAILURE;
+            break;
+        }
+
+        /* Continue at start of the dnode after the run */
+        buf_idx += run;
+        dnode_num += run_blocks;
+        pos_in_dnode = 0;
+    }
+
+    __put_block(inode_buf);
+    return ret == FAILURE ? FAILURE : buf_idx;
+}
+
+/*
+ * file_length
+ *   DESCRIPTION: Gets length in bytes of the file of the given inode number.
+ *        INPUTS: inode_idx - inode number of file
+ *       OUTPUTS: none
+ *  RETURN VALUE: Length of file or FAILURE for invalid inode number or a disk
+ *                error
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t file_length(uint32_t inode_idx)
+{
+    if (tmpfs_is_inode(inode_idx))
+        return tmpfs_length(inode_idx);
+
+    if (inode_idx >= boot_blk->inode_count)
+        return FAILURE;
+
+    bcache_buf_t* buf;
+    inode_t* inode = __get_inode(inode_idx, &buf);
+    if (inode == NULL)
+        return FAILURE;
+
+    int32_t length = inode->length;
+    __put_block(buf);
+    return length;
+}
+
+/*
+ * get_data_block
+ *   DESCRIPTION: Gets address of one data block of a file.
+ *        INPUTS: inode_idx - inode number of file
+ *                block_num - index of block within the file
+ *       OUTPUTS: none
+ *  RETURN VALUE: Address of data block or NULL if inode or block is invalid,
+ *                or if the image is on disk
+ *  SIDE EFFECTS: none
+ */
+uint8_t* get_data_block(uint32_t inode_idx, uint32_t block_num)
+{
+    if (tmpfs_is_inode(inode_idx))
+        return tmpfs_get_block(inode_idx, block_num);
+
+    /* Blocks of an image on disk are only in memory while pinned in the cache */
+    if (on_disk || inode_idx >= boot_blk->inode_count)
+        return NULL;
+
+    bcache_buf_t* buf;
+    uint32_t run_blocks;
+    int32_t dnode = __resolve_run(__get_inode(inode_idx, &buf), inode_idx, block_num, &run_blocks);
+    if (dnode == FAILURE)
+        return NULL;
+
+    return img_base + (data_start + dnode) * BLOCK_SIZE;
+}
+
+/*
+ * __read_data_cursor
+ *   DESCRIPTION: Same as read_data for the file of an open file descriptor,
+ *                but resumes from the cursor left by the previous read so
+ *                sequential reads skip the inode and block lookups until the
+ *                cached run of consecutive data blocks is used up. The
+ *                cursor is rebuilt whenever file_position was moved by
+ *                anything other than a cursor read.
+ *        INPUTS: file - file descriptor entry of a regular file
+ *                length - number of bytes to read
+ *       OUTPUTS: buf - buffer into which read bytes are placed
+ *  RETURN VALUE: Number of bytes read and placed in the buffer or FAILURE.
+ *  SIDE EFFECTS: Updates the cursor of file (not file_position)
+ */
+int32_t __read_data_cursor(file_t* file, uint8_t* buf, uint32_t length)
+{
+    /* If length is 0, do nothing and return 0 */
+    if (length == 0)
+        return 0;
+
+    /* RAM files can change under the cursor, so read them by offset */
+    if (tmpfs_is_inode(file->inode))
+        return read_data(file->inode, file->file_position, buf, length);
+
+    /* Rebuild cursor if never set or position was changed externally */
+    if (!file->cursor_valid || file->cursor_pos != file->file_position)
+    {
+        /* Boot image files never change length */
+        int32_t file_len = file_length(file->inode);
+        if (file_len == FAILURE)
+            return FAILURE;
 
-    /* Get first dnode */
-    int dnode_idx = inode->data_block_num[dnode_num];
-    uint8_t* dnode = (uint8_t*)(dnodes_start + dnode_idx * BLOCK_SIZE);
+        file->cursor_valid = 1;
+        file->file_len = file_len;
+        file->dnode = FAILURE;
+        file->run_len = 0;
+        file->dnode_num = file->file_position / BLOCK_SIZE;
+        file->dnode_pos = file->file_position % BLOCK_SIZE;
+        file->cursor_pos = file->file_position;
+    }
+
+    /* Check that cursor doesn't extend beyond length of file */
+    if (file->cursor_pos >= file->file_len)
+        return 0;
+
+    /* Stop at end of file */
+    if (length > file->file_len - file->cursor_pos)
+        length = file->file_len - file->cursor_pos;
 
-    int buf_idx = 0;    /* Tracks number of bytes read to buf */
+    uint32_t buf_idx = 0;   /* Tracks number of bytes read to buf */
 
-    /* Check for enough bytes read or end of file */
-    while (buf_idx < length && offset + buf_idx < inode->length)
+    while (buf_idx < length)
     {
-        /* Check for end of dnode */
-        if (pos_in_dnode >= BLOCK_SIZE)
+        /* Step past the current run once it is used up */
+        if (file->dnode != FAILURE && file->dnode_pos == file->run_len)
         {
-            /* Get next dnode (not end of file so must be more) */
-            ++dnode_num;
-            dnode_idx = inode->data_block_num[dnode_num];
-            dnode = (uint8_t*)(dnodes_start + dnode_idx * BLOCK_SIZE);
+            file->dnode_num += file->run_len / BLOCK_SIZE;
+            file->dnode_pos = 0;
+            file->dnode = FAILURE;
+        }
+        if (file->dnode == FAILURE)
+        {
+            uint32_t run_blocks;
+            bcache_buf_t* inode_buf;
+            inode_t* inode = __get_inode(file->inode, &inode_buf);
 
-            /* Reset position */
-            pos_in_dnode = 0;
+            if (inode != NULL)
+                file->dnode = __resolve_run(inode, file->inode, file->dnode_num, &run_blocks);
+            __put_block(inode_buf);
+            if (file->dnode == FAILURE)
+            {
+                /* Corrupt block number or disk error, rebuild on the next read */
+                file->cursor_valid = 0;
+                return FAILURE;
+            }
+            file->run_len = run_blocks * BLOCK_SIZE;
         }
 
-        /* Read value into buf */
-        buf[buf_idx] = *(dnode + pos_in_dnode);
+        /* Copy rest of this run or rest of request, whichever is shorter */
+        uint32_t run = file->run_len - file->dnode_pos;
+        if (run > length - buf_idx)
+            run = length - buf_idx;
 
-        /* Prepare for next read */
-        ++buf_idx;
-        ++pos_in_dnode;
+        if (__copy_run(file->dnode, file->run_len / BLOCK_SIZE, file->dnode_pos, buf + buf_idx, run) == FAILURE)
+        {
+            file->cursor_valid = 0;
+            return FAILURE;
+        }
+
+        buf_idx += run;
+        file->dnode_pos += run;
     }
 
+    file->cursor_pos += buf_idx;
     return buf_idx;
 }
 
+/*
+ * __get_block
+ *   DESCRIPTION: Gets a block of the image. Blocks of an image on disk come
+ *                from the buffer cache and stay pinned until __put_block.
+ *        INPUTS: block - block number within the image
+ *                ahead - number of blocks after this one the caller reads
+ *                        next, a read ahead hint for the cache
+ *       OUTPUTS: buf - cache buffer to pass to __put_block, NULL for images
+ *                in memory
+ *  RETURN VALUE: Address of the block or NULL for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+uint8_t* __get_block(uint32_t block, uint32_t ahead, bcache_buf_t** buf)
+{
+    if (!on_disk)
+    {
+        *buf = NULL;
+        return img_base + block * BLOCK_SIZE;
+    }
+
+    *buf = bcache_get(block, ahead);
+    return *buf != NULL ? (*buf)->data : NULL;
+}
+
+/*
+ * __put_block
+ *   DESCRIPTION: Releases a block returned by __get_block
+ *        INPUTS: buf - cache buffer of the block, may be NULL
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void __put_block(bcache_buf_t* buf)
+{
+    if (buf != NULL)
+        bcache_put(buf);
+}
+
+/*
+ * __copy_run
+ *   DESCRIPTION: Copies bytes out of a run of consecutive data blocks. An
+ *                image in memory is copied in one go. On disk each block is
+ *                fetched with the rest of the run as read ahead hint, so a
+ *                miss reads the whole run with one disk command.
+ *        INPUTS: dnode - first data block of the run
+ *                run_blocks - number of blocks in the run
+ *                pos - byte offset within the run to copy from
+ *                length - number of bytes to copy, within the run
+ *       OUTPUTS: buf - buffer into which bytes are placed
+ *  RETURN VALUE: SUCCESS or FAILURE for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t __copy_run(uint32_t dnode, uint32_t run_blocks, uint32_t pos, uint8_t* buf, uint32_t length)
+{
+    bcache_buf_t* cache_buf;
+    uint8_t* block;
+    uint32_t copied = 0;
+
+    if (!on_disk)
+    {
+        memcpy(buf, img_base + (data_start + dnode) * BLOCK_SIZE + pos, length);
+        return SUCCESS;
+    }
+
+    while (copied < length)
+    {
+        uint32_t block_num = pos / BLOCK_SIZE;
+        uint32_t pos_in_block = pos % BLOCK_SIZE;
+        uint32_t chunk = BLOCK_SIZE - pos_in_block;
+        if (chunk > length - copied)
+            chunk = length - copied;
+
+        block = __get_block(data_start + dnode + block_num, run_blocks - block_num - 1, &cache_buf);
+        if (block == NULL)
+            return FAILURE;
+        memcpy(buf + copied, block + pos_in_block, chunk);
+        __put_block(cache_buf);
+
+        copied += chunk;
+        pos += chunk;
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * __get_inode
+ *   DESCRIPTION: Gets an inode block of the image
+ *        INPUTS: inode_idx - inode number, must be less than inode_count
+ *       OUTPUTS: buf - cache buffer to pass to __put_block
+ *  RETURN VALUE: Pointer to inode or NULL for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+inode_t* __get_inode(uint32_t inode_idx, bcache_buf_t** buf)
+{
+    return (inode_t*)__get_block(inode_start + inode_idx, 0, buf);
+}
+
+/*
+ * __read_dentry
+ *   DESCRIPTION: Copies a dentry of the image, from the boot block or from
+ *                the directory blocks that follow it.
+ *        INPUTS: dentry_num - dentry number, must be less than boot_dir_count
+ *       OUTPUTS: dentry - copy of the dentry
+ *  RETURN VALUE: SUCCESS or FAILURE for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t __read_dentry(uint32_t dentry_num, dentry_t* dentry)
+{
+    bcache_buf_t* buf;
+    dentry_t* dir_block;
+
+    if (dentry_num < NUM_DIR_ENTRIES)
+    {
+        *dentry = boot_blk->dir_entries[dentry_num];
+        return SUCCESS;
+    }
+
+    dentry_num -= NUM_DIR_ENTRIES;
+    dir_block = (dentry_t*)__get_block(dir_start + dentry_num / DENTRIES_PER_BLOCK, 0, &buf);
+    if (dir_block == NULL)
+        return FAILURE;
+
+    *dentry = dir_block[dentry_num % DENTRIES_PER_BLOCK];
+    __put_block(buf);
+    return SUCCESS;
+}
+
+/*
+ * __index_entry
+ *   DESCRIPTION: Gets an entry of the sorted name index
+ *        INPUTS: pos - position in the index, must be less than boot_dir_count
+ *       OUTPUTS: none
+ *  RETURN VALUE: Dentry number, or boot_dir_count for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+uint32_t __index_entry(uint32_t pos)
+{
+    bcache_buf_t* buf;
+    uint32_t* index_block = (uint32_t*)__get_block(index_start + pos / INDEX_PER_BLOCK, 0, &buf);
+
+    if (index_block == NULL)
+        return boot_dir_count;
+
+    uint32_t dentry_num = index_block[pos % INDEX_PER_BLOCK];
+    __put_block(buf);
+    return dentry_num;
+}
+
+/*
+ * __mount
+ *   DESCRIPTION: Sets up the image boot_blk points at. Newer images carry
+ *                their own sorted index, legacy images are indexed by name
+ *                here.
+ *        INPUTS: img_blocks - number of blocks in the image
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if the header does not add up
+ *  SIDE EFFECTS: Resets the lookup caches and rebuilds the extent table
+ */
+int32_t __mount(uint32_t img_blocks)
+{
+    if (__read_header(img_blocks) == FAILURE && __read_legacy_header(img_blocks) == FAILURE)
+        return FAILURE;
+
+    __clear_neg_cache();
+    data_start = inode_start + boot_blk->inode_count;
+    __build_extents();
+
+    return SUCCESS;
+}
+
+/*
+ * __init_op_tables
+ *   DESCRIPTION: Initializes the file and directory operations tables
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void __init_op_tables(void)
+{
+    /* Initialize file type file_op_table */
+    file_type_op_table.read = file_read;
+    file_type_op_table.write = file_write;
+    file_type_op_table.open = file_open;
+    file_type_op_table.close = file_close;
+    file_type_op_table.stat = file_stat;
+    file_type_op_table.lseek = file_lseek;
+    file_type_op_table.pread = file_pread;
+
+    /* Initialize dir type file_op_table */
+    dir_type_op_table.read = dir_read;
+    dir_type_op_table.write = dir_write;
+    dir_type_op_table.open = dir_open;
+    dir_type_op_table.close = dir_close;
+    dir_type_op_table.stat = dir_stat;
+    dir_type_op_table.lseek = dir_lseek;
+    dir_type_op_table.pread = NULL;
+}
+
+/*
+ * __read_header
+ *   DESCRIPTION: Checks for a revision FS_REVISION_MULTI_DIR or
+ *                FS_REVISION_INDIRECT header and, if its block layout is
+ *                consistent, locates the directory blocks, name index and
+ *                inodes it describes.
+ *        INPUTS: img_blocks - number of blocks in the image
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE for legacy or inconsistent headers
+ *  SIDE EFFECTS: Sets fs_revision, boot_dir_count, dir_start, index_start and
+ *                inode_start on success
+ */
+int32_t __read_header(uint32_t img_blocks)
+{
+    if (boot_blk->magic != FS_MAGIC || boot_blk->dir_count < 0 ||
+        (boot_blk->revision != FS_REVISION_MULTI_DIR && boot_blk->revision != FS_REVISION_INDIRECT))
+        return FAILURE;
+
+    /* Keeps the region sums below from overflowing */
+    if (boot_blk->dir_start >= img_blocks || boot_blk->index_start >= img_blocks ||
+        __check_counts(boot_blk->inode_start, img_blocks) == FAILURE)
+        return FAILURE;
+
+    uint32_t dir_count = boot_blk->dir_count;
+    uint32_t extra_dentries = dir_count > NUM_DIR_ENTRIES ? dir_count - NUM_DIR_ENTRIES : 0;
+    uint32_t num_dir_blocks = (extra_dentries + DENTRIES_PER_BLOCK - 1) / DENTRIES_PER_BLOCK;
+    uint32_t num_index_blocks = (dir_count + INDEX_PER_BLOCK - 1) / INDEX_PER_BLOCK;
+
+    /* Regions must follow one another in order without overlapping */
+    if (boot_blk->dir_start < 1 || boot_blk->index_start < boot_blk->dir_start + num_dir_blocks ||
+        boot_blk->inode_start < boot_blk->index_start + num_index_blocks)
+        return FAILURE;
+
+    fs_revision = boot_blk->revision;
+    boot_dir_count = dir_count;
+    dir_start = boot_blk->dir_start;
+    index_start = boot_blk->index_start;
+    inode_start = boot_blk->inode_start;
+
+    return SUCCESS;
+}
+
+/*
+ * __read_legacy_header
+ *   DESCRIPTION: Sets up the original layout, where at most NUM_DIR_ENTRIES
+ *                dentries in the boot block are followed by the inodes, and
+ *                indexes the dentries by name.
+ *        INPUTS: img_blocks - number of blocks in the image
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if the inodes and data blocks do not fit
+ *                in the image
+ *  SIDE EFFECTS: Sets fs_revision, boot_dir_count, dir_start, index_start and
+ *                inode_start and rebuilds the dentry index on success
+ */
+int32_t __read_legacy_header(uint32_t img_blocks)
+{
+    if (__check_counts(1, img_blocks) == FAILURE)
+        return FAILURE;
+
+    fs_revision = FS_REVISION_LEGACY;
+    if (boot_blk->dir_count < 0)
+        boot_dir_count = 0;
+    else
+        boot_dir_count = boot_blk->dir_count < NUM_DIR_ENTRIES ? boot_blk->dir_count : NUM_DIR_ENTRIES;
+    dir_start = 0;
+    index_start = 0;
+    inode_start = 1;
+    __build_dentry_index();
+
+    return SUCCESS;
+}
+
+/*
+ * __check_counts
+ *   DESCRIPTION: Checks that the inodes and data blocks counted by the boot
+ *                block fit in the image
+ *        INPUTS: first_inode - block of inode 0
+ *                img_blocks - number of blocks in the image
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t __check_counts(uint32_t first_inode, uint32_t img_blocks)
+{
+    if (boot_blk->inode_count < 0 || boot_blk->data_count < 0 || first_inode == 0 ||
+        first_inode > img_blocks)
+        return FAILURE;
+
+    uint32_t blocks_left = img_blocks - first_inode;
+    if (boot_blk->inode_count > blocks_left || boot_blk->data_count > blocks_left - boot_blk->inode_count)
+        return FAILURE;
+
+    return SUCCESS;
+}
+
+/*
+ * __lookup_hashed
+ *   DESCRIPTION: Finds a name in the in-memory hash index of a legacy image
+ *        INPUTS: fname - name to look for
+ *                name_len - length of fname
+ *                hash - __hash_name of fname
+ *       OUTPUTS: none
+ *  RETURN VALUE: Matching dentry or NULL
+ *  SIDE EFFECTS: none
+ */
+dentry_t* __lookup_hashed(const uint8_t* fname, uint32_t name_len, uint32_t hash)
+{
+    /* Probe index until an empty slot ends the run */
+    uint32_t slot = hash & (DENTRY_HASH_SIZE - 1);
+    while (dentry_index[slot] != DENTRY_HASH_EMPTY)
+    {
+        dentry_t* entry = &boot_blk->dir_entries[(uint32_t)dentry_index[slot]];
+
+        if (dentry_index_hash[slot] == hash &&
+            __name_len(entry->filename, FILENAME_LEN) == name_len &&
+            strncmp((int8_t*)fname, entry->filename, name_len) == 0)
+            return entry;
+
+        slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+    }
+
+    return NULL;
+}
+
+/*
+ * __lookup_sorted
+ *   DESCRIPTION: Binary searches the image's sorted name index
+ *        INPUTS: fname - name to look for
+ *                name_len - length of fname
+ *       OUTPUTS: dentry - matching dentry, clobbered on failure
+ *  RETURN VALUE: SUCCESS or FAILURE if not found. Index entries pointing past
+ *                the dentries or inodes never match
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t __lookup_sorted(const uint8_t* fname, uint32_t name_len, dentry_t* dentry)
+{
+    uint32_t low = 0;
+    uint32_t high = boot_dir_count;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        uint32_t dentry_num = __index_entry(mid);
+        if (dentry_num >= boot_dir_count || __read_dentry(dentry_num, dentry) == FAILURE)
+            return FAILURE;
+
+        int32_t cmp = __name_cmp((int8_t*)fname, name_len, dentry->filename);
+
+        if (cmp == 0)
+            return dentry->inode_num < boot_blk->inode_count ? SUCCESS : FAILURE;
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    return FAILURE;
+}
+
+/*
+ * __name_cmp
+ *   DESCRIPTION: Orders a name against a 0-padded dentry filename the same
+ *                way strncmp orders two padded FILENAME_LEN byte names
+ *        INPUTS: fname - name of name_len chars
+ *                name_len - length of fname, at most FILENAME_LEN
+ *                name - dentry filename
+ *       OUTPUTS: none
+ *  RETURN VALUE: Negative, zero or positive as fname sorts before, equal to
+ *                or after name
+ *  SIDE EFFECTS: none
+ */
+int32_t __name_cmp(const int8_t* fname, uint32_t name_len, const int8_t* name)
+{
+    int32_t cmp = strncmp(fname, name, name_len);
+    if (cmp != 0)
+        return cmp;
+
+    /* fname is a prefix of a longer name */
+    if (name_len < FILENAME_LEN && name[name_len] != '\0')
+        return -1;
+
+    return 0;
+}
+
+/*
+ * __dnode_slot
+ *   DESCRIPTION: Finds the inode or indirect block entry holding the data
+ *                block number of a file block. Revision FS_REVISION_INDIRECT
+ *                inodes keep NUM_DIRECT_DNODES direct entries followed by a
+ *                single indirect and a double indirect block number; older
+ *                revisions only have direct entries.
+ *        INPUTS: inode - inode of file
+ *                dnode_num - index of block within the file
+ *       OUTPUTS: slots_left - number of entries from the returned one to the
+ *                end of its table
+ *                buf - cache buffer of the indirect block holding the entry,
+ *                to pass to __put_block
+ *  RETURN VALUE: Pointer to the entry or NULL if dnode_num is beyond what the
+ *                inode can address, an indirect block number is invalid or
+ *                for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t* __dnode_slot(inode_t* inode, uint32_t dnode_num, uint32_t* slots_left, bcache_buf_t** buf)
+{
+    bcache_buf_t* double_buf;
+    int32_t* table;
+    int32_t block;
+
+    *buf = NULL;
+
+    if (fs_revision < FS_REVISION_INDIRECT)
+    {
+        if (dnode_num >= NUM_DNODE_PER_INODE)
+            return NULL;
+        *slots_left = NUM_DNODE_PER_INODE - dnode_num;
+        return &inode->data_block_num[dnode_num];
+    }
+
+    if (dnode_num < NUM_DIRECT_DNODES)
+    {
+        *slots_left = NUM_DIRECT_DNODES - dnode_num;
+        return &inode->data_block_num[dnode_num];
+    }
+    dnode_num -= NUM_DIRECT_DNODES;
+
+    if (dnode_num < DNODES_PER_BLOCK)
+    {
+        table = __indirect_table(inode->data_block_num[INDIRECT_SLOT], buf);
+    }
+    else
+    {
+        dnode_num -= DNODES_PER_BLOCK;
+        if (dnode_num >= DNODES_PER_BLOCK * DNODES_PER_BLOCK)
+            return NULL;
+
+        /* Double indirect block lists single indirect blocks */
+        table = __indirect_table(inode->data_block_num[DOUBLE_INDIRECT_SLOT], &double_buf);
+        if (table == NULL)
+            return NULL;
+        block = table[dnode_num / DNODES_PER_BLOCK];
+        __put_block(double_buf);
+        table = __indirect_table(block, buf);
+        dnode_num %= DNODES_PER_BLOCK;
+    }
+
+    if (table == NULL)
+        return NULL;
+
+    *slots_left = DNODES_PER_BLOCK - dnode_num;
+    return &table[dnode_num];
+}
+
+/*
+ * __indirect_table
+ *   DESCRIPTION: Gets an indirect block as a table of data block numbers
+ *        INPUTS: block - data block number of the indirect block
+ *       OUTPUTS: buf - cache buffer to pass to __put_block
+ *  RETURN VALUE: Pointer to table or NULL if block is not in the image or for
+ *                a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t* __indirect_table(int32_t block, bcache_buf_t** buf)
+{
+    if (block < 0 || block >= boot_blk->data_count)
+    {
+        *buf = NULL;
+        return NULL;
+    }
+
+    return (int32_t*)__get_block(data_start + block, 0, buf);
+}
+
+/*
+ * __resolve_run
+ *   DESCRIPTION: Gets the data block of a file block along with how many of
+ *                the file's following blocks are stored right after it, so
+ *                they can be copied together. A run never crosses the end of
+ *                an inode or indirect table.
+ *        INPUTS: inode - inode of file
+ *                inode_idx - inode number of file
+ *                dnode_num - index of block within the file
+ *       OUTPUTS: run_blocks - number of consecutive blocks, at least 1
+ *  RETURN VALUE: Data block number or FAILURE if the block is past the end of
+ *                file, its block number is invalid or for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t __resolve_run(inode_t* inode, uint32_t inode_idx, uint32_t dnode_num, uint32_t* run_blocks)
+{
+    uint32_t file_blocks = ((uint32_t)inode->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t slots_left, count;
+    bcache_buf_t* buf;
+    int32_t dnode;
+
+    if (dnode_num >= file_blocks)
+        return FAILURE;
+
+    /* Blocks inside the recorded extent need no table walk */
+    if (inode_idx < MAX_EXTENT_INODES && dnode_num < inode_extents[inode_idx].blocks)
+    {
+        *run_blocks = inode_extents[inode_idx].blocks - dnode_num;
+        return inode_extents[inode_idx].start + dnode_num;
+    }
+
+    int32_t* slot = __dnode_slot(inode, dnode_num, &slots_left, &buf);
+    if (slot == NULL || slot[0] < 0 || slot[0] >= boot_blk->data_count)
+    {
+        __put_block(buf);
+        return FAILURE;
+    }
+
+    /* Extend over entries numbered one after another */
+    if (slots_left > file_blocks - dnode_num)
+        slots_left = file_blocks - dnode_num;
+    for (count = 1; count < slots_left && slot[count] == slot[0] + count &&
+                    slot[count] < boot_blk->data_count; ++count);
+
+    *run_blocks = count;
+    dnode = slot[0];
+    __put_block(buf);
+    return dnode;
+}
+
+/*
+ * __build_extents
+ *   DESCRIPTION: Caches the leading extent that FS_FEATURE_EXTENTS images
+ *                record in each file's dentry, indexed by inode number. An
+ *                extent is only kept once every block of it has been checked
+ *                against the inode, so a bad hint costs a table walk rather
+ *                than wrong data.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Rebuilds inode_extents, may read from disk
+ */
+void __build_extents(void)
+{
+    uint32_t i, b, slots_left;
+
+    memset(inode_extents, 0, sizeof(inode_extents));
+    if (!(boot_blk->features & FS_FEATURE_EXTENTS))
+        return;
+
+    for (i = 0; i < boot_dir_count; ++i)
+    {
+        dentry_t dentry;
+        if (__read_dentry(i, &dentry) == FAILURE)
+            return;
+
+        uint32_t inode_idx = dentry.inode_num;
+        if (dentry.filetype != FILE_TYPE || dentry.extent_blocks == 0 ||
+            inode_idx >= boot_blk->inode_count || inode_idx >= MAX_EXTENT_INODES)
+            continue;
+
+        bcache_buf_t* inode_buf;
+        inode_t* inode = __get_inode(inode_idx, &inode_buf);
+        if (inode == NULL)
+            return;
+
+        uint32_t file_blocks = ((uint32_t)inode->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (dentry.extent_blocks <= file_blocks && dentry.extent_start < boot_blk->data_count &&
+            dentry.extent_blocks <= boot_blk->data_count - dentry.extent_start)
+        {
+            for (b = 0; b < dentry.extent_blocks; ++b)
+            {
+                bcache_buf_t* buf;
+                int32_t* slot = __dnode_slot(inode, b, &slots_left, &buf);
+                int32_t match = slot != NULL && *slot == dentry.extent_start + b;
+                __put_block(buf);
+                if (!match)
+                    break;
+            }
+            if (b == dentry.extent_blocks)
+            {
+                inode_extents[inode_idx].start = dentry.extent_start;
+                inode_extents[inode_idx].blocks = dentry.extent_blocks;
+            }
+        }
+        __put_block(inode_buf);
+    }
+}
+
+/*
+ * __build_dentry_index
+ *   DESCRIPTION: Inserts every valid dentry of the boot block into the open
+ *                addressed (linear probing) name index. Duplicate names keep
+ *                the first dentry, matching the order of a linear scan.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Rebuilds dentry index
+ */
+void __build_dentry_index(void)
+{
+    int i;
+
+    /* Mark all slots empty (DENTRY_HASH_EMPTY is all 1 bits) */
+    memset(dentry_index, DENTRY_HASH_EMPTY, sizeof(dentry_index));
+
+    for (i = 0; i < boot_dir_count; ++i)
+    {
+        dentry_t* entry = &boot_blk->dir_entries[i];
+
+        /* Skip dentries that point past the inodes */
+        if (entry->inode_num >= boot_blk->inode_count)
+            continue;
+
+        uint32_t len = __name_len(entry->filename, FILENAME_LEN);
+        uint32_t hash = __hash_name(entry->filename, len);
+        uint32_t slot = hash & (DENTRY_HASH_SIZE - 1);
+
+        /* Find free slot, stopping early on a duplicate name */
+        while (dentry_index[slot] != DENTRY_HASH_EMPTY)
+        {
+            dentry_t* other = &boot_blk->dir_entries[(uint32_t)dentry_index[slot]];
+            if (dentry_index_hash[slot] == hash &&
+                __name_len(other->filename, FILENAME_LEN) == len &&
+                strncmp(entry->filename, other->filename, len) == 0)
+                break;
+
+            slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+        }
+
+        if (dentry_index[slot] == DENTRY_HASH_EMPTY)
+        {
+            dentry_index[slot] = (int8_t)i;
+            dentry_index_hash[slot] = hash;
+        }
+    }
+}
+
+/*
+ * __clear_neg_cache
+ *   DESCRIPTION: Forgets all remembered lookup misses. Must be called whenever
+ *                a name may have been added to the file system.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Invalidates negative cache
+ */
+void __clear_neg_cache(void)
+{
+    memset(neg_cache, 0, sizeof(neg_cache));
+}
+
+/*
+ * __name_len
+ *   DESCRIPTION: Length of a possibly unterminated name, stopping at max_len.
+ *                Dentry names of exactly FILENAME_LEN chars have no '\0'.
+ *        INPUTS: name - char string
+ *                max_len - maximum number of chars to count
+ *       OUTPUTS: none
+ *  RETURN VALUE: Length of name, at most max_len
+ *  SIDE EFFECTS: none
+ */
+uint32_t __name_len(const int8_t* name, uint32_t max_len)
+{
+    uint32_t len = 0;
+    while (len < max_len && name[len] != '\0')
+        ++len;
+    return len;
+}
+
+/*
+ * __hash_name
+ *   DESCRIPTION: 32-bit FNV-1a hash of the first len chars of name.
+ *        INPUTS: name - char string
+ *                len - number of chars to hash
+ *       OUTPUTS: none
+ *  RETURN VALUE: Hash of name
+ *  SIDE EFFECTS: none
+ */
+uint32_t __hash_name(const int8_t* name, uint32_t len)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    uint32_t i;
+    for (i = 0; i < len; ++i)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * __seek
+ *   DESCRIPTION: Sets a file's position to offset from the start, current
+ *                position or end of a file with the given length.
+ *        INPUTS: file - file descriptor entry to move
+ *                offset - distance from whence
+ *                whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *                length - length of the file in units of its file position
+ *       OUTPUTS: none
+ *  RETURN VALUE: New file position or FAILURE for invalid whence or a negative
+ *                resulting position
+ *  SIDE EFFECTS: File position is updated
+ */
+int32_t __seek(file_t* file, int32_t offset, int32_t whence, int32_t length)
+{
+    int32_t base;
+
+    switch (whence)
+    {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = file->file_position;
+            break;
+        case SEEK_END:
+            base = length;
+            break;
+        default:
+            return FAILURE;
+    }
+
+    /* Reject positions that are negative or do not fit in the return value.
+       A corrupt image can give a negative length */
+    if (base < 0)
+        return FAILURE;
+    if (offset < 0 && (uint32_t)0 - (uint32_t)offset > (uint32_t)base)
+        return FAILURE;
+    if (offset > 0 && (uint32_t)base + (uint32_t)offset > MAX_FILE_POS)
+        return FAILURE;
+
+    file->file_position = base + offset;
+
+    return file->file_position;
+}
+
+/*
+ * __dir_count
+ *   DESCRIPTION: Gets number of entries in the directory, boot image and RAM
+ *                files together.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of directory entries
+ *  SIDE EFFECTS: none
+ */
+uint32_t __dir_count()
+{
+    return boot_dir_count + tmpfs_file_count();
+}
+
+/*
+ * __dentry_at
+ *   DESCRIPTION: Gets directory entry number index. Boot image entries come
+ *                first, followed by RAM files in creation order.
+ *        INPUTS: index - entry number
+ *       OUTPUTS: dentry - copy of the entry
+ *  RETURN VALUE: SUCCESS or FAILURE past the last entry or for a disk error
+ *  SIDE EFFECTS: May read from disk
+ */
+int32_t __dentry_at(uint32_t index, dentry_t* dentry)
+{
+    if (index < boot_dir_count)
+        return __read_dentry(index, dentry);
+
+    return tmpfs_dentry_at(index - boot_dir_count, dentry);
+}
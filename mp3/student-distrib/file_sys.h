@@ -5,16 +5,39 @@
 #include "file.h"
 
 #define FILENAME_LEN        32
-#define DENTRY_RESERVED     24
-#define BOOT_BLOCK_RESERVED 52
+#define DENTRY_RESERVED     16
+#define BOOT_BLOCK_RESERVED 28
 #define NUM_DIR_ENTRIES     63
 #define NUM_DNODE_PER_INODE 1023
+#define NUM_DIRECT_DNODES   (NUM_DNODE_PER_INODE - 2)
+#define INDIRECT_SLOT       NUM_DIRECT_DNODES           /* Block of DNODES_PER_BLOCK block numbers */
+#define DOUBLE_INDIRECT_SLOT (NUM_DIRECT_DNODES + 1)    /* Block of indirect block numbers */
+#define DNODES_PER_BLOCK    (BLOCK_SIZE / sizeof(int32_t))
 #define BLOCK_SIZE          4096
 
+/* Format revisions. Legacy images leave the header fields below zeroed */
+#define FS_MAGIC            0x31395346  /* "FS91" */
+#define FS_REVISION_LEGACY  0
+#define FS_REVISION_MULTI_DIR 2         /* Directory continues past the boot block, sorted name index */
+#define FS_REVISION_INDIRECT 3          /* Revision 2 plus indirect blocks in the last two inode slots */
+#define DENTRIES_PER_BLOCK  (BLOCK_SIZE / sizeof(dentry_t))
+#define INDEX_PER_BLOCK     (BLOCK_SIZE / sizeof(uint32_t))
+
+/* Feature bits, valid in any revision */
+#define FS_FEATURE_EXTENTS  0x1         /* Dentries record the leading extent of their file */
+#define FS_FEATURE_DEDUP    0x2         /* Files may share identical data blocks */
+#define MAX_EXTENT_INODES   512         /* Inodes whose extent is cached */
+
 #define RTC_TYPE            0
 #define DIR_TYPE            1
 #define FILE_TYPE           2
 
+#define DENTRY_HASH_SIZE    128     /* Power of 2, at least twice NUM_DIR_ENTRIES */
+#define DENTRY_HASH_EMPTY   -1      /* Marks an unused slot of the dentry index */
+#define NEG_CACHE_SIZE      16      /* Power of 2, recently missed names */
+#define FNV_OFFSET_BASIS    2166136261U
+#define FNV_PRIME           16777619U
+
 
 file_op_table_t file_type_op_table;
 file_op_table_t dir_type_op_table;
@@ -24,21 +47,56 @@ typedef struct dentry
     char    filename[FILENAME_LEN];
     int32_t filetype;
     int32_t inode_num;
+    uint32_t extent_start;          /* With FS_FEATURE_EXTENTS, file blocks */
+    uint32_t extent_blocks;         /* 0..extent_blocks-1 are data blocks extent_start... */
     int8_t  reserved[DENTRY_RESERVED];
 } dentry_t;
 
+/* Revision FS_REVISION_MULTI_DIR places dir_count dentries in the boot block
+ * followed by blocks dir_start..., then dir_count dentry numbers sorted by
+ * name in blocks index_start..., then the inodes from block inode_start */
 typedef struct boot_block
 {
     int32_t dir_count;
     int32_t inode_count;
     int32_t data_count;
+    uint32_t magic;                 /* FS_MAGIC, or 0 in legacy images */
+    uint32_t revision;
+    uint32_t dir_start;             /* Block holding dentry NUM_DIR_ENTRIES */
+    uint32_t index_start;           /* First block of the sorted name index */
+    uint32_t inode_start;           /* Block of inode 0 */
+    uint32_t features;              /* FS_FEATURE_* bits, 0 in createfs images */
     int8_t  reserved[BOOT_BLOCK_RESERVED];
     dentry_t dir_entries[NUM_DIR_ENTRIES];
 } boot_block_t;
 
-typedef struct inode
+/* Consecutive data blocks starting at the first block of a file */
+typedef struct extent
+{
+    uint32_t start;
+    uint32_t blocks;
+} extent_t;
+
+/* Remembers a name that was not found so repeated misses skip the index */
+typedef struct neg_cache_entry
+{
+    uint32_t hash;
+    uint32_t valid;
+    char     filename[FILENAME_LEN];
+} neg_cache_entry_t;
+
+/* Directory record filled in by dir_getdents */
+typedef struct dirent
 {
+    char    filename[FILENAME_LEN];
+    int32_t filetype;
+    int32_t inode_num;
     int32_t length;
+} dirent_t;
+
+typedef struct inode
+{
+    int32_t length;                     /* Caps files at 2 GiB even with indirect blocks */
     int32_t data_block_num[NUM_DNODE_PER_INODE];
 } inode_t;
 
@@ -48,21 +106,32 @@ extern file_op_table_t stdin_op_table;
 extern file_op_table_t stdout_op_table;
 
 
-void file_sys_init(void* file_sys_img);
+void file_sys_init(void* file_sys_img, uint32_t img_size);
+int32_t file_sys_init_disk(void);
 
 /* File Open/Close/Read/Write functions */
 extern int32_t file_open(const uint8_t* filename);
 extern int32_t file_read(int32_t fd, void* buf, int32_t nbytes);
 extern int32_t file_write(int32_t fd, const void* buf, int32_t nbytes);
 extern int32_t file_close(int32_t fd);
+extern int32_t file_truncate(int32_t fd, int32_t length);
+extern int32_t file_stat(int32_t fd, stat_t* buf);
+extern int32_t file_lseek(int32_t fd, int32_t offset, int32_t whence);
+extern int32_t file_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
 
 /* Directory Open/Close/Read/Write functions */
 extern int32_t dir_open(const uint8_t* filename);
 extern int32_t dir_read(int32_t fd, void* buf, int32_t nbytes);
 extern int32_t dir_write(int32_t fd, const void* buf, int32_t nbytes);
 extern int32_t dir_close(int32_t fd);
+extern int32_t dir_getdents(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t dir_stat(int32_t fd, stat_t* buf);
+extern int32_t dir_lseek(int32_t fd, int32_t offset, int32_t whence);
 
 int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
+int32_t read_dentry_by_scan(const uint8_t* fname, dentry_t* dentry);
 int32_t read_data(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t length);
+int32_t file_length(uint32_t inode_idx);
+uint8_t* get_data_block(uint32_t inode_idx, uint32_t block_num);
 
 #endif
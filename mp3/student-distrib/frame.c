@@ -0,0 +1,642 @@
+/*
+ * File: frame.c
+ *   Physical frame allocator. Large frames are 4 MiB program pages, tracked by
+ *   one bitmap for all of memory. Small frames are 4 KiB pages carved out of
+ *   large frames below PROG_VIRT_ADDR, where the kernel reaches them through
+ *   an identity mapped 4 MB supervisor page.
+ */
+#include "frame.h"
+#include "kstats.h"
+#include "lib.h"
+#include "paging.h"
+
+#define FRAME_MEM_TYPE_RAM  1           /* Memory map type of usable RAM */
+#define FRAME_MMAP_FLAG     6           /* Multiboot flags bit of mmap_addr and mmap_length */
+#define FRAME_MEM_FLAG      0           /* Multiboot flags bit of mem_lower and mem_upper */
+#define FRAME_MODS_FLAG     3           /* Multiboot flags bit of mods_addr and mods_count */
+#define FRAME_LOW_MEM_END   0x100000    /* mem_upper counts from 1 MB */
+#define FRAME_END           0x100000    /* Small frame number of the end of 4 GiB */
+#define FRAME_WORD_BITS     32
+
+#define FRAME_BIT(n)        (1U << ((n) % FRAME_WORD_BITS))
+#define FRAME_WORD(n)       ((n) / FRAME_WORD_BITS)
+
+/* Set bits are large frames that are RAM, free, or identity mapped */
+static uint32_t large_ram[FRAME_LARGE_WORDS];
+static uint32_t large_free[FRAME_LARGE_WORDS];
+static uint32_t large_mapped[FRAME_LARGE_WORDS];
+
+/* Small frames of the large frames below 128 MB, set bits are free */
+static uint32_t small_free[FRAME_DIRECT_LARGE][FRAME_SMALL_WORDS];
+static uint32_t small_count[FRAME_DIRECT_LARGE];
+static uint32_t split_frames;           /* Direct large frames that are split */
+static uint32_t split_avail;            /* Split frames with a free small frame */
+
+/* References to allocated small frames beyond the first, for shared pages */
+static uint16_t small_refs[FRAME_DIRECT_LARGE][FRAMES_PER_LARGE];
+
+static module_t modules[FRAME_MAX_MODULES];
+static uint32_t num_modules;
+static uint32_t failures;
+
+/* Local helpers */
+void __frame_add_range(uint32_t first, uint32_t end);
+void __frame_reserve_range(uint32_t first, uint32_t end);
+void __frame_finish_direct(void);
+int32_t __frame_split(void);
+int32_t __frame_find_run(uint32_t large, uint32_t count);
+void __frame_map(uint32_t large);
+uint32_t __frame_count_bits(uint32_t word);
+int32_t __frame_fill(int8_t* buf, int32_t size);
+
+/*
+ * frame_init
+ *   DESCRIPTION: Builds the free frame bitmaps from the multiboot memory map,
+ *                falling back to mem_upper without one. Memory below the end
+ *                of the kernel page and the boot modules are never handed out.
+ *                Call before paging_init, while the multiboot info is mapped,
+ *                and allocate frames only after frame_map_boot.
+ *        INPUTS: mbi - multiboot info from the boot loader
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Registers the "framestat" kernel stats file
+ */
+void frame_init(multiboot_info_t* mbi)
+{
+    memory_map_t* mmap;
+    module_t* mod;
+    uint32_t i;
+
+    if (mbi->flags & (1 << FRAME_MMAP_FLAG)) {
+        for (mmap = (memory_map_t*)mbi->mmap_addr;
+             (uint32_t)mmap < mbi->mmap_addr + mbi->mmap_length;
+             mmap = (memory_map_t*)((uint32_t)mmap + mmap->size + sizeof(mmap->size)))
+        {
+            uint32_t end = mmap->base_addr_low + mmap->length_low;
+
+            /* Only the first 4 GiB are addressable without PAE */
+            if (mmap->type != FRAME_MEM_TYPE_RAM || mmap->base_addr_high != 0)
+                continue;
+
+            if (mmap->length_high != 0 || end < mmap->base_addr_low)
+                __frame_add_range((mmap->base_addr_low + FRAME_SIZE - 1) >> FRAME_SMALL_BITS, FRAME_END);
+            else
+                __frame_add_range((mmap->base_addr_low + FRAME_SIZE - 1) >> FRAME_SMALL_BITS, end >> FRAME_SMALL_BITS);
+        }
+    }
+    else if (mbi->flags & (1 << FRAME_MEM_FLAG)) {
+        __frame_add_range(FRAME_LOW_MEM_END >> FRAME_SMALL_BITS,
+                          (FRAME_LOW_MEM_END + mbi->mem_upper * 1024) >> FRAME_SMALL_BITS);
+    }
+
+    /* The file system image and any other modules stay where GRUB put them */
+    num_modules = 0;
+    if (mbi->flags & (1 << FRAME_MODS_FLAG)) {
+        mod = (module_t*)mbi->mods_addr;
+        for (i = 0; i < mbi->mods_count; ++i, ++mod) {
+            __frame_reserve_range(mod->mod_start >> FRAME_SMALL_BITS,
+                                  (mod->mod_end + FRAME_SIZE - 1) >> FRAME_SMALL_BITS);
+            if (num_modules < FRAME_MAX_MODULES)
+                modules[num_modules++] = *mod;
+        }
+    }
+
+    __frame_finish_direct();
+    kstats_register("framestat", __frame_fill);
+}
+
+/*
+ * frame_map_boot
+ *   DESCRIPTION: Identity maps every large frame of RAM below 128 MB and the
+ *                boot modules that lie above the kernel page, so both stay
+ *                reachable once paging is on. Mapping all of them up front
+ *                keeps the kernel's PD entries fixed, which lets every process
+ *                PD copy them once. Call right after paging_init.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Adds 4 MB supervisor pages to the page directory
+ */
+void frame_map_boot(void)
+{
+    uint32_t i, large;
+
+    for (large = 0; large < FRAME_DIRECT_LARGE; ++large) {
+        if ((large_ram[0] | split_frames) & FRAME_BIT(large))
+            __frame_map(large);
+    }
+
+    for (i = 0; i < num_modules; ++i) {
+        if (modules[i].mod_end <= KERNEL_LOC_END)
+            continue;
+        for (large = modules[i].mod_start >> FRAME_LARGE_BITS;
+             large <= (modules[i].mod_end - 1) >> FRAME_LARGE_BITS; ++large)
+        {
+            if (large >= KERNEL_LOC_END >> FRAME_LARGE_BITS)
+                __frame_map(large);
+        }
+    }
+}
+
+/*
+ * frame_alloc
+ *   DESCRIPTION: Allocates a 4 KiB frame, splitting the lowest free large
+ *                frame below 128 MB when no split frame has room
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Physical address of the frame, which is also its kernel
+ *                virtual address, or NULL if memory is exhausted
+ *  SIDE EFFECTS: none
+ */
+uint32_t frame_alloc(void)
+{
+    uint32_t large, word, bit;
+    long flags;
+
+    cli_and_save(flags);
+
+    if (split_avail == 0 && __frame_split() == FAILURE) {
+        ++failures;
+        restore_flags(flags);
+        return NULL;
+    }
+
+    /* Lowest frame with room, then its first free frame */
+    large = bsf(split_avail);
+    for (word = 0; small_free[large][word] == 0; ++word)
+        ;
+    bit = bsf(small_free[large][word]);
+
+    small_free[large][word] &= ~(1U << bit);
+    if (--small_count[large] == 0)
+        split_avail &= ~FRAME_BIT(large);
+
+    restore_flags(flags);
+
+    return (large << FRAME_LARGE_BITS) | ((word * FRAME_WORD_BITS + bit) << FRAME_SMALL_BITS);
+}
+
+/*
+ * frame_free
+ *   DESCRIPTION: Drops a reference to a 4 KiB frame and frees it when it was
+ *                the last one. A large frame whose small frames are all free
+ *                again becomes a free large frame.
+ *        INPUTS: frame - address returned by frame_alloc
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Ignores addresses that are not allocated small frames
+ */
+void frame_free(uint32_t frame)
+{
+    uint32_t large = frame >> FRAME_LARGE_BITS;
+    uint32_t small = (frame >> FRAME_SMALL_BITS) % FRAMES_PER_LARGE;
+    long flags;
+
+    if ((frame & (FRAME_SIZE - 1)) != 0 || large >= FRAME_DIRECT_LARGE)
+        return;
+
+    cli_and_save(flags);
+
+    if ((split_frames & FRAME_BIT(large)) && !(small_free[large][FRAME_WORD(small)] & FRAME_BIT(small))) {
+        if (small_refs[large][small] != 0) {
+            --small_refs[large][small];
+            restore_flags(flags);
+            return;
+        }
+
+        small_free[large][FRAME_WORD(small)] |= FRAME_BIT(small);
+        split_avail |= FRAME_BIT(large);
+
+        /* Frames split at boot keep the holes of reserved memory and never merge */
+        if (++small_count[large] == FRAMES_PER_LARGE) {
+            split_frames &= ~FRAME_BIT(large);
+            split_avail &= ~FRAME_BIT(large);
+            large_free[FRAME_WORD(large)] |= FRAME_BIT(large);
+        }
+    }
+
+    restore_flags(flags);
+}
+
+/*
+ * frame_ref
+ *   DESCRIPTION: Adds a reference to an allocated 4 KiB frame, so it takes
+ *                one more frame_free to free it. Used for frames mapped into
+ *                several address spaces.
+ *        INPUTS: frame - address returned by frame_alloc
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if frame is not an allocated small frame
+ *                or has too many references
+ *  SIDE EFFECTS: none
+ */
+int32_t frame_ref(uint32_t frame)
+{
+    uint32_t large = frame >> FRAME_LARGE_BITS;
+    uint32_t small = (frame >> FRAME_SMALL_BITS) % FRAMES_PER_LARGE;
+    int32_t result = FAILURE;
+    long flags;
+
+    if ((frame & (FRAME_SIZE - 1)) != 0 || large >= FRAME_DIRECT_LARGE)
+        return FAILURE;
+
+    cli_and_save(flags);
+
+    if ((split_frames & FRAME_BIT(large)) && !(small_free[large][FRAME_WORD(small)] & FRAME_BIT(small)) &&
+        small_refs[large][small] != FRAME_MAX_REFS - 1) {
+        ++small_refs[large][small];
+        result = SUCCESS;
+    }
+
+    restore_flags(flags);
+    return result;
+}
+
+/*
+ * frame_refcount
+ *   DESCRIPTION: Counts the references to a 4 KiB frame
+ *        INPUTS: frame - physical address of a small frame
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of references, 0 if the frame is free or invalid
+ *  SIDE EFFECTS: none
+ */
+uint32_t frame_refcount(uint32_t frame)
+{
+    uint32_t large = frame >> FRAME_LARGE_BITS;
+    uint32_t small = (frame >> FRAME_SMALL_BITS) % FRAMES_PER_LARGE;
+
+    if (large >= FRAME_DIRECT_LARGE || !(split_frames & FRAME_BIT(large)) ||
+        (small_free[large][FRAME_WORD(small)] & FRAME_BIT(small)))
+        return 0;
+
+    return small_refs[large][small] + 1;
+}
+
+/*
+ * frame_alloc_contig
+ *   DESCRIPTION: Allocates physically contiguous 4 KiB frames inside one
+ *                large frame below 128 MB, for kernel objects over a page
+ *        INPUTS: count - number of frames, at most FRAMES_PER_LARGE
+ *       OUTPUTS: none
+ *  RETURN VALUE: Address of the first frame or NULL if no run is free
+ *  SIDE EFFECTS: none
+ */
+uint32_t frame_alloc_contig(uint32_t count)
+{
+    uint32_t avail, large, i;
+    int32_t first = FAILURE;
+    int32_t split;
+    long flags;
+
+    if (count == 0 || count > FRAMES_PER_LARGE)
+        return NULL;
+    if (count == 1)
+        return frame_alloc();
+
+    cli_and_save(flags);
+
+    /* Split frames first, then a fresh one, whose run starts at frame 0 */
+    for (avail = split_avail; avail != 0 && first == FAILURE; avail &= avail - 1) {
+        large = bsf(avail);
+        if (small_count[large] >= count)
+            first = __frame_find_run(large, count);
+    }
+    if (first == FAILURE) {
+        split = __frame_split();
+        if (split == FAILURE) {
+            ++failures;
+            restore_flags(flags);
+            return NULL;
+        }
+        large = split;
+        first = 0;
+    }
+
+    for (i = first; i < first + count; ++i)
+        small_free[large][FRAME_WORD(i)] &= ~FRAME_BIT(i);
+    small_count[large] -= count;
+    if (small_count[large] == 0)
+        split_avail &= ~FRAME_BIT(large);
+
+    restore_flags(flags);
+
+    return (large << FRAME_LARGE_BITS) | (first << FRAME_SMALL_BITS);
+}
+
+/*
+ * frame_free_contig
+ *   DESCRIPTION: Frees frames allocated by frame_alloc_contig
+ *        INPUTS: frame - address returned by frame_alloc_contig
+ *                count - number of frames it was called with
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void frame_free_contig(uint32_t frame, uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; ++i)
+        frame_free(frame + i * FRAME_SIZE);
+}
+
+/*
+ * frame_alloc_large
+ *   DESCRIPTION: Allocates a 4 MiB frame, taking the highest one so small
+ *                frames keep the memory below 128 MB
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Physical address of the frame or NULL if none is free
+ *  SIDE EFFECTS: The frame is not mapped, map it with map_page
+ */
+uint32_t frame_alloc_large(void)
+{
+    int32_t word;
+    uint32_t bit;
+    long flags;
+
+    cli_and_save(flags);
+
+    for (word = FRAME_LARGE_WORDS - 1; word >= 0; --word) {
+        if (large_free[word] != 0) {
+            bit = bsr(large_free[word]);
+            large_free[word] &= ~(1U << bit);
+            restore_flags(flags);
+            return (word * FRAME_WORD_BITS + bit) << FRAME_LARGE_BITS;
+        }
+    }
+
+    ++failures;
+    restore_flags(flags);
+    return NULL;
+}
+
+/*
+ * frame_free_large
+ *   DESCRIPTION: Frees a 4 MiB frame
+ *        INPUTS: frame - address returned by frame_alloc_large
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Ignores addresses that are not allocated large frames
+ */
+void frame_free_large(uint32_t frame)
+{
+    uint32_t large = frame >> FRAME_LARGE_BITS;
+    long flags;
+
+    if ((frame & (FRAME_LARGE_SIZE - 1)) != 0)
+        return;
+
+    cli_and_save(flags);
+
+    if ((large_ram[FRAME_WORD(large)] & FRAME_BIT(large)) &&
+        !(large_free[FRAME_WORD(large)] & FRAME_BIT(large)) &&
+        !(large < FRAME_DIRECT_LARGE && (split_frames & FRAME_BIT(large))))
+    {
+        large_free[FRAME_WORD(large)] |= FRAME_BIT(large);
+    }
+
+    restore_flags(flags);
+}
+
+/*
+ * frame_get_stats
+ *   DESCRIPTION: Counts the free and total frames
+ *        INPUTS: none
+ *       OUTPUTS: stats - filled with the current counts
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void frame_get_stats(frame_stats_t* stats)
+{
+    uint32_t i;
+    long flags;
+
+    memset(stats, 0, sizeof(*stats));
+
+    cli_and_save(flags);
+
+    for (i = 0; i < FRAME_LARGE_WORDS; ++i) {
+        stats->total_large += __frame_count_bits(large_ram[i]);
+        stats->free_large += __frame_count_bits(large_free[i]);
+    }
+    for (i = 0; i < FRAME_DIRECT_LARGE; ++i) {
+        if (split_frames & FRAME_BIT(i)) {
+            ++stats->split_large;
+            stats->total_small += FRAMES_PER_LARGE;
+            stats->free_small += small_count[i];
+        }
+    }
+    stats->failures = failures;
+
+    restore_flags(flags);
+}
+
+/*
+ * __frame_add_range
+ *   DESCRIPTION: Marks RAM free. Below 128 MB single small frames are marked,
+ *                above it only large frames that lie completely in the range.
+ *        INPUTS: first - first small frame number
+ *                end - small frame number after the range
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Skips everything below the end of the kernel page
+ */
+void __frame_add_range(uint32_t first, uint32_t end)
+{
+    uint32_t direct_end = FRAME_DIRECT_LARGE * FRAMES_PER_LARGE;
+    uint32_t large;
+
+    if (first < KERNEL_LOC_END >> FRAME_SMALL_BITS)
+        first = KERNEL_LOC_END >> FRAME_SMALL_BITS;
+
+    for (; first < end && first < direct_end; ++first)
+        small_free[first / FRAMES_PER_LARGE][FRAME_WORD(first % FRAMES_PER_LARGE)] |= FRAME_BIT(first);
+
+    for (large = (first + FRAMES_PER_LARGE - 1) / FRAMES_PER_LARGE;
+         (large + 1) * FRAMES_PER_LARGE <= end; ++large)
+    {
+        large_ram[FRAME_WORD(large)] |= FRAME_BIT(large);
+        large_free[FRAME_WORD(large)] |= FRAME_BIT(large);
+    }
+}
+
+/*
+ * __frame_reserve_range
+ *   DESCRIPTION: Takes memory that is in use at boot out of the free bitmaps
+ *        INPUTS: first - first small frame number
+ *                end - small frame number after the range
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Large frames above 128 MB are reserved whole
+ */
+void __frame_reserve_range(uint32_t first, uint32_t end)
+{
+    uint32_t direct_end = FRAME_DIRECT_LARGE * FRAMES_PER_LARGE;
+    uint32_t large;
+
+    for (; first < end && first < direct_end; ++first)
+        small_free[first / FRAMES_PER_LARGE][FRAME_WORD(first % FRAMES_PER_LARGE)] &= ~FRAME_BIT(first);
+
+    for (large = first / FRAMES_PER_LARGE; large * FRAMES_PER_LARGE < end; ++large) {
+        large_ram[FRAME_WORD(large)] &= ~FRAME_BIT(large);
+        large_free[FRAME_WORD(large)] &= ~FRAME_BIT(large);
+    }
+}
+
+/*
+ * __frame_finish_direct
+ *   DESCRIPTION: Turns the small frame bitmaps built at boot into frames.
+ *                Completely free large frames below 128 MB become free large
+ *                frames, partly free ones are split right away.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void __frame_finish_direct(void)
+{
+    uint32_t large, word, count;
+
+    split_frames = 0;
+    split_avail = 0;
+
+    for (large = 0; large < FRAME_DIRECT_LARGE; ++large) {
+        count = 0;
+        for (word = 0; word < FRAME_SMALL_WORDS; ++word)
+            count += __frame_count_bits(small_free[large][word]);
+
+        small_count[large] = count;
+        if (count == FRAMES_PER_LARGE) {
+            large_ram[0] |= FRAME_BIT(large);
+            large_free[0] |= FRAME_BIT(large);
+            memset(small_free[large], 0, sizeof(small_free[large]));
+        }
+        else if (count > 0) {
+            split_frames |= FRAME_BIT(large);
+            split_avail |= FRAME_BIT(large);
+        }
+    }
+}
+
+/*
+ * __frame_split
+ *   DESCRIPTION: Splits the lowest free large frame below 128 MB into small
+ *                frames. frame_map_boot already identity mapped it for the
+ *                kernel. Call with interrupts disabled.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Large frame number or FAILURE if none is free
+ *  SIDE EFFECTS: none
+ */
+int32_t __frame_split(void)
+{
+    uint32_t large;
+
+    /* Word 0 covers exactly the FRAME_DIRECT_LARGE frames below 128 MB */
+    if (large_free[0] == 0)
+        return FAILURE;
+
+    large = bsf(large_free[0]);
+    large_free[0] &= ~FRAME_BIT(large);
+    split_frames |= FRAME_BIT(large);
+    split_avail |= FRAME_BIT(large);
+    small_count[large] = FRAMES_PER_LARGE;
+    memset(small_free[large], 0xFF, sizeof(small_free[large]));
+
+    return large;
+}
+
+/*
+ * __frame_find_run
+ *   DESCRIPTION: Finds the first run of free small frames in a split frame.
+ *                Call with interrupts disabled.
+ *        INPUTS: large - split large frame number
+ *                count - length of the run
+ *       OUTPUTS: none
+ *  RETURN VALUE: Small frame index of the run or FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t __frame_find_run(uint32_t large, uint32_t count)
+{
+    uint32_t i, run = 0;
+
+    for (i = 0; i < FRAMES_PER_LARGE; ++i) {
+        /* Whole words in use end the run without testing each bit */
+        if (small_free[large][FRAME_WORD(i)] == 0) {
+            run = 0;
+            i += FRAME_WORD_BITS - 1 - i % FRAME_WORD_BITS;
+        }
+        else if (small_free[large][FRAME_WORD(i)] & FRAME_BIT(i)) {
+            if (++run == count)
+                return i + 1 - count;
+        }
+        else {
+            run = 0;
+        }
+    }
+    return FAILURE;
+}
+
+/*
+ * __frame_map
+ *   DESCRIPTION: Identity maps a large frame as a 4 MB supervisor page once
+ *        INPUTS: large - large frame number
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Flushes TLBs the first time
+ */
+void __frame_map(uint32_t large)
+{
+    uint32_t addr = large << FRAME_LARGE_BITS;
+
+    if (large_mapped[FRAME_WORD(large)] & FRAME_BIT(large))
+        return;
+
+    large_mapped[FRAME_WORD(large)] |= FRAME_BIT(large);
+    map_page(addr, addr, TRUE, FALSE, TRUE);
+}
+
+/*
+ * __frame_count_bits
+ *   DESCRIPTION: Counts the set bits of a word
+ *        INPUTS: word - bitmap word
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of set bits
+ *  SIDE EFFECTS: none
+ */
+uint32_t __frame_count_bits(uint32_t word)
+{
+    uint32_t count = 0;
+
+    /* Clears the lowest set bit each pass */
+    for (; word != 0; word &= word - 1)
+        ++count;
+    return count;
+}
+
+/*
+ * __frame_fill
+ *   DESCRIPTION: Writes the "framestat" kernel stats file
+ *        INPUTS: buf - destination for the text
+ *                size - size of buf
+ *       OUTPUTS: none
+ *  RETURN VALUE: Length of the text
+ *  SIDE EFFECTS: none
+ */
+int32_t __frame_fill(int8_t* buf, int32_t size)
+{
+    frame_stats_t stats;
+    int32_t len = 0;
+
+    frame_get_stats(&stats);
+
+    len = kstats_line(buf, size, len, "large frames", stats.total_large);
+    len = kstats_line(buf, size, len, "free large frames", stats.free_large);
+    len = kstats_line(buf, size, len, "split large frames", stats.split_large);
+    len = kstats_line(buf, size, len, "small frames", stats.total_small);
+    len = kstats_line(buf, size, len, "free small frames", stats.free_small);
+    len = kstats_line(buf, size, len, "free KB", stats.free_large * (FRAME_LARGE_SIZE / 1024) +
+                                                 stats.free_small * (FRAME_SIZE / 1024));
+    len = kstats_line(buf, size, len, "failures", stats.failures);
+    return len;
+}
@@ -0,0 +1,42 @@
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include "types.h"
+#include "multiboot.h"
+
+#define FRAME_SIZE          0x1000      /* Small frames are 4 KiB, one page */
+#define FRAME_LARGE_SIZE    0x400000    /* Large frames are 4 MiB, one program page */
+#define FRAME_SMALL_BITS    12          /* Shift from address to small frame number */
+#define FRAME_LARGE_BITS    22          /* Shift from address to large frame number */
+#define FRAMES_PER_LARGE    1024        /* Small frames in a large frame */
+#define FRAME_LARGE_WORDS   32          /* Bitmap words for the 1024 large frames of 4 GiB */
+#define FRAME_SMALL_WORDS   32          /* Bitmap words for the small frames of a large frame */
+#define FRAME_DIRECT_LARGE  32          /* Large frames below 128 MB that are split into small frames */
+#define FRAME_MAX_MODULES   4           /* Boot modules kept mapped after paging_init */
+#define FRAME_MAX_REFS      0x10000     /* References a small frame can have */
+
+/* Counters reported by the "framestat" kernel stats file */
+typedef struct frame_stats {
+    uint32_t total_large;               /* Large frames of RAM, split or not */
+    uint32_t free_large;
+    uint32_t split_large;               /* Large frames handing out small frames */
+    uint32_t total_small;               /* Small frames in split large frames */
+    uint32_t free_small;
+    uint32_t failures;                  /* Allocations that found no memory */
+} frame_stats_t;
+
+void frame_init(multiboot_info_t* mbi);
+void frame_map_boot(void);
+
+uint32_t frame_alloc(void);
+void frame_free(uint32_t frame);
+int32_t frame_ref(uint32_t frame);
+uint32_t frame_refcount(uint32_t frame);
+uint32_t frame_alloc_contig(uint32_t count);
+void frame_free_contig(uint32_t frame, uint32_t count);
+uint32_t frame_alloc_large(void);
+void frame_free_large(uint32_t frame);
+
+void frame_get_stats(frame_stats_t* stats);
+
+#endif /* FRAME_H_ */
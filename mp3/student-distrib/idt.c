@@ -6,6 +6,7 @@
 #include "system.h"
 #include "scheduler.h"
 #include "pit.h"
+#include "vm.h"
 
 /*
  * set_idt_interrupt_gate
@@ -136,7 +137,25 @@ asm
         jmp     return_from_exc     \n"
 );
 
-/* Exception IDT Stubs (0-19)
+/* Page Fault
+ *  The processor pushes an error code in place of the exc number. Saves all
+ *  regs, pushes the error code and CR2 as parameters to do_page_fault, calls
+ *  do_page_fault, and returns from exception, popping the error code.
+ */
+asm
+(
+    "exc0E:                         \n\
+        pushal                      \n\
+        cld                         \n\
+        pushl   32(%esp)            \n\
+        movl    %cr2, %eax          \n\
+        pushl   %eax                \n\
+        call    do_page_fault       \n\
+        addl    $8, %esp            \n\
+        jmp     return_from_exc     \n"
+);
+
+/* Exception IDT Stubs (0-19, except 14)
  *  Pushes exception number and calls common_exc.
  */
 asm
@@ -183,9 +202,6 @@ asm
     exc0D:                          \n\
         pushl   $13                 \n\
         jmp     common_exc          \n\
-    exc0E:                          \n\
-        pushl   $14                 \n\
-        jmp     common_exc          \n\
     exc0F:                          \n\
         pushl   $15                 \n\
         jmp     common_exc          \n\
@@ -224,6 +240,26 @@ void do_exc(int exc_number) {
     system_halt(HALT_CODE_EXC);
 }
 
+/*
+ * do_page_fault
+ *   DESCRIPTION: Lets the current process' address space fill in the missing
+ *                page, or reports the exception like do_exc. Called by page
+ *                fault assembly.
+ *        INPUTS: addr - faulting address, read from CR2
+ *                error - error code pushed by the processor
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Maps a page or never returns
+ */
+void do_page_fault(uint32_t addr, uint32_t error)
+{
+    if (vm_page_fault(addr, error) == SUCCESS)
+        return;
+
+    printf("Fault at 0x%x, error 0x%x\n", addr, error);
+    do_exc(IDT_EXC_PF);
+}
+
 
 /***** Interrupt Handling *****/
 
@@ -325,7 +361,7 @@ static void (*int_stub_labels[NUM_INTERRUPTS]) = { irq0, irq1, irq2, irq3, irq4,
                   pushed_cs - code segment register, used for scheduling
  *       OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Calls interrupt handlers
+ *  SIDE EFFECTS: Calls interrupt handlers, switches to processes they woke
  */
 void do_irq(int irq_number, uint32_t proc_push_top, uint32_t pushed_cs)
 {
@@ -333,9 +369,11 @@ void do_irq(int irq_number, uint32_t proc_push_top, uint32_t pushed_cs)
     {
         case IRQ_KB:
             keyboard_handler();
+            schedule_preempt(proc_push_top, pushed_cs);
             break;
         case IRQ_RTC:
             rtc_wrapper();
+            schedule_preempt(proc_push_top, pushed_cs);
             break;
         case IRQ_PIT:
             schedule_next(proc_push_top, pushed_cs);
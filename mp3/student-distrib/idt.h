@@ -4,6 +4,7 @@
 #include "x86_desc.h"
 
 #define NUM_EXCEPTIONS  20
+#define IDT_EXC_PF      0x0E
 #define IDT_EXC_19      0x13
 #define NUM_INTERRUPTS  16
 #define IDT_INT_0       0x20
@@ -54,6 +55,7 @@ extern void irqE(void);
 extern void irqF(void);
 
 void do_exc(int exc_number);
+void do_page_fault(uint32_t addr, uint32_t error);
 void do_irq(int irq_number, uint32_t proc_push_top, uint32_t pushed_cs);
 void set_all_idt(idt_desc_t* idt);
 
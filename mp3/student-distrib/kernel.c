@@ -18,6 +18,15 @@
 #include "term.h"
 #include "pit.h"
 #include "scheduler.h"
+#include "kstats.h"
+#include "exec_cache.h"
+#include "tmpfs.h"
+#include "bcache.h"
+#include "device/ata.h"
+#include "frame.h"
+#include "kmalloc.h"
+#include "vm.h"
+#include "pipe.h"
 
 /* Macros. */
 /* Check if the bit BIT in FLAGS is set. */
@@ -56,13 +65,21 @@ void entry(unsigned long magic, unsigned long addr) {
     if (CHECK_FLAG(mbi->flags, 2))
         printf("cmdline = %s\n", (char *)mbi->cmdline);
 
+    /* Kernel stats files are registered by the modules initialized below */
+    kstats_init();
+
+    /* Build the frame allocator while the memory map is still mapped */
+    frame_init(mbi);
+
     if (CHECK_FLAG(mbi->flags, 3)) {
         int mod_count = 0;
         int i;
         module_t* mod = (module_t*)mbi->mods_addr;
 
         /* Initialize File System */
-        file_sys_init((void*)(mod->mod_start));
+        file_sys_init((void*)(mod->mod_start), mod->mod_end - mod->mod_start);
+        exec_cache_init();
+        tmpfs_init();
 
         while (mod_count < mbi->mods_count) {
             printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
@@ -76,6 +93,23 @@ void entry(unsigned long magic, unsigned long addr) {
             mod++;
         }
     }
+    else {
+        /* No image module, look for one on the drives. The boot drive goes last */
+        int drive;
+        int mounted = 0;
+
+        ata_init();
+        for (drive = 1; drive <= ATA_MAX_DRIVES && !mounted; drive++) {
+            if (bcache_init(drive % ATA_MAX_DRIVES) == SUCCESS && file_sys_init_disk() == SUCCESS) {
+                printf("File system mounted from drive %d\n", drive % ATA_MAX_DRIVES);
+                mounted = 1;
+            }
+        }
+        if (!mounted)
+            file_sys_init(NULL, 0);
+        exec_cache_init();
+        tmpfs_init();
+    }
     /* Bits 4 and 5 are mutually exclusive! */
     if (CHECK_FLAG(mbi->flags, 4) && CHECK_FLAG(mbi->flags, 5)) {
         printf("Both bits 4 and 5 are set.\n");
@@ -150,6 +184,9 @@ void entry(unsigned long magic, unsigned long addr) {
 
     /* Initialize paging */
     paging_init();
+    frame_map_boot();
+    kmalloc_init();
+    vm_init();
 
     /* Initialize PCB */
     scheduler_init();
@@ -165,6 +202,7 @@ void entry(unsigned long magic, unsigned long addr) {
     rtc_init();
     keyboard_init();
     term_init();
+    pipe_init();
 
     /* Enable interrupts */
     sti();
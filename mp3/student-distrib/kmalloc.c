@@ -0,0 +1,476 @@
+/*
+ * File: kmalloc.c
+ *   Slab allocator for kernel objects. Each cache hands out objects of one
+ *   size from 4 KiB slab frames. kmalloc rounds requests up to a power of two
+ *   size class, and requests over the largest class get contiguous frames.
+ */
+#include "frame.h"
+#include "kmalloc.h"
+#include "kstats.h"
+#include "lib.h"
+
+#define KMEM_HDR_SIZE       ((sizeof(kmem_slab_t) + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1))
+#define KMEM_MAX_CLASS_SIZE (1 << (KMEM_MIN_CLASS + KMEM_NUM_CLASSES - 1))
+#define KMEM_PREFIX         "kmalloc-"
+#define KMEM_PREFIX_LEN     8
+#define KMEM_STAT_COLUMNS   7
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+static uint32_t num_caches;
+static kmem_cache_t* size_caches[KMEM_NUM_CLASSES];
+
+static uint32_t large_pages;            /* Frames held by large allocations */
+static uint32_t large_allocs;
+static uint32_t large_failures;
+
+/* Local helpers */
+kmem_slab_t* __kmem_new_slab(kmem_cache_t* cache);
+void __kmem_push(kmem_slab_t** list, kmem_slab_t* slab);
+void __kmem_unlink(kmem_slab_t** list, kmem_slab_t* slab);
+void* __kmalloc_large(uint32_t size);
+void __kfree_large(kmem_slab_t* hdr);
+int32_t __kmalloc_fill(int8_t* buf, int32_t size);
+
+/*
+ * kmalloc_init
+ *   DESCRIPTION: Creates the kmalloc size classes and registers the
+ *                "slabstat" kernel stats file. Slab frames are allocated on
+ *                first use, so call any time after kstats_init.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void kmalloc_init(void)
+{
+    int8_t name[KMEM_NAME_LEN + 1];
+    uint32_t i;
+
+    for (i = 0; i < KMEM_NUM_CLASSES; ++i) {
+        strcpy(name, KMEM_PREFIX);
+        itoa(1 << (KMEM_MIN_CLASS + i), name + KMEM_PREFIX_LEN, 10);
+        size_caches[i] = kmem_cache_create(name, 1 << (KMEM_MIN_CLASS + i));
+    }
+
+    kstats_register("slabstat", __kmalloc_fill);
+}
+
+/*
+ * kmem_cache_create
+ *   DESCRIPTION: Creates a cache for objects of one size. Caches are never
+ *                destroyed.
+ *        INPUTS: name - name shown in "slabstat", truncated to KMEM_NAME_LEN
+ *                size - object size in bytes, at most what fits in one slab
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer to the cache or NULL if the size does not fit or
+ *                KMEM_MAX_CACHES caches exist
+ *  SIDE EFFECTS: none
+ */
+kmem_cache_t* kmem_cache_create(const int8_t* name, uint32_t size)
+{
+    kmem_cache_t* cache;
+    long flags;
+
+    /* Free objects hold the free list pointer */
+    if (size < sizeof(void*))
+        size = sizeof(void*);
+    size = (size + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1);
+    if (size > FRAME_SIZE - KMEM_HDR_SIZE)
+        return NULL;
+
+    cli_and_save(flags);
+    if (num_caches == KMEM_MAX_CACHES) {
+        restore_flags(flags);
+        return NULL;
+    }
+    cache = &caches[num_caches++];
+    restore_flags(flags);
+
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy(cache->name, name, KMEM_NAME_LEN);
+    cache->name[KMEM_NAME_LEN] = '\0';
+    cache->obj_size = size;
+    cache->per_slab = (FRAME_SIZE - KMEM_HDR_SIZE) / size;
+    return cache;
+}
+
+/*
+ * kmem_cache_alloc
+ *   DESCRIPTION: Allocates an object, from a partly used slab when there is
+ *                one so slabs fill up before new frames are taken
+ *        INPUTS: cache - cache from kmem_cache_create
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer to the object, not cleared, or NULL if out of memory
+ *  SIDE EFFECTS: May allocate a frame
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache)
+{
+    kmem_slab_t* slab;
+    void* obj;
+    long flags;
+
+    if (cache == NULL)
+        return NULL;
+
+    cli_and_save(flags);
+
+    slab = cache->partial;
+    if (slab == NULL) {
+        slab = cache->empty;
+        if (slab != NULL) {
+            __kmem_unlink(&cache->empty, slab);
+            --cache->num_empty;
+        }
+        else {
+            slab = __kmem_new_slab(cache);
+            if (slab == NULL) {
+                ++cache->failures;
+                restore_flags(flags);
+                return NULL;
+            }
+        }
+        __kmem_push(&cache->partial, slab);
+    }
+
+    obj = slab->free;
+    slab->free = *(void**)obj;
+    ++slab->inuse;
+    ++cache->active;
+    ++cache->allocs;
+
+    if (slab->inuse == cache->per_slab) {
+        __kmem_unlink(&cache->partial, slab);
+        __kmem_push(&cache->full, slab);
+    }
+
+    restore_flags(flags);
+    return obj;
+}
+
+/*
+ * kmem_cache_free
+ *   DESCRIPTION: Frees an object. Keeps up to KMEM_KEEP_EMPTY empty slabs and
+ *                returns the frames of any others.
+ *        INPUTS: cache - cache the object came from
+ *                obj - object from kmem_cache_alloc
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Ignores objects that are not from the cache
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj)
+{
+    kmem_slab_t* slab = (kmem_slab_t*)((uint32_t)obj & ~(FRAME_SIZE - 1));
+    uint32_t offset = (uint32_t)obj - (uint32_t)slab;
+    long flags;
+
+    if (obj == NULL || cache == NULL || slab->cache != cache ||
+        offset < KMEM_HDR_SIZE || (offset - KMEM_HDR_SIZE) % cache->obj_size != 0)
+        return;
+
+    cli_and_save(flags);
+
+    /* Double free into a kept empty slab */
+    if (slab->inuse == 0) {
+        restore_flags(flags);
+        return;
+    }
+
+    if (slab->inuse == cache->per_slab) {
+        __kmem_unlink(&cache->full, slab);
+        __kmem_push(&cache->partial, slab);
+    }
+
+    *(void**)obj = slab->free;
+    slab->free = obj;
+    --slab->inuse;
+    --cache->active;
+    ++cache->frees;
+
+    if (slab->inuse == 0) {
+        __kmem_unlink(&cache->partial, slab);
+        if (cache->num_empty < KMEM_KEEP_EMPTY) {
+            __kmem_push(&cache->empty, slab);
+            ++cache->num_empty;
+        }
+        else {
+            slab->cache = NULL;
+            --cache->num_slabs;
+            frame_free((uint32_t)slab);
+        }
+    }
+
+    restore_flags(flags);
+}
+
+/*
+ * kmem_cache_frag
+ *   DESCRIPTION: Gets the share of a cache's slab memory that holds no live
+ *                object, counting headers, unused tails, and free objects
+ *        INPUTS: cache - cache to measure
+ *       OUTPUTS: none
+ *  RETURN VALUE: Percent from 0 to 100, 0 for a cache without slabs
+ *  SIDE EFFECTS: none
+ */
+uint32_t kmem_cache_frag(kmem_cache_t* cache)
+{
+    uint32_t total = cache->num_slabs * FRAME_SIZE;
+    uint32_t waste = total - cache->active * cache->obj_size;
+
+    if (total == 0)
+        return 0;
+
+    /* Avoid overflowing waste * 100 on large caches */
+    return waste < (uint32_t)-1 / 100 ? waste * 100 / total : waste / (total / 100);
+}
+
+/*
+ * kmalloc
+ *   DESCRIPTION: Allocates kernel memory from the smallest size class that
+ *                fits, or contiguous frames for requests over 2 KiB
+ *        INPUTS: size - bytes needed
+ *       OUTPUTS: none
+ *  RETURN VALUE: 8-byte aligned pointer, not cleared, or NULL if size is 0
+ *                or memory is exhausted
+ *  SIDE EFFECTS: none
+ */
+void* kmalloc(uint32_t size)
+{
+    if (size == 0)
+        return NULL;
+
+    if (size <= KMEM_MAX_CLASS_SIZE) {
+        /* Smallest class 2^n with size <= 2^n */
+        uint32_t class = size <= (1 << KMEM_MIN_CLASS) ? 0 : bsr(size - 1) + 1 - KMEM_MIN_CLASS;
+        return kmem_cache_alloc(size_caches[class]);
+    }
+
+    return __kmalloc_large(size);
+}
+
+/*
+ * kzalloc
+ *   DESCRIPTION: kmalloc that clears the memory
+ *        INPUTS: size - bytes needed
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer to size zero bytes or NULL
+ *  SIDE EFFECTS: none
+ */
+void* kzalloc(uint32_t size)
+{
+    void* ptr = kmalloc(size);
+
+    if (ptr != NULL)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
+/*
+ * kfree
+ *   DESCRIPTION: Frees memory from kmalloc. The slab header at the start of
+ *                the page tells which cache the memory came from.
+ *        INPUTS: ptr - pointer from kmalloc or kzalloc, NULL is ignored
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void kfree(void* ptr)
+{
+    kmem_slab_t* hdr = (kmem_slab_t*)((uint32_t)ptr & ~(FRAME_SIZE - 1));
+
+    if (ptr == NULL)
+        return;
+
+    if (hdr->cache == NULL)
+        __kfree_large(hdr);
+    else
+        kmem_cache_free(hdr->cache, ptr);
+}
+
+/*
+ * kmalloc_large_pages
+ *   DESCRIPTION: Gets the number of frames held by large allocations
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of frames
+ *  SIDE EFFECTS: none
+ */
+uint32_t kmalloc_large_pages(void)
+{
+    return large_pages;
+}
+
+/*
+ * __kmem_new_slab
+ *   DESCRIPTION: Allocates a frame and threads all of its objects onto the
+ *                free list, lowest address first. Call with interrupts
+ *                disabled.
+ *        INPUTS: cache - cache the slab belongs to
+ *       OUTPUTS: none
+ *  RETURN VALUE: New slab, on no list, or NULL if out of frames
+ *  SIDE EFFECTS: none
+ */
+kmem_slab_t* __kmem_new_slab(kmem_cache_t* cache)
+{
+    kmem_slab_t* slab = (kmem_slab_t*)frame_alloc();
+    uint8_t* obj;
+    uint32_t i;
+
+    if (slab == NULL)
+        return NULL;
+
+    slab->cache = cache;
+    slab->num_pages = 1;
+    slab->inuse = 0;
+    slab->prev = NULL;
+    slab->next = NULL;
+
+    obj = (uint8_t*)slab + KMEM_HDR_SIZE;
+    slab->free = obj;
+    for (i = 1; i < cache->per_slab; ++i, obj += cache->obj_size)
+        *(void**)obj = obj + cache->obj_size;
+    *(void**)obj = NULL;
+
+    ++cache->num_slabs;
+    return slab;
+}
+
+/*
+ * __kmem_push
+ *   DESCRIPTION: Adds a slab to the front of a list
+ *        INPUTS: list - head of the list
+ *                slab - slab on no list
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void __kmem_push(kmem_slab_t** list, kmem_slab_t* slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+        (*list)->prev = slab;
+    *list = slab;
+}
+
+/*
+ * __kmem_unlink
+ *   DESCRIPTION: Removes a slab from a list
+ *        INPUTS: list - head of the list the slab is on
+ *                slab - slab to remove
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void __kmem_unlink(kmem_slab_t** list, kmem_slab_t* slab)
+{
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+/*
+ * __kmalloc_large
+ *   DESCRIPTION: Allocates contiguous frames for a request over the largest
+ *                size class. The header takes the start of the first frame.
+ *        INPUTS: size - bytes needed
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer just past the header or NULL
+ *  SIDE EFFECTS: none
+ */
+void* __kmalloc_large(uint32_t size)
+{
+    kmem_slab_t* hdr;
+    uint32_t pages;
+    long flags;
+
+    if (size > FRAMES_PER_LARGE * FRAME_SIZE - KMEM_HDR_SIZE)
+        return NULL;
+    pages = (size + KMEM_HDR_SIZE + FRAME_SIZE - 1) / FRAME_SIZE;
+
+    hdr = (kmem_slab_t*)frame_alloc_contig(pages);
+
+    cli_and_save(flags);
+    if (hdr == NULL) {
+        ++large_failures;
+        restore_flags(flags);
+        return NULL;
+    }
+    large_pages += pages;
+    ++large_allocs;
+    restore_flags(flags);
+
+    hdr->cache = NULL;
+    hdr->num_pages = pages;
+    hdr->free = NULL;
+    hdr->inuse = 1;
+    hdr->prev = NULL;
+    hdr->next = NULL;
+    return (uint8_t*)hdr + KMEM_HDR_SIZE;
+}
+
+/*
+ * __kfree_large
+ *   DESCRIPTION: Frees the frames of a large allocation
+ *        INPUTS: hdr - header of the allocation
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Ignores headers that are already freed
+ */
+void __kfree_large(kmem_slab_t* hdr)
+{
+    uint32_t pages;
+    long flags;
+
+    cli_and_save(flags);
+    if (hdr->inuse != 1 || hdr->num_pages == 0) {
+        restore_flags(flags);
+        return;
+    }
+    pages = hdr->num_pages;
+    hdr->inuse = 0;
+    hdr->num_pages = 0;
+    large_pages -= pages;
+    restore_flags(flags);
+
+    frame_free_contig((uint32_t)hdr, pages);
+}
+
+/*
+ * __kmalloc_fill
+ *   DESCRIPTION: Writes the "slabstat" kernel stats file, one row per cache
+ *        INPUTS: buf - destination for the text
+ *                size - size of buf
+ *       OUTPUTS: none
+ *  RETURN VALUE: Length of the text
+ *  SIDE EFFECTS: none
+ */
+int32_t __kmalloc_fill(int8_t* buf, int32_t size)
+{
+    uint32_t values[KMEM_STAT_COLUMNS];
+    kmem_cache_t* cache;
+    int32_t len = 0;
+    uint32_t i;
+
+    len = kstats_text(buf, size, len, "cache: size per_slab slabs active allocs failures frag%\n");
+    for (i = 0; i < num_caches; ++i) {
+        cache = &caches[i];
+        values[0] = cache->obj_size;
+        values[1] = cache->per_slab;
+        values[2] = cache->num_slabs;
+        values[3] = cache->active;
+        values[4] = cache->allocs;
+        values[5] = cache->failures;
+        values[6] = kmem_cache_frag(cache);
+        len = kstats_row(buf, size, len, cache->name, values, KMEM_STAT_COLUMNS);
+    }
+
+    len = kstats_line(buf, size, len, "large pages", large_pages);
+    len = kstats_line(buf, size, len, "large allocs", large_allocs);
+    len = kstats_line(buf, size, len, "large failures", large_failures);
+    return len;
+}
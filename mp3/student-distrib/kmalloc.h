@@ -0,0 +1,53 @@
+#ifndef KMALLOC_H_
+#define KMALLOC_H_
+
+#include "types.h"
+
+#define KMEM_MAX_CACHES     16          /* Size classes plus named caches */
+#define KMEM_NAME_LEN       15
+#define KMEM_ALIGN          8           /* Objects are 8-byte aligned */
+#define KMEM_MIN_CLASS      4           /* Smallest kmalloc size class is 16 bytes */
+#define KMEM_NUM_CLASSES    8           /* kmalloc size classes 16 B to 2 KiB */
+#define KMEM_KEEP_EMPTY     1           /* Empty slabs a cache keeps before freeing frames */
+
+struct kmem_cache;
+
+/* Header at the start of every slab page and of every large allocation */
+typedef struct kmem_slab {
+    struct kmem_cache* cache;           /* NULL for large allocations */
+    uint32_t num_pages;                 /* Frames of a large allocation */
+    void* free;                         /* Free objects, linked through their first word */
+    uint32_t inuse;
+    struct kmem_slab* prev;
+    struct kmem_slab* next;
+} kmem_slab_t;
+
+/* Objects of one size. Slabs are on exactly one of the three lists */
+typedef struct kmem_cache {
+    int8_t name[KMEM_NAME_LEN + 1];
+    uint32_t obj_size;                  /* Rounded up to KMEM_ALIGN */
+    uint32_t per_slab;
+    kmem_slab_t* partial;               /* Slabs with free and used objects, used first */
+    kmem_slab_t* full;
+    kmem_slab_t* empty;
+    uint32_t num_slabs;
+    uint32_t num_empty;
+    uint32_t active;                    /* Objects in use */
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+} kmem_cache_t;
+
+void kmalloc_init(void);
+
+kmem_cache_t* kmem_cache_create(const int8_t* name, uint32_t size);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+uint32_t kmem_cache_frag(kmem_cache_t* cache);
+
+void* kmalloc(uint32_t size);
+void* kzalloc(uint32_t size);
+void kfree(void* ptr);
+uint32_t kmalloc_large_pages(void);
+
+#endif /* KMALLOC_H_ */
@@ -0,0 +1,241 @@
+#include "kstats.h"
+#include "lib.h"
+#include "pcb.h"
+
+/* Registered stats files */
+static kstats_file_t kstats_files[KSTATS_MAX_FILES];
+static int32_t kstats_count;
+
+/* Text of the stats file being read */
+static int8_t kstats_buf[KSTATS_BUF_SIZE];
+
+/* Local helpers */
+int32_t __kstats_append(int8_t* buf, int32_t size, int32_t len, const int8_t* str);
+
+/*
+ * kstats_init
+ *   DESCRIPTION: Initializes kstats file_op_table and clears registered files.
+ *                Must run before any module registers a stats file.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void kstats_init()
+{
+    kstats_op_table.read = kstats_read;
+    kstats_op_table.write = NULL;
+    kstats_op_table.open = kstats_open;
+    kstats_op_table.close = kstats_close;
+    kstats_op_table.stat = NULL;
+    kstats_op_table.lseek = NULL;
+    kstats_op_table.pread = NULL;
+
+    kstats_count = 0;
+}
+
+/*
+ * kstats_register
+ *   DESCRIPTION: Adds a read-only kernel stats file that can be opened by name.
+ *                Names in the file system image take precedence.
+ *        INPUTS: name - name of the stats file, at most KSTATS_NAME_LEN chars
+ *                fill - function that generates the file's text
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if table is full or name is invalid
+ *  SIDE EFFECTS: none
+ */
+int32_t kstats_register(const int8_t* name, kstats_fill_t fill)
+{
+    if (kstats_count >= KSTATS_MAX_FILES || fill == NULL || strlen(name) > KSTATS_NAME_LEN)
+        return FAILURE;
+
+    strncpy(kstats_files[kstats_count].name, name, KSTATS_NAME_LEN + 1);
+    kstats_files[kstats_count].fill = fill;
+    ++kstats_count;
+
+    return SUCCESS;
+}
+
+/*
+ * kstats_open
+ *   DESCRIPTION: Opens the stats file of the given name by getting the next
+ *                available fd in the current PCB and populating that entry.
+ *        INPUTS: filename - name of a registered stats file
+ *       OUTPUTS: none
+ *  RETURN VALUE: Returns fd index number or FAILURE if no such stats file or
+ *                no open fd.
+ *  SIDE EFFECTS: Marks one fd as in use
+ */
+int32_t kstats_open(const uint8_t* filename)
+{
+    int32_t i;
+    int32_t name_len = strlen((int8_t*)filename);
+
+    for (i = 0; i < kstats_count; ++i)
+    {
+        if (name_len == strlen(kstats_files[i].name) &&
+            strncmp((int8_t*)filename, kstats_files[i].name, name_len) == 0)
+        {
+            int32_t fd = get_new_fd();
+            if (fd == FAILURE)
+                return FAILURE;
+
+            /* Populate file descriptor index, inode holds stats file number */
+            file_t* fd_array = get_current_pcb()->fd_table;
+            fd_array[fd].file_ops = &kstats_op_table;
+            fd_array[fd].inode = i;
+            fd_array[fd].file_position = INIT_FILE_POS;
+            claim_fd(fd);
+            fd_array[fd].cursor_valid = 0;
+
+            return fd;
+        }
+    }
+
+    return FAILURE;
+}
+
+/*
+ * kstats_read
+ *   DESCRIPTION: Regenerates the stats file's text and reads nbytes of it
+ *                from the file position into buf.
+ *        INPUTS: fd - file descriptor index of stats file
+ *                nbytes - number of bytes to read
+ *       OUTPUTS: buf - buffer in which to place read text
+ *  RETURN VALUE: Number of bytes read, 0 at end of text, or FAILURE
+ *  SIDE EFFECTS: File position is updated
+ */
+int32_t kstats_read(int32_t fd, void* buf, int32_t nbytes)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+    long flags;
+
+    /* Check for valid parameters */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || buf == NULL || nbytes < 0)
+        return FAILURE;
+
+    cli_and_save(flags);
+
+    int32_t len = kstats_files[fd_array[fd].inode].fill(kstats_buf, KSTATS_BUF_SIZE);
+    int32_t pos = fd_array[fd].file_position;
+    int32_t bytes_read = 0;
+
+    if (pos < len)
+    {
+        bytes_read = nbytes < len - pos ? nbytes : len - pos;
+        memcpy(buf, kstats_buf + pos, bytes_read);
+        fd_array[fd].file_position += bytes_read;
+    }
+
+    restore_flags(flags);
+
+    return bytes_read;
+}
+
+/*
+ * kstats_close
+ *   DESCRIPTION: Marks given file descriptor as not in use.
+ *        INPUTS: fd - file descriptor index of stats file
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS/FAILURE
+ *  SIDE EFFECTS: Clears file descriptor
+ */
+int32_t kstats_close(int32_t fd)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid fd */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE)
+        return FAILURE;
+
+    /* Mark file descriptor as not in use */
+    fd_array[fd].file_ops = NULL;
+    release_fd(fd);
+    return SUCCESS;
+}
+
+/*
+ * kstats_line
+ *   DESCRIPTION: Appends a "label: value" line to the text in buf, truncating
+ *                if buf is full.
+ *        INPUTS: buf - text being generated
+ *                size - size of buf
+ *                len - current length of text in buf
+ *                label - name of the value
+ *                value - unsigned value to print in decimal
+ *       OUTPUTS: none
+ *  RETURN VALUE: New length of text in buf
+ *  SIDE EFFECTS: none
+ */
+int32_t kstats_line(int8_t* buf, int32_t size, int32_t len, const int8_t* label, uint32_t value)
+{
+    int8_t num_buf[KSTATS_NUM_LEN];
+
+    len = __kstats_append(buf, size, len, label);
+    len = __kstats_append(buf, size, len, ": ");
+    len = __kstats_append(buf, size, len, itoa(value, num_buf, 10));
+    return __kstats_append(buf, size, len, "\n");
+}
+
+/*
+ * kstats_row
+ *   DESCRIPTION: Appends a "label: value value ..." line to the text in buf,
+ *                truncating if buf is full. Used for tables, one row each.
+ *        INPUTS: buf - text being generated
+ *                size - size of buf
+ *                len - current length of text in buf
+ *                label - name of the row
+ *                values - unsigned values to print in decimal
+ *                count - number of values
+ *       OUTPUTS: none
+ *  RETURN VALUE: New length of text in buf
+ *  SIDE EFFECTS: none
+ */
+int32_t kstats_row(int8_t* buf, int32_t size, int32_t len, const int8_t* label, const uint32_t* values, int32_t count)
+{
+    int8_t num_buf[KSTATS_NUM_LEN];
+    int32_t i;
+
+    len = __kstats_append(buf, size, len, label);
+    len = __kstats_append(buf, size, len, ":");
+    for (i = 0; i < count; ++i) {
+        len = __kstats_append(buf, size, len, " ");
+        len = __kstats_append(buf, size, len, itoa(values[i], num_buf, 10));
+    }
+    return __kstats_append(buf, size, len, "\n");
+}
+
+/*
+ * kstats_text
+ *   DESCRIPTION: Appends a string to the text in buf, truncating if full.
+ *                Used for headers of kstats_row tables.
+ *        INPUTS: buf - text being generated
+ *                size - size of buf
+ *                len - current length of text in buf
+ *                str - string to append
+ *       OUTPUTS: none
+ *  RETURN VALUE: New length of text in buf
+ *  SIDE EFFECTS: none
+ */
+int32_t kstats_text(int8_t* buf, int32_t size, int32_t len, const int8_t* str)
+{
+    return __kstats_append(buf, size, len, str);
+}
+
+/*
+ * __kstats_append
+ *   DESCRIPTION: Appends a string to the text in buf, truncating if full.
+ *        INPUTS: buf - text being generated
+ *                size - size of buf
+ *                len - current length of text in buf
+ *                str - string to append
+ *       OUTPUTS: none
+ *  RETURN VALUE: New length of text in buf
+ *  SIDE EFFECTS: none
+ */
+int32_t __kstats_append(int8_t* buf, int32_t size, int32_t len, const int8_t* str)
+{
+    while (*str != '\0' && len < size)
+        buf[len++] = *str++;
+    return len;
+}
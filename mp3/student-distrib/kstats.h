@@ -0,0 +1,35 @@
+#ifndef KSTATS_H_
+#define KSTATS_H_
+
+#include "types.h"
+#include "file.h"
+
+#define KSTATS_MAX_FILES    8           /* Number of kernel stats files that may be registered */
+#define KSTATS_NAME_LEN     32          /* Same as FILENAME_LEN */
+#define KSTATS_BUF_SIZE     2048        /* Max size of generated stats text */
+#define KSTATS_NUM_LEN      12          /* Enough for a 32-bit decimal value */
+
+/* Writes the text of a stats file into buf, returns its length */
+typedef int32_t (*kstats_fill_t)(int8_t* buf, int32_t size);
+
+/* Read-only text file generated by the kernel each time it is read */
+typedef struct kstats_file {
+    int8_t name[KSTATS_NAME_LEN + 1];
+    kstats_fill_t fill;
+} kstats_file_t;
+
+file_op_table_t kstats_op_table;
+
+void kstats_init();
+int32_t kstats_register(const int8_t* name, kstats_fill_t fill);
+
+int32_t kstats_open(const uint8_t* filename);
+int32_t kstats_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t kstats_close(int32_t fd);
+
+/* Helpers for fill functions */
+int32_t kstats_line(int8_t* buf, int32_t size, int32_t len, const int8_t* label, uint32_t value);
+int32_t kstats_row(int8_t* buf, int32_t size, int32_t len, const int8_t* label, const uint32_t* values, int32_t count);
+int32_t kstats_text(int8_t* buf, int32_t size, int32_t len, const int8_t* str);
+
+#endif /* KSTATS_H_ */
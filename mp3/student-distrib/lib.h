@@ -82,6 +82,40 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the low 32 bits of the time-stamp counter. Deltas between two reads
+ * are wrap-safe as long as the measured interval is under 2^32 cycles */
+static inline uint32_t rdtsc(void) {
+    uint32_t val;
+    asm volatile ("rdtsc"
+            : "=a"(val)
+            :
+            : "edx"
+    );
+    return val;
+}
+
+/* Returns the index of the lowest set bit. Undefined when word is 0 */
+static inline uint32_t bsf(uint32_t word) {
+    uint32_t idx;
+    asm ("bsfl %1, %0"
+            : "=r"(idx)
+            : "rm"(word)
+            : "cc"
+    );
+    return idx;
+}
+
+/* Returns the index of the highest set bit. Undefined when word is 0 */
+static inline uint32_t bsr(uint32_t word) {
+    uint32_t idx;
+    asm ("bsrl %1, %0"
+            : "=r"(idx)
+            : "rm"(word)
+            : "cc"
+    );
+    return idx;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -105,7 +139,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
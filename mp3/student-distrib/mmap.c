@@ -0,0 +1,155 @@
+#include "mmap.h"
+#include "file_sys.h"
+#include "frame.h"
+#include "lib.h"
+#include "paging.h"
+#include "pcb.h"
+
+/* Local helpers */
+int32_t __find_free_pages(uint32_t* page_table, uint32_t num_pages);
+
+/*
+ * mmap_file
+ *   DESCRIPTION: Maps every data block of a file read-only into the current
+ *                process' mmap area as consecutive 4 kB pages. Data blocks
+ *                are page aligned within the file system image, so no data
+ *                is copied. Bytes past the end of file in the last page are
+ *                whatever the last data block holds.
+ *        INPUTS: inode_idx - inode number of a regular file
+ *       OUTPUTS: start - virtual address of first byte of the file
+ *  RETURN VALUE: Length of file or FAILURE if file is empty, invalid, or there
+ *                is no free region, address range, or page table frame
+ *  SIDE EFFECTS: Maps pages in current process' mmap page table, allocating
+ *                it in the process' PD on the first call
+ */
+int32_t mmap_file(uint32_t inode_idx, uint8_t** start)
+{
+    pcb_t* pcb = get_current_pcb();
+    int32_t length = file_length(inode_idx);
+    int32_t region, first_page;
+    uint32_t i, num_pages;
+
+    if (length <= 0)
+        return FAILURE;
+    num_pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    /* Find unused region slot */
+    for (region = 0; region < MMAP_MAX_REGIONS; ++region)
+    {
+        if (pcb->mmaps[region].start == 0)
+            break;
+    }
+    if (region == MMAP_MAX_REGIONS)
+        return FAILURE;
+
+    /* Every page must be backed by a valid data block */
+    for (i = 0; i < num_pages; ++i)
+    {
+        if (get_data_block(inode_idx, i) == NULL)
+            return FAILURE;
+    }
+
+    /* First mapping of the process gets a page table, freed with its PD */
+    if (pcb->mmap_table == NULL)
+    {
+        pcb->mmap_table = (uint32_t*)frame_alloc();
+        if (pcb->mmap_table == NULL)
+            return FAILURE;
+        memset(pcb->mmap_table, 0, PAGE_SIZE);
+        map_page_table(MMAP_VIRT_ADDR, pcb->mmap_table, TRUE);
+    }
+
+    /* Find enough consecutive unmapped pages */
+    first_page = __find_free_pages(pcb->mmap_table, num_pages);
+    if (first_page == FAILURE)
+        return FAILURE;
+
+    /* Map each data block read-only and user accessible */
+    uint32_t virt_addr = MMAP_VIRT_ADDR + first_page * PAGE_SIZE;
+    for (i = 0; i < num_pages; ++i)
+    {
+        map_page(virt_addr + i * PAGE_SIZE, (uint32_t)get_data_block(inode_idx, i), FALSE, TRUE, FALSE);
+    }
+
+    pcb->mmaps[region].start = virt_addr;
+    pcb->mmaps[region].num_pages = num_pages;
+
+    *start = (uint8_t*)virt_addr;
+    return length;
+}
+
+/*
+ * mmap_unmap
+ *   DESCRIPTION: Unmaps the mapped file of the current process starting at
+ *                the given address.
+ *        INPUTS: start - address returned by mmap_file
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if no file is mapped at start
+ *  SIDE EFFECTS: Unmaps pages in current process' mmap page table
+ */
+int32_t mmap_unmap(uint32_t start)
+{
+    pcb_t* pcb = get_current_pcb();
+    int32_t region;
+    uint32_t i;
+
+    for (region = 0; region < MMAP_MAX_REGIONS; ++region)
+    {
+        if (start != 0 && pcb->mmaps[region].start == start)
+        {
+            for (i = 0; i < pcb->mmaps[region].num_pages; ++i)
+            {
+                unmap_page(start + i * PAGE_SIZE, FALSE);
+            }
+
+            pcb->mmaps[region].start = 0;
+            pcb->mmaps[region].num_pages = 0;
+            return SUCCESS;
+        }
+    }
+
+    return FAILURE;
+}
+
+/*
+ * mmap_unmap_all
+ *   DESCRIPTION: Forgets all files mapped by a process. The mmap page table
+ *                belongs to the process' PD and is freed along with it.
+ *        INPUTS: pid - process whose mappings are removed
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Clears regions
+ */
+void mmap_unmap_all(int32_t pid)
+{
+    pcb_t* pcb = get_pcb_addr(pid);
+    if (pcb == NULL)
+        return;
+
+    pcb->mmap_table = NULL;
+    memset(pcb->mmaps, 0, sizeof(pcb->mmaps));
+}
+
+/*
+ * __find_free_pages
+ *   DESCRIPTION: First fit search for consecutive unmapped pages.
+ *        INPUTS: page_table - mmap page table to search
+ *                num_pages - number of pages needed
+ *       OUTPUTS: none
+ *  RETURN VALUE: Index of first page of range or FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t __find_free_pages(uint32_t* page_table, uint32_t num_pages)
+{
+    uint32_t i;
+    uint32_t run = 0;
+
+    for (i = 0; i < NUM_PAGE_ENTRIES; ++i)
+    {
+        run = (page_table[i] & PDE_PRESENT) ? 0 : run + 1;
+        if (run == num_pages)
+            return i + 1 - num_pages;
+    }
+
+    return FAILURE;
+}
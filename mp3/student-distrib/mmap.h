@@ -0,0 +1,19 @@
+#ifndef MMAP_H_
+#define MMAP_H_
+
+#include "types.h"
+
+#define MMAP_VIRT_ADDR      0x08400000      /* 132MB, the 4 MB just above the program page */
+#define MMAP_MAX_REGIONS    8               /* Mapped files per process */
+
+/* Range of the mmap area holding one mapped file */
+typedef struct mmap_region {
+    uint32_t start;                         /* Virtual address, 0 if unused */
+    uint32_t num_pages;
+} mmap_region_t;
+
+int32_t mmap_file(uint32_t inode_idx, uint8_t** start);
+int32_t mmap_unmap(uint32_t start);
+void mmap_unmap_all(int32_t pid);
+
+#endif /* MMAP_H_ */
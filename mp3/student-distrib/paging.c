@@ -4,20 +4,24 @@
 #include "lib.h"
 #include "paging.h"
 
-#define SPACE               0x07200720  /* ASCII value of a space */
-
 /* Local Helpers */
 void __flush_tlb();
+uint32_t* __get_page_table(uint32_t pd_num);
 
 /* Define page directory and page table aligned to 4KiB page */
 unsigned int page_directory[NUM_PAGE_ENTRIES] __attribute__((aligned (PAGE_SIZE)));
 unsigned int page_table_0[NUM_PAGE_ENTRIES] __attribute__((aligned (PAGE_SIZE)));
 
+/* PD in CR3, which map_page and friends change. Every PD shares the kernel's
+ * entries below PD_USER, including PT0 */
+static uint32_t* current_pd = page_directory;
+
 /* @sjw2
  * init_paging
  *   DESCRIPTION: Initializes page directory and single page table with video
  *                memory (4KiB page) and kernel (4MiB page). Sets appropriate
- *                control registers to enable paging.
+ *                control registers to enable paging with write protection
+ *                in supervisor mode.
  *        INPUTS: none
  *       OUTPUTS: none
  *  RETURN VALUE: none
@@ -47,23 +51,6 @@ void paging_init()
     page_table_0[PT_VIDEO_ENTRY] = (unsigned int)VIDEO_KERNEL & FLAG_MASK;                       /* Mask out flag bits of pointer */
     page_table_0[PT_VIDEO_ENTRY] |= PDE_READ_WRITE | PDE_PRESENT;                                /* Set appropriate flag bits */
 
-    /* Map video save pages */
-    map_page(VIDEO_GROUP_1, VIDEO_GROUP_1, TRUE, FALSE, FALSE);
-    map_page(VIDEO_GROUP_2, VIDEO_GROUP_2, TRUE, FALSE, FALSE);
-    map_page(VIDEO_GROUP_3, VIDEO_GROUP_3, TRUE, FALSE, FALSE);
-
-    /* Clear video save pages */
-    int* vid_group1_ptr = (void*)VIDEO_GROUP_1;
-    int* vid_group2_ptr = (void*)VIDEO_GROUP_2;
-    int* vid_group3_ptr = (void*)VIDEO_GROUP_3;
-
-    int i;
-    for (i = 0; i*sizeof(int) < PAGE_SIZE; i++){
-        vid_group1_ptr[i] = SPACE;
-        vid_group2_ptr[i] = SPACE;
-        vid_group3_ptr[i] = SPACE;
-    }
-
     /* Set upper 20 bits of CR3 to point to PD (PDBR) */
     unsigned int page_directory_base = (unsigned int)page_directory;
     asm volatile(
@@ -73,10 +60,11 @@ void paging_init()
         : "cc", "memory"
     );
 
-    /* Enable paging; set PG, CR0 bit 31 */
+    /* Enable paging; set PG, CR0 bit 31. Set WP, bit 16, so the kernel
+     * cannot write to read-only user pages shared between processes */
     asm volatile(
         "movl   %%cr0, %%eax            \n\
-         orl    $0x80000001, %%eax      \n\
+         orl    $0x80010001, %%eax      \n\
          movl   %%eax, %%cr0            \n"
         :
         :
@@ -84,14 +72,66 @@ void paging_init()
     );
 }
 
+/*
+ * set_page_directory
+ *   DESCRIPTION: Loads a page directory into CR3 and makes it the one changed
+ *                by map_page, unmap_page, and map_page_table.
+ *        INPUTS: page_dir - PD from init_page_directory, or NULL for the
+ *                kernel's PD
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Modifies CR3, which flushes TLBs
+ */
+void set_page_directory(uint32_t* page_dir)
+{
+    current_pd = (page_dir != NULL) ? page_dir : (uint32_t*)page_directory;
+
+    asm volatile(
+        "movl   %%eax, %%cr3"
+        :
+        : "a" (current_pd)
+        : "cc", "memory"
+    );
+}
+
+/*
+ * get_page_directory
+ *   DESCRIPTION: Gets the page directory loaded in CR3.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Active PD
+ *  SIDE EFFECTS: none
+ */
+uint32_t* get_page_directory(void)
+{
+    return current_pd;
+}
+
+/*
+ * init_page_directory
+ *   DESCRIPTION: Copies the kernel's PD entries below PD_USER (video PT, the
+ *                kernel page, and the identity mapped frames) into a new page
+ *                directory and clears the entries private to the process. The
+ *                kernel entries must not change once processes have a PD.
+ *        INPUTS: page_dir - 4 kB aligned frame for the PD
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void init_page_directory(uint32_t* page_dir)
+{
+    memcpy(page_dir, page_directory, PD_USER * sizeof(uint32_t));
+    memset(page_dir + PD_USER, 0, (NUM_PAGE_ENTRIES - PD_USER) * sizeof(uint32_t));
+}
+
 /*
  * map_page
  *   DESCRIPTION: Marks a page as present corresponding to the given virtual
  *                address and maps it to the given physical address with given
- *                flags. 4 KB pages will always be mapped within 0-4 MB of
- *                physical memory.
+ *                flags. 4 KB pages are placed in the page table of the PD
+ *                entry covering virtual_loc, and are ignored if there is none.
  *        INPUTS: virtual_loc - virtual address. Will be truncated to 4 MB
- *                aligned. For 4 kB pages, will be masked with 0x003FF000.
+ *                aligned. For 4 kB pages, will be masked with 0xFFFFF000.
  *                phys_loc - physical address. Will be truncated to 4 MB
  *                aligned. For 4 kB pages, will be masked with 0x003FF000.
  *                read_write - set flag for page read/write permissions
@@ -99,7 +139,7 @@ void paging_init()
  *                page_size - set for 4 MB page, unset for 4 KB page
  *       OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Maps page in PD or 0-4 MB PT. Flushes TLBs.
+ *  SIDE EFFECTS: Maps page in active PD or one of its PTs. Flushes TLBs.
  */
 void map_page(uint32_t virtual_loc, uint32_t phys_loc, uint8_t read_write, uint8_t user, uint8_t page_size)
 {
@@ -118,9 +158,11 @@ void map_page(uint32_t virtual_loc, uint32_t phys_loc, uint8_t read_write, uint8
 
     /* Set entry in appropriate table */
     if (page_size) {                    /* Set: 4 MB page */
-        page_directory[pd_num] = entry;
+        current_pd[pd_num] = entry;
     } else {                            /* Clear: 4 KB page */
-        page_table_0[pt_num] = entry;
+        uint32_t* page_table = __get_page_table(pd_num);
+        if (page_table != NULL)
+            page_table[pt_num] = entry;
     }
 
     __flush_tlb();
@@ -133,21 +175,99 @@ void map_page(uint32_t virtual_loc, uint32_t phys_loc, uint8_t read_write, uint8
  *                page_size - set to unmap a 4MB page, unset to unmap 4kB page
  *       OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Unmaps page in PD. Flushes TLBs.
+ *  SIDE EFFECTS: Unmaps page in active PD. Flushes TLBs.
  */
 void unmap_page(uint32_t virtual_loc, uint8_t page_size) {
     uint32_t pd_num = (virtual_loc & FLAG_MASK) >> BITS_TO_PD_IDX;
     uint32_t pt_num = ((virtual_loc & FLAG_MASK) >> BITS_TO_PT_IDX) & PT_MASK;
 
     if (page_size) {                    /* Clear 4 MB page */
-        page_directory[pd_num] = 0; 
+        current_pd[pd_num] = 0;
     } else {                            /* Clear 4kB page */
-        page_table_0[pt_num] = 0;
+        uint32_t* page_table = __get_page_table(pd_num);
+        if (page_table != NULL)
+            page_table[pt_num] = 0;
     }
 
     __flush_tlb();
 }
 
+/*
+ * map_page_table
+ *   DESCRIPTION: Points the PD entry covering virtual_loc at the given page
+ *                table so its 4 kB pages become visible. Used to swap in
+ *                per-process page tables.
+ *        INPUTS: virtual_loc - virtual address. Will be truncated to 4 MB
+ *                aligned.
+ *                page_table - 4 kB aligned page table, kernel address equals
+ *                physical address
+ *                user - set flag for user access
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Sets entry in active PD. Flushes TLBs.
+ */
+void map_page_table(uint32_t virtual_loc, uint32_t* page_table, uint8_t user)
+{
+    uint32_t pd_num = (virtual_loc & FLAG_MASK) >> BITS_TO_PD_IDX;
+
+    /* Pages within the table carry their own read/write permission */
+    current_pd[pd_num] = ((uint32_t)page_table & FLAG_MASK) | PDE_READ_WRITE | PDE_PRESENT;
+    current_pd[pd_num] |= (user) ? PDE_USER_SUPERVISOR : 0;
+
+    __flush_tlb();
+}
+
+/*
+ * flush_tlb
+ *   DESCRIPTION: Flushes TLBs for callers that edit page tables directly.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Flushes TLBs
+ */
+void flush_tlb(void)
+{
+    __flush_tlb();
+}
+
+/*
+ * flush_tlb_page
+ *   DESCRIPTION: Flushes the TLB entry of one page, cheaper than flush_tlb
+ *                when a single PTE changes.
+ *        INPUTS: virtual_loc - address within the page
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Flushes one TLB entry
+ */
+void flush_tlb_page(uint32_t virtual_loc)
+{
+    asm volatile(
+        "invlpg (%0)"
+        :
+        : "r" (virtual_loc)
+        : "memory"
+    );
+}
+
+/*
+ * __get_page_table
+ *   DESCRIPTION: Gets page table referenced by an entry of the active PD.
+ *        INPUTS: pd_num - index into PD
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer to page table or NULL if PD entry is not present or
+ *                maps a 4 MB page
+ *  SIDE EFFECTS: none
+ */
+uint32_t* __get_page_table(uint32_t pd_num)
+{
+    uint32_t pde = current_pd[pd_num];
+
+    if (!(pde & PDE_PRESENT) || (pde & PDE_PAGE_SIZE))
+        return NULL;
+
+    return (uint32_t*)(pde & FLAG_MASK);
+}
+
 /*
  * __flush_tlb
  *   DESCRIPTION: Flushes TLBs by rewriting CR3.
@@ -7,17 +7,18 @@
 #define PD_VIDEO_ENTRY      0           /* Index of video memory in the PD */
 #define PT_VIDEO_ENTRY      184         /* Index of video memory in PT0 */
 #define PD_KERNEL           1           /* Index of kernel in the PD */
+#define PD_USER             32          /* First PD entry private to a process (PROG_VIRT_ADDR) */
 
 #define PDE_PAGE_SIZE       0x80        /* Bit 7 of PDE is page size */
 #define PDE_USER_SUPERVISOR 0x4         /* Bit 2 of PDE is user/supervisor */
 #define PDE_READ_WRITE      0x2         /* Bit 1 of PDE is read/write */
 #define PDE_PRESENT         0x1         /* Bit 0 of PDE is present */
+#define PTE_OWNED           0x200       /* Bit 9 of PTE (free for software) marks frames freed with the PD */
+#define PTE_COW             0x400       /* Bit 10 of PTE (free for software) marks copy-on-write pages */
+#define PTE_SHARED          0x800       /* Bit 11 of PTE (free for software) marks shared memory pages */
 
 #define VIDEO_KERNEL        0xB8000     /* Location of video memory */
 #define VIDEO_USER          0xB9000     /* Virtual address of user's page to video memory */
-#define VIDEO_GROUP_1       0xBA000     /* Address of process group 1's saved video page */
-#define VIDEO_GROUP_2       0xBB000     /* Address of process group 2's saved video page */
-#define VIDEO_GROUP_3       0xBC000     /* Address of process group 3's saved video page */
 #define KERNEL_LOC          0x400000    /* Location of kernel in physical memory */
 #define KERNEL_LOC_END      0x800000    /* First location after end of kernel memory */
 #define PROG_PAGE_SIZE      0x400000    /* Each page in prog mem is 4MB in size */
@@ -33,10 +34,28 @@
 
 void paging_init();
 
+/* Makes a page directory the active one, NULL for the kernel's */
+void set_page_directory(uint32_t* page_dir);
+
+/* Gets the active page directory */
+uint32_t* get_page_directory(void);
+
+/* Fills a new page directory with the kernel's entries below PD_USER */
+void init_page_directory(uint32_t* page_dir);
+
 /* Maps page of virtual mem to physical location provided */
 void map_page(uint32_t virtual_loc, uint32_t phys_loc, uint8_t read_write, uint8_t user, uint8_t page_size);
 
 /* Unmaps page of virtual mem */
 void unmap_page(uint32_t virtual_loc, uint8_t page_size);
 
+/* Points the PD entry covering virtual_loc at a page table */
+void map_page_table(uint32_t virtual_loc, uint32_t* page_table, uint8_t user);
+
+/* Flushes TLBs after page tables are changed directly */
+void flush_tlb(void);
+
+/* Flushes the TLB entry of a single 4 kB page */
+void flush_tlb_page(uint32_t virtual_loc);
+
 #endif
@@ -1,14 +1,29 @@
+#include "frame.h"
+#include "kmalloc.h"
 #include "lib.h"
+#include "mmap.h"
 #include "pcb.h"
 #include "scheduler.h"
+#include "shm.h"
 #include "term.h"
+#include "vm.h"
 #include "x86_desc.h"
 
 #define KERNEL_LOC_END      0x800000
+#define KERNEL_PCB_ADDR     (KERNEL_LOC_END - KSTACK_SIZE)  /* Kernel's PCB and stack stay in the kernel page */
 
 
 /* Local variables */
 static pcb_t* pid_array[MAX_PID];   /* Pointers to MAX_PID PCBs of active processes */
+static pcb_t* current_pcb;          /* Process running on the processor */
+static uint32_t pid_map[PID_MAP_WORDS]; /* Bit set for each PID in use */
+static kmem_cache_t* pcb_cache;
+static pcb_t* exited_pcb;           /* Halted forked process whose stack is not freed yet */
+
+/* Local helpers */
+void __pcb_release_files(pcb_t* pcb);
+void __pcb_orphan_children(pcb_t* pcb);
+void __pcb_free(pcb_t* pcb);
 
 /*
  * pcb_init
@@ -17,7 +32,7 @@ static pcb_t* pid_array[MAX_PID];   /* Pointers to MAX_PID PCBs of active proces
  *        INPUTS: none
  *       OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Initializes pid_array, current_pid, and PID 0's PCB.
+ *  SIDE EFFECTS: Initializes pid_array, the current process, and PID 0's PCB.
  */
 void pcb_init()
 {
@@ -28,20 +43,22 @@ void pcb_init()
     {
         pid_array[i] = NULL;
     }
-
-    /* Set active PIDs to 0 */
-    for (i = 0; i < NUM_OF_PROCESS_GROUPS; ++i)
-    {
-        active_pid[i] = 0;
-    }
+    memset(pid_map, 0, sizeof(pid_map));
+    pcb_cache = kmem_cache_create("pcb", sizeof(pcb_t));
 
     /* Set up PCB for kernel so first child (shell) may be properly spawned */
-    pcb_t* pcb = get_pcb_addr(active_pid[get_current_group()]);
-    pid_array[active_pid[get_current_group()]] = pcb;
+    pcb_t* pcb = (pcb_t*)KERNEL_PCB_ADDR;
+    memset(pcb, 0, sizeof(pcb_t));
+    pid_array[0] = pcb;
+    pid_map[0] |= 1;
+    current_pcb = pcb;
 
     /* Fill in PCB */
-    pcb->pid = active_pid[get_current_group()];
+    pcb->pid = 0;
     pcb->parent_pid = -1;       /* Kernel has no parent */
+    pcb->kstack = KERNEL_PCB_ADDR;
+    pcb->group = 0;
+    pcb->priority = SCHED_PRIO_DEFAULT;
 
     /* Open stdin and stdout */
     term_open((const uint8_t*)"stdin");
@@ -55,40 +72,65 @@ void pcb_init()
 
     /* Clear argument length field */
     pcb->args_len = 0;
+
+    /* The kernel runs until it spawns the first shell */
+    schedule_enqueue(pcb);
 }
 
 /*
  * pcb_setup
- *   DESCRIPTION: Gets next available PID, updates pid_array to associated PCB
- *                location, updates the current PID, fills the new PCB with the
- *                child and parent PIDs, initializes the FD array, and opens
- *                stdin/stdout.
- *        INPUTS: none
+ *   DESCRIPTION: Allocates the PCB, kernel stack, and empty address space of
+ *                a new process of the current process' terminal, updates
+ *                pid_array, fills the new PCB with the child and parent PIDs,
+ *                initializes the FD array, and opens stdin/stdout. The new
+ *                process becomes the current one and takes the parent's place
+ *                on the run queue.
+ *        INPUTS: child_pid - unused PID from get_new_pid
  *       OUTPUTS: none
- *  RETURN VALUE: Pointer to newly setup PCB or NULL if no new PIDs
- *  SIDE EFFECTS: Updates pid_array, current_group, and tss.esp0
+ *  RETURN VALUE: Pointer to newly setup PCB or NULL if no new PIDs or out of
+ *                memory
+ *  SIDE EFFECTS: Updates pid_array, the current process, and the run queue
  */
 pcb_t* pcb_setup(int32_t child_pid)
 {
     int i;
-    int32_t parent_pid;
-    int32_t current_group = get_current_group();
+    pcb_t* parent_pcb = get_current_pcb();
     pcb_t* child_pcb;
+    uint32_t* page_dir;
+    uint32_t kstack;
     
-    if (child_pid == FAILURE)
+    if (child_pid < 0 || child_pid >= MAX_PID || pid_array[child_pid] != NULL)
         return NULL;
 
-    child_pcb = get_pcb_addr(child_pid);            /* Get PCB location */
+    /* Memory of a halted forked process can be reused now */
+    pcb_reap();
+
+    /* Allocate everything before anything changes */
+    page_dir = vm_create();
+    kstack = frame_alloc_contig(KSTACK_SIZE / FRAME_SIZE);
+    child_pcb = kmem_cache_alloc(pcb_cache);
+    if (page_dir == NULL || kstack == NULL || child_pcb == NULL)
+    {
+        vm_destroy(page_dir);
+        frame_free_contig(kstack, KSTACK_SIZE / FRAME_SIZE);
+        kmem_cache_free(pcb_cache, child_pcb);
+        return NULL;
+    }
+
     pid_array[child_pid] = child_pcb;               /* Set PCB location in PID array */
-    parent_pid = active_pid[current_group];         /* Save parent PID */
-    active_pid[current_group] = child_pid;          /* Update current PID */
+    pid_map[child_pid / 32] |= 1U << (child_pid % 32);
+    current_pcb = child_pcb;                        /* Update current process */
 
     /* Clear Memory in PCB prior to filling in */
     memset(child_pcb, 0, sizeof(pcb_t));
 
     /* Fill in PCB */
     child_pcb->pid = child_pid;
-    child_pcb->parent_pid = parent_pid;
+    child_pcb->parent_pid = parent_pcb->pid;
+    child_pcb->page_dir = page_dir;
+    child_pcb->kstack = kstack;
+    child_pcb->group = parent_pcb->group;
+    child_pcb->priority = parent_pcb->priority;
 
     /* Open stdin and stdout */
     term_open((const uint8_t*)"stdin");
@@ -103,43 +145,179 @@ pcb_t* pcb_setup(int32_t child_pid)
     /* Clear argument length field */
     child_pcb->args_len = 0;
 
+    /* The parent waits for the child, which takes its place on the run queue */
+    schedule_dequeue(parent_pcb);
+    schedule_enqueue(child_pcb);
+
     return child_pcb;
 }
 
 /*
  * pcb_teardown
- *   DESCRIPTION: Closes all open FDs including stdin/stdout, clears the
- *                associated pid_array entry, updates the current_pid to that
- *                of the parent process, updates esp0 in the TSS to point to
- *                the parent's kernel stack, and clears the PCB's memory.
+ *   DESCRIPTION: Closes all open FDs including stdin/stdout, unmaps all
+ *                mapped files and shared memory, clears the associated pid_array entry, makes
+ *                the parent process the current one, updates esp0
+ *                in the TSS to point to the parent's kernel stack, switches to
+ *                the parent's address space, and frees the PCB, kernel stack,
+ *                and address space. The parent takes the process' place on
+ *                the run queue. Must not run on the kernel stack being
+ *                freed.
  *        INPUTS: none
  *       OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Updates pid_array, current_pid, and tss.esp0
+ *  SIDE EFFECTS: Updates pid_array, the current process, tss.esp0, and CR3
  */
 void pcb_teardown()
 {
-    int i;
     pcb_t* pcb = get_current_pcb();
-    
-    /* Close all files that are still open */
-    for (i = 0; i < FD_ARRAY_SIZE; ++i)
-    {
-        if (pcb->fd_table[i].flags == IN_USE && pcb->fd_table[i].file_ops->close != NULL)
-        {
-            pcb->fd_table[i].file_ops->close(i);
-        }
-    }
 
-    /* Clear pid array entry and update current pid */
-    pid_array[active_pid[get_current_group()]] = NULL;
-    active_pid[get_current_group()] = pcb->parent_pid;
+    /* Close files, unmap mapped files and shared memory */
+    __pcb_release_files(pcb);
+    __pcb_orphan_children(pcb);
+
+    /* Clear pid array entry and update current process */
+    pid_array[pcb->pid] = NULL;
+    pid_map[pcb->pid / 32] &= ~(1U << (pcb->pid % 32));
+    current_pcb = get_pcb_addr(pcb->parent_pid);
+    schedule_dequeue(pcb);
+    schedule_enqueue(current_pcb);
 
     /* Update esp0 to point to parent's kstack */
-    tss.esp0 = get_kstack_addr(active_pid[get_current_group()]);    
+    tss.esp0 = get_kstack_addr(current_pcb->pid);
 
-    /* Clear PCB */
+    /* Free address space once the parent's is active, stack, and PCB */
+    vm_switch(current_pcb->pid);
+    vm_destroy(pcb->page_dir);
+    frame_free_contig(pcb->kstack, KSTACK_SIZE / FRAME_SIZE);
     memset(pcb, 0, sizeof(pcb_t));
+    kmem_cache_free(pcb_cache, pcb);
+}
+
+/*
+ * pcb_exit
+ *   DESCRIPTION: Halts the current process when it was created by fork. Its
+ *                parent keeps running, so nobody returns to it: the process
+ *                releases its files and becomes a zombie holding its exit
+ *                status until the parent collects it with pcb_wait. Its
+ *                kernel stack and address space are still in use and are
+ *                freed by pcb_reap once another process runs.
+ *        INPUTS: status - exit status for the parent
+ *       OUTPUTS: none
+ *  RETURN VALUE: none, never returns
+ *  SIDE EFFECTS: Wakes the parent, takes the process off the run queue
+ */
+void pcb_exit(int32_t status)
+{
+    pcb_t* pcb = get_current_pcb();
+    pcb_t* parent;
+
+    cli();
+
+    /* Only one process waits to be reaped at a time */
+    pcb_reap();
+
+    __pcb_release_files(pcb);
+    __pcb_orphan_children(pcb);
+
+    pcb->exit_status = status;
+    pcb->zombie = 1;
+    exited_pcb = pcb;
+
+    parent = get_pcb_addr(pcb->parent_pid);
+    if (parent != NULL)
+        wait_queue_wake(&parent->children);
+
+    schedule_exit();
+}
+
+/*
+ * pcb_wait
+ *   DESCRIPTION: Waits for a forked child of the current process to halt
+ *                and frees what is left of it.
+ *        INPUTS: pid - PID returned by fork
+ *       OUTPUTS: none
+ *  RETURN VALUE: Child's exit status or FAILURE if pid is not a forked child
+ *                of the current process
+ *  SIDE EFFECTS: Blocks the current process until the child halts
+ */
+int32_t pcb_wait(int32_t pid)
+{
+    pcb_t* pcb = get_current_pcb();
+    pcb_t* child = get_pcb_addr(pid);
+    int32_t status;
+    long flags;
+
+    if (child == NULL || child == pcb || !child->forked || child->parent_pid != pcb->pid)
+        return FAILURE;
+
+    cli_and_save(flags);
+    while (!child->zombie)
+        wait_queue_sleep(&pcb->children);
+
+    /* The child is off its stack once the parent runs */
+    pcb_reap();
+    status = child->exit_status;
+    __pcb_free(child);
+    restore_flags(flags);
+
+    return status;
+}
+
+/*
+ * pcb_reap
+ *   DESCRIPTION: Frees the kernel stack and address space of the last forked
+ *                process that halted, unless it is still the current
+ *                process. Orphans are freed entirely since no parent will
+ *                wait for them. Called in process context because the
+ *                allocators may not be used from interrupt handlers.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Frees memory
+ */
+void pcb_reap()
+{
+    pcb_t* pcb = exited_pcb;
+    long flags;
+
+    cli_and_save(flags);
+    if (pcb != NULL && pcb != current_pcb)
+    {
+        exited_pcb = NULL;
+        vm_destroy(pcb->page_dir);
+        pcb->page_dir = NULL;
+        frame_free_contig(pcb->kstack, KSTACK_SIZE / FRAME_SIZE);
+        pcb->kstack = NULL;
+
+        if (pcb->parent_pid < 0)
+            __pcb_free(pcb);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * pcb_image_busy
+ *   DESCRIPTION: Checks whether a file is the executable of a live process.
+ *                Its pages are filled from the file on demand, so the file
+ *                must not change while the process runs.
+ *        INPUTS: inode - inode number of file
+ *       OUTPUTS: none
+ *  RETURN VALUE: 1 if a process is executing the file, 0 otherwise
+ *  SIDE EFFECTS: none
+ */
+int32_t pcb_image_busy(uint32_t inode)
+{
+    int32_t pid;
+    pcb_t* pcb;
+
+    for (pid = 0; pid < MAX_PID; ++pid)
+    {
+        pcb = pid_array[pid];
+        if (pcb != NULL && !pcb->zombie && pcb->exec_length != 0 && pcb->exec_inode == inode)
+            return 1;
+    }
+
+    return 0;
 }
 
 /*
@@ -152,13 +330,27 @@ void pcb_teardown()
  */
 pcb_t* get_current_pcb()
 {
-    return pid_array[active_pid[get_current_group()]];
+    return current_pcb;
+}
+
+/*
+ * set_current_pcb
+ *   DESCRIPTION: Makes a process the one running on the processor. Used by
+ *                the scheduler when it switches processes.
+ *        INPUTS: pcb - process being switched to
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Changes the current process and terminal
+ */
+void set_current_pcb(pcb_t* pcb)
+{
+    current_pcb = pcb;
 }
 
 /*
  * get_new_fd
- *   DESCRIPTION: Gets next available file descriptor index from PCB of current
- *                process. (Does not mark returned FD as in use.)
+ *   DESCRIPTION: Gets lowest available file descriptor index from PCB of
+ *                current process. (Does not mark returned FD as in use.)
  *        INPUTS: none
  *       OUTPUTS: none
  *  RETURN VALUE: Next available FD or FAILURE if no available FDs
@@ -166,14 +358,44 @@ pcb_t* get_current_pcb()
  */
 int get_new_fd()
 {
-    int fd;
-    for (fd = 0; fd < FD_ARRAY_SIZE; ++fd)
-    {
-        if (get_current_pcb()->fd_table[fd].flags == NOT_IN_USE)
-            return fd;
-    }
+    uint32_t free_fds = ~get_current_pcb()->fd_map & FD_MAP_MASK;
 
-    return FAILURE;
+    if (free_fds == 0)
+        return FAILURE;
+
+    return bsf(free_fds);
+}
+
+/*
+ * claim_fd
+ *   DESCRIPTION: Marks a file descriptor of the current process as in use
+ *        INPUTS: fd - index from get_new_fd
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Updates flags and the FD bitmap
+ */
+void claim_fd(int32_t fd)
+{
+    pcb_t* pcb = get_current_pcb();
+
+    pcb->fd_table[fd].flags = IN_USE;
+    pcb->fd_map |= 1U << fd;
+}
+
+/*
+ * release_fd
+ *   DESCRIPTION: Marks a file descriptor of the current process as not in use
+ *        INPUTS: fd - valid file descriptor index
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Updates flags and the FD bitmap
+ */
+void release_fd(int32_t fd)
+{
+    pcb_t* pcb = get_current_pcb();
+
+    pcb->fd_table[fd].flags = NOT_IN_USE;
+    pcb->fd_map &= ~(1U << fd);
 }
 
 /*
@@ -182,7 +404,7 @@ int get_new_fd()
  *   DESCRIPTION: Gets pointer to PCB based on given PID.
  *        INPUTS: pid - process ID number
  *       OUTPUTS: none
- *  RETURN VALUE: Pointer to PID's PCB
+ *  RETURN VALUE: Pointer to PID's PCB or NULL if the PID is not in use
  *  SIDE EFFECTS: none
  */
 pcb_t* get_pcb_addr(int32_t pid)
@@ -190,31 +412,32 @@ pcb_t* get_pcb_addr(int32_t pid)
     if (pid < 0 || pid >= MAX_PID)
         return NULL;
 
-    return (pcb_t*)(KERNEL_LOC_END - PCB_BLK_SIZE * (pid + 1));
+    return pid_array[pid];
 }
 
 /*
  * get_kstack_addr
- *   DESCRIPTION: Gets address to base of PID's PCB block from which its kernel
- *                stack grows.
+ *   DESCRIPTION: Gets address to base of PID's kernel stack.
  *        INPUTS: pid - process ID number
  *       OUTPUTS: none
- *  RETURN VALUE: Address of kernel stack base
+ *  RETURN VALUE: Address of kernel stack base or NULL if the PID is not in use
  *  SIDE EFFECTS: none
  */
 uint32_t get_kstack_addr(int32_t pid)
 {
-    if (pid < 0 || pid >= MAX_PID)
+    pcb_t* pcb = get_pcb_addr(pid);
+
+    if (pcb == NULL)
         return NULL;
 
-    /* Kernel stack is a word (4 bytes) from the bottom of the corresponding PCB block in the kernel page */
-    return (uint32_t)(KERNEL_LOC_END - PCB_BLK_SIZE * pid - 4);
+    /* Kernel stack starts a word (4 bytes) from the top of its block */
+    return pcb->kstack + KSTACK_SIZE - 4;
 }
 
 /*
  * get available pid
  * get_new_pid
- *   DESCRIPTION: Gets next available PID in the pid_array.
+ *   DESCRIPTION: Gets lowest available PID. (Does not mark it as in use.)
  *        INPUTS: none
  *       OUTPUTS: none
  *  RETURN VALUE: Next available PID or FAILURE if no available PIDs
@@ -222,12 +445,89 @@ uint32_t get_kstack_addr(int32_t pid)
  */
 int32_t get_new_pid()
 {
-    int32_t pid;
-    for (pid = 0; pid < MAX_PID; ++pid)
+    int32_t word;
+
+    for (word = 0; word < PID_MAP_WORDS; ++word)
     {
-        if (pid_array[pid] == NULL)
-            return pid;
+        if (pid_map[word] != ~0U)
+            return word * 32 + bsf(~pid_map[word]);
     }
     
     return FAILURE;
 }
+
+/*
+ * __pcb_release_files
+ *   DESCRIPTION: Closes all open FDs including stdin/stdout and unmaps all
+ *                mapped files and shared memory of a halting process.
+ *        INPUTS: pcb - current process
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Calls close functions, unmaps pages
+ */
+void __pcb_release_files(pcb_t* pcb)
+{
+    int i;
+
+    /* Close all files that are still open */
+    for (i = 0; i < FD_ARRAY_SIZE; ++i)
+    {
+        if (pcb->fd_table[i].flags == IN_USE && pcb->fd_table[i].file_ops->close != NULL)
+        {
+            pcb->fd_table[i].file_ops->close(i);
+        }
+    }
+
+    /* Unmap all mapped files and shared memory */
+    mmap_unmap_all(pcb->pid);
+    shm_detach_all(pcb->pid);
+}
+
+/*
+ * __pcb_orphan_children
+ *   DESCRIPTION: Frees the zombies among a halting process' forked children
+ *                and detaches the others, which are freed when they halt.
+ *        INPUTS: pcb - halting process
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Frees memory
+ */
+void __pcb_orphan_children(pcb_t* pcb)
+{
+    int32_t pid;
+    pcb_t* child;
+
+    for (pid = 0; pid < MAX_PID; ++pid)
+    {
+        child = pid_array[pid];
+        if (child == NULL || !child->forked || child->parent_pid != pcb->pid)
+            continue;
+
+        if (child->zombie)
+        {
+            pcb_reap();
+            __pcb_free(child);
+        }
+        else
+        {
+            child->parent_pid = -1;
+        }
+    }
+}
+
+/*
+ * __pcb_free
+ *   DESCRIPTION: Frees the PCB and PID of a zombie whose stack and address
+ *                space are already freed.
+ *        INPUTS: pcb - reaped process
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Updates pid_array
+ */
+void __pcb_free(pcb_t* pcb)
+{
+    pid_array[pcb->pid] = NULL;
+    pid_map[pcb->pid / 32] &= ~(1U << (pcb->pid % 32));
+    memset(pcb, 0, sizeof(pcb_t));
+    kmem_cache_free(pcb_cache, pcb);
+}
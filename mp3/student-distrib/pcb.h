@@ -3,15 +3,18 @@
 
 #include "types.h"
 #include "file.h"
+#include "mmap.h"
+#include "shm.h"
+#include "wait_queue.h"
 // #include "term.h"
 
 #define MAX_PROCESS_GROUPS  3               /* Number of process groups */
-#define MAX_PID             7               /* 6 processes plus the kernel (PID 0) */
-#define PCB_BLK_SIZE        0x2000          /* 8 KiB */
+#define MAX_PID             1024            /* Processes plus the kernel (PID 0), a multiple of 32 */
+#define PID_MAP_WORDS       (MAX_PID / 32)
+#define KSTACK_SIZE         0x2000          /* 8 KiB kernel stack per process */
+#define FD_MAP_MASK         ((1U << FD_ARRAY_SIZE) - 1)
 #define TERM_BUFFER_SIZE    128
 
-int32_t active_pid[MAX_PROCESS_GROUPS];  /* PIDs of leaf processes of each process group */
-
 typedef struct process_control_block {
     int32_t pid;
     int32_t parent_pid;
@@ -21,17 +24,50 @@ typedef struct process_control_block {
     uint32_t kernel_esp;                /* Kernel's ESP while process is waiting to be scheduled */
     uint32_t kernel_ebp;                /* Kernel's EBP while process is in waiting to be scheduled */
     uint32_t tss_esp0;                  /* holds tss esp0 */
+    uint32_t* page_dir;                 /* Address space, NULL for the kernel */
+    uint32_t exec_inode;                /* Executable backing the program area */
+    uint32_t exec_length;               /* Length of the executable image, 0 for none */
+    uint32_t kstack;                    /* Lowest address of the kernel stack */
+    uint32_t fd_map;                    /* Bit set for each fd in use */
     file_t fd_table[FD_ARRAY_SIZE];
     uint8_t args[TERM_BUFFER_SIZE];     /* Program arguments */
     uint8_t args_len;
     uint8_t vid_map_called;             /* 0 if user vidmem page is not mapped, 1 if is mapped */
+    mmap_region_t mmaps[MMAP_MAX_REGIONS];  /* Files mapped into the mmap area */
+    uint32_t* mmap_table;               /* Page table of the mmap area, NULL until first mmap */
+    shm_region_t shms[SHM_MAX_ATTACH];  /* Shared memory segments attached */
+    uint8_t blocked;                    /* 1 while sleeping on a wait queue */
+    struct process_control_block* wait_next;    /* Next sleeper on the same wait queue */
+    int32_t group;                      /* Process group (terminal) the process belongs to */
+    uint8_t priority;                   /* Share of the processor, SCHED_PRIO_MIN-SCHED_PRIO_MAX */
+    uint8_t queued;                     /* 1 while on the run queue */
+    uint32_t slice_left;                /* PIT ticks left in the time slice */
+    uint32_t vruntime;                  /* PIT ticks run, weighted down by priority */
+    struct process_control_block* run_next;     /* Next process on the run queue */
+    uint32_t run_ticks;                 /* PIT ticks charged to the process */
+    uint32_t run_switches;              /* Times switched to */
+    uint32_t wakeups;                   /* Times added to the run queue */
+    uint32_t wake_tsc;                  /* TSC when added to the run queue, 0 once running */
+    uint32_t wake_kcycles;              /* Total time from being added to running */
+    uint32_t wake_max_kcycles;          /* Longest time from being added to running */
+    uint8_t forked;                     /* 1 if created by fork, collected by pcb_wait */
+    uint8_t zombie;                     /* 1 once a forked process halted */
+    int32_t exit_status;                /* Halt status kept for pcb_wait */
+    wait_queue_t children;              /* Parent waiting for a forked child to halt */
 } pcb_t;
 
 extern void pcb_init();
 extern pcb_t* pcb_setup();
 extern void pcb_teardown();
+extern void pcb_exit(int32_t status);
+extern int32_t pcb_wait(int32_t pid);
+extern void pcb_reap();
+extern int32_t pcb_image_busy(uint32_t inode);
 extern pcb_t* get_current_pcb();
+extern void set_current_pcb(pcb_t* pcb);
 extern int get_new_fd();
+extern void claim_fd(int32_t fd);
+extern void release_fd(int32_t fd);
 extern pcb_t* get_pcb_addr(int32_t pid);
 extern uint32_t get_kstack_addr(int32_t pid);
 extern int32_t get_new_pid();
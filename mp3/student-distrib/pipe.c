@@ -0,0 +1,311 @@
+/*
+ * File: pipe.c
+ *   Pipes. A pipe is a ring buffer in kernel memory with a read end and a
+ *   write end, each opened as a file descriptor. Readers sleep on a wait
+ *   queue while the buffer is empty and writers while it is full, so the
+ *   scheduler runs other processes instead of spinning. The pipe is freed
+ *   when the last FD of either end is closed; FDs copied by fork count as
+ *   their own.
+ */
+#include "pipe.h"
+#include "frame.h"
+#include "lib.h"
+#include "pcb.h"
+
+static pipe_t pipes[PIPE_MAX];
+
+/* Local helpers */
+int32_t __pipe_open_end(file_op_table_t* ops, int32_t id);
+void __pipe_release(int32_t id);
+
+/*
+ * pipe_init
+ *   DESCRIPTION: Initializes the file_op_tables of both pipe ends.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void pipe_init()
+{
+    pipe_read_op_table.read = pipe_read;
+    pipe_read_op_table.write = NULL;
+    pipe_read_op_table.open = NULL;
+    pipe_read_op_table.close = pipe_close;
+    pipe_read_op_table.stat = NULL;
+    pipe_read_op_table.lseek = NULL;
+    pipe_read_op_table.pread = NULL;
+
+    pipe_write_op_table.read = NULL;
+    pipe_write_op_table.write = pipe_write;
+    pipe_write_op_table.open = NULL;
+    pipe_write_op_table.close = pipe_close;
+    pipe_write_op_table.stat = NULL;
+    pipe_write_op_table.lseek = NULL;
+    pipe_write_op_table.pread = NULL;
+}
+
+/*
+ * pipe_create
+ *   DESCRIPTION: Creates a pipe and opens both of its ends in the current
+ *                process.
+ *        INPUTS: none
+ *       OUTPUTS: fds - fds[0] is the read end, fds[1] the write end, left
+ *                untouched on failure
+ *  RETURN VALUE: SUCCESS or FAILURE if no pipe, memory, or two FDs are free
+ *  SIDE EFFECTS: Allocates the ring buffer and marks two FDs as in use
+ */
+int32_t pipe_create(int32_t* fds)
+{
+    int32_t id;
+    int32_t read_fd, write_fd;
+
+    for (id = 0; id < PIPE_MAX; ++id)
+    {
+        if (pipes[id].buf == NULL)
+            break;
+    }
+    if (id == PIPE_MAX)
+        return FAILURE;
+
+    pipes[id].buf = (uint8_t*)frame_alloc_contig(PIPE_PAGES);
+    if (pipes[id].buf == NULL)
+        return FAILURE;
+    pipes[id].head = 0;
+    pipes[id].tail = 0;
+    pipes[id].readers = 0;
+    pipes[id].writers = 0;
+    wait_queue_init(&pipes[id].readable);
+    wait_queue_init(&pipes[id].writable);
+
+    read_fd = __pipe_open_end(&pipe_read_op_table, id);
+    if (read_fd == FAILURE)
+    {
+        __pipe_release(id);
+        return FAILURE;
+    }
+    write_fd = __pipe_open_end(&pipe_write_op_table, id);
+    if (write_fd == FAILURE)
+    {
+        pipe_close(read_fd);
+        return FAILURE;
+    }
+
+    /* The caller's array is only written once both ends are open */
+    fds[0] = read_fd;
+    fds[1] = write_fd;
+
+    return SUCCESS;
+}
+
+/*
+ * pipe_read
+ *   DESCRIPTION: Reads up to nbytes buffered bytes from a pipe, waiting
+ *                until at least one is written or no write end is open.
+ *        INPUTS: fd - file descriptor index of a read end
+ *                nbytes - most bytes to read
+ *       OUTPUTS: buf - buffer in which to place read bytes
+ *  RETURN VALUE: Number of bytes read, 0 once the pipe is empty and has no
+ *                writers, or FAILURE
+ *  SIDE EFFECTS: Blocks the current process while the pipe is empty
+ */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+    pipe_t* pipe;
+    uint32_t count, pos, first;
+    long flags;
+
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE ||
+        fd_array[fd].file_ops != &pipe_read_op_table || buf == NULL || nbytes < 0)
+        return FAILURE;
+    pipe = &pipes[fd_array[fd].inode];
+
+    cli_and_save(flags);
+    while (pipe->head == pipe->tail && pipe->writers > 0 && nbytes > 0)
+        wait_queue_sleep(&pipe->readable);
+
+    count = pipe->head - pipe->tail;
+    if (count > (uint32_t)nbytes)
+        count = nbytes;
+
+    /* Copy in up to two pieces around the end of the ring */
+    pos = pipe->tail & (PIPE_SIZE - 1);
+    first = (count < PIPE_SIZE - pos) ? count : PIPE_SIZE - pos;
+    memcpy(buf, pipe->buf + pos, first);
+    memcpy((uint8_t*)buf + first, pipe->buf, count - first);
+    pipe->tail += count;
+    wait_queue_wake(&pipe->writable);
+
+    restore_flags(flags);
+
+    return count;
+}
+
+/*
+ * pipe_write
+ *   DESCRIPTION: Writes nbytes to a pipe, waiting for readers to make room
+ *                whenever the buffer is full.
+ *        INPUTS: fd - file descriptor index of a write end
+ *                buf - bytes to write
+ *                nbytes - number of bytes to write
+ *       OUTPUTS: none
+ *  RETURN VALUE: nbytes, the number written before the last read end was
+ *                closed, or FAILURE if no read end is open at all
+ *  SIDE EFFECTS: Blocks the current process while the pipe is full
+ */
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+    pipe_t* pipe;
+    uint32_t written = 0;
+    uint32_t count, pos, first;
+    long flags;
+
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE ||
+        fd_array[fd].file_ops != &pipe_write_op_table || buf == NULL || nbytes < 0)
+        return FAILURE;
+    pipe = &pipes[fd_array[fd].inode];
+
+    cli_and_save(flags);
+    while (written < (uint32_t)nbytes && pipe->readers > 0)
+    {
+        count = PIPE_SIZE - (pipe->head - pipe->tail);
+        if (count == 0)
+        {
+            wait_queue_sleep(&pipe->writable);
+            continue;
+        }
+        if (count > nbytes - written)
+            count = nbytes - written;
+
+        /* Copy in up to two pieces around the end of the ring */
+        pos = pipe->head & (PIPE_SIZE - 1);
+        first = (count < PIPE_SIZE - pos) ? count : PIPE_SIZE - pos;
+        memcpy(pipe->buf + pos, (uint8_t*)buf + written, first);
+        memcpy(pipe->buf, (uint8_t*)buf + written + first, count - first);
+        pipe->head += count;
+        written += count;
+        wait_queue_wake(&pipe->readable);
+    }
+    restore_flags(flags);
+
+    if (written == 0 && nbytes > 0)
+        return FAILURE;
+    return written;
+}
+
+/*
+ * pipe_close
+ *   DESCRIPTION: Closes one end of a pipe, freeing the pipe when no end is
+ *                open anymore.
+ *        INPUTS: fd - file descriptor index of a pipe end
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS/FAILURE
+ *  SIDE EFFECTS: Clears file descriptor, wakes the other end. Waiting
+ *                readers see end of file once no writer is left, waiting
+ *                writers stop once no reader is left.
+ */
+int32_t pipe_close(int32_t fd)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+    int32_t id;
+
+    /* Check for valid fd */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE)
+        return FAILURE;
+
+    id = fd_array[fd].inode;
+    if (fd_array[fd].file_ops == &pipe_read_op_table)
+        --pipes[id].readers;
+    else if (fd_array[fd].file_ops == &pipe_write_op_table)
+        --pipes[id].writers;
+    else
+        return FAILURE;
+
+    /* Mark file descriptor as not in use */
+    fd_array[fd].file_ops = NULL;
+    release_fd(fd);
+
+    /* The other end may be waiting for an end that is gone now */
+    wait_queue_wake(&pipes[id].readable);
+    wait_queue_wake(&pipes[id].writable);
+    if (pipes[id].readers == 0 && pipes[id].writers == 0)
+        __pipe_release(id);
+    return SUCCESS;
+}
+
+/*
+ * pipe_inherit
+ *   DESCRIPTION: Counts the pipe ends a forked process copied from its
+ *                parent along with its FD array.
+ *        INPUTS: pid - process whose FDs were copied
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void pipe_inherit(int32_t pid)
+{
+    pcb_t* pcb = get_pcb_addr(pid);
+    int32_t fd;
+
+    if (pcb == NULL)
+        return;
+
+    for (fd = 0; fd < FD_ARRAY_SIZE; ++fd)
+    {
+        if (pcb->fd_table[fd].flags == NOT_IN_USE)
+            continue;
+
+        if (pcb->fd_table[fd].file_ops == &pipe_read_op_table)
+            ++pipes[pcb->fd_table[fd].inode].readers;
+        else if (pcb->fd_table[fd].file_ops == &pipe_write_op_table)
+            ++pipes[pcb->fd_table[fd].inode].writers;
+    }
+}
+
+/*
+ * __pipe_open_end
+ *   DESCRIPTION: Opens one end of a pipe in the next available FD of the
+ *                current process.
+ *        INPUTS: ops - op table of the read or write end
+ *                id - pipe index
+ *       OUTPUTS: none
+ *  RETURN VALUE: FD index or FAILURE if no FD is free
+ *  SIDE EFFECTS: Marks one fd as in use
+ */
+int32_t __pipe_open_end(file_op_table_t* ops, int32_t id)
+{
+    int32_t fd = get_new_fd();
+    if (fd == FAILURE)
+        return FAILURE;
+
+    /* Populate file descriptor index, inode holds pipe index */
+    file_t* fd_array = get_current_pcb()->fd_table;
+    fd_array[fd].file_ops = ops;
+    fd_array[fd].inode = id;
+    fd_array[fd].file_position = INIT_FILE_POS;
+    claim_fd(fd);
+    fd_array[fd].cursor_valid = 0;
+
+    if (ops == &pipe_read_op_table)
+        ++pipes[id].readers;
+    else
+        ++pipes[id].writers;
+
+    return fd;
+}
+
+/*
+ * __pipe_release
+ *   DESCRIPTION: Frees a pipe's ring buffer and table entry.
+ *        INPUTS: id - pipe index
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Frees frames
+ */
+void __pipe_release(int32_t id)
+{
+    frame_free_contig((uint32_t)pipes[id].buf, PIPE_PAGES);
+    memset(&pipes[id], 0, sizeof(pipe_t));
+}
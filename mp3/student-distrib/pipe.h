@@ -0,0 +1,34 @@
+#ifndef PIPE_H_
+#define PIPE_H_
+
+#include "types.h"
+#include "file.h"
+#include "wait_queue.h"
+
+#define PIPE_MAX            16              /* Pipes in the system */
+#define PIPE_PAGES          4
+#define PIPE_SIZE           (PIPE_PAGES * 4096) /* Ring buffer bytes, a power of 2 */
+
+/* Kernel ring buffer shared by the read and write ends of a pipe. Unused
+ * while buf is NULL. Positions only grow; head - tail bytes are buffered */
+typedef struct pipe {
+    uint8_t* buf;
+    uint32_t head;                          /* Position of next byte written */
+    uint32_t tail;                          /* Position of next byte read */
+    uint32_t readers;                       /* Open read end FDs in all processes */
+    uint32_t writers;                       /* Open write end FDs in all processes */
+    wait_queue_t readable;                  /* Readers waiting for bytes */
+    wait_queue_t writable;                  /* Writers waiting for room */
+} pipe_t;
+
+file_op_table_t pipe_read_op_table;
+file_op_table_t pipe_write_op_table;
+
+void pipe_init();
+int32_t pipe_create(int32_t* fds);
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t pipe_close(int32_t fd);
+void pipe_inherit(int32_t pid);
+
+#endif /* PIPE_H_ */
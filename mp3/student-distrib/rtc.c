@@ -5,6 +5,7 @@
 #include "pcb.h"
 #include "file.h"
 #include "scheduler.h"
+#include "wait_queue.h"
 
 #define RTC_FREQ        1024
 #define RTC_MAX_DIVIDER 6
@@ -17,6 +18,9 @@ static volatile int rtc_read_waiting[3];
 static volatile int rtc_intr_count[3];
 static volatile int rtc_freq_divider[3];
 
+/* Readers of each group sleeping until their interrupt count is reached */
+static wait_queue_t rtc_queues[3];
+
 /*
  * rtc_init
  *   DESCRIPTION: Initializes register A and B of CMOS to allow RTC interrupts.
@@ -28,13 +32,20 @@ static volatile int rtc_freq_divider[3];
 void rtc_init()
 {
     int flags;
+    int group;
     cli_and_save(flags);
 
+    for (group = 0; group < MAX_PROCESS_GROUPS; ++group)
+        wait_queue_init(&rtc_queues[group]);
+
     /* Initialize rtc type file_op_table */
     rtc_type_op_table.read = rtc_read;
     rtc_type_op_table.write = rtc_write;
     rtc_type_op_table.open = rtc_open;
     rtc_type_op_table.close = rtc_close;
+    rtc_type_op_table.stat = NULL;
+    rtc_type_op_table.lseek = NULL;
+    rtc_type_op_table.pread = NULL;
 
     /* Turn on periodic interrupt enable */
     outb(RTC_REG_B_NMI, RTC_PORT0);     /* Select register B 0x0B and disable NMI 0x80 */
@@ -79,6 +90,7 @@ void rtc_wrapper(void)
             if (rtc_intr_count[group] >= RTC_FREQ/rtc_freq_divider[group])
             {
                 rtc_read_waiting[group] = RTC_NOT_WAITING;
+                wait_queue_wake(&rtc_queues[group]);
             }
         }
     }
@@ -93,11 +105,12 @@ void rtc_wrapper(void)
 
 /*
  * rtc_read
- *   DESCRIPTION: Returns only after an interrupt has occurred.
+ *   DESCRIPTION: Returns only after an interrupt has occurred, sleeping
+ *                until then so other processes can run.
  *        INPUTS: none
  *       OUTPUTS: none
  *  RETURN VALUE: 0
- *  SIDE EFFECTS: none
+ *  SIDE EFFECTS: Blocks the current process
  */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
     /* Void Variables in order to keep the signatures similar*/
@@ -110,6 +123,9 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
     #endif
 
     int group = get_current_group();
+    long flags;
+
+    cli_and_save(flags);
 
     /* Set waiting flag */
     rtc_read_waiting[group] = RTC_WAITING;
@@ -117,8 +133,11 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
     /* Clear count */
     rtc_intr_count[group] = 0;
 
-    /* Wait for interrupt to occur before continuing */
-    while (rtc_read_waiting[group] != RTC_NOT_WAITING){};
+    /* Sleep until enough interrupts have occurred before continuing */
+    while (rtc_read_waiting[group] != RTC_NOT_WAITING)
+        wait_queue_sleep(&rtc_queues[group]);
+
+    restore_flags(flags);
 
     #if RUN_TESTS
     tests_rtc_read_waited_for_int = 1;
@@ -221,7 +240,7 @@ int32_t rtc_close(int32_t fd)
     /* Mark file descriptor as not in use */
     file_t* fd_array = get_current_pcb()->fd_table;
     fd_array[fd].file_ops = NULL;
-    fd_array[fd].flags = NOT_IN_USE;
+    release_fd(fd);
 
     return SUCCESS;
 }
@@ -1,29 +1,61 @@
+/*
+ * File: scheduler.c
+ *   Preemptive scheduler. Runnable processes sit on a run queue no matter
+ *   which terminal they belong to; processes waiting for a child or sleeping
+ *   on a wait queue are taken off it. Each process gets a share of the
+ *   processor proportional to its priority: every PIT tick it runs adds
+ *   SCHED_VRUNTIME_TICK / priority to its virtual runtime, and when a time
+ *   slice ends the queued process with the least virtual runtime runs next.
+ *   A process that was not runnable for a while may start at most one slice
+ *   ahead of the others, enough for interactive processes to preempt
+ *   compute-bound ones as soon as they wake without ever starving them.
+ */
 #include "lib.h"
+#include "vm.h"
 #include "paging.h"
 #include "system.h"
 #include "i8259.h"
+#include "idt.h"
+#include "kstats.h"
 #include "scheduler.h"
 #include "pcb.h"
+#include "term.h"
 #include "x86_desc.h"
 #include "paging.h"
 
-/* Used to keep track of the process currently being scheduled */
-static int32_t current_group;
+static struct process_control_block* run_queue;    /* Runnable processes, linked through run_next */
+static uint32_t min_vruntime;           /* Least virtual runtime picked, never decreases */
+static uint32_t need_resched;           /* A process woke that should run before the current one */
+static uint32_t yield_pending;          /* Next PIT interrupt is raised in software */
+static sched_stats_t sched_stats;
+
+/* Local helpers */
+uint32_t __schedule_slice(pcb_t* pcb);
+int32_t __schedule_fill(int8_t* buf, int32_t size);
 
 /* scheduler_init
- *   DESCRIPTION: Initializes scheduler
+ *   DESCRIPTION: Initializes scheduler and registers the "schedstat" kernel
+ *                stats file
  *        INPUTS: none
  *       OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Scheduler begins with first terminal
+ *  SIDE EFFECTS: Scheduler begins with an empty run queue
  */
 void scheduler_init()
 {
-    current_group = 0;
+    run_queue = NULL;
+    min_vruntime = 0;
+    need_resched = 0;
+    yield_pending = 0;
+    memset(&sched_stats, 0, sizeof(sched_stats));
+    kstats_register("schedstat", __schedule_fill);
 }
 
 /* schedule_next 
- *   DESCRIPTION: Switches between processes using round-robin approach, across terminals 1-3. 
+ *   DESCRIPTION: Charges a PIT tick to the current process and, once its time
+ *                slice is used up, switches to the runnable process with the
+ *                least virtual runtime. Also entered through schedule_yield
+ *                and schedule_preempt, which switch without charging a tick.
  *        INPUTS: proc_push_top _ indicates the top of the process' stack
                   pushed_cs - code segment register, gives privilege level
  *       OUTPUTS: none
@@ -34,22 +66,61 @@ void schedule_next(uint32_t proc_push_top, uint32_t pushed_cs)
 {
     cli();
 
-    /* Accept another interrupt */
-    send_eoi(IRQ_0);
+    /* Get PCB of process being paused */
+    pcb_t* pcb_old = get_current_pcb();
+    /* Get PCB of process being unpaused */
+    pcb_t* pcb_new;
+    uint32_t latency;
+
+    if (yield_pending)
+    {
+        /* Raised in software, the PIT did not tick */
+        yield_pending = 0;
+    }
+    else
+    {
+        /* Accept another interrupt */
+        send_eoi(IRQ_0);
+
+        /* Keep running for the rest of the time slice unless a process woke
+         * that should run first */
+        schedule_tick(pcb_old);
+        if (pcb_old->queued && pcb_old->slice_left > 0 && !need_resched)
+        {
+            sti();
+            return;
+        }
+    }
 
-    int32_t old_group = current_group;
-    current_group++;
+    /* Stay in the current process, idling if it is blocked, when nothing
+     * else can run */
+    need_resched = 0;
+    pcb_new = schedule_pick();
+    if (pcb_new == NULL)
+        pcb_new = pcb_old;
+    if (pcb_new != pcb_old || pcb_new->slice_left == 0)
+        pcb_new->slice_left = __schedule_slice(pcb_new);
 
-    /* current_group cycles from 0-2, wraps around */
-    if (current_group >= NUM_OF_PROCESS_GROUPS)
+    /* Time from being woken to running */
+    if (pcb_new->wake_tsc != 0)
     {
-        current_group = 0;
+        latency = (rdtsc() - pcb_new->wake_tsc) / 1000;
+        pcb_new->wake_kcycles += latency;
+        if (latency > pcb_new->wake_max_kcycles)
+            pcb_new->wake_max_kcycles = latency;
+        pcb_new->wake_tsc = 0;
     }
 
-    /* Get PCB of process being paused */
-    pcb_t* pcb_old = get_pcb_addr(active_pid[old_group]);
-    /* Get PCB of process being unpaused */
-    pcb_t* pcb_new = get_pcb_addr(active_pid[current_group]);
+    if (pcb_new == pcb_old)
+    {
+        sti();
+        return;
+    }
+
+    ++sched_stats.switches;
+    if (pcb_old->queued && pcb_old->slice_left > 0)
+        ++sched_stats.preemptions;
+    ++pcb_new->run_switches;
 
     /* Save data of old process: esp, ebp, esp0 */
     if ((pushed_cs & CPL_MASK) == CPL_3) {
@@ -69,13 +140,13 @@ void schedule_next(uint32_t proc_push_top, uint32_t pushed_cs)
     /* Remap user video page */
     if (pcb_new->vid_map_called)
     {
-        if (visible_group == current_group)
+        if (visible_group == pcb_new->group)
         {
             map_page(VIDEO_USER, VIDEO_KERNEL, TRUE, TRUE, FALSE);
         }
         else
         {
-            map_page(VIDEO_USER, VIDEO_GROUP_1 + current_group * PAGE_SIZE, TRUE, TRUE, FALSE);
+            map_page(VIDEO_USER, get_video_save_page(pcb_new->group), TRUE, TRUE, FALSE);
         }
     }
     else
@@ -83,8 +154,9 @@ void schedule_next(uint32_t proc_push_top, uint32_t pushed_cs)
         unmap_page(VIDEO_USER, FALSE);
     }
     
-    /* Map <insert expletive> Process */
-    map_page(PROG_VIRT_ADDR, get_prog_phys_addr(pcb_new->pid), TRUE, TRUE, TRUE);
+    /* Switch to new process and its address space */
+    set_current_pcb(pcb_new);
+    vm_switch(pcb_new->pid);
 
     /* Restore task state segment */
     tss.ss0 = KERNEL_DS;
@@ -103,26 +175,290 @@ void schedule_next(uint32_t proc_push_top, uint32_t pushed_cs)
     sti();
 }
 
+/* schedule_preempt
+ *   DESCRIPTION: Switches right away to a process woken by an interrupt
+ *                handler if it should run before the current one, instead of
+ *                waiting for the current time slice to end.
+ *        INPUTS: proc_push_top _ indicates the top of the process' stack
+                  pushed_cs - code segment register, gives privilege level
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: May pause the current process
+ */
+void schedule_preempt(uint32_t proc_push_top, uint32_t pushed_cs)
+{
+    if (!need_resched)
+        return;
+
+    yield_pending = 1;
+    schedule_next(proc_push_top, pushed_cs);
+}
+
+/* schedule_yield
+ *   DESCRIPTION: Gives up the rest of the current process' time slice by
+ *                raising the PIT interrupt in software. Used by processes
+ *                waiting in the kernel for another process.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Runs other processes before returning
+ */
+void schedule_yield()
+{
+    long flags;
+
+    /* A real PIT interrupt in between would take the flag and skip its EOI */
+    cli_and_save(flags);
+    yield_pending = 1;
+    asm volatile("int %0" : : "i" (IDT_INT_0 + IRQ_PIT) : "cc", "memory");
+    restore_flags(flags);
+}
+
+/* schedule_exit
+ *   DESCRIPTION: Leaves the current process for good. Used by halting
+ *                processes that have no parent waiting to be switched back
+ *                to; the process is never put on the run queue again.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none, never returns
+ *  SIDE EFFECTS: Runs other processes
+ */
+void schedule_exit()
+{
+    cli();
+    schedule_dequeue(get_current_pcb());
+
+    while (1)
+    {
+        schedule_yield();
+
+        /* Nothing else was runnable, idle until an interrupt */
+        asm volatile("sti; hlt; cli" : : : "memory", "cc");
+    }
+}
+
+/* schedule_enqueue
+ *   DESCRIPTION: Adds a process that became runnable to the run queue. Its
+ *                virtual runtime is raised to at most one slice behind the
+ *                least one picked, so time spent waiting is not banked.
+ *        INPUTS: pcb - new, woken, or resumed process
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Requests a switch if the process should run before the
+ *                current one
+ */
+void schedule_enqueue(pcb_t* pcb)
+{
+    uint32_t floor = min_vruntime - SCHED_WAKE_CREDIT;
+    pcb_t* current;
+    long flags;
+
+    if (pcb == NULL || pcb->queued)
+        return;
+
+    cli_and_save(flags);
+
+    if ((int32_t)(pcb->vruntime - floor) < 0)
+        pcb->vruntime = floor;
+    pcb->run_next = run_queue;
+    run_queue = pcb;
+    pcb->queued = 1;
+    ++pcb->wakeups;
+
+    /* Processes that never left the processor have no latency */
+    current = get_current_pcb();
+    if (pcb == current)
+    {
+        pcb->wake_tsc = 0;
+    }
+    else
+    {
+        pcb->wake_tsc = rdtsc();
+        if (current == NULL || !current->queued || (int32_t)(pcb->vruntime - current->vruntime) < 0)
+            need_resched = 1;
+    }
+
+    restore_flags(flags);
+}
+
+/* schedule_dequeue
+ *   DESCRIPTION: Takes a process that can no longer run off the run queue.
+ *        INPUTS: pcb - blocked, waiting, or halting process
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void schedule_dequeue(pcb_t* pcb)
+{
+    pcb_t** link;
+    long flags;
+
+    if (pcb == NULL || !pcb->queued)
+        return;
+
+    cli_and_save(flags);
+    for (link = &run_queue; *link != NULL; link = &(*link)->run_next)
+    {
+        if (*link == pcb)
+        {
+            *link = pcb->run_next;
+            break;
+        }
+    }
+    pcb->run_next = NULL;
+    pcb->queued = 0;
+    restore_flags(flags);
+}
+
+/* schedule_pick
+ *   DESCRIPTION: Finds the runnable process with the least virtual runtime.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: PCB of the process to run next or NULL if none is runnable
+ *  SIDE EFFECTS: Advances min_vruntime
+ */
+pcb_t* schedule_pick()
+{
+    pcb_t* pcb;
+    pcb_t* best = NULL;
+
+    for (pcb = run_queue; pcb != NULL; pcb = pcb->run_next)
+    {
+        if (best == NULL || (int32_t)(pcb->vruntime - best->vruntime) < 0)
+            best = pcb;
+    }
+
+    if (best != NULL && (int32_t)(best->vruntime - min_vruntime) > 0)
+        min_vruntime = best->vruntime;
+
+    return best;
+}
+
+/* schedule_tick
+ *   DESCRIPTION: Charges a PIT tick to the process that was running.
+ *        INPUTS: pcb - current process
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Advances its virtual runtime and uses up its time slice,
+ *                or counts an idle tick if it is not runnable
+ */
+void schedule_tick(pcb_t* pcb)
+{
+    ++sched_stats.ticks;
+
+    if (pcb == NULL || !pcb->queued)
+    {
+        ++sched_stats.idle_ticks;
+        return;
+    }
+
+    ++pcb->run_ticks;
+    pcb->vruntime += SCHED_VRUNTIME_TICK / pcb->priority;
+    if (pcb->slice_left > 0)
+        --pcb->slice_left;
+}
+
+/* schedule_set_priority
+ *   DESCRIPTION: Changes a process' share of the processor, taking effect
+ *                from its next tick.
+ *        INPUTS: pcb - process to change
+ *                priority - SCHED_PRIO_MIN to SCHED_PRIO_MAX
+ *       OUTPUTS: none
+ *  RETURN VALUE: Previous priority or FAILURE if priority is out of range
+ *  SIDE EFFECTS: none
+ */
+int32_t schedule_set_priority(pcb_t* pcb, int32_t priority)
+{
+    int32_t old;
+
+    if (pcb == NULL || priority < SCHED_PRIO_MIN || priority > SCHED_PRIO_MAX)
+        return FAILURE;
+
+    old = pcb->priority;
+    pcb->priority = priority;
+    return old;
+}
+
+/* schedule_get_stats
+ *   DESCRIPTION: Copies the scheduler statistics
+ *        INPUTS: none
+ *       OUTPUTS: stats - copy of the current statistics
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void schedule_get_stats(sched_stats_t* stats)
+{
+    *stats = sched_stats;
+}
+
 /* get_current_group 
- *   DESCRIPTION: Getter for current_group
+ *   DESCRIPTION: Getter for the process group (terminal) of the current
+ *                process
  *        INPUTS: none
- *       OUTPUTS: current_group
+ *       OUTPUTS: current process' group
  *  RETURN VALUE: none
  *  SIDE EFFECTS: none
  */
 int32_t get_current_group()
 {
-    return current_group;
+    pcb_t* pcb = get_current_pcb();
+
+    return (pcb != NULL) ? pcb->group : 0;
 }
 
-/* set_current_group 
- *   DESCRIPTION: Setter for current_group
- *        INPUTS: pid -- new current_group value
+/* __schedule_slice
+ *   DESCRIPTION: Length of a process' time slice, longer for higher
+ *                priorities
+ *        INPUTS: pcb - process about to run
  *       OUTPUTS: none
- *  RETURN VALUE: none
- *  SIDE EFFECTS: Changes current_group
+ *  RETURN VALUE: PIT ticks, at least 1
+ *  SIDE EFFECTS: none
  */
-void set_current_group(int32_t pid)
+uint32_t __schedule_slice(pcb_t* pcb)
 {
-    current_group = pid;
+    uint32_t ticks = SCHED_SLICE_TICKS * pcb->priority / SCHED_PRIO_DEFAULT;
+
+    return (ticks > 0) ? ticks : 1;
+}
+
+/* __schedule_fill
+ *   DESCRIPTION: Writes the "schedstat" kernel stats file: totals, then a
+ *                row per process
+ *        INPUTS: buf - destination for the text
+ *                size - size of buf
+ *       OUTPUTS: none
+ *  RETURN VALUE: Length of the text
+ *  SIDE EFFECTS: none
+ */
+int32_t __schedule_fill(int8_t* buf, int32_t size)
+{
+    uint32_t values[SCHED_STAT_COLUMNS];
+    int8_t label[KSTATS_NUM_LEN];
+    int32_t len = 0;
+    int32_t pid;
+    pcb_t* pcb;
+
+    len = kstats_line(buf, size, len, "ticks", sched_stats.ticks);
+    len = kstats_line(buf, size, len, "idle ticks", sched_stats.idle_ticks);
+    len = kstats_line(buf, size, len, "switches", sched_stats.switches);
+    len = kstats_line(buf, size, len, "preemptions", sched_stats.preemptions);
+
+    len = kstats_text(buf, size, len, "pid: terminal prio ticks switches wakeups avg_wake_kc max_wake_kc\n");
+    for (pid = 0; pid < MAX_PID; ++pid)
+    {
+        pcb = get_pcb_addr(pid);
+        if (pcb == NULL)
+            continue;
+
+        values[0] = pcb->group + 1;
+        values[1] = pcb->priority;
+        values[2] = pcb->run_ticks;
+        values[3] = pcb->run_switches;
+        values[4] = pcb->wakeups;
+        values[5] = pcb->wakeups ? pcb->wake_kcycles / pcb->wakeups : 0;
+        values[6] = pcb->wake_max_kcycles;
+        len = kstats_row(buf, size, len, itoa(pid, label, 10), values, SCHED_STAT_COLUMNS);
+    }
+
+    return len;
 }
@@ -9,11 +9,36 @@
 #define CPL_MASK                0x03
 #define ENTRY_SIZE              4
 
+#define SCHED_PRIO_MIN          1           /* Smallest share of the processor */
+#define SCHED_PRIO_MAX          8           /* Largest share, SCHED_PRIO_MAX times SCHED_PRIO_MIN's */
+#define SCHED_PRIO_DEFAULT      4
+#define SCHED_SLICE_TICKS       2           /* PIT ticks per time slice at SCHED_PRIO_DEFAULT */
+#define SCHED_VRUNTIME_TICK     840         /* Virtual runtime of a tick at priority 1, divisible by every priority */
+#define SCHED_WAKE_CREDIT       (SCHED_SLICE_TICKS * SCHED_VRUNTIME_TICK / SCHED_PRIO_DEFAULT)
+#define SCHED_STAT_COLUMNS      7
+
+struct process_control_block;
+
+typedef struct sched_stats {
+    uint32_t ticks;                     /* PIT ticks */
+    uint32_t idle_ticks;                /* Ticks while nothing was runnable */
+    uint32_t switches;                  /* Context switches */
+    uint32_t preemptions;               /* Switches before the time slice was used up */
+} sched_stats_t;
+
 int visible_group;                                  /* Currently Visible Terminal - Starts at 0 */
 
 void schedule_next(uint32_t proc_push_top, uint32_t pushed_cs);
+void schedule_preempt(uint32_t proc_push_top, uint32_t pushed_cs);
+void schedule_yield();
+void schedule_exit();
+void schedule_enqueue(struct process_control_block* pcb);
+void schedule_dequeue(struct process_control_block* pcb);
+struct process_control_block* schedule_pick();
+void schedule_tick(struct process_control_block* pcb);
+int32_t schedule_set_priority(struct process_control_block* pcb, int32_t priority);
+void schedule_get_stats(sched_stats_t* stats);
 int32_t get_current_group();
-void set_current_group(int32_t pid);
 void scheduler_init();
 
 
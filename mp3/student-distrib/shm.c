@@ -0,0 +1,310 @@
+/*
+ * File: shm.c
+ *   Shared memory segments. A segment is a set of zeroed frames named by a
+ *   key. Every process that attaches it maps the same frames writable into
+ *   its shared memory area, so processes of different terminals can
+ *   exchange data without copying. Mappings live in the process' PD and
+ *   survive scheduling like the rest of its address space. The segment holds
+ *   a reference to its frames until the last mapping is detached, or until
+ *   the process that created it halts if it was never attached.
+ */
+#include "shm.h"
+#include "frame.h"
+#include "lib.h"
+#include "paging.h"
+#include "pcb.h"
+#include "vm.h"
+
+static shm_segment_t shm_segments[SHM_MAX_SEGMENTS];
+
+/* Local helpers */
+int32_t __shm_range_free(pcb_t* pcb, uint32_t start, uint32_t num_pages);
+void __shm_release(int32_t id);
+void __shm_free(int32_t id);
+
+/*
+ * shm_get
+ *   DESCRIPTION: Finds the segment with the given key, creating it with
+ *                zeroed pages if there is none.
+ *        INPUTS: key - positive name of the segment
+ *                size - bytes needed, rounded up to whole pages
+ *       OUTPUTS: none
+ *  RETURN VALUE: Segment ID or FAILURE if the key is invalid, an existing
+ *                segment is too small, or the table or memory is full
+ *  SIDE EFFECTS: May allocate frames
+ */
+int32_t shm_get(int32_t key, int32_t size)
+{
+    uint32_t num_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    int32_t id, free_id = FAILURE;
+    uint32_t i;
+
+    if (key <= 0 || size <= 0 || num_pages > SHM_MAX_PAGES)
+        return FAILURE;
+
+    for (id = 0; id < SHM_MAX_SEGMENTS; ++id)
+    {
+        if (shm_segments[id].num_pages == 0)
+        {
+            if (free_id == FAILURE)
+                free_id = id;
+        }
+        else if (shm_segments[id].key == key)
+        {
+            return (num_pages <= shm_segments[id].num_pages) ? id : FAILURE;
+        }
+    }
+    if (free_id == FAILURE)
+        return FAILURE;
+
+    for (i = 0; i < num_pages; ++i)
+    {
+        shm_segments[free_id].frames[i] = frame_alloc();
+        if (shm_segments[free_id].frames[i] == NULL)
+        {
+            while (i-- > 0)
+                frame_free(shm_segments[free_id].frames[i]);
+            return FAILURE;
+        }
+        memset((void*)shm_segments[free_id].frames[i], 0, PAGE_SIZE);
+    }
+
+    shm_segments[free_id].key = key;
+    shm_segments[free_id].num_pages = num_pages;
+    shm_segments[free_id].attaches = 0;
+    shm_segments[free_id].creator = get_current_pcb()->pid;
+    return free_id;
+}
+
+/*
+ * shm_attach
+ *   DESCRIPTION: Maps a segment writable into the current process' shared
+ *                memory area at the given address, or at the first free
+ *                range if none is given.
+ *        INPUTS: id - segment ID from shm_get
+ *                start - pointer to a page aligned address in the shared
+ *                memory area, or to NULL
+ *       OUTPUTS: start - address at which the segment is mapped
+ *  RETURN VALUE: Size of the segment in bytes or FAILURE if the segment or
+ *                address is invalid, the range is in use, or out of memory
+ *  SIDE EFFECTS: Maps pages in current process' PD
+ */
+int32_t shm_attach(int32_t id, uint8_t** start)
+{
+    pcb_t* pcb = get_current_pcb();
+    uint32_t addr = (uint32_t)*start;
+    int32_t region, page;
+    uint32_t i, num_pages;
+
+    if (id < 0 || id >= SHM_MAX_SEGMENTS || shm_segments[id].num_pages == 0)
+        return FAILURE;
+    num_pages = shm_segments[id].num_pages;
+
+    /* Find unused region slot */
+    for (region = 0; region < SHM_MAX_ATTACH; ++region)
+    {
+        if (pcb->shms[region].start == 0)
+            break;
+    }
+    if (region == SHM_MAX_ATTACH)
+        return FAILURE;
+
+    if (addr == NULL)
+    {
+        /* First fit */
+        for (page = 0; page + num_pages <= SHM_AREA_PAGES; ++page)
+        {
+            if (__shm_range_free(pcb, SHM_VIRT_ADDR + page * PAGE_SIZE, num_pages) == SUCCESS)
+                break;
+        }
+        if (page + num_pages > SHM_AREA_PAGES)
+            return FAILURE;
+        addr = SHM_VIRT_ADDR + page * PAGE_SIZE;
+    }
+    else if ((addr & ~FLAG_MASK) || addr < SHM_VIRT_ADDR ||
+             addr + num_pages * PAGE_SIZE > SHM_VIRT_ADDR + SHM_AREA_PAGES * PAGE_SIZE ||
+             __shm_range_free(pcb, addr, num_pages) == FAILURE)
+    {
+        return FAILURE;
+    }
+
+    for (i = 0; i < num_pages; ++i)
+    {
+        if (vm_map_shared(addr + i * PAGE_SIZE, shm_segments[id].frames[i]) == FAILURE)
+        {
+            while (i-- > 0)
+                vm_unmap_page(addr + i * PAGE_SIZE);
+            return FAILURE;
+        }
+    }
+
+    pcb->shms[region].start = addr;
+    pcb->shms[region].segment = id;
+    ++shm_segments[id].attaches;
+
+    *start = (uint8_t*)addr;
+    return num_pages * PAGE_SIZE;
+}
+
+/*
+ * shm_detach
+ *   DESCRIPTION: Unmaps the segment the current process attached at the
+ *                given address.
+ *        INPUTS: start - address returned by shm_attach
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if no segment is attached at start
+ *  SIDE EFFECTS: Unmaps pages in current process' PD, frees the segment if
+ *                it was the last mapping
+ */
+int32_t shm_detach(uint32_t start)
+{
+    pcb_t* pcb = get_current_pcb();
+    int32_t region, id;
+    uint32_t i;
+
+    for (region = 0; region < SHM_MAX_ATTACH; ++region)
+    {
+        if (start != 0 && pcb->shms[region].start == start)
+        {
+            id = pcb->shms[region].segment;
+            for (i = 0; i < shm_segments[id].num_pages; ++i)
+            {
+                vm_unmap_page(start + i * PAGE_SIZE);
+            }
+
+            pcb->shms[region].start = 0;
+            __shm_release(id);
+            return SUCCESS;
+        }
+    }
+
+    return FAILURE;
+}
+
+/*
+ * shm_inherit
+ *   DESCRIPTION: Counts the mappings a forked process copied from its
+ *                parent along with its address space.
+ *        INPUTS: pid - process whose regions were copied
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void shm_inherit(int32_t pid)
+{
+    pcb_t* pcb = get_pcb_addr(pid);
+    int32_t region;
+
+    if (pcb == NULL)
+        return;
+
+    for (region = 0; region < SHM_MAX_ATTACH; ++region)
+    {
+        if (pcb->shms[region].start != 0)
+            ++shm_segments[pcb->shms[region].segment].attaches;
+    }
+}
+
+/*
+ * shm_detach_all
+ *   DESCRIPTION: Forgets all segments attached by a process. The pages
+ *                belong to the process' PD and are unmapped along with it.
+ *                Segments the process created that were never attached
+ *                would otherwise never be freed, so they go too.
+ *        INPUTS: pid - process whose mappings are removed
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Clears regions, frees segments that are no longer mapped
+ */
+void shm_detach_all(int32_t pid)
+{
+    pcb_t* pcb = get_pcb_addr(pid);
+    int32_t region, id;
+
+    if (pcb == NULL)
+        return;
+
+    for (region = 0; region < SHM_MAX_ATTACH; ++region)
+    {
+        if (pcb->shms[region].start != 0)
+        {
+            pcb->shms[region].start = 0;
+            __shm_release(pcb->shms[region].segment);
+        }
+    }
+
+    for (id = 0; id < SHM_MAX_SEGMENTS; ++id)
+    {
+        if (shm_segments[id].num_pages != 0 && shm_segments[id].attaches == 0 &&
+            shm_segments[id].creator == pid)
+        {
+            __shm_free(id);
+        }
+    }
+}
+
+/*
+ * __shm_range_free
+ *   DESCRIPTION: Checks that a range of the shared memory area does not
+ *                overlap a segment the process already attached.
+ *        INPUTS: pcb - process attaching a segment
+ *                start - page aligned first address of the range
+ *                num_pages - length of the range
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS if the range is free, FAILURE otherwise
+ *  SIDE EFFECTS: none
+ */
+int32_t __shm_range_free(pcb_t* pcb, uint32_t start, uint32_t num_pages)
+{
+    uint32_t end = start + num_pages * PAGE_SIZE;
+    uint32_t other_start, other_end;
+    int32_t region;
+
+    for (region = 0; region < SHM_MAX_ATTACH; ++region)
+    {
+        other_start = pcb->shms[region].start;
+        if (other_start == 0)
+            continue;
+
+        other_end = other_start + shm_segments[pcb->shms[region].segment].num_pages * PAGE_SIZE;
+        if (start < other_end && other_start < end)
+            return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * __shm_release
+ *   DESCRIPTION: Drops a mapping of a segment, freeing the segment and its
+ *                reference to the frames when it was the last one. Frames
+ *                still mapped by a PD being destroyed are freed with it.
+ *        INPUTS: id - attached segment
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: May free frames
+ */
+void __shm_release(int32_t id)
+{
+    if (--shm_segments[id].attaches == 0)
+        __shm_free(id);
+}
+
+/*
+ * __shm_free
+ *   DESCRIPTION: Frees a segment and its reference to the frames.
+ *        INPUTS: id - segment without mappings
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: May free frames
+ */
+void __shm_free(int32_t id)
+{
+    uint32_t i;
+
+    for (i = 0; i < shm_segments[id].num_pages; ++i)
+    {
+        frame_free(shm_segments[id].frames[i]);
+    }
+    memset(&shm_segments[id], 0, sizeof(shm_segment_t));
+}
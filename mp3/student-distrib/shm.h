@@ -0,0 +1,33 @@
+#ifndef SHM_H_
+#define SHM_H_
+
+#include "types.h"
+
+#define SHM_VIRT_ADDR       0x08800000      /* 136MB, the 4 MB just above the mmap area */
+#define SHM_AREA_PAGES      1024            /* 4 kB pages in the shared memory area */
+#define SHM_MAX_SEGMENTS    16              /* Segments in the system */
+#define SHM_MAX_PAGES       256             /* 1 MB largest segment */
+#define SHM_MAX_ATTACH      8               /* Attached segments per process */
+
+/* Shared memory segment, unused while num_pages is 0 */
+typedef struct shm_segment {
+    int32_t key;                            /* Name processes agree on */
+    uint32_t num_pages;
+    uint32_t attaches;                      /* Mappings in all processes */
+    int32_t creator;                        /* PID that created it, frees it if never attached */
+    uint32_t frames[SHM_MAX_PAGES];
+} shm_segment_t;
+
+/* Range of the shared memory area holding one attached segment */
+typedef struct shm_region {
+    uint32_t start;                         /* Virtual address, 0 if unused */
+    int32_t segment;
+} shm_region_t;
+
+int32_t shm_get(int32_t key, int32_t size);
+int32_t shm_attach(int32_t id, uint8_t** start);
+int32_t shm_detach(uint32_t start);
+void shm_inherit(int32_t pid);
+void shm_detach_all(int32_t pid);
+
+#endif /* SHM_H_ */
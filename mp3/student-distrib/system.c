@@ -1,26 +1,41 @@
+#include "exec_cache.h"
 #include "file_sys.h"
 #include "idt.h"
+#include "kstats.h"
 #include "lib.h"
+#include "mmap.h"
 #include "paging.h"
 #include "pcb.h"
+#include "pipe.h"
 #include "rtc.h"
 #include "system.h"
 #include "scheduler.h"
+#include "shm.h"
 #include "term.h"
+#include "tmpfs.h"
+#include "vm.h"
 #include "x86_desc.h"
 
 /* Local helper functions */
-int32_t __load_program(const uint8_t* filename);
+int32_t __load_program(pcb_t* pcb, const uint8_t* filename);
 int32_t __validate_user_ptr(uint32_t ptr);
+int32_t __validate_user_range(uint32_t ptr, uint32_t len);
+int32_t __copy_user_string(uint8_t* dst, const uint8_t* src, uint32_t size);
+void __fork_child_stack(pcb_t* pcb, syscall_frame_t* frame);
+void __record_exec_latency(uint32_t cycles);
+extern void fork_child_return(void);
 
-/* System call linkage. Immediately saves registers before calling dispatcher */
+static exec_stats_t exec_stats;
+
+/* System call linkage. Immediately saves registers before calling dispatcher.
+ * EBX, ECX, EDX and ESI are pushed last so they are the first four arguments */
 asm(
     ".global system_call_handler                    \n\
     system_call_handler:                            \n\
         pushl %edi                                  \n\
-        pushl %esi                                  \n\
         pushl %ebp                                  \n\
         pushl %esp                                  \n\
+        pushl %esi                                  \n\
         pushl %edx                                  \n\
         pushl %ecx                                  \n\
         pushl %ebx                                  \n\
@@ -32,7 +47,7 @@ asm(
 /* System call dispatcher. Returns with -1 for invalid system call numbers */
 asm(
     "do_system_call:                                \n\
-        cmpl $8, %eax                               \n\
+        cmpl $26, %eax                              \n\
         ja  system_call_handler_failure             \n\
         cmpl $0, %eax                               \n\
         je  system_call_handler_failure             \n\
@@ -50,25 +65,41 @@ asm(
         popl %ebx                                   \n\
         popl %ecx                                   \n\
         popl %edx                                   \n\
+        popl %esi                                   \n\
         popl %esp                                   \n\
         popl %ebp                                   \n\
-        popl %esi                                   \n\
         popl %edi                                   \n\
         jmp  iret_and_save_tss_esp                  \n"
 );
 
+/* First instructions of a forked child, entered from schedule_next. Returns
+ * to the user program from fork with 0 in EAX */
+asm(
+    "fork_child_return:                             \n\
+        xorl %eax, %eax                             \n\
+        jmp system_call_handler_return              \n"
+);
+
 /* Jump table to system call functions */
 asm(
     "system_call_jump_table:                                \n\
         .long 0, system_halt, system_execute, system_read   \n\
         .long system_write, system_open, system_close       \n\
-        .long system_getargs, system_vidmap                 \n"
+        .long system_getargs, system_vidmap                 \n\
+        .long system_sethandler, system_sigreturn           \n\
+        .long system_mmap, system_munmap, system_getdents   \n\
+        .long system_stat, system_lseek, system_pread       \n\
+        .long system_sendfile, system_create                \n\
+        .long system_truncate, system_fork                  \n\
+        .long system_shmget, system_shmat, system_shmdt     \n\
+        .long system_pipe, system_setprio, system_wait      \n"
 );
 
 /*
  * system_halt
  *   DESCRIPTION: Halts currently executing program by switching back to the
- *                parent's context.
+ *                parent's context. Processes created by fork instead become
+ *                zombies until their parent calls system_wait.
  *        INPUTS: status - halt code to return to the parent process
  *       OUTPUTS: none
  *  RETURN VALUE: Passes halt code to parent through EAX
@@ -76,8 +107,15 @@ asm(
  */
 int32_t system_halt(uint32_t status)
 {
+    /* Nobody waits in fork for a forked process, its parent is running */
+    if (get_current_pcb()->forked)
+        pcb_exit(status);
+
     /* Get parent's PCB */
     pcb_t* parent_pcb = get_pcb_addr(get_current_pcb()->parent_pid);
+
+    /* Unmap mapped files before leaving the process */
+    mmap_unmap_all(get_current_pcb()->pid);
     
     /* Set up IRET context and IRET to return_from_exec */
     asm volatile(
@@ -111,6 +149,8 @@ int32_t system_halt(uint32_t status)
  */
 int32_t system_execute(const uint8_t* command)
 {
+    uint32_t exec_start = rdtsc();
+
     cli();
 
     /* Command must be a valid pointer */
@@ -187,19 +227,18 @@ int32_t system_execute(const uint8_t* command)
     /* Save length of argument buffer in PCB */
     child_pcb->args_len = args_idx;
 
-    /* Map program page */
-    map_page(PROG_VIRT_ADDR, get_prog_phys_addr(child_pcb->pid), TRUE, TRUE, TRUE);
-
     /* Load program */
-    uint32_t program_eip = __load_program(filename);
+    uint32_t program_eip = __load_program(child_pcb, filename);
     if (program_eip == FAILURE) 
     {
         /* Clean up */
-        map_page(PROG_VIRT_ADDR, get_prog_phys_addr(parent_pcb->pid), TRUE, TRUE, TRUE);
         pcb_teardown();     /* Reverts current pid to parent */
         return FAILURE;
     }
 
+    /* Switch to child's address space, the command is no longer needed */
+    vm_switch(child_pcb->pid);
+
     /* Update TSS's esp0 to point to child's kstack */
     tss.ss0 = KERNEL_DS;
     tss.esp0 = get_kstack_addr(child_pid);
@@ -222,6 +261,8 @@ int32_t system_execute(const uint8_t* command)
         : "cc", "memory"
     );
 
+    __record_exec_latency(rdtsc() - exec_start);
+
     //sti();  // flags set in assembly below
 
     /* Context switch */
@@ -261,16 +302,13 @@ int32_t system_execute(const uint8_t* command)
         : "cc", "memory"
     );
 
-    /* Page switch: remap process page to parent's physical page */
-    map_page(PROG_VIRT_ADDR, get_prog_phys_addr(parent_pcb->pid), TRUE, TRUE, TRUE);
-
     /* Unmap vid_map page if parent has not called vidmap system call */
     if (parent_pcb->vid_map_called == 0)
     {
         unmap_page(VIDEO_USER, FALSE);
     }
 
-    /* Clean up child's PCB */
+    /* Clean up child's PCB, switching back to parent's address space */
     pcb_teardown();
 
     return ret;
@@ -345,9 +383,9 @@ int32_t system_open(const uint8_t* filename)
 {
     dentry_t dentry;
 
-    /* Check for valid filename */
+    /* Check for valid filename, falling back to kernel stats files */
     if (read_dentry_by_name(filename, &dentry) != SUCCESS)
-        return FAILURE;
+        return kstats_open(filename);
 
     /* Get next available file descriptor index from PCB */
     int fd = get_new_fd();
@@ -358,7 +396,8 @@ int32_t system_open(const uint8_t* filename)
     file_t* fd_array = get_current_pcb()->fd_table;
     fd_array[fd].inode = dentry.inode_num;
     fd_array[fd].file_position = INIT_FILE_POS;
-    fd_array[fd].flags = IN_USE;
+    claim_fd(fd);
+    fd_array[fd].cursor_valid = 0;
 
     /* Assign file_op_table based on file type */
     switch (dentry.filetype)
@@ -462,7 +501,7 @@ int32_t system_vidmap(uint8_t** screen_start)
     if (visible_group == current_group) {
         map_page(VIDEO_USER, VIDEO_KERNEL, TRUE, TRUE, FALSE);
     } else {
-        map_page(VIDEO_USER, VIDEO_GROUP_1 + current_group * PAGE_SIZE, TRUE, TRUE, FALSE);
+        map_page(VIDEO_USER, get_video_save_page(current_group), TRUE, TRUE, FALSE);
     }
 
     *screen_start = (uint8_t*)VIDEO_USER;
@@ -471,61 +510,514 @@ int32_t system_vidmap(uint8_t** screen_start)
 }
 
 /*
- * __load_program
- *   DESCRIPTION: Opens given file, checks that it is an executable, then
- *                copies it into the program page. Closes file and returns the
- *                program's entry point (initial instruction pointer).
- *        INPUTS: filename - executable file to load
+ * system_sethandler
+ *   DESCRIPTION: Signals are not supported.
+ *        INPUTS: signum - signal number
+ *                handler_address - user handler
  *       OUTPUTS: none
- *  RETURN VALUE: Loaded program's IP or FAILURE if file fails to open or read
- *                or if file is not an executable.
- *  SIDE EFFECTS: Loads file into program page
+ *  RETURN VALUE: FAILURE
+ *  SIDE EFFECTS: none
  */
-int32_t __load_program(const uint8_t* filename)
+int32_t system_sethandler(int32_t signum, void* handler_address)
 {
-    /* Open file */
-    int fd = system_open(filename);
-    if (fd == FAILURE)
+    return FAILURE;
+}
+
+/*
+ * system_sigreturn
+ *   DESCRIPTION: Signals are not supported.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t system_sigreturn(void)
+{
+    return FAILURE;
+}
+
+/*
+ * system_mmap
+ *   DESCRIPTION: Maps the data of an open regular file read-only into the
+ *                caller's address space without copying it.
+ *        INPUTS: fd - file descriptor index of a regular file
+ *       OUTPUTS: start - pointer to a location in the user program in which
+ *                to put the address of the mapped file
+ *  RETURN VALUE: Length of the mapped file or FAILURE if fd is not an open
+ *                regular file, start is not valid, or no space is left
+ *  SIDE EFFECTS: Maps 4 KB user-accessible read-only pages to the file's
+ *                data blocks
+ */
+int32_t system_mmap(int32_t fd, uint8_t** start)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid fd of a boot image file and valid pointer. RAM files
+       are not mapped since their blocks can be freed by truncate */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE ||
+        fd_array[fd].file_ops != &file_type_op_table || tmpfs_is_inode(fd_array[fd].inode) ||
+        __validate_user_ptr((uint32_t)start) == FAILURE)
         return FAILURE;
-    
-    /* Check if file is executable by checking first 4 bytes */
-    int magic_num;
-    int ret = file_read(fd, (void*)&magic_num, EXEC_MAGIC_LEN);
-    if (ret == FAILURE || ret < EXEC_MAGIC_LEN || magic_num != EXEC_MAGIC_STR)
+
+    return mmap_file(fd_array[fd].inode, start);
+}
+
+/*
+ * system_munmap
+ *   DESCRIPTION: Unmaps a file mapped by system_mmap.
+ *        INPUTS: start - address given by system_mmap
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if no file is mapped at start
+ *  SIDE EFFECTS: Unmaps the file's pages
+ */
+int32_t system_munmap(uint8_t* start)
+{
+    return mmap_unmap((uint32_t)start);
+}
+
+/*
+ * system_getdents
+ *   DESCRIPTION: Reads as many directory records as fit in buf with a single
+ *                system call.
+ *        INPUTS: fd - file descriptor index of a directory
+ *                nbytes - size of buf in bytes
+ *       OUTPUTS: buf - buffer in the user program in which to place records
+ *  RETURN VALUE: Number of bytes placed in buf, 0 at the end of the directory,
+ *                or FAILURE if fd is not an open directory or buf is invalid
+ *  SIDE EFFECTS: Advances the directory's file position
+ */
+int32_t system_getdents(int32_t fd, void* buf, int32_t nbytes)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid fd of a directory and buffer inside the program page */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE ||
+        fd_array[fd].file_ops != &dir_type_op_table || nbytes < 0 ||
+        __validate_user_range((uint32_t)buf, nbytes) == FAILURE)
+        return FAILURE;
+
+    return dir_getdents(fd, buf, nbytes);
+}
+
+/*
+ * system_stat
+ *   DESCRIPTION: Calls appropriate stat function from the given FD's
+ *                file_op_table.
+ *        INPUTS: fd - file descriptor index
+ *       OUTPUTS: buf - stat_t in the user program to fill in
+ *  RETURN VALUE: Return value of file's stat function or FAILURE for invalid
+ *                FD, invalid buf, or no stat function.
+ *  SIDE EFFECTS: none
+ */
+int32_t system_stat(int32_t fd, stat_t* buf)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid fd and buffer inside the program page */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE ||
+        __validate_user_range((uint32_t)buf, sizeof(stat_t)) == FAILURE)
+        return FAILURE;
+
+    if (fd_array[fd].file_ops->stat != NULL)
+        return fd_array[fd].file_ops->stat(fd, buf);
+
+    return FAILURE;
+}
+
+/*
+ * system_lseek
+ *   DESCRIPTION: Calls appropriate lseek function from the given FD's
+ *                file_op_table.
+ *        INPUTS: fd - file descriptor index
+ *                offset - distance to move from whence
+ *                whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *       OUTPUTS: none
+ *  RETURN VALUE: New file position or FAILURE for invalid FD or no lseek
+ *                function.
+ *  SIDE EFFECTS: Moves the file position
+ */
+int32_t system_lseek(int32_t fd, int32_t offset, int32_t whence)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid fd */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE)
+        return FAILURE;
+
+    if (fd_array[fd].file_ops->lseek != NULL)
+        return fd_array[fd].file_ops->lseek(fd, offset, whence);
+
+    return FAILURE;
+}
+
+/*
+ * system_pread
+ *   DESCRIPTION: Calls appropriate pread function from the given FD's
+ *                file_op_table. Takes its fourth argument in ESI.
+ *        INPUTS: fd - file descriptor index
+ *                nbytes - number of bytes to read
+ *                offset - position in the file to read from
+ *       OUTPUTS: buf - buffer in the user program in which to place data
+ *  RETURN VALUE: Number of bytes read or FAILURE for invalid FD, invalid buf,
+ *                or no pread function.
+ *  SIDE EFFECTS: none
+ */
+int32_t system_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid fd and buffer inside the program page */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE || nbytes < 0 ||
+        __validate_user_range((uint32_t)buf, nbytes) == FAILURE)
+        return FAILURE;
+
+    if (fd_array[fd].file_ops->pread != NULL)
+        return fd_array[fd].file_ops->pread(fd, buf, nbytes, offset);
+
+    return FAILURE;
+}
+
+/*
+ * system_sendfile
+ *   DESCRIPTION: Prints up to count bytes of a regular file from its file
+ *                position to a terminal without copying through the user
+ *                program. At most SENDFILE_MAX_CHUNK bytes are sent per call,
+ *                with interrupts enabled between short bursts.
+ *        INPUTS: out_fd - file descriptor index of terminal output
+ *                in_fd - file descriptor index of a regular file
+ *                count - maximum number of bytes to send
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of bytes sent, 0 at end of file, or FAILURE for
+ *                invalid FDs or count
+ *  SIDE EFFECTS: Writes to the terminal and advances in_fd's file position
+ */
+int32_t system_sendfile(int32_t out_fd, int32_t in_fd, int32_t count)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid terminal output fd, regular file input fd and count */
+    if (out_fd < 0 || out_fd >= FD_ARRAY_SIZE || fd_array[out_fd].flags == NOT_IN_USE ||
+        fd_array[out_fd].file_ops != &stdout_op_table ||
+        in_fd < 0 || in_fd >= FD_ARRAY_SIZE || fd_array[in_fd].flags == NOT_IN_USE ||
+        fd_array[in_fd].file_ops != &file_type_op_table || count < 0)
+        return FAILURE;
+
+    int32_t length = file_length(fd_array[in_fd].inode);
+    uint32_t position = fd_array[in_fd].file_position;
+    if (length == FAILURE)
+        return FAILURE;
+
+    /* Stop at end of file and at the chunk limit */
+    if (position >= length)
+        return 0;
+    if (count > length - position)
+        count = length - position;
+    if (count > SENDFILE_MAX_CHUNK)
+        count = SENDFILE_MAX_CHUNK;
+
+    int32_t sent = term_write_file(fd_array[in_fd].inode, position, count);
+    fd_array[in_fd].file_position += sent;
+
+    return sent;
+}
+
+/*
+ * system_create
+ *   DESCRIPTION: Creates an empty writable file in the RAM file system and
+ *                opens it.
+ *        INPUTS: filename - name of the new file
+ *       OUTPUTS: none
+ *  RETURN VALUE: File descriptor index or FAILURE if the name is invalid,
+ *                longer than FILENAME_LEN, or already in use, or no file or
+ *                descriptor is free
+ *  SIDE EFFECTS: Adds a directory entry
+ */
+int32_t system_create(const uint8_t* filename)
+{
+    uint8_t name[FILENAME_LEN + 1];
+
+    /* Copy the name in so no scan runs past the program page */
+    if (__copy_user_string(name, filename, sizeof(name)) == FAILURE || tmpfs_create(name) == FAILURE)
+        return FAILURE;
+
+    return system_open(name);
+}
+
+/*
+ * system_truncate
+ *   DESCRIPTION: Sets the length of a file in the RAM file system.
+ *        INPUTS: fd - file descriptor index of a regular file
+ *                length - new length in bytes
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE for invalid FD, boot image files, or not
+ *                enough space
+ *  SIDE EFFECTS: Frees or allocates the file's blocks
+ */
+int32_t system_truncate(int32_t fd, int32_t length)
+{
+    file_t* fd_array = get_current_pcb()->fd_table;
+
+    /* Check for valid fd of a regular file */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd_array[fd].flags == NOT_IN_USE ||
+        fd_array[fd].file_ops != &file_type_op_table)
+        return FAILURE;
+
+    return file_truncate(fd, length);
+}
+
+/*
+ * system_fork
+ *   DESCRIPTION: Spawns a child process running a copy of the caller. The
+ *                child shares the caller's pages copy-on-write, inherits its
+ *                open files, mapped files, shared memory, and arguments, and
+ *                returns 0 from fork. Both processes are on the run queue and
+ *                run concurrently; the caller collects the child's halt
+ *                status with system_wait.
+ *        INPUTS: frame - caller's registers saved by the system call linkage
+ *       OUTPUTS: none
+ *  RETURN VALUE: PID of the child, or FAILURE if out of PIDs or memory
+ *  SIDE EFFECTS: Write protects the caller's pages until they are written
+ */
+int32_t system_fork(syscall_frame_t frame)
+{
+    cli();
+
+    pcb_t* parent_pcb = get_current_pcb();
+    if (parent_pcb == NULL || parent_pcb->page_dir == NULL)
         return FAILURE;
 
-    /* Reset file position */
-    get_current_pcb()->fd_table[fd].file_position = 0;
+    /* Create child PCB */
+    int32_t child_pid = get_new_pid();
+    pcb_t* child_pcb = pcb_setup(child_pid);
+    if (child_pcb == NULL)
+        return FAILURE;
 
-    /* Copy file into program page one byte at a time */
-    uint32_t prog_addr = PROG_VIRT_ADDR + PROG_OFFSET;
-    ret = file_read(fd, (void*)(prog_addr++), 1);
-    while (ret != 0)
+    /* Share the parent's pages, which is still the active PD */
+    if (vm_fork(parent_pcb->page_dir, child_pcb->page_dir) == FAILURE)
     {
-        if (ret == FAILURE)
-            return FAILURE;
-        ret = file_read(fd, (void*)(prog_addr++), 1);
+        pcb_teardown();     /* Reverts current pid to parent */
+        return FAILURE;
     }
 
-    /* Close file */
-    file_close(fd);
+    /* Inherit everything execute would have set up */
+    memcpy(child_pcb->args, parent_pcb->args, sizeof(child_pcb->args));
+    child_pcb->args_len = parent_pcb->args_len;
+    child_pcb->exec_inode = parent_pcb->exec_inode;
+    child_pcb->exec_length = parent_pcb->exec_length;
+    child_pcb->vid_map_called = parent_pcb->vid_map_called;
+    memcpy(child_pcb->fd_table, parent_pcb->fd_table, sizeof(child_pcb->fd_table));
+    child_pcb->fd_map = parent_pcb->fd_map;
+    pipe_inherit(child_pid);
+    memcpy(child_pcb->mmaps, parent_pcb->mmaps, sizeof(child_pcb->mmaps));
+    if (parent_pcb->mmap_table != NULL)
+        child_pcb->mmap_table = (uint32_t*)(child_pcb->page_dir[MMAP_VIRT_ADDR >> BITS_TO_PD_IDX] & FLAG_MASK);
+    memcpy(child_pcb->shms, parent_pcb->shms, sizeof(child_pcb->shms));
+    shm_inherit(child_pid);
+    child_pcb->forked = 1;
+
+    /* The child first runs when the scheduler switches to it */
+    __fork_child_stack(child_pcb, &frame);
+
+    /* Keep running the parent next to its child */
+    set_current_pcb(parent_pcb);
+    schedule_enqueue(parent_pcb);
+
+    sti();
+    return child_pid;
+}
+
+/*
+ * system_shmget
+ *   DESCRIPTION: Gets the shared memory segment of the given key, creating it
+ *                if needed.
+ *        INPUTS: key - positive name of the segment
+ *                size - bytes needed
+ *       OUTPUTS: none
+ *  RETURN VALUE: Segment ID or FAILURE if the key or size is invalid, or no
+ *                segment or memory is left
+ *  SIDE EFFECTS: May allocate the segment's pages
+ */
+int32_t system_shmget(int32_t key, int32_t size)
+{
+    return shm_get(key, size);
+}
+
+/*
+ * system_shmat
+ *   DESCRIPTION: Maps a shared memory segment writable into the caller's
+ *                address space.
+ *        INPUTS: id - segment ID from system_shmget
+ *                start - pointer to a location in the user program holding a
+ *                page aligned address in the shared memory area, or NULL for
+ *                the kernel to choose
+ *       OUTPUTS: start - address at which the segment is mapped
+ *  RETURN VALUE: Size of the segment in bytes or FAILURE if the segment,
+ *                start, or address is invalid
+ *  SIDE EFFECTS: Maps 4 KB user-accessible read/write pages to the segment
+ */
+int32_t system_shmat(int32_t id, uint8_t** start)
+{
+    if (__validate_user_ptr((uint32_t)start) == FAILURE)
+        return FAILURE;
+
+    return shm_attach(id, start);
+}
+
+/*
+ * system_shmdt
+ *   DESCRIPTION: Unmaps a segment mapped by system_shmat.
+ *        INPUTS: start - address given by system_shmat
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if no segment is attached at start
+ *  SIDE EFFECTS: Unmaps the segment's pages
+ */
+int32_t system_shmdt(uint8_t* start)
+{
+    return shm_detach((uint32_t)start);
+}
+
+/*
+ * system_pipe
+ *   DESCRIPTION: Creates a pipe and opens its read and write ends.
+ *        INPUTS: none
+ *       OUTPUTS: fds - array of two FDs in the user program: the read end
+ *                followed by the write end
+ *  RETURN VALUE: SUCCESS or FAILURE if fds is invalid or no pipe or FDs are
+ *                left
+ *  SIDE EFFECTS: Marks two FDs as in use
+ */
+int32_t system_pipe(int32_t* fds)
+{
+    if (__validate_user_ptr((uint32_t)fds) == FAILURE ||
+        __validate_user_ptr((uint32_t)(fds + 2) - 1) == FAILURE)
+        return FAILURE;
+
+    return pipe_create(fds);
+}
+
+/*
+ * system_setprio
+ *   DESCRIPTION: Sets the current process' share of the processor relative
+ *                to other runnable processes. Children start with their
+ *                parent's priority.
+ *        INPUTS: priority - SCHED_PRIO_MIN (1) to SCHED_PRIO_MAX (8), the
+ *                default is SCHED_PRIO_DEFAULT (4)
+ *       OUTPUTS: none
+ *  RETURN VALUE: Previous priority or FAILURE if priority is out of range
+ *  SIDE EFFECTS: none
+ */
+int32_t system_setprio(int32_t priority)
+{
+    return schedule_set_priority(get_current_pcb(), priority);
+}
+
+/*
+ * system_wait
+ *   DESCRIPTION: Waits for a child created by system_fork to halt.
+ *        INPUTS: pid - PID returned by system_fork
+ *       OUTPUTS: none
+ *  RETURN VALUE: Child's halt status or FAILURE if pid is not a forked child
+ *                of the caller
+ *  SIDE EFFECTS: Blocks the caller until the child halts, frees the child
+ */
+int32_t system_wait(int32_t pid)
+{
+    return pcb_wait(pid);
+}
+
+/*
+ * __load_program
+ *   DESCRIPTION: Looks up given file and makes it the executable backing a
+ *                process' program area. The executable cache validates the
+ *                image; nothing is copied until the program touches its pages.
+ *                Returns the program's entry point (initial instruction
+ *                pointer).
+ *        INPUTS: pcb - process being spawned
+ *                filename - executable file to load
+ *       OUTPUTS: none
+ *  RETURN VALUE: Loaded program's IP or FAILURE if file is not found, is not
+ *                an executable, or is too large.
+ *  SIDE EFFECTS: Sets executable of PCB
+ */
+int32_t __load_program(pcb_t* pcb, const uint8_t* filename)
+{
+    dentry_t dentry;
+    int32_t eip;
+
+    /* Look up file once */
+    if (read_dentry_by_name(filename, &dentry) != SUCCESS || dentry.filetype != FILE_TYPE)
+        return FAILURE;
+
+    eip = exec_cache_load(&dentry, &pcb->exec_length);
+    if (eip == FAILURE)
+        return FAILURE;
 
-    /* If successful, return entry point of program */
-    return *((uint32_t*)(PROG_VIRT_ADDR + PROG_OFFSET + PROG_EIP_OFF));
+    pcb->exec_inode = dentry.inode_num;
+    return eip;
 }
 
 /*
- * get_prog_phys_addr
- *   DESCRIPTION: Gets physical address of a 4 MB block based on the program's
- *                PID.
- *        INPUTS: pid - proccess ID number
+ * get_exec_stats
+ *   DESCRIPTION: Gets execute latency statistics.
+ *        INPUTS: none
  *       OUTPUTS: none
- *  RETURN VALUE: Physical address of program block
+ *  RETURN VALUE: Pointer to execute latency statistics
  *  SIDE EFFECTS: none
  */
-uint32_t get_prog_phys_addr(int32_t pid)
+exec_stats_t* get_exec_stats(void)
+{
+    return &exec_stats;
+}
+
+/*
+ * __fork_child_stack
+ *   DESCRIPTION: Builds the kernel stack a forked child starts on. It holds a
+ *                copy of the parent's system call frame below a return
+ *                address to fork_child_return, laid out the way schedule_next
+ *                leaves a paused process, so the first switch to the child
+ *                returns to the user program from fork.
+ *        INPUTS: pcb - forked child
+ *                frame - parent's registers saved by the system call linkage
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Writes to the child's kernel stack
+ */
+void __fork_child_stack(pcb_t* pcb, syscall_frame_t* frame)
+{
+    uint32_t top = get_kstack_addr(pcb->pid);
+    syscall_frame_t* child_frame = (syscall_frame_t*)(top - sizeof(syscall_frame_t));
+    uint32_t* slot = (uint32_t*)child_frame;
+
+    *child_frame = *frame;
+    child_frame->kernel_esp = (uint32_t)&child_frame->ebp;
+    child_frame->eflags |= 0x200;
+
+    /* schedule_next ends with leave and ret */
+    *--slot = (uint32_t)fork_child_return;
+    *--slot = 0;
+    pcb->kernel_esp = (uint32_t)slot;
+    pcb->kernel_ebp = (uint32_t)slot;
+    pcb->tss_esp0 = top;
+}
+
+/*
+ * __record_exec_latency
+ *   DESCRIPTION: Adds the latency of one execute to the statistics.
+ *        INPUTS: cycles - TSC cycles taken to spawn the program
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Updates exec_stats
+ */
+void __record_exec_latency(uint32_t cycles)
 {
-    return KERNEL_LOC_END + ((pid - 1) * PROG_PAGE_SIZE);
+    if (exec_stats.count == 0 || cycles < exec_stats.min_cycles)
+        exec_stats.min_cycles = cycles;
+    if (cycles > exec_stats.max_cycles)
+        exec_stats.max_cycles = cycles;
+
+    exec_stats.last_cycles = cycles;
+    exec_stats.total_kcycles += cycles / 1000;
+    ++exec_stats.count;
 }
 
 /*
@@ -545,6 +1037,52 @@ int32_t __validate_user_ptr(uint32_t ptr)
     return FAILURE;
 }
 
+/*
+ * __validate_user_range
+ *   DESCRIPTION: Checks that every byte of a buffer lies within the user
+ *                program page.
+ *        INPUTS: ptr - first byte of the buffer
+ *                len - size of the buffer in bytes
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS/FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t __validate_user_range(uint32_t ptr, uint32_t len)
+{
+    if (__validate_user_ptr(ptr) == SUCCESS && len <= PROG_VIRT_ADDR + PROG_PAGE_SIZE - ptr)
+        return SUCCESS;
+
+    return FAILURE;
+}
+
+/*
+ * __copy_user_string
+ *   DESCRIPTION: Copies a NUL terminated string out of the user program
+ *                page, reading no byte outside of it.
+ *        INPUTS: src - string in the user program page
+ *                size - size of dst, including the terminating NUL
+ *       OUTPUTS: dst - kernel buffer receiving the string
+ *  RETURN VALUE: SUCCESS or FAILURE if src leaves the program page or the
+ *                string does not fit in size bytes
+ *  SIDE EFFECTS: none
+ */
+int32_t __copy_user_string(uint8_t* dst, const uint8_t* src, uint32_t size)
+{
+    uint32_t i;
+
+    for (i = 0; i < size; ++i)
+    {
+        if (__validate_user_ptr((uint32_t)(src + i)) == FAILURE)
+            return FAILURE;
+
+        dst[i] = src[i];
+        if (dst[i] == '\0')
+            return SUCCESS;
+    }
+
+    return FAILURE;
+}
+
 /* static_start_shell
  *   DESCRIPTION: Statically start shell 2 or 3. Sets up a fake stack to allow
  *                  for scheduling switches and standard execution.
@@ -552,45 +1090,43 @@ int32_t __validate_user_ptr(uint32_t ptr)
  *       OUTPUTS: N/A
  *  RETURN VALUE: SUCCESS or FAILURE
  *  SIDE EFFECTS: Sets up fake stack in kernel space for programs 2/3
- *                Updates active_pid array
+ *                Adds shell to the run queue
  */
 int32_t static_start_shell(int32_t pid)
 {
+    uint32_t exec_start = rdtsc();
     uint8_t filename[] = "shell";
 
     /* PID must be 2, or 3 */
     if (pid < 2 || pid > 3)
         return FAILURE;
 
-    /* Create PCB */
+    /* Create PCB, parent is the kernel */
+    pcb_t* kernel_pcb = get_current_pcb();
     pcb_t* child_pcb = pcb_setup(pid);
-    active_pid[0] = 0;  /* This happens before scheduling so active_pid[0] is accidentally overwritten */
     if (child_pcb == NULL)
         return FAILURE;
 
-    /* Modify PCB's parent - should be 0 for kernel */
-    child_pcb->parent_pid = 0;
+    /* Shell runs in its own terminal */
+    child_pcb->group = pid - 1;
 
     /* Starter shells have no arguments */
     child_pcb->args[0] = '\0';
     child_pcb->args_len = 0;
 
-    /* Map program page */
-    map_page(PROG_VIRT_ADDR, get_prog_phys_addr(child_pcb->pid), TRUE, TRUE, TRUE);
-
-    /* Load program */
-    uint32_t program_eip = __load_program(filename);
+    /* Load program, its pages are filled in once the scheduler runs it */
+    uint32_t program_eip = __load_program(child_pcb, filename);
     if (program_eip == FAILURE) 
     {
         /* Clean up */
-        map_page(PROG_VIRT_ADDR, get_prog_phys_addr(child_pcb->parent_pid), TRUE, TRUE, TRUE);
         pcb_teardown();
         return FAILURE;
     }
 
-    /* Fill active pid number for scheduler  -- should happen after cleanup to
-       override kernel default values */
-    active_pid[pid - 1] = pid;
+    /* The kernel keeps running, the shell waits on the run queue until the
+       scheduler picks it */
+    set_current_pcb(kernel_pcb);
+    schedule_enqueue(kernel_pcb);
 
     /* Set EIP in PCB to entry point of program */
     child_pcb->eip = program_eip;
@@ -601,6 +1137,8 @@ int32_t static_start_shell(int32_t pid)
     /* Set tss_esp0 to be initial base of kernel stack */
     child_pcb->tss_esp0 = get_kstack_addr(child_pcb->pid);
 
+    __record_exec_latency(rdtsc() - exec_start);
+
     /* Set kernel esp and ebp in PCB to frame of schedule_next() (18 4-byte words above base of stack) */
     child_pcb->kernel_ebp = child_pcb->tss_esp0 - CHILD_EBP_OFF;
     child_pcb->kernel_esp = child_pcb->kernel_ebp - SIZE_VARS_SCHEDULING;
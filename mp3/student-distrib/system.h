@@ -2,6 +2,7 @@
 #define SYSTEM_H_
 
 #include "types.h"
+#include "file.h"
 
 #define HALT_CODE_EXC           256         /* Return value of halt when an exception stops the program */
 
@@ -14,6 +15,34 @@
 #define EXEC_MAGIC_LEN          4
 #define EXEC_MAGIC_STR          0x464C457F
 #define MAX_NUM_ARGS            3
+#define SENDFILE_MAX_CHUNK      0x10000     /* Most bytes sendfile prints per call */
+
+/* Registers saved by system_call_handler followed by the processor's IRET
+ * context, as found above the return address of a system call function */
+typedef struct syscall_frame {
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+    uint32_t esi;
+    uint32_t kernel_esp;
+    uint32_t ebp;
+    uint32_t edi;
+    uint32_t eip;
+    uint32_t cs;
+    uint32_t eflags;
+    uint32_t esp;
+    uint32_t ss;
+} syscall_frame_t;
+
+/* Execute latency statistics, in TSC cycles from entering execute to
+ * switching into the new program */
+typedef struct exec_stats {
+    uint32_t count;
+    uint32_t last_cycles;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint32_t total_kcycles;             /* Sum in thousands of cycles, wraps only after hours */
+} exec_stats_t;
 
 extern void system_call_handler(void);
 extern uint32_t sys_call(uint32_t sys_call_number, uint32_t param1, uint32_t param2, uint32_t param3);
@@ -29,9 +58,25 @@ int32_t system_getargs(uint8_t* buf, int32_t nbytes);
 int32_t system_vidmap(uint8_t** screen_start);
 int32_t system_sethandler (int32_t signum, void* handler_address);
 int32_t system_sigreturn(void);
+int32_t system_mmap(int32_t fd, uint8_t** start);
+int32_t system_munmap(uint8_t* start);
+int32_t system_getdents(int32_t fd, void* buf, int32_t nbytes);
+int32_t system_stat(int32_t fd, stat_t* buf);
+int32_t system_lseek(int32_t fd, int32_t offset, int32_t whence);
+int32_t system_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+int32_t system_sendfile(int32_t out_fd, int32_t in_fd, int32_t count);
+int32_t system_create(const uint8_t* filename);
+int32_t system_truncate(int32_t fd, int32_t length);
+int32_t system_fork(syscall_frame_t frame);
+int32_t system_shmget(int32_t key, int32_t size);
+int32_t system_shmat(int32_t id, uint8_t** start);
+int32_t system_shmdt(uint8_t* start);
+int32_t system_pipe(int32_t* fds);
+int32_t system_setprio(int32_t priority);
+int32_t system_wait(int32_t pid);
 
 /* Other helper functions */
-uint32_t get_prog_phys_addr(int32_t pid);
+exec_stats_t* get_exec_stats(void);
 
 
 #endif /* SYSTEM_H_ */
@@ -5,23 +5,29 @@
 #include "pcb.h"
 #include "paging.h"
 #include "scheduler.h"
+#include "file_sys.h"
+#include "frame.h"
 
 /* Local Helpers, see func def comments */
 int8_t __add_char_to_term(uint8_t);
 void __backspace_term(void);
 void __print_char(char);
-uint32_t get_video_save_page(int32_t);
+void __begin_output(int32_t, term_output_t*);
+void __end_output(int32_t, term_output_t*);
 
 /* Save states for working terminals */
 static term_struct_t terms[MAX_PROCESS_GROUPS];
 
+/* Frames holding the video memory of groups that are not visible */
+static uint32_t video_save_pages[MAX_PROCESS_GROUPS];
+
 /* term_init 
  *  DESCRIPTION: Initializes stdin/stdout file op tables, clears out terms,
                  sets current terminal to be 0
  *       INPUTS: None
  *      OUTPUTS: None
  * RETURN VALUE: None
- * SIDE EFFECTS: None
+ * SIDE EFFECTS: Allocates and blanks a video save page for each group
  */
 void term_init()
 {
@@ -32,34 +38,46 @@ void term_init()
     stdin_op_table.write = NULL;
     stdin_op_table.open = term_open;
     stdin_op_table.close = term_close;
+    stdin_op_table.stat = NULL;
+    stdin_op_table.lseek = NULL;
+    stdin_op_table.pread = NULL;
 
     /* Initialize stdout file_op_table */
     stdout_op_table.read = NULL;
     stdout_op_table.write = term_write;
     stdout_op_table.open = term_open;
     stdout_op_table.close = term_close;
+    stdout_op_table.stat = NULL;
+    stdout_op_table.lseek = NULL;
+    stdout_op_table.pread = NULL;
 
     /* Initialize terms and set current term to 0 */
     for (i = 0; i < MAX_PROCESS_GROUPS; i++) {
         terms[i].read_in_progress = 0;
         terms[i].newline_seen = 0;
+        wait_queue_init(&terms[i].readers);
         terms[i].term_buff_size = 0; 
         terms[i].cursor_x = 0;
         terms[i].cursor_y = 0;
+
+        video_save_pages[i] = frame_alloc();
+        if (video_save_pages[i] != NULL)
+            memset_dword((void*)video_save_pages[i], VIDEO_BLANK, PAGE_SIZE / sizeof(uint32_t));
     }
 
     visible_group = 0;
 }
 
 /* term_read 
- *  DESCRIPTION: Reads line-buffered into from kbd into buf
+ *  DESCRIPTION: Reads line-buffered into from kbd into buf, sleeping until
+ *               a line is entered
  *       INPUTS: fd - not used
  *               buf - char ptr in which to store buffered input
  *                     size must be at least TERM_BUFFER_SIZE
  *               nbytes - not used
  *      OUTPUTS: None
  * RETURN VALUE: Number of bytes copied to buf
- * SIDE EFFECTS: None
+ * SIDE EFFECTS: Blocks the current process
  */
 int32_t term_read(int32_t fd, void* buf, int32_t nbytes) {
     long flags;
@@ -69,42 +87,28 @@ int32_t term_read(int32_t fd, void* buf, int32_t nbytes) {
 
     term_struct_t* term_data = &(terms[get_current_group()]);
 
-    while(1) {
-        cli_and_save(flags);
-        if (!(term_data->read_in_progress)) {
-            term_data->read_in_progress = 1;
-            sti();
-            restore_flags(flags);
-            break;
-        }
-        sti();
-        restore_flags(flags);
-    }
+    cli_and_save(flags);
 
-    /* Waits for a newline character */
-    term_data->newline_seen = 0;
-    while(1) {
-        cli_and_save(flags);
-        if (term_data->newline_seen) {
-            sti();
-            restore_flags(flags);
-            break;
-        }
-        sti();
-        restore_flags(flags);
-    }
+    /* Sleeps until no other read is in progress */
+    while (term_data->read_in_progress)
+        wait_queue_sleep(&term_data->readers);
+    term_data->read_in_progress = 1;
 
-    cli_and_save(flags);
+    /* Sleeps until a newline character */
+    term_data->newline_seen = 0;
+    while (!term_data->newline_seen)
+        wait_queue_sleep(&term_data->readers);
 
     /* Read min of nbytes and term_buff_size to buf */
     bytes_to_read = nbytes < term_data->term_buff_size ? nbytes : term_data->term_buff_size;
     memcpy(buf, term_data->term_buff, bytes_to_read);
     term_data->term_buff_size = 0; /* Clear buffer after reading */
 
-    sti();
+    term_data->read_in_progress = 0;
+    wait_queue_wake(&term_data->readers);
+
     restore_flags(flags);
 
-    term_data->read_in_progress = 0;
     return bytes_to_read;
 }
 
@@ -122,6 +126,7 @@ int32_t term_write(int32_t fd, const void* buf, int32_t nbytes) {
     uint8_t * buff = (uint8_t *) buf;
     int i = 0;
     long flags;
+    term_output_t saved;
 
     if (buf == NULL) return -1;
 
@@ -129,37 +134,12 @@ int32_t term_write(int32_t fd, const void* buf, int32_t nbytes) {
 
     cli_and_save(flags);
 
-    if (visible_group == current_group)
-    {
-        /* Print each char in buf to active group */
-        for(i = 0; i < nbytes; i++) {
-            __print_char(buff[i]);
-        }
-    }
-    else
-    {
-        /* Save current video address and cursor position */
-        char* saved_video_mem;
-        int saved_x;
-        int saved_y;
-        get_video_mem(&saved_video_mem);
-        get_cursor(&saved_x, &saved_y);
-        /* Set video address and cursor position to active group */
-        set_video_mem((char *)get_video_save_page(current_group));
-        set_cursor(terms[current_group].cursor_x, terms[current_group].cursor_y);
-
-        /* Print each char in buf to active group */
-        for(i = 0; i < nbytes; i++) {
-            __print_char(buff[i]);
-        }
-
-        /* Save active group's cursor position */
-        get_cursor(&(terms[current_group].cursor_x), &(terms[current_group].cursor_y));
-
-        /* Restore video address and cursor position */
-        set_video_mem(saved_video_mem);
-        set_cursor(saved_x, saved_y);
+    /* Print each char in buf to active group */
+    __begin_output(current_group, &saved);
+    for(i = 0; i < nbytes; i++) {
+        __print_char(buff[i]);
     }
+    __end_output(current_group, &saved);
 
     sti();
     restore_flags(flags);
@@ -167,6 +147,66 @@ int32_t term_write(int32_t fd, const void* buf, int32_t nbytes) {
     return i;
 }
 
+/* term_write_file
+ *  DESCRIPTION: Prints count bytes of a file starting at offset straight from
+ *               its data blocks instead of through a user buffer. Interrupts
+ *               are disabled for at most TERM_FILE_CHUNK bytes at a time, like
+ *               a short term_write. Files on disk are read through a small
+ *               buffer with interrupts enabled
+ *       INPUTS: inode - inode number of the file
+ *               offset - position in the file of the first byte to print
+ *               count - number of bytes to print
+ *      OUTPUTS: None
+ * RETURN VALUE: Number of bytes actually written, which is less than count
+ *               if the file ends first
+ * SIDE EFFECTS: Writes to the current group's terminal
+ */
+int32_t term_write_file(uint32_t inode, uint32_t offset, int32_t count) {
+    int32_t sent = 0;
+    uint32_t i, run, pos_in_block;
+    uint8_t* block;
+    uint8_t chunk[TERM_FILE_CHUNK];
+    long flags;
+    term_output_t saved;
+
+    int current_group = get_current_group();
+
+    while (sent < count) {
+        run = count - sent < TERM_FILE_CHUNK ? count - sent : TERM_FILE_CHUNK;
+
+        cli_and_save(flags);
+
+        /* Print the next piece of this block or of the request */
+        block = get_data_block(inode, offset / BLOCK_SIZE);
+        if (block != NULL) {
+            pos_in_block = offset % BLOCK_SIZE;
+            if (run > BLOCK_SIZE - pos_in_block)
+                run = BLOCK_SIZE - pos_in_block;
+        } else {
+            /* Block is not in memory, copy the next piece out of the file */
+            restore_flags(flags);
+            if (read_data(inode, offset, chunk, run) != run)
+                break;
+            cli_and_save(flags);
+            block = chunk;
+            pos_in_block = 0;
+        }
+
+        __begin_output(current_group, &saved);
+        for (i = 0; i < run; i++) {
+            __print_char(block[pos_in_block + i]);
+        }
+        __end_output(current_group, &saved);
+
+        restore_flags(flags);
+
+        sent += run;
+        offset += run;
+    }
+
+    return sent;
+}
+
 /* term_open
  *  DESCRIPTION: Opens either stdin or stdout given either of those filenames
  *               by getting the next available fd in the current PCB and
@@ -194,7 +234,7 @@ int32_t term_open(const uint8_t* filename)
         fd_array[fd].file_ops = &stdin_op_table;
         fd_array[fd].inode = 0;
         fd_array[fd].file_position = INIT_FILE_POS;
-        fd_array[fd].flags = IN_USE;
+        claim_fd(fd);
 
         return fd;
     }
@@ -210,7 +250,7 @@ int32_t term_open(const uint8_t* filename)
         fd_array[fd].file_ops = &stdout_op_table;
         fd_array[fd].inode = 0;
         fd_array[fd].file_position = INIT_FILE_POS;
-        fd_array[fd].flags = IN_USE;
+        claim_fd(fd);
 
         return fd;
     }
@@ -239,7 +279,7 @@ int32_t term_close(int32_t fd)
 
     /* Mark file descriptor as not in use */
     fd_array[fd].file_ops = NULL;
-    fd_array[fd].flags = NOT_IN_USE;
+    release_fd(fd);
     return SUCCESS;
 }
 
@@ -318,6 +358,7 @@ int8_t __add_char_to_term(uint8_t c) {
             if (!visible_term->read_in_progress) {
                 visible_term->term_buff_size = 0;
             }
+            wait_queue_wake(&visible_term->readers);
         }
 
         sti();
@@ -407,7 +448,7 @@ int32_t switch_term(int32_t group_num) {
 
 /* get_video_save_page
  *  DESCRIPTION: Returns virtual address of save page for group_num
- *       INPUTS: group_num - 0 to MAX_PROCESS_GROUPS
+ *       INPUTS: group_num - 0 to MAX_PROCESS_GROUPS - 1
  *      OUTPUTS: N/A
  * RETURN VALUE: Address of video save page for group_num
  * SIDE EFFECTS: N/A
@@ -415,9 +456,52 @@ int32_t switch_term(int32_t group_num) {
 uint32_t get_video_save_page(int32_t group_num)
 {
     /* Ensure that input is a valid group number */
-    if (group_num < 0 || group_num > MAX_PROCESS_GROUPS)
+    if (group_num < 0 || group_num >= MAX_PROCESS_GROUPS)
         return FAILURE;
 
-    /* Calculate virtual address of corresponding group */
-    return VIDEO_GROUP_1 + group_num * PAGE_SIZE;
+    /* Frames are identity mapped, so this is also the physical address */
+    return video_save_pages[group_num];
+}
+
+/* __begin_output
+ *  DESCRIPTION: Points video memory and the cursor at a group's terminal so
+ *               __print_char writes to it. Groups that are not visible print
+ *               to their video save page. Call with interrupts disabled.
+ *       INPUTS: group - process group to print to
+ *      OUTPUTS: saved - video address and cursor to restore afterwards
+ * RETURN VALUE: None
+ * SIDE EFFECTS: Changes video address and cursor position for hidden groups
+ */
+void __begin_output(int32_t group, term_output_t* saved) {
+    if (visible_group == group)
+        return;
+
+    /* Save current video address and cursor position */
+    get_video_mem(&saved->video_mem);
+    get_cursor(&saved->cursor_x, &saved->cursor_y);
+
+    /* Set video address and cursor position to active group */
+    set_video_mem((char *)get_video_save_page(group));
+    set_cursor(terms[group].cursor_x, terms[group].cursor_y);
+}
+
+/* __end_output
+ *  DESCRIPTION: Undoes __begin_output for the same group
+ *       INPUTS: group - process group that was printed to
+ *               saved - state filled by __begin_output
+ *      OUTPUTS: None
+ * RETURN VALUE: None
+ * SIDE EFFECTS: Saves a hidden group's cursor and restores video address and
+ *               cursor position
+ */
+void __end_output(int32_t group, term_output_t* saved) {
+    if (visible_group == group)
+        return;
+
+    /* Save active group's cursor position */
+    get_cursor(&(terms[group].cursor_x), &(terms[group].cursor_y));
+
+    /* Restore video address and cursor position */
+    set_video_mem(saved->video_mem);
+    set_cursor(saved->cursor_x, saved->cursor_y);
 }
@@ -4,9 +4,12 @@
 #include "types.h"
 #include "file.h"
 #include "pcb.h"
+#include "wait_queue.h"
 
 #define TERM_BUFFER_SIZE    128
 #define TAB_SIZE            4
+#define TERM_FILE_CHUNK     256     /* Bytes printed per burst with interrupts off, and copied at a time from files not in memory */
+#define VIDEO_BLANK         0x07200720  /* Two spaces, light grey on black */
 
 file_op_table_t stdin_op_table;
 file_op_table_t stdout_op_table;
@@ -14,16 +17,25 @@ file_op_table_t stdout_op_table;
 typedef struct term_struct {
     volatile uint8_t read_in_progress;
     volatile uint8_t newline_seen;
+    wait_queue_t readers;               /* Woken by newlines and finished reads */
     uint8_t term_buff[TERM_BUFFER_SIZE]; /* Single Buffer, flushed by \n */
     unsigned term_buff_size; 
     int cursor_x;
     int cursor_y;
 } term_struct_t;
 
+/* Video address and cursor saved while printing to a hidden group */
+typedef struct term_output {
+    char* video_mem;
+    int cursor_x;
+    int cursor_y;
+} term_output_t;
+
 void term_init();
 
 int32_t term_read(int32_t fd, void* buf, int32_t nbytes);
 int32_t term_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t term_write_file(uint32_t inode, uint32_t offset, int32_t count);
 int32_t term_open(const uint8_t* filename);
 int32_t term_close(int32_t fd);
 
@@ -31,5 +43,6 @@ void clear_term(void);
 int8_t add_char_term(uint8_t c);
 
 int32_t switch_term(int32_t group_num);
+uint32_t get_video_save_page(int32_t group_num);
 
 #endif
@@ -9,16 +9,26 @@
 #include "file.h"
 #include "system.h"
 #include "pcb.h"
+#include "exec_cache.h"
+#include "tmpfs.h"
+#include "bcache.h"
+#include "frame.h"
+#include "kmalloc.h"
+#include "vm.h"
+#include "shm.h"
+#include "pipe.h"
+#include "scheduler.h"
 
 
 #define PASS 1
 #define FAIL 0
+#define SKIP 2                          /* Test could not run in this environment */
 
 /* format these macros as you see fit */
 #define TEST_HEADER 	\
     printf("[TEST %s] Running %s at %s:%d\n", __FUNCTION__, __FUNCTION__, __FILE__, __LINE__)
 #define TEST_OUTPUT(name, result)	\
-    printf("[TEST %s] Result = %s\n", name, (result) ? "PASS" : "FAIL");
+    printf("[TEST %s] Result = %s\n", name, __test_result(result));
 #define TEST_FINISHED \
     printf("[TEST %s] Finished %s:%d\n", __FUNCTION__, __FILE__, __LINE__)
 
@@ -29,6 +39,12 @@ static inline void assertion_failure(){
     asm volatile("int $15");
 }
 
+static inline const char* __test_result(int result){
+    if (result == SKIP)
+        return "SKIP";
+    return result ? "PASS" : "FAIL";
+}
+
 #if RUN_TESTS
 
 /* Checkpoint 1 tests */
@@ -680,6 +696,381 @@ int test_read_all_files()
         return PASS;
 }
 
+/*
+ * test_file_read_cursor
+ *   DESCRIPTION: Reads a multi-block file in odd sized chunks through the
+ *                sequential read cursor and compares each chunk with
+ *                read_data at the same offset, then rewinds the file
+ *                position and checks the first chunk again.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: file_read() cursor, read_data()
+ *         FILES: file_sys.c/h, file.h
+ */
+int test_file_read_cursor()
+{
+    uint8_t filename[] = "fish";
+    uint8_t cursor_buf[TERM_BUFFER_SIZE];
+    uint8_t data_buf[TERM_BUFFER_SIZE];
+    uint32_t offset = 0;
+    int32_t ret, i;
+    dentry_t dentry;
+
+    if (read_dentry_by_name(filename, &dentry) != SUCCESS)
+        return FAIL;
+
+    int32_t fd = system_open(filename);
+    if (fd == FAILURE)
+        return FAIL;
+
+    /* Chunk size does not divide BLOCK_SIZE so reads straddle blocks */
+    while ((ret = file_read(fd, cursor_buf, TERM_BUFFER_SIZE - 1)) > 0)
+    {
+        if (read_data(dentry.inode_num, offset, data_buf, TERM_BUFFER_SIZE - 1) != ret)
+            return FAIL;
+        for (i = 0; i < ret; ++i)
+            if (cursor_buf[i] != data_buf[i])
+                return FAIL;
+        offset += ret;
+    }
+
+    /* Rewinding must invalidate the cursor */
+    get_current_pcb()->fd_table[fd].file_position = 0;
+    ret = file_read(fd, cursor_buf, TERM_BUFFER_SIZE - 1);
+    read_data(dentry.inode_num, 0, data_buf, TERM_BUFFER_SIZE - 1);
+    for (i = 0; i < ret; ++i)
+        if (cursor_buf[i] != data_buf[i])
+            return FAIL;
+
+    system_close(fd);
+
+    return offset > BLOCK_SIZE ? PASS : FAIL;
+}
+
+/*
+ * test_dir_getdents
+ *   DESCRIPTION: Reads the directory a few records per call with dir_getdents
+ *                and compares each record with the name dir_read returns and
+ *                that name's dentry.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: dir_getdents()
+ *         FILES: file_sys.c/h, file.h
+ */
+int test_dir_getdents()
+{
+    uint8_t dir_name[] = ".";
+    uint8_t name[FILENAME_LEN + 1];
+    dirent_t records[GETDENTS_BATCH];
+    dentry_t dentry;
+    int32_t ret, i;
+
+    int32_t fd = system_open(dir_name);
+    int32_t name_fd = system_open(dir_name);
+    if (fd == FAILURE || name_fd == FAILURE)
+        return FAIL;
+
+    /* Too small for one record */
+    if (dir_getdents(fd, records, sizeof(dirent_t) - 1) != FAILURE)
+        return FAIL;
+
+    name[FILENAME_LEN] = '\0';
+    while ((ret = dir_getdents(fd, records, sizeof(records))) > 0)
+    {
+        if (ret % sizeof(dirent_t) != 0)
+            return FAIL;
+        for (i = 0; i < ret / sizeof(dirent_t); ++i)
+        {
+            if (dir_read(name_fd, name, FILENAME_LEN) <= 0 ||
+                strncmp(records[i].filename, (int8_t*)name, FILENAME_LEN) != 0 ||
+                read_dentry_by_name(name, &dentry) != SUCCESS ||
+                records[i].filetype != dentry.filetype || records[i].inode_num != dentry.inode_num)
+                return FAIL;
+            if (dentry.filetype == FILE_TYPE && records[i].length != file_length(dentry.inode_num))
+                return FAIL;
+        }
+    }
+
+    /* Both must reach the end of the directory together */
+    if (ret == FAILURE || dir_read(name_fd, name, FILENAME_LEN) != 0)
+        return FAIL;
+
+    system_close(fd);
+    system_close(name_fd);
+
+    return PASS;
+}
+
+/*
+ * test_stat_lseek_pread
+ *   DESCRIPTION: Checks stat against the file's inode, seeks around a file
+ *                and compares reads at each position and pread at the same
+ *                offsets with read_data.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: file_stat(), file_lseek(), file_pread(), dir_stat(), dir_lseek()
+ *         FILES: file_sys.c/h, file.h
+ */
+int test_stat_lseek_pread()
+{
+    uint8_t filename[] = "fish";
+    uint8_t dir_name[] = ".";
+    uint8_t read_buf[BUF_SIZE];
+    uint8_t data_buf[BUF_SIZE];
+    int32_t offsets[] = {0, BLOCK_SIZE - BUF_SIZE / 2, BLOCK_SIZE * 3, 1};
+    dentry_t dentry;
+    stat_t st;
+    int32_t i, j, ret;
+
+    if (read_dentry_by_name(filename, &dentry) != SUCCESS)
+        return FAIL;
+
+    int32_t fd = system_open(filename);
+    int32_t dir_fd = system_open(dir_name);
+    if (fd == FAILURE || dir_fd == FAILURE)
+        return FAIL;
+
+    if (file_stat(fd, &st) != SUCCESS || st.filetype != FILE_TYPE ||
+        st.inode_num != dentry.inode_num || st.length != file_length(dentry.inode_num))
+        return FAIL;
+
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i)
+    {
+        if (file_lseek(fd, offsets[i], SEEK_SET) != offsets[i])
+            return FAIL;
+        ret = file_read(fd, read_buf, BUF_SIZE);
+        if (ret != read_data(dentry.inode_num, offsets[i], data_buf, BUF_SIZE))
+            return FAIL;
+        for (j = 0; j < ret; ++j)
+            if (read_buf[j] != data_buf[j])
+                return FAIL;
+
+        /* pread must not move the file position */
+        if (file_pread(fd, read_buf, BUF_SIZE, offsets[i]) != ret ||
+            file_lseek(fd, 0, SEEK_CUR) != offsets[i] + ret)
+            return FAIL;
+        for (j = 0; j < ret; ++j)
+            if (read_buf[j] != data_buf[j])
+                return FAIL;
+    }
+
+    /* End of file and invalid positions */
+    if (file_lseek(fd, 0, SEEK_END) != st.length || file_read(fd, read_buf, BUF_SIZE) != 0 ||
+        file_lseek(fd, -st.length - 1, SEEK_END) != FAILURE || file_lseek(fd, 0, SEEK_END + 1) != FAILURE)
+        return FAIL;
+
+    /* Directories seek by entry */
+    if (dir_stat(dir_fd, &st) != SUCCESS || st.filetype != DIR_TYPE ||
+        dir_lseek(dir_fd, 0, SEEK_END) != st.length || dir_read(dir_fd, read_buf, BUF_SIZE) != 0 ||
+        dir_lseek(dir_fd, 0, SEEK_SET) != 0 || dir_read(dir_fd, read_buf, BUF_SIZE) <= 0)
+        return FAIL;
+
+    system_close(fd);
+    system_close(dir_fd);
+
+    return PASS;
+}
+
+/*
+ * test_tmpfs
+ *   DESCRIPTION: Creates a RAM file, writes across a block boundary, reads it
+ *                back, truncates it and checks that boot image files stay
+ *                read-only, as do RAM files while a process executes them.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Leaves an empty file "tmpfs_test" in the RAM file system,
+ *                since RAM files cannot be removed
+ *      COVERAGE: file_write(), file_truncate(), tmpfs_create(), read_dentry_by_name(),
+ *                pcb_image_busy()
+ *         FILES: file_sys.c/h, tmpfs.c/h
+ */
+int test_tmpfs()
+{
+    uint8_t filename[] = "tmpfs_test";
+    uint8_t boot_name[] = "frame0.txt";
+    uint8_t buf[BUF_SIZE];
+    uint8_t read_buf[BUF_SIZE];
+    int32_t offset = BLOCK_SIZE - BUF_SIZE / 2;
+    int32_t i;
+    dentry_t dentry;
+
+    for (i = 0; i < BUF_SIZE; ++i)
+        buf[i] = 'a' + i % 26;
+
+    /* Boot image names cannot be created and boot files cannot be written */
+    int32_t boot_fd = system_open(boot_name);
+    if (tmpfs_create(boot_name) != FAILURE || file_write(boot_fd, buf, BUF_SIZE) != FAILURE)
+        return FAIL;
+    system_close(boot_fd);
+
+    /* RAM files are never removed, so a rerun finds the emptied file of the last run */
+    if ((read_dentry_by_name(filename, &dentry) != SUCCESS && tmpfs_create(filename) != SUCCESS) ||
+        tmpfs_create(filename) != FAILURE || read_dentry_by_name(filename, &dentry) != SUCCESS)
+        return FAIL;
+
+    int32_t fd = system_open(filename);
+    if (fd == FAILURE || file_truncate(fd, 0) != SUCCESS)
+        return FAIL;
+
+    /* Write straddling the first block boundary leaves zeros before it */
+    if (file_lseek(fd, offset, SEEK_SET) != offset || file_write(fd, buf, BUF_SIZE) != BUF_SIZE ||
+        file_length(dentry.inode_num) != offset + BUF_SIZE)
+        return FAIL;
+    if (file_pread(fd, read_buf, BUF_SIZE, 0) != BUF_SIZE)
+        return FAIL;
+    for (i = 0; i < BUF_SIZE; ++i)
+        if (read_buf[i] != 0)
+            return FAIL;
+    if (file_pread(fd, read_buf, BUF_SIZE, offset) != BUF_SIZE)
+        return FAIL;
+    for (i = 0; i < BUF_SIZE; ++i)
+        if (read_buf[i] != buf[i])
+            return FAIL;
+
+    /* Shrinking then growing again must not bring back old data */
+    if (file_truncate(fd, offset + 1) != SUCCESS || file_truncate(fd, offset + BUF_SIZE) != SUCCESS ||
+        file_pread(fd, read_buf, BUF_SIZE, offset) != BUF_SIZE || read_buf[0] != buf[0])
+        return FAIL;
+    for (i = 1; i < BUF_SIZE; ++i)
+        if (read_buf[i] != 0)
+            return FAIL;
+
+    /* Pretend the current process runs the file */
+    pcb_t* pcb = get_current_pcb();
+    uint32_t exec_inode = pcb->exec_inode;
+    uint32_t exec_length = pcb->exec_length;
+    pcb->exec_inode = dentry.inode_num;
+    pcb->exec_length = offset + BUF_SIZE;
+    int32_t busy_write = file_write(fd, buf, BUF_SIZE);
+    int32_t busy_truncate = file_truncate(fd, 0);
+    pcb->exec_inode = exec_inode;
+    pcb->exec_length = exec_length;
+    if (busy_write != FAILURE || busy_truncate != FAILURE || file_length(dentry.inode_num) != offset + BUF_SIZE)
+        return FAIL;
+
+    /* Leave the file empty so later tests start with a full block pool */
+    if (file_truncate(fd, 0) != SUCCESS || file_length(dentry.inode_num) != 0)
+        return FAIL;
+    system_close(fd);
+
+    return PASS;
+}
+
+/*
+ * test_dentry_lookup
+ *   DESCRIPTION: Looks up every directory entry, and every entry with its
+ *                last character dropped, through the image's index and by
+ *                linear scan and checks that both agree.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: read_dentry_by_name() for legacy and multi-block directories
+ *         FILES: file_sys.c/h
+ */
+int test_dentry_lookup()
+{
+    uint8_t dir_name[] = ".";
+    uint8_t name[FILENAME_LEN + 1];
+    dentry_t by_name, by_scan;
+    int32_t ret, len, i;
+
+    int32_t fd = system_open(dir_name);
+    if (fd == FAILURE)
+        return FAIL;
+
+    name[FILENAME_LEN] = '\0';
+    while ((ret = dir_read(fd, name, FILENAME_LEN)) > 0)
+    {
+        /* Whole name, then a prefix that must not match the longer name */
+        for (i = 0; i < 2; ++i)
+        {
+            ret = read_dentry_by_name(name, &by_name);
+
+            /* RAM files are not in the image */
+            if (ret == SUCCESS && tmpfs_is_inode(by_name.inode_num))
+                break;
+
+            if (ret != read_dentry_by_scan(name, &by_scan) ||
+                (ret == SUCCESS && (by_name.inode_num != by_scan.inode_num ||
+                                    by_name.filetype != by_scan.filetype)))
+                return FAIL;
+
+            len = strlen((int8_t*)name);
+            if (len <= 1)
+                break;
+            name[len - 1] = '\0';
+        }
+    }
+
+    system_close(fd);
+
+    return ret == FAILURE ? FAIL : PASS;
+}
+
+/*
+ * test_bcache
+ *   DESCRIPTION: Reads the first blocks of the cached drive with a read ahead
+ *                hint and checks that the blocks read ahead are hits, that a
+ *                block reads back the same, and that blocks past the end of
+ *                the drive are refused. Skipped without a drive.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL, or SKIP if there is no drive
+ *  SIDE EFFECTS: Changes cache contents and counters
+ *      COVERAGE: bcache_get(), bcache_put(), ata_read_blocks()
+ *         FILES: bcache.c/h, device/ata.c/h
+ */
+int test_bcache()
+{
+    bcache_stats_t before, after;
+    bcache_buf_t* buf;
+    uint8_t first[BUF_SIZE];
+    uint32_t i, j;
+
+    uint32_t num_blocks = bcache_num_blocks();
+    if (num_blocks < BCACHE_READ_AHEAD)
+    {
+        printf("no disk, ");
+        return SKIP;
+    }
+
+    /* Block 0 is cached before the first read, so start from a clean slate */
+    if (bcache_init(bcache_get_drive()) == FAILURE)
+        return FAIL;
+
+    buf = bcache_get(0, BCACHE_READ_AHEAD - 1);
+    if (buf == NULL || buf->refs != 1)
+        return FAIL;
+    memcpy(first, buf->data, BUF_SIZE);
+    bcache_put(buf);
+    if (buf->refs != 0)
+        return FAIL;
+
+    bcache_get_stats(&before);
+    for (i = 0; i < BCACHE_READ_AHEAD; ++i)
+    {
+        buf = bcache_get(i, 0);
+        if (buf == NULL || buf->block != i)
+            return FAIL;
+        for (j = 0; i == 0 && j < BUF_SIZE; ++j)
+        {
+            if (buf->data[j] != first[j])
+                return FAIL;
+        }
+        bcache_put(buf);
+    }
+    bcache_get_stats(&after);
+
+    /* One command read all of them */
+    if (after.hits - before.hits != BCACHE_READ_AHEAD || after.reads != before.reads ||
+        after.read_ahead_hits - before.read_ahead_hits != BCACHE_READ_AHEAD - 1)
+        return FAIL;
+
+    return bcache_get(num_blocks, 0) == NULL ? PASS : FAIL;
+}
+
 
 /* Checkpoint 3 tests */
 
@@ -755,6 +1146,43 @@ int test_system_invalid_fds()
     return count == 0 ? PASS : FAIL;
 }
 
+/* Sends a small file to stdout in two parts and checks invalid sendfile calls
+ * and the file position after each call. Prints frame0.txt, which must be
+ * verified visually */
+int test_system_sendfile()
+{
+    int32_t fd = system_open((uint8_t*)"frame0.txt");
+    int32_t dir_fd = system_open((uint8_t*)".");
+    file_t* fd_array = get_current_pcb()->fd_table;
+    stat_t st;
+    int result = PASS;
+
+    if (fd == FAILURE || dir_fd == FAILURE || file_stat(fd, &st) != SUCCESS)
+        return FAIL;
+
+    /* Wrong direction, non-file input and negative count */
+    if (system_sendfile(fd, 1, st.length) != FAILURE ||
+        system_sendfile(1, dir_fd, st.length) != FAILURE ||
+        system_sendfile(1, fd, -1) != FAILURE)
+        result = FAIL;
+
+    if (fd_array[fd].file_position != 0)
+        result = FAIL;
+
+    /* Partial send, rest of the file, then end of file */
+    if (system_sendfile(1, fd, BUF_SIZE) != BUF_SIZE || fd_array[fd].file_position != BUF_SIZE)
+        result = FAIL;
+    if (system_sendfile(1, fd, st.length) != st.length - BUF_SIZE || fd_array[fd].file_position != st.length)
+        result = FAIL;
+    if (system_sendfile(1, fd, st.length) != 0 || fd_array[fd].file_position != st.length)
+        result = FAIL;
+
+    system_close(fd);
+    system_close(dir_fd);
+
+    return result;
+}
+
 /* Tests execution with leading/trailing spaces. Checks for success return codes */
 int test_system_execute()
 {
@@ -804,81 +1232,808 @@ int test_page_map_unmap() {
 
 /* Checkpoint 5 tests */
 
-/* Wrapper function which calls all tests relevant to checkpoint 1 */
-void checkpoint1() {
-    TEST_HEADER;
-    /***** Checkpoint 1 Tests *****/
-
-    TEST_OUTPUT("idt_test", idt_test());
+/* Kernel subsystem tests */
 
-    /* Test each of the 20 exception vectors */
-    // asm ("int $0x00");
-    // asm ("int $0x01");
-    // asm ("int $0x02");
-    // asm ("int $0x03");
-    // asm ("int $0x04");
-    // asm ("int $0x05");
-    // asm ("int $0x06");
-    // asm ("int $0x07");
-    // asm ("int $0x08");
-    // asm ("int $0x09");
-    // asm ("int $0x0A");
-    // asm ("int $0x0B");
-    // asm ("int $0x0C");
-    // asm ("int $0x0D");
-    // asm ("int $0x0E");
-    // asm ("int $0x0F");
-    // asm ("int $0x10");
-    // asm ("int $0x11");
-    // asm ("int $0x12");
-    // asm ("int $0x13");
+/*
+ * test_frame_alloc
+ *   DESCRIPTION: Allocates small frames and a large frame, checks that they
+ *                are aligned, distinct, and writable, frees them (one twice)
+ *                and checks that the free counts are restored.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: frame_alloc(), frame_free(), frame_alloc_large(), frame_free_large()
+ *         FILES: frame.c/h
+ */
+int test_frame_alloc()
+{
+    frame_stats_t before, after;
+    uint32_t frames[FRAME_TEST_COUNT];
+    uint32_t large;
+    int32_t i, j;
+    int32_t result = PASS;
 
-    /* Paging tests 0-4 should throw exceptions */
-    // TEST_OUTPUT("paging_test_0", paging_test_0());
-    // TEST_OUTPUT("paging_test_1", paging_test_1());
-    // TEST_OUTPUT("paging_test_2", paging_test_2());
-    // TEST_OUTPUT("paging_test_3", paging_test_3());
-    // TEST_OUTPUT("paging_test_4", paging_test_4());
+    frame_get_stats(&before);
 
-    TEST_OUTPUT("paging_test_video_and_kernel", paging_test_video_and_kernel());
-}
+    for (i = 0; i < FRAME_TEST_COUNT; ++i)
+    {
+        frames[i] = frame_alloc();
+        if (frames[i] == NULL || (frames[i] & (FRAME_SIZE - 1)) != 0 || frames[i] < KERNEL_LOC_END)
+            return FAIL;
+        for (j = 0; j < i; ++j)
+        {
+            if (frames[j] == frames[i])
+                result = FAIL;
+        }
+        memset((void*)frames[i], i, FRAME_SIZE);
+    }
 
-/* Wrapper function which calls all tests relevant to checkpoint 2 */
-void checkpoint2() {
-    TEST_HEADER;
+    /* Each frame still holds its own pattern */
+    for (i = 0; i < FRAME_TEST_COUNT; ++i)
+    {
+        if (((uint8_t*)frames[i])[FRAME_SIZE - 1] != i)
+            result = FAIL;
+    }
 
-    /* Terminal tests */
-    TEST_OUTPUT("term_open_close_test", term_open_close_test());
-    TEST_OUTPUT("term_read_write_test", term_read_write_test());
-    TEST_OUTPUT("term_buff_overflow_test", term_buff_overflow_test());
+    large = frame_alloc_large();
+    if (large == NULL || (large & (FRAME_LARGE_SIZE - 1)) != 0 || large < KERNEL_LOC_END)
+        result = FAIL;
 
-    /* RTC Tests */
-    TEST_OUTPUT("test_rtc_open_close", test_rtc_open_close());
-    TEST_OUTPUT("test_rtc_read", test_rtc_read());
-    TEST_OUTPUT("test_rtc_write", test_rtc_write());
-    TEST_OUTPUT("test_rtc_invalid", test_rtc_invalid());
+    for (i = 0; i < FRAME_TEST_COUNT; ++i)
+        frame_free(frames[i]);
+    frame_free(frames[0]);              /* Double free is ignored */
+    frame_free_large(large);
+    frame_free_large(large);
 
-    /* File System Tests */
-    TEST_OUTPUT("test_file_open_close", test_file_open_close());
-    TEST_OUTPUT("test_file_write_and_dir", test_file_write_and_dir());
-    TEST_OUTPUT("test_dir_read", test_dir_read());
-    uint8_t filename[] = "fish";
-    TEST_OUTPUT("test_file_read", test_file_read(filename));    /* Prints first 32 chars of fish */
-    TEST_OUTPUT("test_read_all_files", test_read_all_files());
+    frame_get_stats(&after);
+    if (after.free_large != before.free_large || after.free_small != before.free_small ||
+        after.split_large != before.split_large)
+        result = FAIL;
 
-    TEST_FINISHED;
+    return result;
 }
 
-/* Wrapper function which calls all tests relevant to checkpoint 3 */
-void checkpoint3() {
-    TEST_HEADER;
-    
-    TEST_OUTPUT("Open too many FDs", test_system_open_all_fds());
-    TEST_OUTPUT("Open invalid filenames", test_system_file_opennames());
-    TEST_OUTPUT("Read/write/close invalid FDs", test_system_invalid_fds());
-    TEST_OUTPUT("Execute programs with white space", test_system_execute());
+/*
+ * test_kmalloc
+ *   DESCRIPTION: Allocates from every size class and a large request, checks
+ *                alignment and that blocks do not overlap, then fills a named
+ *                cache past one slab and checks that freeing everything gives
+ *                back all but the kept empty slab.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Creates the "test" cache, which is never destroyed
+ *      COVERAGE: kmalloc(), kfree(), kmem_cache_alloc(), kmem_cache_free()
+ *         FILES: kmalloc.c/h
+ */
+int test_kmalloc()
+{
+    static kmem_cache_t* cache;
+    void* objs[KMALLOC_TEST_OBJS];
+    uint8_t* blocks[KMALLOC_TEST_SIZES];
+    uint32_t large_before = kmalloc_large_pages();
+    uint32_t size;
+    int32_t i;
+    int32_t result = PASS;
+
+    /* 1 byte up through a large allocation of several frames */
+    for (i = 0, size = 1; i < KMALLOC_TEST_SIZES; ++i, size = size * 3 + 5)
+    {
+        blocks[i] = kmalloc(size);
+        if (blocks[i] == NULL || ((uint32_t)blocks[i] & (KMEM_ALIGN - 1)) != 0)
+            return FAIL;
+        memset(blocks[i], i, size);
+    }
+    for (i = 0, size = 1; i < KMALLOC_TEST_SIZES; ++i, size = size * 3 + 5)
+    {
+        if (blocks[i][0] != i || blocks[i][size - 1] != i)
+            result = FAIL;
+        kfree(blocks[i]);
+    }
+    if (kmalloc(0) != NULL || kmalloc_large_pages() != large_before)
+        result = FAIL;
 
-    TEST_FINISHED;
+    if (cache == NULL)
+        cache = kmem_cache_create("test", KMALLOC_TEST_OBJ_SIZE);
+    if (cache == NULL || cache->per_slab * 2 > KMALLOC_TEST_OBJS)
+        return FAIL;
+
+    for (i = 0; i < KMALLOC_TEST_OBJS; ++i)
+    {
+        objs[i] = kmem_cache_alloc(cache);
+        if (objs[i] == NULL)
+            return FAIL;
+        memset(objs[i], i, KMALLOC_TEST_OBJ_SIZE);
+    }
+    if (cache->active != KMALLOC_TEST_OBJS || cache->num_slabs < 2 || cache->full == NULL)
+        result = FAIL;
+
+    for (i = 0; i < KMALLOC_TEST_OBJS; ++i)
+    {
+        if (((uint8_t*)objs[i])[KMALLOC_TEST_OBJ_SIZE - 1] != i)
+            result = FAIL;
+        kmem_cache_free(cache, objs[i]);
+    }
+
+    if (cache->active != 0 || cache->num_slabs != KMEM_KEEP_EMPTY || kmem_cache_frag(cache) != 100)
+        result = FAIL;
+
+    return result;
+}
+
+/*
+ * test_exec_cache_evict
+ *   DESCRIPTION: Loads one more distinct executable than the exec cache has
+ *                slots. Every load must miss, the first image must be evicted
+ *                and miss again, the last must hit, and both the reloaded
+ *                image and the evicted one must read back the file.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Replaces the contents of the exec cache
+ *      COVERAGE: exec_cache_load(), exec_cache_read(), exec_cache_invalidate()
+ *         FILES: exec_cache.c/h
+ */
+int test_exec_cache_evict()
+{
+    const char* names[] = { "cat", "counter", "fish", "grep", "hello", "ls", "pingpong", "shell",
+                            "sigtest", "syserr", "testprint", "shmbench", "pipebench", "schedbench" };
+    dentry_t dentry[EXEC_CACHE_SLOTS + 1];
+    exec_cache_stats_t before, after;
+    uint8_t cached[BUF_SIZE], file[BUF_SIZE];
+    uint32_t length, offset;
+    int32_t i, j, bytes;
+    int32_t result = PASS;
+
+    if (sizeof(names) / sizeof(names[0]) < EXEC_CACHE_SLOTS + 1)
+        return FAIL;
+
+    for (i = 0; i <= EXEC_CACHE_SLOTS; ++i)
+    {
+        if (read_dentry_by_name((uint8_t*)names[i], &dentry[i]) != SUCCESS ||
+            file_length(dentry[i].inode_num) > EXEC_CACHE_SLOT_SIZE)
+            return FAIL;
+        exec_cache_invalidate(dentry[i].inode_num);
+    }
+
+    /* Every image misses, so the first is the least recently used once all slots are taken */
+    before = *get_exec_cache_stats();
+    for (i = 0; i <= EXEC_CACHE_SLOTS; ++i)
+    {
+        if (exec_cache_load(&dentry[i], &length) == FAILURE || length != file_length(dentry[i].inode_num))
+            result = FAIL;
+    }
+    after = *get_exec_cache_stats();
+    if (after.misses != before.misses + EXEC_CACHE_SLOTS + 1 || after.hits != before.hits ||
+        after.evictions < before.evictions + 1)
+        result = FAIL;
+
+    /* The first image was evicted and comes back in place of the second */
+    before = after;
+    if (exec_cache_load(&dentry[0], &length) == FAILURE || exec_cache_load(&dentry[EXEC_CACHE_SLOTS], &length) == FAILURE)
+        result = FAIL;
+    after = *get_exec_cache_stats();
+    if (after.misses != before.misses + 1 || after.evictions != before.evictions + 1 || after.hits != before.hits + 1)
+        result = FAIL;
+
+    /* The reloaded image comes from its slot, the evicted one from the file system */
+    for (i = 0; i < 2; ++i)
+    {
+        for (offset = 0; offset < file_length(dentry[i].inode_num); offset += bytes)
+        {
+            bytes = exec_cache_read(dentry[i].inode_num, offset, cached, BUF_SIZE);
+            if (bytes <= 0 || read_data(dentry[i].inode_num, offset, file, BUF_SIZE) != bytes)
+            {
+                result = FAIL;
+                break;
+            }
+            for (j = 0; j < bytes; ++j)
+            {
+                if (cached[j] != file[j])
+                    result = FAIL;
+            }
+        }
+    }
+
+    for (i = 0; i <= EXEC_CACHE_SLOTS; ++i)
+        exec_cache_invalidate(dentry[i].inode_num);
+
+    return result;
+}
+
+/*
+ * test_demand_paging
+ *   DESCRIPTION: Gives a new process testprint as its executable and touches
+ *                its program area from the kernel. The image page must read
+ *                back the file, the page below it and the stack must be zero,
+ *                and every frame must come back after teardown once the exec
+ *                cache drops its text page.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: vm_create(), vm_switch(), vm_page_fault(), vm_destroy()
+ *         FILES: vm.c/h, paging.c/h, idt.c
+ */
+int test_demand_paging()
+{
+    frame_stats_t before, after;
+    vm_stats_t vm_before, vm_after;
+    dentry_t dentry;
+    uint8_t header[BUF_SIZE];
+    uint8_t* image = (uint8_t*)(PROG_VIRT_ADDR + PROG_OFFSET);
+    uint32_t* stack = (uint32_t*)(PROG_VIRT_ADDR + PROG_PAGE_SIZE - 4);
+    pcb_t* pcb;
+    int32_t i;
+    int32_t result = PASS;
+
+    if (read_dentry_by_name((uint8_t*)"testprint", &dentry) != SUCCESS ||
+        read_data(dentry.inode_num, 0, header, BUF_SIZE) != BUF_SIZE)
+        return FAIL;
+
+    /* Warm up, so the PCB cache already holds the empty slab it keeps */
+    if (pcb_setup(get_new_pid()) == NULL)
+        return FAIL;
+    pcb_teardown();
+    exec_cache_invalidate(dentry.inode_num);
+    frame_get_stats(&before);
+    vm_get_stats(&vm_before);
+
+    pcb = pcb_setup(get_new_pid());
+    if (pcb == NULL)
+        return FAIL;
+    if (exec_cache_load(&dentry, &pcb->exec_length) == FAILURE)
+        result = FAIL;
+    pcb->exec_inode = dentry.inode_num;
+    vm_switch(pcb->pid);
+
+    for (i = 0; i < BUF_SIZE; ++i)
+    {
+        if (image[i] != header[i])
+            result = FAIL;
+    }
+    if (*((uint32_t*)PROG_VIRT_ADDR) != 0 || *stack != 0)
+        result = FAIL;
+    *stack = EXEC_MAGIC_STR;
+    if (*stack != EXEC_MAGIC_STR)
+        result = FAIL;
+
+    vm_get_stats(&vm_after);
+    if (vm_after.shared_faults != vm_before.shared_faults + 1 || vm_after.zero_faults != vm_before.zero_faults + 2 ||
+        vm_after.resident != vm_before.resident + 3)
+        result = FAIL;
+
+    pcb_teardown();
+    exec_cache_invalidate(dentry.inode_num);
+
+    frame_get_stats(&after);
+    vm_get_stats(&vm_after);
+    if (vm_after.resident != vm_before.resident || vm_after.spaces != vm_before.spaces ||
+        after.free_large * FRAMES_PER_LARGE + after.free_small != before.free_large * FRAMES_PER_LARGE + before.free_small)
+        result = FAIL;
+
+    return result;
+}
+
+/*
+ * __test_user_pte
+ *   DESCRIPTION: Looks up the page table entry of a user address in the
+ *                active PD
+ *        INPUTS: addr - user address whose page table exists
+ *  RETURN VALUE: Page table entry
+ *  SIDE EFFECTS: none
+ */
+uint32_t __test_user_pte(uint32_t addr)
+{
+    uint32_t* table = (uint32_t*)(get_page_directory()[addr >> BITS_TO_PD_IDX] & FLAG_MASK);
+
+    return table[(addr >> BITS_TO_PT_IDX) & PT_MASK];
+}
+
+/*
+ * test_shared_text
+ *   DESCRIPTION: Runs testprint in a process and its child. Both must map the
+ *                same read-only frame for the entry point but private stacks,
+ *                and the frame's reference count must follow the mappings.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: exec_cache_text_page(), frame_ref(), frame_refcount(),
+ *                vm_page_fault(), vm_destroy()
+ *         FILES: exec_cache.c/h, frame.c/h, vm.c/h
+ */
+int test_shared_text()
+{
+    dentry_t dentry;
+    pcb_t* pcb[2];
+    uint32_t text[2], stack[2];
+    uint32_t stack_addr = PROG_VIRT_ADDR + PROG_PAGE_SIZE - 4;
+    int32_t eip = FAILURE;
+    int32_t i;
+    int32_t num_procs = 0;
+    int32_t result = PASS;
+
+    if (read_dentry_by_name((uint8_t*)"testprint", &dentry) != SUCCESS)
+        return FAIL;
+
+    for (i = 0; i < 2; ++i)
+    {
+        pcb[i] = pcb_setup(get_new_pid());
+        if (pcb[i] == NULL)
+        {
+            result = FAIL;
+            break;
+        }
+        ++num_procs;
+        eip = exec_cache_load(&dentry, &pcb[i]->exec_length);
+        pcb[i]->exec_inode = dentry.inode_num;
+        vm_switch(pcb[i]->pid);
+        if (eip == FAILURE)
+        {
+            result = FAIL;
+            break;
+        }
+
+        *((volatile uint8_t*)eip);
+        *((volatile uint32_t*)stack_addr) = i;
+        text[i] = __test_user_pte(eip);
+        stack[i] = __test_user_pte(stack_addr);
+        if ((text[i] & PDE_READ_WRITE) || !(stack[i] & PDE_READ_WRITE))
+            result = FAIL;
+        text[i] &= FLAG_MASK;
+        stack[i] &= FLAG_MASK;
+    }
+
+    /* Cache plus two processes share the text, the stacks are private */
+    if (i == 2 && (text[0] != text[1] || stack[0] == stack[1] || frame_refcount(text[0]) != 3))
+        result = FAIL;
+
+    /* Each teardown drops one reference, the cache keeps the last */
+    while (num_procs > 0)
+    {
+        pcb_teardown();
+        --num_procs;
+        if (i == 2 && frame_refcount(text[0]) != num_procs + 1)
+            result = FAIL;
+        if (i == 2 && num_procs == 1 && *((uint32_t*)stack_addr) != 0)
+            result = FAIL;
+    }
+
+    return result;
+}
+
+/*
+ * test_cow_fork
+ *   DESCRIPTION: Forks a process with a written stack page. Both must map the
+ *                frame read-only until the child writes and gets a copy, after
+ *                which the parent's write reuses the original frame.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: vm_fork(), vm_page_fault(), frame_ref(), frame_refcount()
+ *         FILES: frame.c/h, vm.c/h
+ */
+int test_cow_fork()
+{
+    pcb_t* parent;
+    pcb_t* child;
+    vm_stats_t vm_before, vm_after;
+    uint32_t stack_addr = PROG_VIRT_ADDR + PROG_PAGE_SIZE - 4;
+    volatile uint32_t* stack = (volatile uint32_t*)stack_addr;
+    uint32_t shared, copy;
+    int32_t result = PASS;
+
+    vm_get_stats(&vm_before);
+
+    parent = pcb_setup(get_new_pid());
+    if (parent == NULL)
+        return FAIL;
+    vm_switch(parent->pid);
+    *stack = 0x391;
+
+    child = pcb_setup(get_new_pid());
+    if (child == NULL || vm_fork(parent->page_dir, child->page_dir) == FAILURE)
+        result = FAIL;
+
+    if (result == PASS)
+    {
+        vm_switch(child->pid);
+
+        /* Both map the same frame read-only until someone writes */
+        shared = __test_user_pte(stack_addr);
+        if ((shared & PDE_READ_WRITE) || !(shared & PTE_COW) || *stack != 0x391 ||
+            frame_refcount(shared & FLAG_MASK) != 2)
+            result = FAIL;
+        shared &= FLAG_MASK;
+
+        *stack = 0x392;
+        copy = __test_user_pte(stack_addr);
+        if (!(copy & PDE_READ_WRITE) || (copy & FLAG_MASK) == shared || frame_refcount(shared) != 1)
+            result = FAIL;
+    }
+
+    /* Parent still sees its value, and keeps the frame when it writes */
+    if (child != NULL)
+        pcb_teardown();
+    if (result == PASS)
+    {
+        if (*stack != 0x391)
+            result = FAIL;
+        *stack = 0x393;
+        if ((__test_user_pte(stack_addr) & (FLAG_MASK | PTE_COW | PDE_READ_WRITE)) != (shared | PDE_READ_WRITE))
+            result = FAIL;
+    }
+    pcb_teardown();
+
+    vm_get_stats(&vm_after);
+    if (vm_after.cow_copies != vm_before.cow_copies + 1 || vm_after.cow_reuses != vm_before.cow_reuses + 1)
+        result = FAIL;
+
+    return result;
+}
+
+/*
+ * test_shm
+ *   DESCRIPTION: Attaches a segment to two processes, one at a kernel chosen
+ *                and one at a caller chosen address. Writes from each must be
+ *                seen by the other, and the frames must be freed once the
+ *                last process detaches. A segment that is never attached
+ *                must be freed when its creator halts.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: shm_get(), shm_attach(), shm_detach(), shm_detach_all(),
+ *                vm_map_shared(), vm_unmap_page()
+ *         FILES: shm.c/h, vm.c/h
+ */
+int test_shm()
+{
+    frame_stats_t before, after;
+    pcb_t* pcb[2];
+    uint8_t* start[2];
+    uint32_t frame;
+    int32_t id;
+    int32_t num_procs = 0;
+    int32_t result = PASS;
+
+    pcb[0] = pcb_setup(get_new_pid());
+    if (pcb[0] == NULL)
+        return FAIL;
+    ++num_procs;
+    vm_switch(pcb[0]->pid);
+
+    id = shm_get(SHM_TEST_KEY, SHM_TEST_SIZE);
+    start[0] = NULL;
+    if (id == FAILURE || shm_attach(id, &start[0]) != 3 * PAGE_SIZE || start[0] != (uint8_t*)SHM_VIRT_ADDR)
+        result = FAIL;
+
+    /* Same key gets the same segment, mapped elsewhere by the second process */
+    if (result == PASS)
+    {
+        start[0][2 * PAGE_SIZE] = 0x39;
+        pcb[1] = pcb_setup(get_new_pid());
+        if (pcb[1] == NULL)
+            result = FAIL;
+    }
+    if (result == PASS)
+    {
+        ++num_procs;
+        vm_switch(pcb[1]->pid);
+        start[1] = (uint8_t*)(SHM_VIRT_ADDR + 4 * PAGE_SIZE);
+        if (shm_get(SHM_TEST_KEY, PAGE_SIZE) != id || shm_attach(id, &start[1]) != 3 * PAGE_SIZE ||
+            start[1] != (uint8_t*)(SHM_VIRT_ADDR + 4 * PAGE_SIZE))
+            result = FAIL;
+    }
+
+    if (result == PASS)
+    {
+        frame = __test_user_pte((uint32_t)start[1]) & FLAG_MASK;
+        if (start[1][2 * PAGE_SIZE] != 0x39 || frame_refcount(frame) != 3)
+            result = FAIL;
+        start[1][0] = 0x91;
+
+        /* Segment stays while the first process is attached */
+        pcb_teardown();
+        --num_procs;
+        if (start[0][0] != 0x91 || frame_refcount(frame) != 2)
+            result = FAIL;
+        if (shm_detach((uint32_t)start[0]) != SUCCESS || frame_refcount(frame) != 0)
+            result = FAIL;
+    }
+
+    /* Halting detaches whatever is still attached */
+    while (num_procs > 0)
+    {
+        pcb_teardown();
+        --num_procs;
+    }
+
+    /* An unattached segment goes away with its creator */
+    frame_get_stats(&before);
+    if (pcb_setup(get_new_pid()) == NULL)
+        return FAIL;
+    if (shm_get(SHM_TEST_KEY + 1, SHM_TEST_SIZE) == FAILURE)
+        result = FAIL;
+    pcb_teardown();
+    frame_get_stats(&after);
+    if (after.free_large * FRAMES_PER_LARGE + after.free_small != before.free_large * FRAMES_PER_LARGE + before.free_small)
+        result = FAIL;
+
+    return result;
+}
+
+/*
+ * test_pipe
+ *   DESCRIPTION: Streams chunks through a pipe so that they wrap around its
+ *                ring buffer, then checks end of file after the write end is
+ *                closed and that writes fail without a read end.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: pipe_create(), pipe_read(), pipe_write(), pipe_close()
+ *         FILES: pipe.c/h
+ */
+int test_pipe()
+{
+    static uint8_t out[PIPE_TEST_CHUNK];
+    static uint8_t in[PIPE_TEST_CHUNK];
+    int32_t fds[2];
+    int32_t i, chunk, cnt;
+    int32_t result = PASS;
+
+    if (pcb_setup(get_new_pid()) == NULL)
+        return FAIL;
+    if (pipe_create(fds) == FAILURE || fds[0] != 2 || fds[1] != 3)
+        result = FAIL;
+
+    for (chunk = 0; result == PASS && chunk < 3; ++chunk)
+    {
+        for (i = 0; i < PIPE_TEST_CHUNK; ++i)
+            out[i] = (uint8_t)(chunk + i);
+
+        /* Both writes fit, the reads may come back in pieces */
+        if (pipe_write(fds[1], out, PIPE_TEST_CHUNK) != PIPE_TEST_CHUNK ||
+            pipe_write(fds[1], out, PIPE_TEST_CHUNK) != PIPE_TEST_CHUNK)
+            result = FAIL;
+        for (i = 0; result == PASS && i < 2; ++i)
+        {
+            for (cnt = 0; cnt < PIPE_TEST_CHUNK; )
+            {
+                int32_t ret = pipe_read(fds[0], in + cnt, PIPE_TEST_CHUNK - cnt);
+                if (ret <= 0)
+                {
+                    result = FAIL;
+                    break;
+                }
+                cnt += ret;
+            }
+            for (cnt = 0; cnt < PIPE_TEST_CHUNK; ++cnt)
+            {
+                if (in[cnt] != out[cnt])
+                    result = FAIL;
+            }
+        }
+    }
+
+    /* End of file without writers, FAILURE without readers */
+    if (result == PASS)
+    {
+        pipe_write(fds[1], out, 1);
+        if (pipe_close(fds[1]) != SUCCESS || pipe_read(fds[0], in, PIPE_TEST_CHUNK) != 1 ||
+            pipe_read(fds[0], in, PIPE_TEST_CHUNK) != 0)
+            result = FAIL;
+        if (pipe_close(fds[0]) != SUCCESS || pipe_create(fds) == FAILURE ||
+            pipe_close(fds[0]) != SUCCESS || pipe_write(fds[1], out, 1) != FAILURE)
+            result = FAIL;
+    }
+
+    /* Halting closes any end still open */
+    pcb_teardown();
+
+    return result;
+}
+
+/*
+ * test_wait_queue
+ *   DESCRIPTION: Sleeps in rtc_read a few times. The interrupt handler must
+ *                wake the process and leave it runnable and off the queue.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: wait_queue_sleep(), wait_queue_wake(), rtc_read
+ *         FILES: wait_queue.c/h, rtc.c/.h
+ */
+int test_wait_queue()
+{
+    pcb_t* pcb = get_current_pcb();
+    int32_t fd;
+    int32_t i;
+    int32_t result = PASS;
+
+    fd = rtc_open((const uint8_t*)"rtc");
+
+    for (i = 0; i < 4; ++i)
+    {
+        tests_rtc_read_waited_for_int = 0;
+        rtc_read(fd, NULL, 0);
+        if (!tests_rtc_read_waited_for_int || pcb->blocked || pcb->wait_next != NULL)
+            result = FAIL;
+    }
+
+    rtc_close(fd);
+
+    return result;
+}
+
+/*
+ * test_run_queue
+ *   DESCRIPTION: Runs two processes of the same terminal with different
+ *                priorities through PIT ticks charged by hand, picking the
+ *                next process after every tick. Their ticks must follow their priorities,
+ *                and after one of them was off the run queue for a while it
+ *                must run first without locking the other one out.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: none
+ *      COVERAGE: schedule_enqueue(), schedule_dequeue(), schedule_pick(),
+ *                schedule_tick(), schedule_set_priority(), pcb_setup()
+ *         FILES: scheduler.c/h, pcb.c/h
+ */
+int test_run_queue()
+{
+    pcb_t* low;
+    pcb_t* high;
+    pcb_t* current;
+    uint32_t i, low_ticks;
+    int32_t result = PASS;
+    long flags;
+
+    /* No interrupt may switch to the processes being set up */
+    cli_and_save(flags);
+
+    /* Like fork, the parent keeps running next to its child */
+    low = pcb_setup(get_new_pid());
+    if (low == NULL)
+    {
+        restore_flags(flags);
+        return FAIL;
+    }
+    high = pcb_setup(get_new_pid());
+    if (high == NULL)
+    {
+        pcb_teardown();
+        restore_flags(flags);
+        return FAIL;
+    }
+    schedule_enqueue(low);
+    if (!low->queued || !high->queued || get_pcb_addr(0)->queued || low->group != high->group)
+        result = FAIL;
+    if (schedule_set_priority(low, SCHED_TEST_LOW_PRIO) != SCHED_PRIO_DEFAULT ||
+        schedule_set_priority(high, SCHED_TEST_HIGH_PRIO) != SCHED_PRIO_DEFAULT ||
+        schedule_set_priority(high, SCHED_PRIO_MAX + 1) != FAILURE)
+        result = FAIL;
+
+    /* Shares follow priorities */
+    for (i = 0; result == PASS && i < SCHED_TEST_TICKS; ++i)
+    {
+        current = schedule_pick();
+        schedule_tick(current);
+    }
+    if (high->run_ticks + low->run_ticks != SCHED_TEST_TICKS ||
+        high->run_ticks * SCHED_TEST_LOW_PRIO + SCHED_TEST_HIGH_PRIO < low->run_ticks * SCHED_TEST_HIGH_PRIO ||
+        high->run_ticks * SCHED_TEST_LOW_PRIO > low->run_ticks * SCHED_TEST_HIGH_PRIO + SCHED_TEST_HIGH_PRIO)
+        result = FAIL;
+
+    /* Sleeping banks at most one slice */
+    schedule_dequeue(high);
+    for (i = 0; result == PASS && i < SCHED_TEST_TICKS; ++i)
+    {
+        if (schedule_pick() != low)
+            result = FAIL;
+        schedule_tick(low);
+    }
+    schedule_enqueue(high);
+    if (schedule_pick() != high)
+        result = FAIL;
+    low_ticks = low->run_ticks;
+    for (i = 0; result == PASS && i < SCHED_TEST_WAKE_TICKS; ++i)
+    {
+        current = schedule_pick();
+        schedule_tick(current);
+    }
+    if (low->run_ticks == low_ticks)
+        result = FAIL;
+
+    /* The kernel gets its place back from the last child */
+    pcb_teardown();
+    pcb_teardown();
+    if (!get_pcb_addr(0)->queued)
+        result = FAIL;
+
+    restore_flags(flags);
+
+    return result;
+}
+
+/* Wrapper function which calls all tests relevant to checkpoint 1 */
+void checkpoint1() {
+    TEST_HEADER;
+    /***** Checkpoint 1 Tests *****/
+
+    TEST_OUTPUT("idt_test", idt_test());
+
+    /* Test each of the 20 exception vectors */
+    // asm ("int $0x00");
+    // asm ("int $0x01");
+    // asm ("int $0x02");
+    // asm ("int $0x03");
+    // asm ("int $0x04");
+    // asm ("int $0x05");
+    // asm ("int $0x06");
+    // asm ("int $0x07");
+    // asm ("int $0x08");
+    // asm ("int $0x09");
+    // asm ("int $0x0A");
+    // asm ("int $0x0B");
+    // asm ("int $0x0C");
+    // asm ("int $0x0D");
+    // asm ("int $0x0E");
+    // asm ("int $0x0F");
+    // asm ("int $0x10");
+    // asm ("int $0x11");
+    // asm ("int $0x12");
+    // asm ("int $0x13");
+
+    /* Paging tests 0-4 should throw exceptions */
+    // TEST_OUTPUT("paging_test_0", paging_test_0());
+    // TEST_OUTPUT("paging_test_1", paging_test_1());
+    // TEST_OUTPUT("paging_test_2", paging_test_2());
+    // TEST_OUTPUT("paging_test_3", paging_test_3());
+    // TEST_OUTPUT("paging_test_4", paging_test_4());
+
+    TEST_OUTPUT("paging_test_video_and_kernel", paging_test_video_and_kernel());
+}
+
+/* Wrapper function which calls all tests relevant to checkpoint 2 */
+void checkpoint2() {
+    TEST_HEADER;
+
+    /* Terminal tests */
+    TEST_OUTPUT("term_open_close_test", term_open_close_test());
+    TEST_OUTPUT("term_read_write_test", term_read_write_test());
+    TEST_OUTPUT("term_buff_overflow_test", term_buff_overflow_test());
+
+    /* RTC Tests */
+    TEST_OUTPUT("test_rtc_open_close", test_rtc_open_close());
+    TEST_OUTPUT("test_rtc_read", test_rtc_read());
+    TEST_OUTPUT("test_rtc_write", test_rtc_write());
+    TEST_OUTPUT("test_rtc_invalid", test_rtc_invalid());
+
+    /* File System Tests */
+    TEST_OUTPUT("test_file_open_close", test_file_open_close());
+    TEST_OUTPUT("test_file_write_and_dir", test_file_write_and_dir());
+    TEST_OUTPUT("test_dir_read", test_dir_read());
+    uint8_t filename[] = "fish";
+    TEST_OUTPUT("test_file_read", test_file_read(filename));    /* Prints first 32 chars of fish */
+    TEST_OUTPUT("test_read_all_files", test_read_all_files());
+    TEST_OUTPUT("test_file_read_cursor", test_file_read_cursor());
+    TEST_OUTPUT("test_dir_getdents", test_dir_getdents());
+    TEST_OUTPUT("test_dentry_lookup", test_dentry_lookup());
+    TEST_OUTPUT("test_stat_lseek_pread", test_stat_lseek_pread());
+    TEST_OUTPUT("test_tmpfs", test_tmpfs());
+    TEST_OUTPUT("test_bcache", test_bcache());
+
+    TEST_FINISHED;
+}
+
+/* Wrapper function which calls all tests relevant to checkpoint 3 */
+void checkpoint3() {
+    TEST_HEADER;
+    
+    TEST_OUTPUT("Open too many FDs", test_system_open_all_fds());
+    TEST_OUTPUT("Open invalid filenames", test_system_file_opennames());
+    TEST_OUTPUT("Read/write/close invalid FDs", test_system_invalid_fds());
+    TEST_OUTPUT("Send file to terminal", test_system_sendfile());
+    TEST_OUTPUT("Execute programs with white space", test_system_execute());
+
+    TEST_FINISHED;
 }
 
 /* Wrapper function which calls all tests relevant to checkpoint 4 */
@@ -898,6 +2053,451 @@ void checkpoint5() {
     TEST_FINISHED;
 }
 
+/* Wrapper function which calls all tests of the memory, process and IPC
+ * subsystems. Each test sets up and tears down its own processes */
+void kernel_subsystems() {
+    TEST_HEADER;
+
+    TEST_OUTPUT("test_frame_alloc", test_frame_alloc());
+    TEST_OUTPUT("test_kmalloc", test_kmalloc());
+    TEST_OUTPUT("test_exec_cache_evict", test_exec_cache_evict());
+    TEST_OUTPUT("test_demand_paging", test_demand_paging());
+    TEST_OUTPUT("test_shared_text", test_shared_text());
+    TEST_OUTPUT("test_cow_fork", test_cow_fork());
+    TEST_OUTPUT("test_shm", test_shm());
+    TEST_OUTPUT("test_pipe", test_pipe());
+    TEST_OUTPUT("test_wait_queue", test_wait_queue());
+    TEST_OUTPUT("test_run_queue", test_run_queue());
+
+    TEST_FINISHED;
+}
+
+/* Performance benchmarks */
+
+#define PIT_CH2_DATA_PORT   0x42
+#define PIT_MODE_PORT       0x43
+#define PIT_CH2_MODE_0      0xB0        /* Channel 2, lobyte/hibyte, mode 0, binary */
+#define PIT_GATE_PORT       0x61
+#define PIT_CH2_GATE        0x01
+#define PIT_SPEAKER         0x02
+#define PIT_CH2_OUT         0x20
+#define PIT_HZ              1193182
+#define CALIBRATE_MS        10
+
+/* Names of all dentries in the directory, filled by __bench_read_names */
+static uint8_t bench_names[NUM_DIR_ENTRIES][FILENAME_LEN + 1];
+static uint8_t bench_buf[BENCH_BUF_SIZE];
+static uint8_t bench_stream_buf[BENCH_STREAM_CHUNK];
+static uint32_t tsc_khz;
+
+/*
+ * __bench_tsc_khz
+ *   DESCRIPTION: Measures the TSC frequency by counting cycles while PIT
+ *                channel 2 counts down CALIBRATE_MS milliseconds. The result
+ *                is cached after the first call.
+ *        INPUTS: none
+ *  RETURN VALUE: TSC frequency in kHz
+ *  SIDE EFFECTS: Reprograms PIT channel 2 (PC speaker timer)
+ */
+uint32_t __bench_tsc_khz()
+{
+    uint32_t start;
+    uint32_t count = PIT_HZ * CALIBRATE_MS / 1000;
+
+    if (tsc_khz != 0)
+        return tsc_khz;
+
+    /* Raise channel 2 gate with speaker disconnected */
+    outb((inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_CH2_GATE, PIT_GATE_PORT);
+
+    /* Output goes high once the count reaches zero */
+    outb(PIT_CH2_MODE_0, PIT_MODE_PORT);
+    outb(count & 0xFF, PIT_CH2_DATA_PORT);
+    outb(count >> 8, PIT_CH2_DATA_PORT);
+
+    start = rdtsc();
+    while (!(inb(PIT_GATE_PORT) & PIT_CH2_OUT));
+    tsc_khz = (rdtsc() - start) / CALIBRATE_MS;
+
+    return tsc_khz;
+}
+
+/*
+ * __bench_mb_per_sec
+ *   DESCRIPTION: Converts a byte count moved in some number of cycles to MiB/s.
+ *                Operands are scaled down by 2^10 each to stay in 32 bits.
+ *        INPUTS: bytes - number of bytes moved
+ *                cycles - TSC cycles taken
+ *  RETURN VALUE: Throughput in MiB per second
+ *  SIDE EFFECTS: none
+ */
+uint32_t __bench_mb_per_sec(uint32_t bytes, uint32_t cycles)
+{
+    uint32_t kcycles = cycles / 1000;
+    if (kcycles == 0)
+        kcycles = 1;
+
+    return ((bytes >> 10) * (__bench_tsc_khz() >> 10)) / kcycles;
+}
+
+/*
+ * __bench_read_names
+ *   DESCRIPTION: Reads the name of every dentry into bench_names.
+ *        INPUTS: none
+ *  RETURN VALUE: Number of names read
+ *  SIDE EFFECTS: Overwrites bench_names
+ */
+int32_t __bench_read_names()
+{
+    int32_t num_names = 0;
+    int32_t fd = system_open((uint8_t*)".");
+    if (fd == FAILURE)
+        return 0;
+
+    while (num_names < NUM_DIR_ENTRIES && dir_read(fd, bench_names[num_names], FILENAME_LEN) > 0)
+    {
+        bench_names[num_names][FILENAME_LEN] = '\0';
+        ++num_names;
+    }
+    system_close(fd);
+
+    return num_names;
+}
+
+/*
+ * bench_dentry_lookup
+ *   DESCRIPTION: Times BENCH_ITERS lookups of every file in the directory and
+ *                of a missing name, through both the linear scan and the
+ *                hashed dentry index, and prints cycles per lookup.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Prints timings
+ *      COVERAGE: read_dentry_by_name(), read_dentry_by_scan()
+ *         FILES: file_sys.c/h
+ */
+int bench_dentry_lookup()
+{
+    TEST_HEADER;
+
+    uint8_t miss_name[] = "nosuchfile";
+    dentry_t dentry;
+    int result = PASS;
+    int32_t i, j;
+    uint32_t start;
+
+    int32_t num_names = __bench_read_names();
+    if (num_names == 0)
+        return FAIL;
+
+    /* Hits through linear scan */
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERS; ++i)
+        for (j = 0; j < num_names; ++j)
+            if (read_dentry_by_scan(bench_names[j], &dentry) != SUCCESS)
+                result = FAIL;
+    uint32_t scan_hit = rdtsc() - start;
+
+    /* Hits through hashed index */
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERS; ++i)
+        for (j = 0; j < num_names; ++j)
+            if (read_dentry_by_name(bench_names[j], &dentry) != SUCCESS)
+                result = FAIL;
+    uint32_t hash_hit = rdtsc() - start;
+
+    /* Misses through both */
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERS; ++i)
+        if (read_dentry_by_scan(miss_name, &dentry) != FAILURE)
+            result = FAIL;
+    uint32_t scan_miss = rdtsc() - start;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERS; ++i)
+        if (read_dentry_by_name(miss_name, &dentry) != FAILURE)
+            result = FAIL;
+    uint32_t hash_miss = rdtsc() - start;
+
+    printf("%d files, cycles per lookup:\n", num_names);
+    printf("    hit:  scan %u, hashed %u\n", scan_hit / (BENCH_ITERS * num_names), hash_hit / (BENCH_ITERS * num_names));
+    printf("    miss: scan %u, hashed %u\n", scan_miss / BENCH_ITERS, hash_miss / BENCH_ITERS);
+
+    return result;
+}
+
+/*
+ * __bench_read_all
+ *   DESCRIPTION: Reads every regular file in the directory through read_data
+ *                in chunks of chunk_size bytes.
+ *        INPUTS: num_names - number of names in bench_names
+ *                chunk_size - bytes per read_data call, at most BENCH_BUF_SIZE
+ *       OUTPUTS: cycles - TSC cycles spent in read_data
+ *  RETURN VALUE: Total bytes read or FAILURE
+ *  SIDE EFFECTS: Overwrites bench_buf
+ */
+int32_t __bench_read_all(int32_t num_names, uint32_t chunk_size, uint32_t* cycles)
+{
+    dentry_t dentry;
+    int32_t i, ret;
+    uint32_t offset, start;
+    uint32_t total = 0;
+
+    *cycles = 0;
+    for (i = 0; i < num_names; ++i)
+    {
+        if (read_dentry_by_name(bench_names[i], &dentry) != SUCCESS)
+            return FAILURE;
+        if (dentry.filetype != FILE_TYPE)
+            continue;
+
+        offset = 0;
+        start = rdtsc();
+        while ((ret = read_data(dentry.inode_num, offset, bench_buf, chunk_size)) > 0)
+            offset += ret;
+        *cycles += rdtsc() - start;
+
+        if (ret == FAILURE)
+            return FAILURE;
+        total += offset;
+    }
+
+    return total;
+}
+
+/*
+ * bench_read_data
+ *   DESCRIPTION: Reads every file in the image with block sized and with
+ *                terminal line sized reads and prints throughput of each.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Prints timings
+ *      COVERAGE: read_data()
+ *         FILES: file_sys.c/h
+ */
+int bench_read_data()
+{
+    TEST_HEADER;
+
+    uint32_t cycles;
+    int32_t num_names = __bench_read_names();
+    if (num_names == 0)
+        return FAIL;
+
+    printf("TSC: %u kHz\n", __bench_tsc_khz());
+
+    int32_t bytes = __bench_read_all(num_names, BENCH_BUF_SIZE, &cycles);
+    if (bytes == FAILURE)
+        return FAIL;
+    printf("%d byte reads: %u bytes, %u cycles, %u MiB/s\n", BENCH_BUF_SIZE, bytes, cycles, __bench_mb_per_sec(bytes, cycles));
+
+    bytes = __bench_read_all(num_names, BENCH_SMALL_READ, &cycles);
+    if (bytes == FAILURE)
+        return FAIL;
+    printf("%d byte reads: %u bytes, %u cycles, %u MiB/s\n", BENCH_SMALL_READ, bytes, cycles, __bench_mb_per_sec(bytes, cycles));
+
+    return PASS;
+}
+
+/*
+ * bench_exec_latency
+ *   DESCRIPTION: Executes a short program BENCH_EXEC_ITERS times and prints
+ *                the spawn latency recorded by execute.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Runs testprint, prints timings
+ *      COVERAGE: system_execute(), __load_program()
+ *         FILES: system.c/h
+ */
+int bench_exec_latency()
+{
+    TEST_HEADER;
+
+    exec_stats_t* stats = get_exec_stats();
+    uint32_t count = stats->count;
+    uint32_t total_k = stats->total_kcycles;
+    int32_t i;
+
+    for (i = 0; i < BENCH_EXEC_ITERS; ++i)
+    {
+        if (system_execute((uint8_t*)"testprint") != SUCCESS)
+            return FAIL;
+    }
+
+    if (stats->count - count != BENCH_EXEC_ITERS)
+        return FAIL;
+
+    printf("execute latency: avg %u, min %u, max %u cycles\n",
+           (stats->total_kcycles - total_k) * 1000 / BENCH_EXEC_ITERS, stats->min_cycles, stats->max_cycles);
+    printf("exec cache: %u hits, %u misses\n", get_exec_cache_stats()->hits, get_exec_cache_stats()->misses);
+
+    return PASS;
+}
+
+/*
+ * bench_stream_file
+ *   DESCRIPTION: Streams the largest file of the image through file_read in
+ *                BENCH_STREAM_CHUNK reads, rewinding at end of file, until
+ *                BENCH_STREAM_BYTES have been read. Images with a file of at
+ *                least that size (indirect blocks) stream it exactly once.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Prints throughput, and buffer cache counters of images on
+ *                disk
+ *      COVERAGE: file_read() cursor over block runs and indirect blocks
+ *         FILES: file_sys.c/h, bcache.c/h
+ */
+int bench_stream_file()
+{
+    TEST_HEADER;
+
+    bcache_stats_t before, after;
+    dentry_t dentry;
+    int32_t largest = -1;
+    int32_t largest_len = 0;
+    uint32_t total = 0;
+    uint32_t kcycles = 0;
+    int32_t i, ret;
+
+    int32_t num_names = __bench_read_names();
+    for (i = 0; i < num_names; ++i)
+    {
+        if (read_dentry_by_name(bench_names[i], &dentry) == SUCCESS && dentry.filetype == FILE_TYPE &&
+            file_length(dentry.inode_num) > largest_len)
+        {
+            largest = i;
+            largest_len = file_length(dentry.inode_num);
+        }
+    }
+    if (largest == -1)
+        return FAIL;
+
+    int32_t fd = system_open(bench_names[largest]);
+    if (fd == FAILURE)
+        return FAIL;
+
+    bcache_get_stats(&before);
+
+    /* Time each pass separately so the cycle count cannot wrap */
+    while (total < BENCH_STREAM_BYTES)
+    {
+        uint32_t start = rdtsc();
+        while (total < BENCH_STREAM_BYTES && (ret = file_read(fd, bench_stream_buf, BENCH_STREAM_CHUNK)) > 0)
+            total += ret;
+        kcycles += (rdtsc() - start) / 1000;
+
+        if (ret == FAILURE || file_lseek(fd, 0, SEEK_SET) != 0)
+        {
+            system_close(fd);
+            return FAIL;
+        }
+    }
+    system_close(fd);
+
+    uint32_t ms = kcycles / (__bench_tsc_khz() / 1000);
+    if (ms == 0)
+        ms = 1;
+    printf("%s (%d bytes): %u MiB in %u ms, %u MiB/s\n", bench_names[largest], largest_len,
+           total >> 20, ms, (total >> 20) * 1000 / ms);
+
+    bcache_get_stats(&after);
+    if (after.hits + after.misses != before.hits + before.misses)
+    {
+        printf("cache: %u hits, %u misses, %u disk reads of %u blocks, %u read ahead hits\n",
+               after.hits - before.hits, after.misses - before.misses, after.reads - before.reads,
+               after.blocks_read - before.blocks_read, after.read_ahead_hits - before.read_ahead_hits);
+    }
+
+    return PASS;
+}
+
+/*
+ * bench_spawn_depth
+ *   DESCRIPTION: Spawns nested processes, each the child of the last, until
+ *                PIDs or memory run out, loading testprint into each one and
+ *                faulting in its entry point and stack like a starting
+ *                program. Prints the spawn latency at each depth, then tears
+ *                the chain down and checks that every frame came back.
+ *        INPUTS: none
+ *  RETURN VALUE: PASS/FAIL
+ *  SIDE EFFECTS: Prints timings
+ *      COVERAGE: pcb_setup(), pcb_teardown(), get_new_pid(), vm_page_fault()
+ *         FILES: pcb.c/h, frame.c/h, vm.c/h
+ */
+int bench_spawn_depth()
+{
+    TEST_HEADER;
+
+    frame_stats_t before, after;
+    dentry_t dentry;
+    pcb_t* pcb;
+    int32_t base_pid = get_current_pcb()->pid;
+    int32_t depth = 0;
+    int32_t result = PASS;
+    int32_t eip;
+    uint32_t start, cycles, total = 0;
+
+    if (read_dentry_by_name((uint8_t*)"testprint", &dentry) != SUCCESS)
+        return FAIL;
+
+    /* Warm up, so the PCB cache already holds the empty slab it keeps */
+    if (pcb_setup(get_new_pid()) == NULL)
+        return FAIL;
+    pcb_teardown();
+    exec_cache_invalidate(dentry.inode_num);
+    frame_get_stats(&before);
+
+    while (depth < MAX_PID)
+    {
+        start = rdtsc();
+        pcb = pcb_setup(get_new_pid());
+        if (pcb == NULL)
+            break;
+        eip = exec_cache_load(&dentry, &pcb->exec_length);
+        pcb->exec_inode = dentry.inode_num;
+        vm_switch(pcb->pid);
+        if (eip == FAILURE)
+            result = FAIL;
+        else
+            *((volatile uint8_t*)eip);
+        *((volatile uint32_t*)(PROG_VIRT_ADDR + PROG_PAGE_SIZE - 4)) = 0;
+        cycles = rdtsc() - start;
+
+        total += cycles;
+        ++depth;
+        printf("%d:%u%c", depth, cycles, depth % BENCH_SPAWN_PER_LINE == 0 ? '\n' : ' ');
+    }
+    if (depth % BENCH_SPAWN_PER_LINE != 0)
+        printf("\n");
+
+    /* Halt the chain from the deepest process up */
+    while (get_current_pcb()->pid != base_pid)
+        pcb_teardown();
+
+    /* The cache holds the shared text page until testprint is evicted */
+    exec_cache_invalidate(dentry.inode_num);
+    frame_get_stats(&after);
+    /* Splitting and merging large frames moves frames between the counts */
+    if (depth == 0 || after.free_large * FRAMES_PER_LARGE + after.free_small !=
+                      before.free_large * FRAMES_PER_LARGE + before.free_small)
+        result = FAIL;
+
+    printf("spawned %d nested processes, avg %u cycles\n", depth, depth == 0 ? 0 : total / depth);
+    return result;
+}
+
+/* Wrapper function which calls all performance benchmarks */
+void benchmarks() {
+    TEST_HEADER;
+
+    TEST_OUTPUT("bench_dentry_lookup", bench_dentry_lookup());
+    TEST_OUTPUT("bench_read_data", bench_read_data());
+    TEST_OUTPUT("bench_exec_latency", bench_exec_latency());
+    TEST_OUTPUT("bench_spawn_depth", bench_spawn_depth());
+    TEST_OUTPUT("bench_stream_file", bench_stream_file());
+
+    TEST_FINISHED;
+}
+
 #endif /* RUN_TESTS */
 
 /* Test suite entry point */
@@ -922,6 +2522,14 @@ void launch_tests() {
         #if RUN_CHECKPOINT_5
             checkpoint5();
         #endif
+
+        #if RUN_KERNEL_SUBSYSTEMS
+            kernel_subsystems();
+        #endif
+
+        #if RUN_BENCHMARKS
+            benchmarks();
+        #endif
     #endif /* RUN_TESTS */
 
     printf("Tests Completed\n\n");
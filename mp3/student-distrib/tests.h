@@ -7,10 +7,31 @@
 #define RUN_CHECKPOINT_3    0
 #define RUN_CHECKPOINT_4    0
 #define RUN_CHECKPOINT_5    0
+#define RUN_KERNEL_SUBSYSTEMS   0
+#define RUN_BENCHMARKS      0
 
 #define NUM_EXCEPTIONS      20
 #define TTBUF_SIZE          18
 #define BUF_SIZE            32
+#define GETDENTS_BATCH      5
+#define FRAME_TEST_COUNT    8
+#define KMALLOC_TEST_SIZES  9           /* 1 to 22961 bytes, size = size * 3 + 5 */
+#define KMALLOC_TEST_OBJS   256         /* Over two slabs of KMALLOC_TEST_OBJ_SIZE objects, 101 per slab */
+#define KMALLOC_TEST_OBJ_SIZE   40
+#define SHM_TEST_KEY        391
+#define SHM_TEST_SIZE       (2 * 4096 + 1)  /* Three pages */
+#define PIPE_TEST_CHUNK     6000            /* Three chunks wrap around the ring */
+#define SCHED_TEST_TICKS    240
+#define SCHED_TEST_WAKE_TICKS   8           /* Enough for a woken SCHED_TEST_HIGH_PRIO process to use up its credit */
+#define SCHED_TEST_LOW_PRIO 2
+#define SCHED_TEST_HIGH_PRIO    6
+#define BENCH_ITERS         1000
+#define BENCH_BUF_SIZE      4096
+#define BENCH_SMALL_READ    128
+#define BENCH_EXEC_ITERS    5
+#define BENCH_SPAWN_PER_LINE    6
+#define BENCH_STREAM_BYTES  0x4000000   /* 64 MiB */
+#define BENCH_STREAM_CHUNK  0x10000
 
 // test launcher
 void launch_tests();
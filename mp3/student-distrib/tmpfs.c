@@ -0,0 +1,486 @@
+#include "tmpfs.h"
+#include "exec_cache.h"
+#include "kstats.h"
+#include "lib.h"
+#include "pcb.h"
+
+/* Block pool and free-block bitmap. A set bit marks a block in use */
+static uint8_t tmpfs_blocks[TMPFS_NUM_BLOCKS][BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+static uint32_t tmpfs_block_map[TMPFS_MAP_WORDS];
+static uint32_t tmpfs_free_blocks;
+
+/* Files are never removed, so slots [0, tmpfs_num_files) are all in use and
+ * the file in slot i has inode number TMPFS_INODE_BASE + i */
+static dentry_t tmpfs_dentries[TMPFS_MAX_FILES];
+static tmpfs_inode_t tmpfs_inodes[TMPFS_MAX_FILES];
+static uint32_t tmpfs_num_files;
+
+/* Local helpers */
+tmpfs_inode_t* __tmpfs_get_inode(uint32_t inode_idx);
+int32_t __alloc_block(void);
+void __free_block(int32_t block);
+int32_t __grow(tmpfs_inode_t* inode, int32_t num_blocks);
+void __shrink(tmpfs_inode_t* inode, int32_t num_blocks);
+int32_t __tmpfs_fill(int8_t* buf, int32_t size);
+
+/*
+ * tmpfs_init
+ *   DESCRIPTION: Empties the RAM file system and registers the "tmpfsstat"
+ *                kernel stats file.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void tmpfs_init()
+{
+    memset(tmpfs_block_map, 0, sizeof(tmpfs_block_map));
+    tmpfs_free_blocks = TMPFS_NUM_BLOCKS;
+    tmpfs_num_files = 0;
+
+    kstats_register("tmpfsstat", __tmpfs_fill);
+}
+
+/*
+ * tmpfs_create
+ *   DESCRIPTION: Creates an empty regular file. Names already used by the
+ *                boot image or the RAM file system cannot be created again.
+ *        INPUTS: fname - name of new file
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if name is invalid or taken, or no file
+ *                slots are left
+ *  SIDE EFFECTS: Adds a dentry listed after the boot image's
+ */
+int32_t tmpfs_create(const uint8_t* fname)
+{
+    dentry_t dentry;
+    long flags;
+    int32_t ret = FAILURE;
+
+    uint32_t name_len = strlen((int8_t*)fname);
+    if (name_len == 0 || name_len > FILENAME_LEN)
+        return FAILURE;
+
+    cli_and_save(flags);
+
+    if (tmpfs_num_files < TMPFS_MAX_FILES && read_dentry_by_name(fname, &dentry) == FAILURE)
+    {
+        dentry_t* entry = &tmpfs_dentries[tmpfs_num_files];
+        tmpfs_inode_t* inode = &tmpfs_inodes[tmpfs_num_files];
+
+        memset(entry, 0, sizeof(dentry_t));
+        strncpy(entry->filename, (int8_t*)fname, FILENAME_LEN);
+        entry->filetype = FILE_TYPE;
+        entry->inode_num = TMPFS_INODE_BASE + tmpfs_num_files;
+
+        inode->length = 0;
+        inode->num_blocks = 0;
+
+        ++tmpfs_num_files;
+        ret = SUCCESS;
+    }
+
+    restore_flags(flags);
+
+    return ret;
+}
+
+/*
+ * tmpfs_lookup
+ *   DESCRIPTION: Finds a RAM file by name. Called by read_dentry_by_name
+ *                once the boot image misses.
+ *        INPUTS: fname - name to look for
+ *                name_len - length of fname, at most FILENAME_LEN
+ *       OUTPUTS: dentry - copy of file's dentry
+ *  RETURN VALUE: SUCCESS or FAILURE if no RAM file has the name
+ *  SIDE EFFECTS: none
+ */
+int32_t tmpfs_lookup(const uint8_t* fname, uint32_t name_len, dentry_t* dentry)
+{
+    uint32_t i;
+
+    for (i = 0; i < tmpfs_num_files; ++i)
+    {
+        int8_t* name = tmpfs_dentries[i].filename;
+
+        if (strncmp((int8_t*)fname, name, name_len) == 0 &&
+            (name_len == FILENAME_LEN || name[name_len] == '\0'))
+        {
+            *dentry = tmpfs_dentries[i];
+            return SUCCESS;
+        }
+    }
+
+    return FAILURE;
+}
+
+/*
+ * tmpfs_dentry_at
+ *   DESCRIPTION: Gets the RAM file system's dentry at index, in creation order
+ *        INPUTS: index - 0 to tmpfs_file_count() - 1
+ *       OUTPUTS: dentry - copy of the dentry
+ *  RETURN VALUE: SUCCESS or FAILURE if index is out of range
+ *  SIDE EFFECTS: none
+ */
+int32_t tmpfs_dentry_at(uint32_t index, dentry_t* dentry)
+{
+    if (index >= tmpfs_num_files)
+        return FAILURE;
+
+    *dentry = tmpfs_dentries[index];
+    return SUCCESS;
+}
+
+/*
+ * tmpfs_file_count
+ *   DESCRIPTION: Gets the number of RAM files
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of files created
+ *  SIDE EFFECTS: none
+ */
+uint32_t tmpfs_file_count()
+{
+    return tmpfs_num_files;
+}
+
+/*
+ * tmpfs_is_inode
+ *   DESCRIPTION: Checks whether an inode number belongs to the RAM file
+ *                system rather than the boot image
+ *        INPUTS: inode_idx - inode number
+ *       OUTPUTS: none
+ *  RETURN VALUE: 1 if it does, else 0
+ *  SIDE EFFECTS: none
+ */
+int32_t tmpfs_is_inode(uint32_t inode_idx)
+{
+    return inode_idx >= TMPFS_INODE_BASE;
+}
+
+/*
+ * tmpfs_length
+ *   DESCRIPTION: Gets length of a RAM file in bytes
+ *        INPUTS: inode_idx - inode number of file
+ *       OUTPUTS: none
+ *  RETURN VALUE: Length of file or FAILURE for invalid inode
+ *  SIDE EFFECTS: none
+ */
+int32_t tmpfs_length(uint32_t inode_idx)
+{
+    tmpfs_inode_t* inode = __tmpfs_get_inode(inode_idx);
+    if (inode == NULL)
+        return FAILURE;
+
+    return inode->length;
+}
+
+/*
+ * tmpfs_read
+ *   DESCRIPTION: Reads up to length bytes of a RAM file starting at offset,
+ *                one block run at a time.
+ *        INPUTS: inode_idx - inode number of file
+ *                offset - position in file to start reading
+ *                length - number of bytes to read
+ *       OUTPUTS: buf - buffer in which to place data
+ *  RETURN VALUE: Number of bytes read, 0 at end of file, or FAILURE for
+ *                invalid inode
+ *  SIDE EFFECTS: none
+ */
+int32_t tmpfs_read(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t length)
+{
+    tmpfs_inode_t* inode = __tmpfs_get_inode(inode_idx);
+    uint32_t buf_idx = 0;
+    long flags;
+
+    if (inode == NULL)
+        return FAILURE;
+
+    cli_and_save(flags);
+
+    /* Stop at end of file */
+    if (offset >= inode->length)
+        length = 0;
+    else if (length > inode->length - offset)
+        length = inode->length - offset;
+
+    while (buf_idx < length)
+    {
+        /* Copy rest of this block or rest of request, whichever is shorter */
+        uint32_t pos_in_block = offset % BLOCK_SIZE;
+        uint32_t run = BLOCK_SIZE - pos_in_block;
+        if (run > length - buf_idx)
+            run = length - buf_idx;
+
+        memcpy(buf + buf_idx, tmpfs_blocks[inode->block[offset / BLOCK_SIZE]] + pos_in_block, run);
+
+        buf_idx += run;
+        offset += run;
+    }
+
+    restore_flags(flags);
+
+    return buf_idx;
+}
+
+/*
+ * tmpfs_write
+ *   DESCRIPTION: Writes length bytes to a RAM file at offset, growing it as
+ *                needed. A gap between the old end of file and offset reads
+ *                as zeros. Writes are cut short when the file reaches
+ *                TMPFS_MAX_FILE_SIZE or the block pool runs out.
+ *        INPUTS: inode_idx - inode number of file
+ *                offset - position in file to start writing
+ *                buf - data to write
+ *                length - number of bytes to write
+ *       OUTPUTS: none
+ *  RETURN VALUE: Number of bytes written or FAILURE for invalid inode, the
+ *                executable of a running process, or if no byte could be
+ *                written
+ *  SIDE EFFECTS: Allocates blocks, frees any past the written bytes, and
+ *                drops the file from the exec cache
+ */
+int32_t tmpfs_write(uint32_t inode_idx, uint32_t offset, const uint8_t* buf, uint32_t length)
+{
+    tmpfs_inode_t* inode = __tmpfs_get_inode(inode_idx);
+    uint32_t buf_idx = 0;
+    long flags;
+
+    if (inode == NULL || buf == NULL || pcb_image_busy(inode_idx))
+        return FAILURE;
+    if (length == 0)
+        return 0;
+    if (offset >= TMPFS_MAX_FILE_SIZE)
+        return FAILURE;
+
+    cli_and_save(flags);
+
+    /* Allocate through the last block written, keeping what fits */
+    if (length > TMPFS_MAX_FILE_SIZE - offset)
+        length = TMPFS_MAX_FILE_SIZE - offset;
+    __grow(inode, (offset + length + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    if (offset + length > inode->num_blocks * BLOCK_SIZE)
+        length = offset < inode->num_blocks * BLOCK_SIZE ? inode->num_blocks * BLOCK_SIZE - offset : 0;
+
+    while (buf_idx < length)
+    {
+        /* Copy rest of this block or rest of request, whichever is shorter */
+        uint32_t pos_in_block = offset % BLOCK_SIZE;
+        uint32_t run = BLOCK_SIZE - pos_in_block;
+        if (run > length - buf_idx)
+            run = length - buf_idx;
+
+        memcpy(tmpfs_blocks[inode->block[offset / BLOCK_SIZE]] + pos_in_block, buf + buf_idx, run);
+
+        buf_idx += run;
+        offset += run;
+    }
+
+    if (offset > inode->length)
+        inode->length = offset;
+
+    /* A short write keeps only the blocks up to the new end of file */
+    __shrink(inode, (inode->length + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+    restore_flags(flags);
+
+    exec_cache_invalidate(inode_idx);
+
+    return buf_idx > 0 ? buf_idx : FAILURE;
+}
+
+/*
+ * tmpfs_truncate
+ *   DESCRIPTION: Sets the length of a RAM file. Shrinking frees blocks past
+ *                the new end; growing appends zeros.
+ *        INPUTS: inode_idx - inode number of file
+ *                length - new length in bytes
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE for invalid inode, the executable of a
+ *                running process, length above TMPFS_MAX_FILE_SIZE, or too
+ *                few free blocks
+ *  SIDE EFFECTS: Allocates or frees blocks and drops the file from the exec
+ *                cache
+ */
+int32_t tmpfs_truncate(uint32_t inode_idx, uint32_t length)
+{
+    tmpfs_inode_t* inode = __tmpfs_get_inode(inode_idx);
+    int32_t num_blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int32_t ret = SUCCESS;
+    long flags;
+
+    if (inode == NULL || length > TMPFS_MAX_FILE_SIZE || pcb_image_busy(inode_idx))
+        return FAILURE;
+
+    cli_and_save(flags);
+
+    if (num_blocks > inode->num_blocks)
+    {
+        /* All or nothing: give back what was taken if the pool runs dry */
+        int32_t old_num_blocks = inode->num_blocks;
+        if (__grow(inode, num_blocks) == FAILURE)
+        {
+            __shrink(inode, old_num_blocks);
+            ret = FAILURE;
+        }
+    }
+    else
+    {
+        __shrink(inode, num_blocks);
+
+        /* Bytes past the end of file must read as zeros if it grows again */
+        if (length < inode->length && length % BLOCK_SIZE != 0)
+            memset(tmpfs_blocks[inode->block[length / BLOCK_SIZE]] + length % BLOCK_SIZE, 0,
+                   BLOCK_SIZE - length % BLOCK_SIZE);
+    }
+
+    if (ret == SUCCESS)
+        inode->length = length;
+
+    restore_flags(flags);
+
+    exec_cache_invalidate(inode_idx);
+
+    return ret;
+}
+
+/*
+ * tmpfs_get_block
+ *   DESCRIPTION: Gets address of one data block of a RAM file
+ *        INPUTS: inode_idx - inode number of file
+ *                block_num - index of block within the file
+ *       OUTPUTS: none
+ *  RETURN VALUE: Address of block or NULL if inode or block is invalid
+ *  SIDE EFFECTS: none
+ */
+uint8_t* tmpfs_get_block(uint32_t inode_idx, uint32_t block_num)
+{
+    tmpfs_inode_t* inode = __tmpfs_get_inode(inode_idx);
+
+    if (inode == NULL || block_num >= inode->num_blocks || block_num * BLOCK_SIZE >= inode->length)
+        return NULL;
+
+    return tmpfs_blocks[inode->block[block_num]];
+}
+
+/*
+ * __tmpfs_get_inode
+ *   DESCRIPTION: Gets RAM inode for an inode number
+ *        INPUTS: inode_idx - inode number
+ *       OUTPUTS: none
+ *  RETURN VALUE: Pointer to inode or NULL if no such RAM file exists
+ *  SIDE EFFECTS: none
+ */
+tmpfs_inode_t* __tmpfs_get_inode(uint32_t inode_idx)
+{
+    if (!tmpfs_is_inode(inode_idx) || inode_idx - TMPFS_INODE_BASE >= tmpfs_num_files)
+        return NULL;
+
+    return &tmpfs_inodes[inode_idx - TMPFS_INODE_BASE];
+}
+
+/*
+ * __alloc_block
+ *   DESCRIPTION: Takes the lowest free block from the pool and zeroes it.
+ *                Call with interrupts disabled.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Block index or FAILURE if the pool is empty
+ *  SIDE EFFECTS: Marks block in use
+ */
+int32_t __alloc_block()
+{
+    uint32_t word, bit;
+
+    for (word = 0; word < TMPFS_MAP_WORDS; ++word)
+    {
+        if (tmpfs_block_map[word] == 0xFFFFFFFF)
+            continue;
+
+        for (bit = 0; tmpfs_block_map[word] & (1 << bit); ++bit);
+
+        tmpfs_block_map[word] |= 1 << bit;
+        --tmpfs_free_blocks;
+        memset(tmpfs_blocks[word * 32 + bit], 0, BLOCK_SIZE);
+        return word * 32 + bit;
+    }
+
+    return FAILURE;
+}
+
+/*
+ * __free_block
+ *   DESCRIPTION: Returns a block to the pool. Call with interrupts disabled.
+ *        INPUTS: block - block index from __alloc_block
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Marks block free
+ */
+void __free_block(int32_t block)
+{
+    tmpfs_block_map[block / 32] &= ~(1 << (block % 32));
+    ++tmpfs_free_blocks;
+}
+
+/*
+ * __grow
+ *   DESCRIPTION: Allocates zeroed blocks until the file has num_blocks, or
+ *                the pool runs out. Call with interrupts disabled.
+ *        INPUTS: inode - file to grow
+ *                num_blocks - wanted number of blocks, at most
+ *                             TMPFS_MAX_FILE_BLOCKS
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if the pool ran out first
+ *  SIDE EFFECTS: Allocates blocks
+ */
+int32_t __grow(tmpfs_inode_t* inode, int32_t num_blocks)
+{
+    while (inode->num_blocks < num_blocks)
+    {
+        int32_t block = __alloc_block();
+        if (block == FAILURE)
+            return FAILURE;
+
+        inode->block[inode->num_blocks++] = block;
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * __shrink
+ *   DESCRIPTION: Frees blocks from the end of the file until it has
+ *                num_blocks. Call with interrupts disabled.
+ *        INPUTS: inode - file to shrink
+ *                num_blocks - wanted number of blocks
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Frees blocks
+ */
+void __shrink(tmpfs_inode_t* inode, int32_t num_blocks)
+{
+    while (inode->num_blocks > num_blocks)
+    {
+        __free_block(inode->block[--inode->num_blocks]);
+        inode->block[inode->num_blocks] = TMPFS_NO_BLOCK;
+    }
+}
+
+/*
+ * __tmpfs_fill
+ *   DESCRIPTION: Fill function of the "tmpfsstat" kernel stats file
+ *        INPUTS: size - size of buf
+ *       OUTPUTS: buf - text of stats file
+ *  RETURN VALUE: Length of text
+ *  SIDE EFFECTS: none
+ */
+int32_t __tmpfs_fill(int8_t* buf, int32_t size)
+{
+    int32_t len = 0;
+
+    len = kstats_line(buf, size, len, "files", tmpfs_num_files);
+    len = kstats_line(buf, size, len, "max files", TMPFS_MAX_FILES);
+    len = kstats_line(buf, size, len, "blocks used", TMPFS_NUM_BLOCKS - tmpfs_free_blocks);
+    len = kstats_line(buf, size, len, "blocks free", tmpfs_free_blocks);
+    return len;
+}
@@ -0,0 +1,38 @@
+#ifndef TMPFS_H_
+#define TMPFS_H_
+
+#include "types.h"
+#include "file_sys.h"
+
+#define TMPFS_NUM_BLOCKS        256         /* 1 MiB pool of BLOCK_SIZE blocks */
+#define TMPFS_MAP_WORDS         (TMPFS_NUM_BLOCKS / 32)
+#define TMPFS_MAX_FILES         16
+#define TMPFS_MAX_FILE_BLOCKS   64          /* 256 KiB per file */
+#define TMPFS_MAX_FILE_SIZE     (TMPFS_MAX_FILE_BLOCKS * BLOCK_SIZE)
+#define TMPFS_INODE_BASE        0x40000000  /* Above any boot image inode number */
+#define TMPFS_NO_BLOCK          -1
+
+/* RAM-backed file. block[i] indexes tmpfs_blocks for the file's ith block */
+typedef struct tmpfs_inode {
+    int32_t length;
+    int32_t num_blocks;
+    int32_t block[TMPFS_MAX_FILE_BLOCKS];
+} tmpfs_inode_t;
+
+void tmpfs_init();
+
+/* Directory */
+int32_t tmpfs_create(const uint8_t* fname);
+int32_t tmpfs_lookup(const uint8_t* fname, uint32_t name_len, dentry_t* dentry);
+int32_t tmpfs_dentry_at(uint32_t index, dentry_t* dentry);
+uint32_t tmpfs_file_count();
+
+/* File data */
+int32_t tmpfs_is_inode(uint32_t inode_idx);
+int32_t tmpfs_length(uint32_t inode_idx);
+int32_t tmpfs_read(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t length);
+int32_t tmpfs_write(uint32_t inode_idx, uint32_t offset, const uint8_t* buf, uint32_t length);
+int32_t tmpfs_truncate(uint32_t inode_idx, uint32_t length);
+uint8_t* tmpfs_get_block(uint32_t inode_idx, uint32_t block_num);
+
+#endif /* TMPFS_H_ */
@@ -0,0 +1,451 @@
+/*
+ * File: vm.c
+ *   Process address spaces. Each process has its own page directory sharing
+ *   the kernel's entries below PD_USER. Its program area at PROG_VIRT_ADDR
+ *   starts out empty and is filled one 4 kB page at a time by the page fault
+ *   handler. Read-only text pages are shared through the exec cache by every
+ *   process running the same executable. Other pages overlapping the image
+ *   are private copies read from the file, and everything else (bss, heap,
+ *   stack) is zero filled. Fork shares private pages copy-on-write: both
+ *   processes map them read-only until one of them writes. Shared memory
+ *   pages stay writable and shared in both.
+ */
+#include "vm.h"
+#include "exec_cache.h"
+#include "frame.h"
+#include "kstats.h"
+#include "lib.h"
+#include "paging.h"
+#include "pcb.h"
+#include "system.h"
+
+static vm_stats_t vm_stats;
+
+/* Local helpers */
+uint32_t* __vm_get_table(uint32_t* page_dir, uint32_t addr);
+int32_t __vm_fill_page(pcb_t* pcb, uint32_t page, uint8_t* frame);
+int32_t __vm_cow_fault(uint32_t* page_dir, uint32_t page, uint32_t error);
+int32_t __vm_fill(int8_t* buf, int32_t size);
+
+/*
+ * vm_init
+ *   DESCRIPTION: Clears statistics and registers the "vmstat" kernel stats
+ *                file.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void vm_init(void)
+{
+    memset(&vm_stats, 0, sizeof(vm_stats));
+    kstats_register("vmstat", __vm_fill);
+}
+
+/*
+ * vm_create
+ *   DESCRIPTION: Creates an empty address space: a page directory holding
+ *                only the kernel's entries.
+ *        INPUTS: none
+ *       OUTPUTS: none
+ *  RETURN VALUE: Page directory or NULL if out of memory
+ *  SIDE EFFECTS: Allocates a frame
+ */
+uint32_t* vm_create(void)
+{
+    uint32_t* page_dir = (uint32_t*)frame_alloc();
+
+    if (page_dir == NULL)
+        return NULL;
+
+    init_page_directory(page_dir);
+    ++vm_stats.spaces;
+    return page_dir;
+}
+
+/*
+ * vm_destroy
+ *   DESCRIPTION: Frees an address space: the frames its pages own, all of
+ *                its page tables, and the page directory. Pages not marked
+ *                PTE_OWNED, like mapped file blocks, are left alone.
+ *        INPUTS: page_dir - PD from vm_create that is not the active one, or
+ *                NULL
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Frees frames
+ */
+void vm_destroy(uint32_t* page_dir)
+{
+    uint32_t i, j;
+    uint32_t* table;
+
+    if (page_dir == NULL)
+        return;
+
+    for (i = PD_USER; i < NUM_PAGE_ENTRIES; ++i)
+    {
+        if (!(page_dir[i] & PDE_PRESENT) || (page_dir[i] & PDE_PAGE_SIZE))
+            continue;
+
+        table = (uint32_t*)(page_dir[i] & FLAG_MASK);
+        for (j = 0; j < NUM_PAGE_ENTRIES; ++j)
+        {
+            if ((table[j] & (PTE_OWNED | PDE_PRESENT)) == (PTE_OWNED | PDE_PRESENT))
+            {
+                frame_free(table[j] & FLAG_MASK);
+                --vm_stats.resident;
+            }
+        }
+        frame_free((uint32_t)table);
+    }
+
+    frame_free((uint32_t)page_dir);
+    --vm_stats.spaces;
+}
+
+/*
+ * vm_fork
+ *   DESCRIPTION: Fills an empty address space with a copy-on-write copy of
+ *                another. Both processes get the same frames, each holding a
+ *                reference; writable pages other than shared memory become
+ *                read-only copy-on-write pages in both. Pages the parent does
+ *                not own, like mapped file blocks, are mapped as they are.
+ *        INPUTS: parent_dir - active PD being copied
+ *                child_dir - PD from vm_create
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if out of memory, in which case the
+ *                child must be destroyed
+ *  SIDE EFFECTS: Write protects parent's pages. Flushes TLBs.
+ */
+int32_t vm_fork(uint32_t* parent_dir, uint32_t* child_dir)
+{
+    uint32_t i, j, pte;
+    uint32_t *src, *dst;
+    int32_t result = SUCCESS;
+
+    for (i = PD_USER; i < NUM_PAGE_ENTRIES && result == SUCCESS; ++i)
+    {
+        if (!(parent_dir[i] & PDE_PRESENT) || (parent_dir[i] & PDE_PAGE_SIZE))
+            continue;
+
+        dst = (uint32_t*)frame_alloc();
+        if (dst == NULL)
+        {
+            result = FAILURE;
+            break;
+        }
+        memset(dst, 0, PAGE_SIZE);
+        child_dir[i] = (uint32_t)dst | (parent_dir[i] & ~FLAG_MASK);
+
+        src = (uint32_t*)(parent_dir[i] & FLAG_MASK);
+        for (j = 0; j < NUM_PAGE_ENTRIES; ++j)
+        {
+            pte = src[j];
+            if (!(pte & PDE_PRESENT))
+                continue;
+
+            if (pte & PTE_OWNED)
+            {
+                if (frame_ref(pte & FLAG_MASK) == FAILURE)
+                {
+                    result = FAILURE;
+                    break;
+                }
+                if ((pte & (PDE_READ_WRITE | PTE_SHARED)) == PDE_READ_WRITE)
+                {
+                    pte = (pte & ~PDE_READ_WRITE) | PTE_COW;
+                    src[j] = pte;
+                }
+                ++vm_stats.resident;
+            }
+            dst[j] = pte;
+        }
+    }
+
+    flush_tlb();
+    return result;
+}
+
+/*
+ * vm_switch
+ *   DESCRIPTION: Makes a process' address space the active one.
+ *        INPUTS: pid - process about to run, the kernel's PD is used for PID 0
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Loads CR3, flushing TLBs
+ */
+void vm_switch(int32_t pid)
+{
+    pcb_t* pcb = get_pcb_addr(pid);
+
+    set_page_directory(pcb != NULL ? pcb->page_dir : NULL);
+}
+
+/*
+ * vm_page_fault
+ *   DESCRIPTION: Handles a fault on a missing page of the current process'
+ *                program area. Text pages map the executable's shared frame
+ *                read-only, other pages get a private frame filled from the
+ *                executable or with zeros. Writes to copy-on-write pages get
+ *                a private copy. Faults from the kernel touching user buffers
+ *                are handled the same way. Runs with interrupts disabled.
+ *        INPUTS: addr - faulting address from CR2
+ *                error - error code pushed by the processor
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS if the access can be retried, FAILURE if the fault
+ *                is a real error
+ *  SIDE EFFECTS: Allocates a frame and maybe a page table
+ */
+int32_t vm_page_fault(uint32_t addr, uint32_t error)
+{
+    pcb_t* pcb = get_current_pcb();
+    uint32_t page = addr & FLAG_MASK;
+    uint32_t image = PROG_VIRT_ADDR + PROG_OFFSET;
+    uint32_t* table;
+    uint32_t frame;
+
+    /* Only the program area of the active PD is demand paged */
+    if (pcb == NULL || pcb->page_dir == NULL || pcb->page_dir != get_page_directory() ||
+        addr < PROG_VIRT_ADDR || addr >= PROG_VIRT_ADDR + PROG_PAGE_SIZE)
+    {
+        ++vm_stats.failures;
+        return FAILURE;
+    }
+
+    if (error & PF_PRESENT)
+        return __vm_cow_fault(pcb->page_dir, page, error);
+
+    table = __vm_get_table(pcb->page_dir, page);
+    if (table == NULL)
+    {
+        ++vm_stats.failures;
+        return FAILURE;
+    }
+
+    /* The reference to a shared frame is the process' own, dropped by vm_destroy */
+    frame = (page >= image) ? exec_cache_text_page(pcb->exec_inode, page - image) : NULL;
+    if (frame != NULL)
+    {
+        table[(page >> BITS_TO_PT_IDX) & PT_MASK] = frame | PTE_OWNED | PDE_USER_SUPERVISOR | PDE_PRESENT;
+        ++vm_stats.shared_faults;
+    }
+    else
+    {
+        frame = frame_alloc();
+        if (frame == NULL || __vm_fill_page(pcb, page, (uint8_t*)frame) == FAILURE)
+        {
+            frame_free(frame);
+            ++vm_stats.failures;
+            return FAILURE;
+        }
+        table[(page >> BITS_TO_PT_IDX) & PT_MASK] = frame | PTE_OWNED | PDE_USER_SUPERVISOR | PDE_READ_WRITE | PDE_PRESENT;
+    }
+
+    flush_tlb_page(page);
+    ++vm_stats.resident;
+
+    return SUCCESS;
+}
+
+/*
+ * vm_map_shared
+ *   DESCRIPTION: Maps a shared memory frame writable into the active address
+ *                space. The mapping holds its own reference to the frame,
+ *                dropped when it is unmapped or the address space destroyed.
+ *        INPUTS: addr - page aligned user address that is not mapped
+ *                frame - frame to map
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS or FAILURE if out of memory
+ *  SIDE EFFECTS: May allocate a page table
+ */
+int32_t vm_map_shared(uint32_t addr, uint32_t frame)
+{
+    uint32_t* page_dir = get_page_directory();
+    uint32_t* table = __vm_get_table(page_dir, addr);
+
+    if (table == NULL || frame_ref(frame) == FAILURE)
+        return FAILURE;
+
+    table[(addr >> BITS_TO_PT_IDX) & PT_MASK] = frame | PTE_SHARED | PTE_OWNED | PDE_USER_SUPERVISOR | PDE_READ_WRITE | PDE_PRESENT;
+    flush_tlb_page(addr);
+    ++vm_stats.resident;
+
+    return SUCCESS;
+}
+
+/*
+ * vm_unmap_page
+ *   DESCRIPTION: Unmaps a page of the active address space, dropping its
+ *                reference to the frame if the page owns one.
+ *        INPUTS: addr - page aligned user address
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: May free a frame
+ */
+void vm_unmap_page(uint32_t addr)
+{
+    uint32_t* page_dir = get_page_directory();
+    uint32_t* table;
+    uint32_t* pte;
+
+    if (!(page_dir[addr >> BITS_TO_PD_IDX] & PDE_PRESENT))
+        return;
+
+    table = (uint32_t*)(page_dir[addr >> BITS_TO_PD_IDX] & FLAG_MASK);
+    pte = &table[(addr >> BITS_TO_PT_IDX) & PT_MASK];
+    if ((*pte & (PTE_OWNED | PDE_PRESENT)) == (PTE_OWNED | PDE_PRESENT))
+    {
+        frame_free(*pte & FLAG_MASK);
+        --vm_stats.resident;
+    }
+    *pte = 0;
+    flush_tlb_page(addr);
+}
+
+/*
+ * vm_get_stats
+ *   DESCRIPTION: Copies the address space counters
+ *        INPUTS: none
+ *       OUTPUTS: stats - filled with the current counts
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void vm_get_stats(vm_stats_t* stats)
+{
+    *stats = vm_stats;
+}
+
+/*
+ * __vm_get_table
+ *   DESCRIPTION: Gets the page table covering a user address, allocating an
+ *                empty one the first time.
+ *        INPUTS: page_dir - process' PD
+ *                addr - user address
+ *       OUTPUTS: none
+ *  RETURN VALUE: Page table or NULL if out of memory
+ *  SIDE EFFECTS: May allocate a frame
+ */
+uint32_t* __vm_get_table(uint32_t* page_dir, uint32_t addr)
+{
+    uint32_t pd_num = addr >> BITS_TO_PD_IDX;
+    uint32_t table;
+
+    if (page_dir[pd_num] & PDE_PRESENT)
+        return (uint32_t*)(page_dir[pd_num] & FLAG_MASK);
+
+    table = frame_alloc();
+    if (table == NULL)
+        return NULL;
+    memset((void*)table, 0, PAGE_SIZE);
+
+    /* Pages within the table carry their own read/write permission */
+    page_dir[pd_num] = table | PDE_USER_SUPERVISOR | PDE_READ_WRITE | PDE_PRESENT;
+    return (uint32_t*)table;
+}
+
+/*
+ * __vm_fill_page
+ *   DESCRIPTION: Fills a new frame for a page of the program area. Bytes the
+ *                executable image covers are read from it, the rest are zero.
+ *                The RAM file system refuses to change a file while a
+ *                process executes it, so all pages come from the same image.
+ *        INPUTS: pcb - process the page belongs to
+ *                page - page aligned user address
+ *       OUTPUTS: frame - frame to fill
+ *  RETURN VALUE: SUCCESS/FAILURE
+ *  SIDE EFFECTS: none
+ */
+int32_t __vm_fill_page(pcb_t* pcb, uint32_t page, uint8_t* frame)
+{
+    uint32_t image = PROG_VIRT_ADDR + PROG_OFFSET;
+    uint32_t first = page > image ? page : image;
+    uint32_t end = page + PAGE_SIZE < image + pcb->exec_length ? page + PAGE_SIZE : image + pcb->exec_length;
+
+    memset(frame, 0, PAGE_SIZE);
+    if (first >= end)
+    {
+        ++vm_stats.zero_faults;
+        return SUCCESS;
+    }
+
+    if (exec_cache_read(pcb->exec_inode, first - image, frame + (first - page), end - first) != (int32_t)(end - first))
+        return FAILURE;
+
+    ++vm_stats.file_faults;
+    return SUCCESS;
+}
+
+/*
+ * __vm_cow_fault
+ *   DESCRIPTION: Handles a write to a copy-on-write page by copying it to a
+ *                private frame, or by making it writable again when no other
+ *                address space maps the frame anymore.
+ *        INPUTS: page_dir - active PD
+ *                page - page aligned user address of a present page
+ *                error - error code pushed by the processor
+ *       OUTPUTS: none
+ *  RETURN VALUE: SUCCESS if the write can be retried, FAILURE if the page is
+ *                not copy-on-write or memory is exhausted
+ *  SIDE EFFECTS: May allocate a frame and drop a reference to the old one
+ */
+int32_t __vm_cow_fault(uint32_t* page_dir, uint32_t page, uint32_t error)
+{
+    uint32_t* table = (uint32_t*)(page_dir[page >> BITS_TO_PD_IDX] & FLAG_MASK);
+    uint32_t* pte = &table[(page >> BITS_TO_PT_IDX) & PT_MASK];
+    uint32_t old_frame = *pte & FLAG_MASK;
+    uint32_t frame;
+
+    /* Writes to read-only text, and reads, are real protection faults */
+    if (!(error & PF_WRITE) || !(*pte & PTE_COW))
+    {
+        ++vm_stats.failures;
+        return FAILURE;
+    }
+
+    if (frame_refcount(old_frame) == 1)
+    {
+        *pte = (*pte & ~PTE_COW) | PDE_READ_WRITE;
+        ++vm_stats.cow_reuses;
+    }
+    else
+    {
+        frame = frame_alloc();
+        if (frame == NULL)
+        {
+            ++vm_stats.failures;
+            return FAILURE;
+        }
+        memcpy((void*)frame, (void*)old_frame, PAGE_SIZE);
+        *pte = frame | PTE_OWNED | PDE_USER_SUPERVISOR | PDE_READ_WRITE | PDE_PRESENT;
+        frame_free(old_frame);
+        ++vm_stats.cow_copies;
+    }
+
+    flush_tlb_page(page);
+    return SUCCESS;
+}
+
+/*
+ * __vm_fill
+ *   DESCRIPTION: Writes the "vmstat" kernel stats file
+ *        INPUTS: buf - destination for the text
+ *                size - size of buf
+ *       OUTPUTS: none
+ *  RETURN VALUE: Length of the text
+ *  SIDE EFFECTS: none
+ */
+int32_t __vm_fill(int8_t* buf, int32_t size)
+{
+    int32_t len = 0;
+
+    len = kstats_line(buf, size, len, "address spaces", vm_stats.spaces);
+    len = kstats_line(buf, size, len, "resident pages", vm_stats.resident);
+    len = kstats_line(buf, size, len, "resident KB", vm_stats.resident * (PAGE_SIZE / 1024));
+    len = kstats_line(buf, size, len, "shared text faults", vm_stats.shared_faults);
+    len = kstats_line(buf, size, len, "file faults", vm_stats.file_faults);
+    len = kstats_line(buf, size, len, "zero faults", vm_stats.zero_faults);
+    len = kstats_line(buf, size, len, "cow copies", vm_stats.cow_copies);
+    len = kstats_line(buf, size, len, "cow reuses", vm_stats.cow_reuses);
+    len = kstats_line(buf, size, len, "failures", vm_stats.failures);
+    return len;
+}
@@ -0,0 +1,34 @@
+#ifndef VM_H_
+#define VM_H_
+
+#include "types.h"
+
+#define PF_PRESENT          0x1         /* Page fault error code: page was present */
+#define PF_WRITE            0x2         /* Page fault error code: access was a write */
+#define PF_USER             0x4         /* Page fault error code: access was from user mode */
+
+/* Counters reported by the "vmstat" kernel stats file */
+typedef struct vm_stats {
+    uint32_t spaces;                    /* Process page directories in use */
+    uint32_t resident;                  /* User pages mapped to a frame, shared or not */
+    uint32_t shared_faults;             /* Faults mapping a shared text page */
+    uint32_t file_faults;               /* Faults filled from an executable */
+    uint32_t zero_faults;               /* Faults filled with zeros (bss, stack) */
+    uint32_t cow_copies;                /* Writes that copied a shared page */
+    uint32_t cow_reuses;                /* Writes to a page no one else maps anymore */
+    uint32_t failures;                  /* Faults that could not be handled */
+} vm_stats_t;
+
+void vm_init(void);
+
+uint32_t* vm_create(void);
+void vm_destroy(uint32_t* page_dir);
+int32_t vm_fork(uint32_t* parent_dir, uint32_t* child_dir);
+void vm_switch(int32_t pid);
+int32_t vm_page_fault(uint32_t addr, uint32_t error);
+int32_t vm_map_shared(uint32_t addr, uint32_t frame);
+void vm_unmap_page(uint32_t addr);
+
+void vm_get_stats(vm_stats_t* stats);
+
+#endif /* VM_H_ */
@@ -0,0 +1,89 @@
+/*
+ * File: wait_queue.c
+ *   Wait queues let a process sleep in the kernel until an event, usually
+ *   an interrupt, instead of spinning through its time slices. A sleeping
+ *   process is marked blocked and taken off the run queue until it is
+ *   woken. Callers check their condition with interrupts disabled and
+ *   sleep in a loop, since a wakeup only means the condition may be true:
+ *
+ *       cli_and_save(flags);
+ *       while (!condition)
+ *           wait_queue_sleep(&queue);
+ *       restore_flags(flags);
+ */
+#include "wait_queue.h"
+#include "lib.h"
+#include "pcb.h"
+#include "scheduler.h"
+
+/*
+ * wait_queue_init
+ *   DESCRIPTION: Empties a wait queue.
+ *        INPUTS: queue - wait queue to initialize
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: none
+ */
+void wait_queue_init(wait_queue_t* queue)
+{
+    queue->head = NULL;
+}
+
+/*
+ * wait_queue_sleep
+ *   DESCRIPTION: Blocks the current process until the queue is woken. Other
+ *                processes run in the meantime; when none can, the processor
+ *                halts until the next interrupt. Must be called with
+ *                interrupts disabled so that a wakeup between checking the
+ *                condition and sleeping is not lost.
+ *        INPUTS: queue - wait queue of the event
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Returns with interrupts disabled
+ */
+void wait_queue_sleep(wait_queue_t* queue)
+{
+    pcb_t* pcb = get_current_pcb();
+
+    pcb->blocked = 1;
+    pcb->wait_next = queue->head;
+    queue->head = pcb;
+    schedule_dequeue(pcb);
+
+    while (pcb->blocked)
+    {
+        schedule_yield();
+
+        /* Nothing else was runnable, idle until an interrupt */
+        if (pcb->blocked)
+        {
+            asm volatile("sti; hlt; cli" : : : "memory", "cc");
+        }
+    }
+}
+
+/*
+ * wait_queue_wake
+ *   DESCRIPTION: Makes every process sleeping on the queue runnable again.
+ *                Safe to call from interrupt handlers.
+ *        INPUTS: queue - wait queue of the event
+ *       OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: Empties the queue, may request a switch to a woken process
+ */
+void wait_queue_wake(wait_queue_t* queue)
+{
+    pcb_t* pcb;
+    long flags;
+
+    cli_and_save(flags);
+    while (queue->head != NULL)
+    {
+        pcb = queue->head;
+        queue->head = pcb->wait_next;
+        pcb->wait_next = NULL;
+        pcb->blocked = 0;
+        schedule_enqueue(pcb);
+    }
+    restore_flags(flags);
+}
@@ -0,0 +1,17 @@
+#ifndef WAIT_QUEUE_H_
+#define WAIT_QUEUE_H_
+
+#include "types.h"
+
+struct process_control_block;
+
+/* Processes sleeping until an event, linked through their PCBs */
+typedef struct wait_queue {
+    struct process_control_block* head;
+} wait_queue_t;
+
+void wait_queue_init(wait_queue_t* queue);
+void wait_queue_sleep(wait_queue_t* queue);
+void wait_queue_wake(wait_queue_t* queue);
+
+#endif /* WAIT_QUEUE_H_ */
@@ -3,6 +3,8 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
+#define SENDFILE_CHUNK 0x10000
+
 int main ()
 {
     int32_t fd, cnt;
@@ -18,6 +20,16 @@ int main ()
 	return 2;
     }
 
+    /* Let the kernel print regular files straight from their data blocks */
+    if (-1 != (cnt = ece391_sendfile (1, fd, SENDFILE_CHUNK))) {
+	while (0 != cnt) {
+	    if (-1 == cnt)
+		return 3;
+	    cnt = ece391_sendfile (1, fd, SENDFILE_CHUNK);
+	}
+	return 0;
+    }
+
     while (0 != (cnt = ece391_read (fd, buf, 1024))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"file read failed\n");
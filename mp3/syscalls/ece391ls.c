@@ -4,25 +4,32 @@
 #include "ece391syscall.h"
 
 #define SBUFSIZE 33
+#define NUM_DIRENTS 16
 
 int main ()
 {
-    int32_t fd, cnt;
+    int32_t fd, cnt, i, len;
     uint8_t buf[SBUFSIZE];
+    struct ece391_dirent dirents[NUM_DIRENTS];
 
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
         return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    /* Fetch a batch of entries per system call */
+    while (0 != (cnt = ece391_getdents (fd, dirents, sizeof (dirents)))) {
         if (-1 == cnt) {
 	        ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	        return 3;
 	    }
-	    buf[cnt] = '\n';
-	    if (-1 == ece391_write (1, buf, cnt + 1))
-	        return 3;
+	    for (i = 0; i < cnt / (int32_t)sizeof (struct ece391_dirent); i++) {
+	        for (len = 0; len < SBUFSIZE - 1 && '\0' != dirents[i].name[len]; len++)
+	            buf[len] = dirents[i].name[len];
+	        buf[len] = '\n';
+	        if (-1 == ece391_write (1, buf, len + 1))
+	            return 3;
+	    }
     }
 
     return 0;
@@ -0,0 +1,98 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/* Streams data through a pipe and reports its bandwidth. A forked child
+ * writes while the parent reads, so both run at once and the writer
+ * sleeps whenever the kernel's ring buffer is full. */
+
+#define BUFSIZE 32
+#define CHUNK 8192                          /* Half of the kernel's ring buffer */
+#define CHUNKS 2048                         /* 16 MB in total */
+
+static uint32_t rdtsc (void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+static void print_num (const char* label, uint32_t value, const char* unit)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, buf, 10));
+    ece391_fdputs (1, (uint8_t*)unit);
+}
+
+/* Byte at offset pos of the stream, which holds consecutive words */
+static uint8_t stream_byte (uint32_t pos)
+{
+    return (uint8_t)((pos / 4) >> (8 * (pos % 4)));
+}
+
+static int producer (int32_t fd)
+{
+    static uint32_t out[CHUNK / 4];
+    uint32_t i, c;
+
+    for (c = 0; c < CHUNKS; c++) {
+        for (i = 0; i < CHUNK / 4; i++)
+            out[i] = c * (CHUNK / 4) + i;
+        if (CHUNK != ece391_write (fd, out, CHUNK)) {
+            ece391_fdputs (1, (uint8_t*)"pipe write failed\n");
+            return 3;
+        }
+    }
+
+    ece391_close (fd);
+    return 0;
+}
+
+int main ()
+{
+    static uint8_t in[CHUNK];
+    int32_t fds[2];
+    int32_t pid, ret, status;
+    uint32_t i, pos = 0, start, total_k, errors = 0;
+
+    if (-1 == ece391_pipe (fds)) {
+        ece391_fdputs (1, (uint8_t*)"could not create pipe\n");
+        return 2;
+    }
+
+    start = rdtsc ();
+    pid = ece391_fork ();
+    if (-1 == pid) {
+        ece391_fdputs (1, (uint8_t*)"could not fork\n");
+        return 2;
+    }
+    if (0 == pid) {
+        ece391_close (fds[0]);
+        return producer (fds[1]);
+    }
+
+    /* Consumer, reads until the child closes the write end. The pipe may
+     * hand back any number of bytes at a time */
+    ece391_close (fds[1]);
+    while (0 < (ret = ece391_read (fds[0], in, CHUNK))) {
+        for (i = 0; i < (uint32_t)ret; i++) {
+            if (in[i] != stream_byte (pos + i))
+                errors++;
+        }
+        pos += ret;
+    }
+    total_k = (rdtsc () - start) / 1000;
+    ece391_close (fds[0]);
+
+    status = ece391_wait (pid);
+    if (-1 == ret || 0 != status || CHUNKS * CHUNK != pos)
+        errors++;
+
+    print_num ("transferred: ", pos / 1024, " KB\n");
+    print_num ("bandwidth: ", pos / (total_k ? total_k : 1), " bytes per kcycle\n");
+    print_num ("errors: ", errors, "\n");
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/* "schedbench [priority ...]" forks one compute-bound spinner per
+ * priority (1-8, "2 4 6" by default) and an interactive ticker, all on the
+ * current terminal. The spinners' rates follow their priorities, and the
+ * ticker's worst interval shows how long a woken process waits behind
+ * them. Children report to the parent over a pipe. "cat schedstat" shows
+ * the kernel's view. */
+
+#define BUFSIZE 32
+#define MAX_SPINNERS 8
+#define SPIN_KCYCLES 6000000                /* About two seconds of wall time */
+#define SPIN_BATCH 4096
+#define TICK_HZ 64
+#define TICK_ROUNDS 128                     /* Two seconds, while the spinners run */
+
+/* Result sent by each child */
+typedef struct result {
+    int32_t prio;                           /* 0 for the ticker */
+    uint32_t value;                         /* Batches per Gcycle, or average interval */
+    uint32_t max;                           /* Worst interval of the ticker */
+} result_t;
+
+static uint32_t rdtsc (void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+static void print_num (const char* label, uint32_t value, const char* unit)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, buf, 10));
+    ece391_fdputs (1, (uint8_t*)unit);
+}
+
+/* Compute-bound: work done in a fixed wall time is proportional to the
+ * share of the processor received */
+static void spin (result_t* res)
+{
+    volatile uint32_t sink = 1;
+    uint32_t i, last, k, total_k = 0, batches = 0;
+
+    last = rdtsc ();
+    while (total_k < SPIN_KCYCLES) {
+        for (i = 0; i < SPIN_BATCH; i++)
+            sink = sink * 1103515245 + 12345;
+        batches++;
+
+        /* Carry the remainder so no cycles are lost */
+        k = (rdtsc () - last) / 1000;
+        total_k += k;
+        last += k * 1000;
+    }
+    res->value = batches / (SPIN_KCYCLES / 1000000);
+}
+
+/* Interactive: sleeps on the RTC, a late wakeup stretches an interval */
+static int32_t tick (result_t* res)
+{
+    int32_t fd, garbage, hz = TICK_HZ;
+    uint32_t r, now, last, cycles, total_k = 0, max = 0;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"rtc")) || -1 == ece391_write (fd, &hz, 4)) {
+        ece391_fdputs (1, (uint8_t*)"could not open rtc\n");
+        return 2;
+    }
+
+    ece391_read (fd, &garbage, 4);
+    last = rdtsc ();
+    for (r = 0; r < TICK_ROUNDS; r++) {
+        ece391_read (fd, &garbage, 4);
+        now = rdtsc ();
+        cycles = now - last;
+        last = now;
+        if (cycles > max)
+            max = cycles;
+        total_k += cycles / 1000;
+    }
+    ece391_close (fd);
+
+    res->value = total_k / TICK_ROUNDS;
+    res->max = max / 1000;
+    return 0;
+}
+
+/* Body of a forked child: runs at prio, or as the ticker for 0, and sends
+ * its result to the parent */
+static int32_t child (int32_t fd, int32_t prio)
+{
+    result_t res;
+    int32_t ret = 0;
+
+    res.prio = prio;
+    res.value = 0;
+    res.max = 0;
+    if (prio == 0)
+        ret = tick (&res);
+    else if (-1 == ece391_setprio (prio))
+        ret = 3;
+    else
+        spin (&res);
+
+    if (ret == 0 && sizeof (res) != ece391_write (fd, &res, sizeof (res)))
+        ret = 3;
+    ece391_close (fd);
+    return ret;
+}
+
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    int32_t prios[MAX_SPINNERS + 1];
+    int32_t pids[MAX_SPINNERS + 1];
+    int32_t fds[2];
+    int32_t i, n = 0, cnt, ret, failed = 0;
+    result_t res;
+
+    /* Priorities are single digits separated by spaces */
+    if (0 != ece391_getargs (buf, BUFSIZE))
+        buf[0] = '\0';
+    for (i = 0; buf[i] != '\0'; i++) {
+        if (buf[i] == ' ')
+            continue;
+        if (buf[i] < '1' || buf[i] > '8' || (buf[i + 1] != ' ' && buf[i + 1] != '\0') || n == MAX_SPINNERS) {
+            ece391_fdputs (1, (uint8_t*)"usage: schedbench [priority 1-8 ...]\n");
+            return 3;
+        }
+        prios[n++] = buf[i] - '0';
+    }
+    if (n == 0) {
+        prios[n++] = 2;
+        prios[n++] = 4;
+        prios[n++] = 6;
+    }
+    prios[n++] = 0;
+
+    if (-1 == ece391_pipe (fds)) {
+        ece391_fdputs (1, (uint8_t*)"could not create pipe\n");
+        return 2;
+    }
+
+    for (i = 0; i < n; i++) {
+        pids[i] = ece391_fork ();
+        if (0 == pids[i]) {
+            ece391_close (fds[0]);
+            return child (fds[1], prios[i]);
+        }
+        if (-1 == pids[i]) {
+            ece391_fdputs (1, (uint8_t*)"could not fork\n");
+            n = i;
+            failed = 1;
+            break;
+        }
+    }
+    ece391_close (fds[1]);
+
+    /* Results arrive as the children finish, until the last one closes
+     * the write end */
+    while (1) {
+        for (cnt = 0; cnt < sizeof (res); cnt += ret) {
+            ret = ece391_read (fds[0], (uint8_t*)&res + cnt, sizeof (res) - cnt);
+            if (ret <= 0)
+                break;
+        }
+        if (cnt != sizeof (res))
+            break;
+
+        if (res.prio == 0) {
+            print_num ("ticker interval avg: ", res.value, " kcycles, ");
+            print_num ("max: ", res.max, " kcycles\n");
+        } else {
+            print_num ("priority ", res.prio, ": ");
+            print_num ("", res.value, " batches per Gcycle\n");
+        }
+    }
+    ece391_close (fds[0]);
+
+    for (i = 0; i < n; i++) {
+        if (0 != ece391_wait (pids[i]))
+            failed = 1;
+    }
+    if (failed) {
+        ece391_fdputs (1, (uint8_t*)"some children failed\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/* Run "shmbench pong" on one terminal, then "shmbench ping" on another */
+
+#define BUFSIZE 32
+#define SHM_KEY 391
+#define SHM_SIZE 0x100000                   /* 1 MB segment */
+#define DATA_OFFSET 4096                    /* Control words use the first page */
+#define DATA_WORDS ((SHM_SIZE - DATA_OFFSET) / 4)
+#define ROUNDS 100
+#define CHUNKS 64
+
+typedef struct shm_ctrl {
+    volatile uint32_t ready;                /* Set by pong once attached */
+    volatile uint32_t ping;                 /* Round sent by ping */
+    volatile uint32_t pong;                 /* Round echoed by pong */
+    volatile uint32_t sent;                 /* Chunk written by ping */
+    volatile uint32_t acked;                /* Chunk checked by pong */
+    volatile uint32_t errors;               /* Words pong found wrong */
+} shm_ctrl_t;
+
+static uint32_t rdtsc (void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+static void print_num (const char* label, uint32_t value, const char* unit)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, buf, 10));
+    ece391_fdputs (1, (uint8_t*)unit);
+}
+
+static void ping (shm_ctrl_t* ctrl, volatile uint32_t* data)
+{
+    uint32_t i, r, c, start, cycles, total_k = 0, min = 0xFFFFFFFF;
+
+    ece391_fdputs (1, (uint8_t*)"waiting for pong\n");
+    while (!ctrl->ready);
+
+    /* Latency: one word each way per round */
+    for (r = 1; r <= ROUNDS; r++) {
+        start = rdtsc ();
+        ctrl->ping = r;
+        while (ctrl->pong != r);
+        cycles = rdtsc () - start;
+        if (cycles < min)
+            min = cycles;
+        total_k += cycles / 1000;
+    }
+    print_num ("round trip avg: ", total_k / ROUNDS, " kcycles\n");
+    print_num ("round trip min: ", min / 1000, " kcycles\n");
+
+    /* Bandwidth: pong reads every word written in place */
+    total_k = 0;
+    for (c = 1; c <= CHUNKS; c++) {
+        start = rdtsc ();
+        for (i = 0; i < DATA_WORDS; i++)
+            data[i] = c + i;
+        ctrl->sent = c;
+        while (ctrl->acked != c);
+        total_k += (rdtsc () - start) / 1000;
+    }
+    print_num ("transferred: ", CHUNKS * (DATA_WORDS * 4 / 1024), " KB\n");
+    print_num ("bandwidth: ", CHUNKS * DATA_WORDS * 4 / (total_k ? total_k : 1), " bytes per kcycle\n");
+    print_num ("errors: ", ctrl->errors, "\n");
+}
+
+static void pong (shm_ctrl_t* ctrl, volatile uint32_t* data)
+{
+    uint32_t i, r, c;
+
+    ctrl->ready = 1;
+    ece391_fdputs (1, (uint8_t*)"ready for ping\n");
+
+    for (r = 1; r <= ROUNDS; r++) {
+        while (ctrl->ping != r);
+        ctrl->pong = r;
+    }
+
+    for (c = 1; c <= CHUNKS; c++) {
+        while (ctrl->sent != c);
+        for (i = 0; i < DATA_WORDS; i++) {
+            if (data[i] != c + i)
+                ctrl->errors++;
+        }
+        ctrl->acked = c;
+    }
+    ece391_fdputs (1, (uint8_t*)"done\n");
+}
+
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    uint8_t* start = 0;
+    int32_t id;
+
+    if (0 != ece391_getargs (buf, BUFSIZE) ||
+        (0 != ece391_strcmp (buf, (uint8_t*)"ping") && 0 != ece391_strcmp (buf, (uint8_t*)"pong"))) {
+        ece391_fdputs (1, (uint8_t*)"usage: shmbench ping|pong\n");
+        return 3;
+    }
+
+    if (-1 == (id = ece391_shmget (SHM_KEY, SHM_SIZE)) || -1 == ece391_shmat (id, &start)) {
+        ece391_fdputs (1, (uint8_t*)"could not attach shared memory\n");
+        return 2;
+    }
+
+    if (0 == ece391_strcmp (buf, (uint8_t*)"ping"))
+        ping ((shm_ctrl_t*)start, (volatile uint32_t*)(start + DATA_OFFSET));
+    else
+        pong ((shm_ctrl_t*)start, (volatile uint32_t*)(start + DATA_OFFSET));
+
+    ece391_shmdt (start);
+    return 0;
+}
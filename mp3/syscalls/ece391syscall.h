@@ -5,6 +5,28 @@
 
 /* All calls return >= 0 on success or -1 on failure. */
 
+/* Directory record returned by getdents; name is not NUL-terminated
+   when it is exactly 32 characters long. */
+struct ece391_dirent {
+    uint8_t name[32];
+    int32_t filetype;
+    int32_t inode;
+    int32_t length;
+};
+
+/* File information returned by stat; length counts entries for the
+   directory. */
+struct ece391_stat {
+    int32_t filetype;
+    int32_t inode;
+    int32_t length;
+};
+
+/* lseek origins */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
 /*  
  * Note that the system call for halt will have to make sure that only
  * the low byte of EBX (the status argument) is returned to the calling
@@ -21,6 +43,22 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+extern int32_t ece391_munmap (uint8_t* start);
+extern int32_t ece391_getdents (int32_t fd, struct ece391_dirent* buf, int32_t nbytes);
+extern int32_t ece391_stat (int32_t fd, struct ece391_stat* buf);
+extern int32_t ece391_lseek (int32_t fd, int32_t offset, int32_t whence);
+extern int32_t ece391_pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_sendfile (int32_t out_fd, int32_t in_fd, int32_t count);
+extern int32_t ece391_create (const uint8_t* filename);
+extern int32_t ece391_truncate (int32_t fd, int32_t length);
+extern int32_t ece391_fork (void);
+extern int32_t ece391_shmget (int32_t key, int32_t size);
+extern int32_t ece391_shmat (int32_t id, uint8_t** start);
+extern int32_t ece391_shmdt (uint8_t* start);
+extern int32_t ece391_pipe (int32_t* fds);
+extern int32_t ece391_setprio (int32_t priority);
+extern int32_t ece391_wait (int32_t pid);
 
 enum signums {
 	DIV_ZERO = 0,
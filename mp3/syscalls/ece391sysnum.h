@@ -11,5 +11,21 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_MMAP    11
+#define SYS_MUNMAP  12
+#define SYS_GETDENTS 13
+#define SYS_STAT    14
+#define SYS_LSEEK   15
+#define SYS_PREAD   16
+#define SYS_SENDFILE 17
+#define SYS_CREATE  18
+#define SYS_TRUNCATE 19
+#define SYS_FORK    20
+#define SYS_SHMGET  21
+#define SYS_SHMAT   22
+#define SYS_SHMDT   23
+#define SYS_PIPE    24
+#define SYS_SETPRIO 25
+#define SYS_WAIT    26
 
 #endif /* ECE391SYSNUM_H */